@@ -0,0 +1,337 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Micro-benchmarks for the primitives everything else leans on.
+// Built as SrModLdr_Bench with the test interface, so it gets the same
+// startup as the unit tests (fresh mods.db, test.bin, games/test.json).
+// Run it from the output directory:
+//     SrModLdr_Bench all          (every benchmark)
+//     SrModLdr_Bench crc32        (just one)
+// Results go to stdout as a table and to bench.json for comparing runs.
+
+#include "../includes.h"
+#include "../funcproto.h"
+#include "../shims/crc32/crc32.h"
+#include <time.h>
+
+#define BENCH_MIN_NS 200000000.0   // Keep doubling iterations until a run takes this long
+#define BENCH_MAX_ITERS (1UL << 30)
+#define BENCH_OUTPUT "bench.json"
+
+#define BENCH_CRC_LEN (64 * 1024)
+#define BENCH_HEX_LEN 512
+
+// Allocation counting. glibc lets the program supply its own malloc family,
+// so count calls here and hand them to the real allocator. Elsewhere
+// allocations/op is reported as unknown.
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long BENCH_ALLOCS = 0;
+
+void *malloc(size_t size)
+{
+	BENCH_ALLOCS++;
+	return __libc_malloc(size);
+}
+void *calloc(size_t count, size_t size)
+{
+	BENCH_ALLOCS++;
+	return __libc_calloc(count, size);
+}
+void *realloc(void *ptr, size_t size)
+{
+	BENCH_ALLOCS++;
+	return __libc_realloc(ptr, size);
+}
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+#endif
+
+struct Bench {
+	const char *Name;
+	BOOL (*Run)(void);
+};
+
+// Fixtures, set up once by Bench_Setup
+static unsigned char *BENCH_CRCBUF = NULL;
+static char BENCH_HEX[BENCH_HEX_LEN + 1];
+static struct ModSpace BENCH_QUERY = {0};
+
+// Monotonic clock in nanoseconds
+static double Bench_Now(void)
+{
+#if defined(HAVE_WINDOWS_H)
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double)count.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+#endif
+}
+
+// Loads sonicr.json's KnownSpaces as clear spaces in test.bin, so
+// Mod_FindSpace has a realistically sized table to search
+static BOOL Bench_LoadSpaces(void)
+{
+	json_t *GameCfg, *spaces, *row;
+	size_t i;
+	int FileID;
+	BOOL result = TRUE;
+
+	GameCfg = JSON_Load("games/sonicr.json");
+	if(!GameCfg){return FALSE;}
+	spaces = json_object_get(GameCfg, "KnownSpaces");
+	FileID = File_GetID("test.bin");
+	if(!json_is_array(spaces) || FileID == -1){
+		json_decref(GameCfg);
+		return FALSE;
+	}
+
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_exec(CURRDB, "BEGIN TRANSACTION", NULL, NULL, NULL)
+	) != 0){
+		json_decref(GameCfg);
+		return FALSE;
+	}
+	json_array_foreach(spaces, i, row){
+		struct ModSpace spc = {0};
+		spc.ID = JSON_GetStr(row, "Name");
+		spc.FileID = FileID;
+		spc.Start = JSON_GetuInt(row, "Start");
+		spc.End = JSON_GetuInt(row, "End");
+		spc.Len = spc.End - spc.Start;
+		asprintf(&spc.PatchID, "%s.MODLOADER@invisibleup", spc.ID);
+		spc.Valid = TRUE;
+
+		result = Mod_MakeSpace(&spc, "MODLOADER@invisibleup", "Clear");
+		safe_free(spc.ID);
+		safe_free(spc.PatchID);
+		if(!result){break;}
+	}
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_exec(CURRDB, result ? "COMMIT" : "ROLLBACK", NULL, NULL, NULL)
+	) != 0){
+		result = FALSE;
+	}
+
+	BENCH_QUERY.ID = "Bench";
+	BENCH_QUERY.PatchID = "Bench.Query";
+	BENCH_QUERY.FileID = FileID;
+	BENCH_QUERY.Start = 4259843;
+	BENCH_QUERY.End = 4700000;
+	BENCH_QUERY.Len = 16;
+
+	json_decref(GameCfg);
+	return result;
+}
+
+static BOOL Bench_Setup(void)
+{
+	struct VarValue var = {0};
+	int i;
+
+	if(!Bench_LoadSpaces()){return FALSE;}
+
+	var.desc = "Benchmark variable";
+	var.UUID = "Value.bench@invisibleup";
+	var.mod = "bench@invisibleup";
+	var.type = Int32;
+	var.Int32 = 1234;
+	var.norepatch = TRUE;
+	if(!Var_MakeEntry(var)){return FALSE;}
+
+	BENCH_CRCBUF = malloc(BENCH_CRC_LEN);
+	if(!BENCH_CRCBUF){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	for(i = 0; i < BENCH_CRC_LEN; i++){
+		BENCH_CRCBUF[i] = (unsigned char)(i * 31 + 7);
+	}
+	for(i = 0; i < BENCH_HEX_LEN; i++){
+		BENCH_HEX[i] = "0123456789ABCDEF"[(i * 7) % 16];
+	}
+	BENCH_HEX[BENCH_HEX_LEN] = '\0';
+
+	return TRUE;
+}
+
+/* Benchmarks. Each does one operation and returns FALSE if it went wrong. */
+
+static BOOL Bench_SQL_GetJSON(void)
+{
+	sqlite3_stmt *command;
+	json_t *out;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_prepare_v2(CURRDB,
+		"SELECT * FROM Spaces LIMIT 256", -1, &command, NULL)
+	) != 0){
+		return FALSE;
+	}
+	out = SQL_GetJSON(command);
+	sqlite3_finalize(command);
+	if(!json_is_array(out)){return FALSE;}
+	json_decref(out);
+	return TRUE;
+}
+
+static BOOL Bench_Eq_Parse_Int_Const(void)
+{
+	return Eq_Parse_Int("( 0x400000 + 16 * 4 )", NULL, FALSE) == 0x400040 &&
+		CURRERROR == errNOERR;
+}
+
+static BOOL Bench_Eq_Parse_Int_Var(void)
+{
+	return Eq_Parse_Int("$ Value.bench@invisibleup * 2 + 1", NULL, FALSE) == 2469 &&
+		CURRERROR == errNOERR;
+}
+
+static BOOL Bench_File_PEToOff(void)
+{
+	return File_PEToOff("test/File_PE/test.exe", 0x402010) == 0x2010;
+}
+
+static BOOL Bench_Mod_FindSpace(void)
+{
+	struct ModSpace found = Mod_FindSpace(&BENCH_QUERY, TRUE);
+	BOOL result = found.Valid;
+
+	safe_free(found.ID);
+	safe_free(found.PatchID);
+	return result;
+}
+
+static BOOL Bench_crc32(void)
+{
+	return crc32(0, BENCH_CRCBUF, BENCH_CRC_LEN) != 0;
+}
+
+static BOOL Bench_Hex2Bytes(void)
+{
+	int len = 0;
+	unsigned char *bytes = Hex2Bytes(BENCH_HEX, &len);
+	BOOL result = (bytes != NULL && len == BENCH_HEX_LEN / 2);
+
+	safe_free(bytes);
+	return result;
+}
+
+static const struct Bench BENCHES[] = {
+	{"SQL_GetJSON", Bench_SQL_GetJSON},
+	{"Eq_Parse_Int_Const", Bench_Eq_Parse_Int_Const},
+	{"Eq_Parse_Int_Var", Bench_Eq_Parse_Int_Var},
+	{"File_PEToOff", Bench_File_PEToOff},
+	{"Mod_FindSpace", Bench_Mod_FindSpace},
+	{"crc32", Bench_crc32},
+	{"Hex2Bytes", Bench_Hex2Bytes},
+};
+#define BENCH_COUNT (sizeof(BENCHES) / sizeof(BENCHES[0]))
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Bench_Run
+ *  Description:  Times one benchmark. Runs it once to check it works (and to warm
+ *                any caches), then doubles the iteration count until a timed run
+ *                takes at least BENCH_MIN_NS. Prints the result and appends it to
+ *                the results array.
+ * =====================================================================================
+ */
+static BOOL Bench_Run(const struct Bench *bench, json_t *results)
+{
+	unsigned long iters = 1, allocs = 0, i;
+	double start, elapsed, nsPerOp;
+	json_t *entry;
+
+	CURRERROR = errNOERR;
+	if(!bench->Run()){
+		printf("[FAIL] %s\n", bench->Name);
+		ErrCracker(CURRERROR);
+		return FALSE;
+	}
+
+	for(;;){
+		#ifdef BENCH_COUNT_ALLOCS
+		allocs = BENCH_ALLOCS;
+		#endif
+		start = Bench_Now();
+		for(i = 0; i < iters; i++){
+			bench->Run();
+		}
+		elapsed = Bench_Now() - start;
+		#ifdef BENCH_COUNT_ALLOCS
+		allocs = BENCH_ALLOCS - allocs;
+		#endif
+
+		if(elapsed >= BENCH_MIN_NS || iters >= BENCH_MAX_ITERS){break;}
+		iters *= 2;
+	}
+
+	nsPerOp = elapsed / iters;
+	entry = json_pack("{s:s, s:I, s:f}",
+		"name", bench->Name,
+		"iterations", (json_int_t)iters,
+		"ns_per_op", nsPerOp
+	);
+	#ifdef BENCH_COUNT_ALLOCS
+	json_object_set_new(entry, "allocs_per_op", json_real((double)allocs / iters));
+	printf("%-24s %12lu %14.1f %14.2f\n",
+		bench->Name, iters, nsPerOp, (double)allocs / iters);
+	#else
+	json_object_set_new(entry, "allocs_per_op", json_null());
+	printf("%-24s %12lu %14.1f %14s\n", bench->Name, iters, nsPerOp, "-");
+	#endif
+	json_array_append_new(results, entry);
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Test_Caller
+ *  Description:  Entry point from the test interface. Runs the named benchmark, or
+ *                all of them for "all", and writes the results to BENCH_OUTPUT.
+ *                Returns nonzero if a benchmark failed or none matched.
+ * =====================================================================================
+ */
+int Test_Caller(const char *input)
+{
+	json_t *results;
+	size_t i;
+	int ran = 0, failed = 0;
+
+	if(!Bench_Setup()){
+		puts("[FAIL] Benchmark setup");
+		ErrCracker(CURRERROR);
+		return 1;
+	}
+
+	results = json_array();
+	printf("%-24s %12s %14s %14s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+	for(i = 0; i < BENCH_COUNT; i++){
+		if(!streq(input, "all") && !streq(input, BENCHES[i].Name)){continue;}
+		ran++;
+		if(!Bench_Run(&BENCHES[i], results)){failed++;}
+	}
+
+	if(ran == 0){
+		printf("[FAIL] No benchmark named %s\n", input);
+	} else if(json_dump_file(results, BENCH_OUTPUT, JSON_INDENT(2)) != 0){
+		printf("[FAIL] Could not write %s\n", BENCH_OUTPUT);
+		failed++;
+	}
+
+	json_decref(results);
+	safe_free(BENCH_CRCBUF);
+	return (ran == 0 || failed != 0);
+}
@@ -0,0 +1,476 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+
+// In-memory copy of the Mods and Dependencies tables.
+// Built once from SQL on first use, then kept up to date as mods are
+// added and removed so dependency checks don't need a query each.
+
+struct DepNode {
+	char *UUID;
+	int Version;
+	int Order;                    //Install order (Mods RowID)
+	BOOL Installed;               //FALSE if only known as somebody's dependency
+	int Mark;                     //Scratch space for graph walks
+	struct HashTable *Children;   //Mods this one depends on
+	struct HashTable *Parents;    //Mods that depend on this one
+};
+
+static struct HashTable *DEPGRAPH = NULL;
+static int DEPGRAPH_ORDER = 0;
+
+static void Dep_FreeNode(void *Value)
+{
+	struct DepNode *node = Value;
+	if(!node){return;}
+	HashTable_Destroy(node->Children, NULL);
+	HashTable_Destroy(node->Parents, NULL);
+	safe_free(node->UUID);
+	free(node);
+}
+
+// Find node for UUID, creating an uninstalled placeholder if needed
+static struct DepNode * Dep_GetNode(const char *UUID, BOOL Create)
+{
+	struct DepNode *node = HashTable_Get(DEPGRAPH, UUID);
+	if(node || !Create){return node;}
+
+	node = calloc(1, sizeof(struct DepNode));
+	if(!node){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+	node->UUID = strdup(UUID);
+	node->Children = HashTable_Create(0);
+	node->Parents = HashTable_Create(0);
+	if(!node->UUID || !node->Children || !node->Parents ||
+		!HashTable_Set(DEPGRAPH, UUID, node, NULL)
+	){
+		CURRERROR = errCRIT_MALLOC;
+		Dep_FreeNode(node);
+		return NULL;
+	}
+	return node;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_Invalidate
+ *  Description:  Throws away the cached graph. Call when the database is swapped out
+ *                or rolled back behind the graph's back.
+ * =====================================================================================
+ */
+void Dep_Invalidate(void)
+{
+	HashTable_Destroy(DEPGRAPH, Dep_FreeNode);
+	DEPGRAPH = NULL;
+	DEPGRAPH_ORDER = 0;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_Build
+ *  Description:  Builds the graph from the Mods and Dependencies tables if it isn't
+ *                already built. Two queries total.
+ * =====================================================================================
+ */
+BOOL Dep_Build(void)
+{
+	sqlite3_stmt *command;
+	const char *query1 = "SELECT RowID AS Ord, UUID, Version FROM Mods ORDER BY RowID;";
+	const char *query2 = "SELECT ParentUUID, ChildUUID FROM Dependencies;";
+	json_t *out, *row;
+	size_t i;
+
+	if(DEPGRAPH){return TRUE;}
+	CURRERROR = errNOERR;
+
+	DEPGRAPH = HashTable_Create(0);
+	if(!DEPGRAPH){return FALSE;}
+
+	//Installed mods
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		Dep_Invalidate();
+		return FALSE;
+	}
+	out = SQL_GetJSON(command);
+	sqlite3_finalize(command);
+
+	json_array_foreach(out, i, row){
+		char *UUID = JSON_GetStr(row, "UUID");
+		struct DepNode *node = Dep_GetNode(UUID, TRUE);
+		safe_free(UUID);
+		if(!node){
+			json_decref(out);
+			Dep_Invalidate();
+			return FALSE;
+		}
+		node->Installed = TRUE;
+		node->Version = JSON_GetInt(row, "Version");
+		node->Order = JSON_GetInt(row, "Ord");
+		DEPGRAPH_ORDER = MAX(DEPGRAPH_ORDER, node->Order);
+	}
+	json_decref(out);
+
+	//Edges
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query2, -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		Dep_Invalidate();
+		return FALSE;
+	}
+	out = SQL_GetJSON(command);
+	sqlite3_finalize(command);
+
+	json_array_foreach(out, i, row){
+		char *Parent = JSON_GetStr(row, "ParentUUID");
+		char *Child = JSON_GetStr(row, "ChildUUID");
+		BOOL result = Dep_AddEdge(Parent, Child);
+		safe_free(Parent);
+		safe_free(Child);
+		if(!result){
+			json_decref(out);
+			Dep_Invalidate();
+			return FALSE;
+		}
+	}
+	json_decref(out);
+
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_IsSatisfied
+ *  Description:  Returns TRUE if UUID is installed at MinVersion or newer.
+ * =====================================================================================
+ */
+BOOL Dep_IsSatisfied(const char *UUID, int MinVersion)
+{
+	struct DepNode *node;
+	if(!Dep_Build()){return FALSE;}
+
+	node = Dep_GetNode(UUID, FALSE);
+	return node && node->Installed && node->Version >= MinVersion;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_HasDependents
+ *  Description:  Returns TRUE if any installed mod depends on UUID.
+ * =====================================================================================
+ */
+BOOL Dep_HasDependents(const char *UUID)
+{
+	struct DepNode *node;
+	struct HashEntry *entry;
+	size_t i;
+
+	if(!Dep_Build()){return FALSE;}
+
+	node = Dep_GetNode(UUID, FALSE);
+	if(!node){return FALSE;}
+
+	HashTable_Foreach(node->Parents, i, entry){
+		struct DepNode *parent = Dep_GetNode(entry->Key, FALSE);
+		if(parent && parent->Installed){
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+// Append a string to a double-null-terminated list
+static BOOL Dep_ListAppend(char **List, size_t *Size, size_t *Cap, const char *Str)
+{
+	size_t len = strlen(Str) + 1;
+	while(*Size + len + 1 > *Cap){
+		char *ListNew;
+		*Cap = *Cap ? *Cap * 2 : 64;
+		ListNew = realloc(*List, *Cap);
+		if(!ListNew){
+			CURRERROR = errCRIT_MALLOC;
+			safe_free(*List);
+			return FALSE;
+		}
+		*List = ListNew;
+	}
+	memcpy(*List + *Size, Str, len);
+	*Size += len;
+	(*List)[*Size] = '\0';
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_GetDependents
+ *  Description:  Returns a double-null-terminated list of every installed mod that
+ *                depends on UUID, directly or not, or NULL on error.
+ * =====================================================================================
+ */
+char * Dep_GetDependents(const char *UUID)
+{
+	struct DepNode *start;
+	struct DepNode **stack = NULL;
+	struct HashEntry *entry;
+	size_t i, StackLen = 0;
+	char *List = NULL;
+	size_t Size = 0, Cap = 0;
+
+	if(!Dep_Build()){return NULL;}
+
+	//Always hand back a valid (empty) list
+	List = calloc(2, 1);
+	Cap = 2;
+	if(!List){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+
+	start = Dep_GetNode(UUID, FALSE);
+	if(!start){return List;}
+
+	HashTable_Foreach(DEPGRAPH, i, entry){
+		((struct DepNode *)entry->Value)->Mark = 0;
+	}
+
+	//Worst case every node is on the stack once
+	stack = malloc((DEPGRAPH->Count + 1) * sizeof(struct DepNode *));
+	if(!stack){
+		CURRERROR = errCRIT_MALLOC;
+		safe_free(List);
+		return NULL;
+	}
+
+	start->Mark = 1;
+	stack[StackLen++] = start;
+	while(StackLen > 0){
+		struct DepNode *node = stack[--StackLen];
+		HashTable_Foreach(node->Parents, i, entry){
+			struct DepNode *parent = Dep_GetNode(entry->Key, FALSE);
+			if(!parent || parent->Mark || !parent->Installed){continue;}
+
+			parent->Mark = 1;
+			stack[StackLen++] = parent;
+			if(!Dep_ListAppend(&List, &Size, &Cap, parent->UUID)){
+				safe_free(stack);
+				return NULL;
+			}
+		}
+	}
+
+	safe_free(stack);
+	return List;
+}
+
+// Order nodes by install order for qsort
+static int Dep_CompareOrder(const void *a, const void *b)
+{
+	const struct DepNode *lhs = *(struct DepNode * const *)a;
+	const struct DepNode *rhs = *(struct DepNode * const *)b;
+	return (lhs->Order > rhs->Order) - (lhs->Order < rhs->Order);
+}
+
+// Collect installed nodes from a table, sorted by install order
+static struct DepNode ** Dep_SortedNodes(struct HashTable *table, BOOL IsGraph, size_t *Count)
+{
+	struct DepNode **nodes;
+	struct HashEntry *entry;
+	size_t i;
+
+	*Count = 0;
+	nodes = malloc((table->Count + 1) * sizeof(struct DepNode *));
+	if(!nodes){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+
+	HashTable_Foreach(table, i, entry){
+		struct DepNode *node = IsGraph ? entry->Value : Dep_GetNode(entry->Key, FALSE);
+		if(node && node->Installed){
+			nodes[(*Count)++] = node;
+		}
+	}
+	qsort(nodes, *Count, sizeof(struct DepNode *), Dep_CompareOrder);
+	return nodes;
+}
+
+// Depth-first post-order walk. Mark: 0 = new, 1 = on path, 2 = done
+static BOOL Dep_Visit(struct DepNode *node, char **List, size_t *Size, size_t *Cap)
+{
+	struct DepNode **children;
+	size_t i, count;
+
+	if(node->Mark == 2){return TRUE;}
+	if(node->Mark == 1){
+		//Dependency cycle. Mod metadata is broken.
+		CURRERROR = errWNG_MODCFG;
+		return FALSE;
+	}
+	node->Mark = 1;
+
+	children = Dep_SortedNodes(node->Children, FALSE, &count);
+	if(!children){return FALSE;}
+	for(i = 0; i < count; i++){
+		if(!Dep_Visit(children[i], List, Size, Cap)){
+			safe_free(children);
+			return FALSE;
+		}
+	}
+	safe_free(children);
+
+	node->Mark = 2;
+	return Dep_ListAppend(List, Size, Cap, node->UUID);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_InstallOrder
+ *  Description:  Returns a double-null-terminated list of every installed mod, with
+ *                each mod after everything it depends on. Ties keep install order.
+ *                Returns NULL and sets errWNG_MODCFG if dependencies form a cycle.
+ * =====================================================================================
+ */
+char * Dep_InstallOrder(void)
+{
+	struct DepNode **nodes;
+	struct HashEntry *entry;
+	size_t i, count;
+	char *List = NULL;
+	size_t Size = 0, Cap = 2;
+
+	if(!Dep_Build()){return NULL;}
+
+	List = calloc(Cap, 1);
+	if(!List){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+
+	HashTable_Foreach(DEPGRAPH, i, entry){
+		((struct DepNode *)entry->Value)->Mark = 0;
+	}
+
+	nodes = Dep_SortedNodes(DEPGRAPH, TRUE, &count);
+	if(!nodes){
+		safe_free(List);
+		return NULL;
+	}
+
+	for(i = 0; i < count; i++){
+		if(!Dep_Visit(nodes[i], &List, &Size, &Cap)){
+			safe_free(nodes);
+			safe_free(List);
+			return NULL;
+		}
+	}
+
+	safe_free(nodes);
+	return List;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_AddMod
+ *  Description:  Marks UUID as installed at the given version. Keep in step with
+ *                inserts into the Mods table.
+ * =====================================================================================
+ */
+BOOL Dep_AddMod(const char *UUID, int Version)
+{
+	struct DepNode *node;
+
+	//Nothing cached yet; the next build will read the table anyways
+	if(!DEPGRAPH){return TRUE;}
+
+	node = Dep_GetNode(UUID, TRUE);
+	if(!node){return FALSE;}
+
+	node->Installed = TRUE;
+	node->Version = Version;
+	node->Order = ++DEPGRAPH_ORDER;
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_AddEdge
+ *  Description:  Records that ParentUUID depends on ChildUUID. Keep in step with
+ *                inserts into the Dependencies table.
+ * =====================================================================================
+ */
+BOOL Dep_AddEdge(const char *ParentUUID, const char *ChildUUID)
+{
+	struct DepNode *parent, *child;
+
+	if(!DEPGRAPH){return TRUE;}
+	if(!ParentUUID || !ChildUUID){
+		CURRERROR = errCRIT_ARGMNT;
+		return FALSE;
+	}
+
+	parent = Dep_GetNode(ParentUUID, TRUE);
+	child = Dep_GetNode(ChildUUID, TRUE);
+	if(!parent || !child){return FALSE;}
+
+	return HashTable_Set(parent->Children, ChildUUID, NULL, NULL) &&
+	       HashTable_Set(child->Parents, ParentUUID, NULL, NULL);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_RemoveEdges
+ *  Description:  Forgets everything ParentUUID depends on. Keep in step with
+ *                deletes from the Dependencies table.
+ * =====================================================================================
+ */
+void Dep_RemoveEdges(const char *ParentUUID)
+{
+	struct DepNode *parent;
+	struct HashEntry *entry;
+	size_t i;
+
+	if(!DEPGRAPH){return;}
+	parent = Dep_GetNode(ParentUUID, FALSE);
+	if(!parent){return;}
+
+	HashTable_Foreach(parent->Children, i, entry){
+		struct DepNode *child = Dep_GetNode(entry->Key, FALSE);
+		if(child){
+			HashTable_Remove(child->Parents, ParentUUID, NULL);
+		}
+	}
+	HashTable_Clear(parent->Children, NULL);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Dep_RemoveMod
+ *  Description:  Marks UUID as uninstalled and drops its own dependencies. The node
+ *                stays around if other mods still list it as a dependency.
+ * =====================================================================================
+ */
+void Dep_RemoveMod(const char *UUID)
+{
+	struct DepNode *node;
+
+	if(!DEPGRAPH){return;}
+	Dep_RemoveEdges(UUID);
+
+	node = Dep_GetNode(UUID, FALSE);
+	if(!node){return;}
+
+	node->Installed = FALSE;
+	node->Version = 0;
+	if(node->Parents->Count == 0){
+		HashTable_Remove(DEPGRAPH, UUID, Dep_FreeNode);
+	}
+}
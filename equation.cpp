@@ -10,7 +10,6 @@
 #include "includes.h"
 #include "funcproto.h"
 #include "errormsgs.h"
-#include "shims/crc32/crc32.h"
 
 // Yep. This one's using C++. I need that queue.
 #include <queue>
@@ -19,61 +18,134 @@
 #include <sstream>
 #include <algorithm>
 #include <stack>
+#include <vector>
+#include <cmath>
 #include <ios>
 #include <iterator>
 
+#if defined(HAVE_WINDOWS_H)
+	#define EQBATCH_THREADS
+#elif defined(HAVE_PTHREAD_H)
+	#include <pthread.h>
+	#define EQBATCH_THREADS
+#endif
+
+// Expressions are compiled once into RPN bytecode and kept by their text.
+// Literals are converted when compiling; everything else is a variable
+// handle, looked up on first use and again only after the variable table
+// changes. Evaluating is then one pass over the bytecode with a stack of
+// numbers. Numbers are signed or unsigned 64-bit integers or doubles, and
+// arithmetic mixes them following C's rules. Comparisons don't: they go by
+// value rather than C's usual arithmetic conversions, so -1 < 0x80000000
+// is 1. Numbers are only narrowed when handed back by Eq_Parse_*.
+
+// Binary operators, in the same order as Eq_BinOpNames
+enum Eq_BinOp {
+	EQ_MUL, EQ_DIV, EQ_MOD, EQ_ADD, EQ_SUB, EQ_SHL, EQ_SHR, EQ_AND, EQ_XOR,
+	EQ_OR, EQ_EQ, EQ_NE, EQ_LT, EQ_GT, EQ_LE, EQ_GE, EQ_LOR, EQ_LAND
+};
+static const char *Eq_BinOpNames[] = {
+	"*", "/", "%", "+", "-", "<<", ">>", "&", "^", "|", "==",
+	"!=", "<", ">", "<=", ">=", "||", "&&"
+};
+
+enum Eq_OpCode {
+	EQOP_NUM,     // Push Nums[Arg]
+	EQOP_VAR,     // Push value of Vars[Arg] (0 if there's no such variable)
+	EQOP_EXISTS,  // Push 1 if Vars[Arg] exists, else 0
+	EQOP_FILE,    // Push result of Files[Arg]
+	EQOP_NOT,     // Bitwise NOT top of stack
+	EQOP_BINARY   // Pop two, push result of Eq_BinOp Arg
+};
+
+enum Eq_FileOp {EQFILE_EXISTS, EQFILE_CRC32, EQFILE_LEN, EQFILE_UNKNOWN};
+
+struct Eq_Instr {
+	enum Eq_OpCode Code;
+	int Arg;
+};
+
+// A number on the evaluation stack
+enum Eq_Type {EQ_INT, EQ_UINT, EQ_REAL};
+struct Eq_Value {
+	enum Eq_Type Type;
+	union {
+		int64_t Int;
+		uint64_t UInt;
+		double Real;
+	};
+};
+
+struct Eq_File {
+	std::string Name;
+	BOOL InModDir;        // "#" rather than "@"
+	enum Eq_FileOp Op;
+};
+
+struct Eq_Program {
+	std::string Text;     // Expression it came from; keys EQCACHE
+	BOOL Valid;           // FALSE if operators and operands don't match up
+	size_t Depth;         // Most values on the stack at once
+	std::vector<Eq_Instr> Code;
+	std::vector<Eq_Value> Nums;
+	std::vector<std::string> VarNames;
+	std::vector<struct VarHandle> Vars;   // UUIDs point into VarNames
+	std::vector<Eq_File> Files;
+};
+
 std::queue<std::string> Eq_Tokenize(const char *input);
 std::queue<std::string> Eq_Reorder(std::queue<std::string> input);
 BOOL Eq_OpIsFileFunct(const std::string op);
-template <typename T> T Eq_Compute_DoOp(T a, T b, std::string op);
-std::string CppStrToUpper(const std::string& str);
-template <typename T> T CppStrToNum(std::string const text);
-template <typename T> T Eq_Compute(std::queue<std::string> input, const char *ModPath, BOOL IsFileOffset);
+static int64_t Eq_ToInt(const Eq_Value &v);
+static uint64_t Eq_ToUInt(const Eq_Value &v);
+static double Eq_ToReal(const Eq_Value &v);
+static Eq_Program * Eq_GetProgram(const char *eq);
+static BOOL Eq_Run(Eq_Program *prog, const char *ModPath, BOOL IsFileOffset, Eq_Value *result);
 
 // Parse an equation string stored as a C string
 int Eq_Parse_Int(const char * eq, const char *ModPath, BOOL IsFileOffset){
-	std::queue<std::string> input;
-	int result;
+	Eq_Value value;
+	int result = 0;
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("Eq_Parse_Int", eq);
 	
-	result = Eq_Compute<int>(
-		Eq_Reorder(
-			Eq_Tokenize(eq)
-		), ModPath, IsFileOffset
-	);
+	if(Eq_Run(Eq_GetProgram(eq), ModPath, IsFileOffset, &value)){
+		result = (int)Eq_ToInt(value);
+	}
 	
+	TRACE_END("Eq_Parse_Int");
 	if(CURRERROR == errNOERR) return result;
 	else return 0;
 }
 
 // Like above, but unsigned
 unsigned int Eq_Parse_uInt(const char * eq, const char *ModPath, BOOL IsFileOffset){
-	std::queue<std::string> input;
-	unsigned int result;
+	Eq_Value value;
+	unsigned int result = 0;
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("Eq_Parse_uInt", eq);
 	
-	result = Eq_Compute<unsigned int>(
-		Eq_Reorder(
-			Eq_Tokenize(eq)
-		), ModPath, IsFileOffset
-	);
+	if(Eq_Run(Eq_GetProgram(eq), ModPath, IsFileOffset, &value)){
+		result = (unsigned int)Eq_ToUInt(value);
+	}
 	
+	TRACE_END("Eq_Parse_uInt");
 	if(CURRERROR == errNOERR) return result;
 	else return 0;
 }
 
 // Like above, but for floating-point numbers
 double Eq_Parse_Double(const char * eq, const char *ModPath, BOOL IsFileOffset){
-	std::queue<std::string> input;
-	double result;
+	Eq_Value value;
+	double result = 0;
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("Eq_Parse_Double", eq);
 	
-	result = Eq_Compute<int>(
-		Eq_Reorder(
-			Eq_Tokenize(eq)
-		), ModPath, IsFileOffset
-	);
+	if(Eq_Run(Eq_GetProgram(eq), ModPath, IsFileOffset, &value)){
+		result = Eq_ToReal(value);
+	}
 	
+	TRACE_END("Eq_Parse_Double");
 	if(CURRERROR == errNOERR) return result;
 	else return 0;
 }
@@ -96,15 +168,12 @@ std::queue<std::string> Eq_Tokenize(const char *input){
 	return output;
 }
 
-// Use railyard shunting algorithm to convert infix to RPN
-std::queue<std::string> Eq_Reorder(std::queue<std::string> input)
+// Precedence order (like C). Built the first time it's needed.
+// All operators are left-associative
+static const std::map<std::string, int> & Eq_Order(void)
 {
-	std::stack<std::string> op;
-	std::queue<std::string> result;
-	
-	// Set up precedence order (like C)
-	// All operators are left-associative
-	std::map<std::string, int> order;
+	static std::map<std::string, int> order;
+	if(!order.empty()){return order;}
 	
 	// Grouping
 	order["("] = 0;
@@ -146,10 +215,21 @@ std::queue<std::string> Eq_Reorder(std::queue<std::string> input)
 	// To possibly add in future:
 	// - Exponentiation & roots
 	
+	return order;
+}
+
+// Use railyard shunting algorithm to convert infix to RPN
+std::queue<std::string> Eq_Reorder(std::queue<std::string> input)
+{
+	std::stack<std::string> op;
+	std::queue<std::string> result;
+	
+	const std::map<std::string, int> &order = Eq_Order();
+	
 	// For each token...
 	while(!input.empty()){
 		std::string token = input.front();
-		std::map<std::string, int>::iterator it;
+		std::map<std::string, int>::const_iterator it;
 		int op1pow;
 		
 		input.pop();
@@ -183,7 +263,7 @@ std::queue<std::string> Eq_Reorder(std::queue<std::string> input)
 
 			} else {
 				int op2pow;
-				std::map<std::string, int>::iterator it;
+				std::map<std::string, int>::const_iterator it;
 				it = order.find(op.top());
 				op2pow = it->second;
 				
@@ -204,7 +284,7 @@ std::queue<std::string> Eq_Reorder(std::queue<std::string> input)
 		// consumed later
 		if(!op.empty() && op.top() != "("){
 			int op2pow;
-			std::map<std::string, int>::iterator it;
+			std::map<std::string, int>::const_iterator it;
 			
 			it = order.find(op.top());
 			op2pow = it->second;
@@ -243,254 +323,874 @@ BOOL Eq_OpIsFileFunct(const std::string op){
 	return (op == "crc32" || op == "len"); 
 }
 
-template <typename T> T Eq_Compute_DoOp(T a, T b, std::string op){
-	if(op == "+") return a + b;
-	if(op == "-") return a - b;
-	if(op == "/") return a / b;
-	if(op == "*") return a * b;
-	if(op == "%") return a & b;
-	
-	if(op == "|") return a | b;
-	if(op == "&") return a & b;
-	if(op == "^") return a ^ b;
-	if(op == ">>") return a >> b;
-	if(op == "<<") return a << b;
-
-	if(op == "==") return a == b;
-	if(op == "<=") return a <= b;
-	if(op == ">=") return a >= b;
-	if(op == "<") return a < b;
-	if(op == ">") return a > b;
-	if(op == "!=") return a != b;
-	
-	if(op == "&&") return a && b;
-	if(op == "||") return a || b;
-
-	return 0;
+static Eq_Value Eq_MakeInt(int64_t x)
+{
+	Eq_Value v;
+	v.Type = EQ_INT;
+	v.Int = x;
+	return v;
 }
 
-// Converts std::string to uppercase
-// http://stackoverflow.com/a/3152340
-std::string CppStrToUpper(const std::string& str)
+static Eq_Value Eq_MakeUInt(uint64_t x)
 {
-    std::string upper;
-	unsigned int i;
+	Eq_Value v;
+	v.Type = EQ_UINT;
+	v.UInt = x;
+	return v;
+}
 
-	// Fails on VC++ 6.0 (Why did I subject myself to this again?)
-    //std::transform(str.begin(), str.end(), std::back_inserter(upper), toupper);
+static Eq_Value Eq_MakeReal(double x)
+{
+	Eq_Value v;
+	v.Type = EQ_REAL;
+	v.Real = x;
+	return v;
+}
 
-	for(i = 0; i < str.length(); i++){
-		upper += toupper(str[i]);
+// Doubles out of range saturate instead of being undefined
+static int64_t Eq_ToInt(const Eq_Value &v)
+{
+	switch(v.Type){
+	case EQ_UINT:
+		return (int64_t)v.UInt;
+	case EQ_REAL:
+		if(v.Real != v.Real){return 0;} // NaN
+		if(v.Real <= -9223372036854775808.0){return INT64_MIN;}
+		if(v.Real >= 9223372036854775808.0){return INT64_MAX;}
+		return (int64_t)v.Real;
+	default:
+		return v.Int;
 	}
-
-    return upper;
 }
 
-// Converts std::string to given numeric type
-// Also accounts for hex and octal numbers, as C++ doesn't by default
-template <typename T> T CppStrToNum(std::string const text)
+static uint64_t Eq_ToUInt(const Eq_Value &v)
 {
-	T value;
-	std::stringstream ss;
-    size_t is_hex;
-    
-    is_hex = CppStrToUpper(text).find("0X");
-    if(is_hex != std::string::npos){ // Hex
-        ss << std::hex << text;
-    } else if (text[0] == '0') { // Octal
-        ss << std::oct << text;
-    } else { // Decimal
-        ss << std::dec << text;
-    }
+	switch(v.Type){
+	case EQ_UINT:
+		return v.UInt;
+	case EQ_REAL:
+		if(!(v.Real >= 0)){return (uint64_t)Eq_ToInt(v);}
+		if(v.Real >= 18446744073709551616.0){return UINT64_MAX;}
+		return (uint64_t)v.Real;
+	default:
+		return (uint64_t)v.Int;
+	}
+}
 
-	ss >> value;
-	return value;
+static double Eq_ToReal(const Eq_Value &v)
+{
+	switch(v.Type){
+	case EQ_UINT:
+		return (double)v.UInt;
+	case EQ_REAL:
+		return v.Real;
+	default:
+		return (double)v.Int;
+	}
 }
 
-// Converts type-generic number to std::string
-// https://stackoverflow.com/a/5590404
-#define CppNumToStr( x ) static_cast< std::ostringstream & >( \
-        ( std::ostringstream() << std::dec << x ) ).str()
+static BOOL Eq_IsTrue(const Eq_Value &v)
+{
+	return v.Type == EQ_REAL ? v.Real != 0 : v.UInt != 0;
+}
 
-// Get a variable's value if needed
-template <typename T> T Eq_GetArgValue(std::string arg, BOOL IsFileOffset)
+// -1, 0 or 1. Signed and unsigned compare by value, so -1 < 0x80000000U.
+static int Eq_Compare(const Eq_Value &a, const Eq_Value &b)
 {
-	if(!Var_Exists(arg.c_str())){
-		return CppStrToNum<T>(arg);
+	if(a.Type == EQ_REAL || b.Type == EQ_REAL){
+		double x = Eq_ToReal(a), y = Eq_ToReal(b);
+		return (x > y) - (x < y);
 	}
+	if(a.Type == EQ_INT && b.Type == EQ_INT){
+		return (a.Int > b.Int) - (a.Int < b.Int);
+	}
+	if(a.Type == EQ_INT && a.Int < 0){return -1;}
+	if(b.Type == EQ_INT && b.Int < 0){return 1;}
+	return (a.UInt > b.UInt) - (a.UInt < b.UInt);
+}
 
-	struct VarValue var = Var_GetValue_SQL(arg.c_str());
-	T result;
+// Shifts keep the type of the left side. Shifting by the width or more
+// gives 0 (or -1 for negative numbers shifted right).
+static Eq_Value Eq_Shift(const Eq_Value &a, const Eq_Value &b, int op)
+{
+	int64_t count = Eq_ToInt(b);
+	
+	if(a.Type == EQ_UINT){
+		uint64_t x = a.UInt;
+		if(count < 0 || count >= 64){
+			x = 0;
+		} else if(op == EQ_SHL){
+			x <<= count;
+		} else {
+			x >>= count;
+		}
+		return Eq_MakeUInt(x);
+	} else {
+		int64_t x = Eq_ToInt(a);
+		if(count < 0 || count >= 64){
+			x = (op == EQ_SHR && x < 0) ? -1 : 0;
+		} else if(op == EQ_SHL){
+			x = (int64_t)((uint64_t)x << count);
+		} else {
+			x >>= count;
+		}
+		return Eq_MakeInt(x);
+	}
+}
 
-	// If this is TRUE, we need to see if variable name starts with "Start.",
-	// if the text immediately after it refers to a known space, and if so,
-	// convert the PE pointer to a file offset
-	if(IsFileOffset){
-		Var_DerefPointer(&var);
+// Applies binary operator op to a and b. FALSE on division by zero.
+static BOOL Eq_DoOp(const Eq_Value &a, const Eq_Value &b, int op, Eq_Value *result)
+{
+	enum Eq_Type type;
+	
+	// Comparisons and logic give 1 or 0
+	switch(op){
+	case EQ_EQ: *result = Eq_MakeInt(Eq_Compare(a, b) == 0); return TRUE;
+	case EQ_NE: *result = Eq_MakeInt(Eq_Compare(a, b) != 0); return TRUE;
+	case EQ_LT: *result = Eq_MakeInt(Eq_Compare(a, b) < 0); return TRUE;
+	case EQ_GT: *result = Eq_MakeInt(Eq_Compare(a, b) > 0); return TRUE;
+	case EQ_LE: *result = Eq_MakeInt(Eq_Compare(a, b) <= 0); return TRUE;
+	case EQ_GE: *result = Eq_MakeInt(Eq_Compare(a, b) >= 0); return TRUE;
+	case EQ_LAND: *result = Eq_MakeInt(Eq_IsTrue(a) && Eq_IsTrue(b)); return TRUE;
+	case EQ_LOR: *result = Eq_MakeInt(Eq_IsTrue(a) || Eq_IsTrue(b)); return TRUE;
+	case EQ_SHL:
+	case EQ_SHR:
+		*result = Eq_Shift(a, b, op);
+		return TRUE;
+	}
+	
+	// Doubles win over unsigned, which wins over signed.
+	// Bit operators work on the integer part of doubles.
+	if(a.Type == EQ_REAL || b.Type == EQ_REAL){
+		type = EQ_REAL;
+	} else if(a.Type == EQ_UINT || b.Type == EQ_UINT){
+		type = EQ_UINT;
+	} else {
+		type = EQ_INT;
+	}
+	if(type == EQ_REAL && (op == EQ_AND || op == EQ_OR || op == EQ_XOR)){
+		type = EQ_INT;
 	}
 	
-	if(var.type == IEEE64 || var.type == IEEE32){
-		result = Var_GetDouble(&var);
+	if(type == EQ_REAL){
+		double x = Eq_ToReal(a), y = Eq_ToReal(b);
+		switch(op){
+		case EQ_ADD: x += y; break;
+		case EQ_SUB: x -= y; break;
+		case EQ_MUL: x *= y; break;
+		case EQ_DIV:
+			if(y == 0){return FALSE;}
+			x /= y;
+			break;
+		case EQ_MOD:
+			if(y == 0){return FALSE;}
+			x = fmod(x, y);
+			break;
+		}
+		*result = Eq_MakeReal(x);
+		
+	} else if(type == EQ_UINT){
+		uint64_t x = Eq_ToUInt(a), y = Eq_ToUInt(b);
+		switch(op){
+		case EQ_ADD: x += y; break;
+		case EQ_SUB: x -= y; break;
+		case EQ_MUL: x *= y; break;
+		case EQ_DIV:
+			if(y == 0){return FALSE;}
+			x /= y;
+			break;
+		case EQ_MOD:
+			if(y == 0){return FALSE;}
+			x %= y;
+			break;
+		case EQ_AND: x &= y; break;
+		case EQ_OR: x |= y; break;
+		case EQ_XOR: x ^= y; break;
+		}
+		*result = Eq_MakeUInt(x);
+		
 	} else {
-		result = Var_GetInt(&var);
+		// Overflow wraps around, like the game would
+		int64_t x = Eq_ToInt(a), y = Eq_ToInt(b);
+		switch(op){
+		case EQ_ADD: x = (int64_t)((uint64_t)x + (uint64_t)y); break;
+		case EQ_SUB: x = (int64_t)((uint64_t)x - (uint64_t)y); break;
+		case EQ_MUL: x = (int64_t)((uint64_t)x * (uint64_t)y); break;
+		case EQ_DIV:
+			if(y == 0){return FALSE;}
+			x = (y == -1) ? (int64_t)(0 - (uint64_t)x) : x / y;
+			break;
+		case EQ_MOD:
+			if(y == 0){return FALSE;}
+			x = (y == -1) ? 0 : x % y;
+			break;
+		case EQ_AND: x &= y; break;
+		case EQ_OR: x |= y; break;
+		case EQ_XOR: x ^= y; break;
+		}
+		*result = Eq_MakeInt(x);
 	}
+	return TRUE;
+}
 
-	Var_Destructor(&var);
-	return result;
+// Reads a number literal. Hex with 0x, octal with a leading 0, and
+// anything with a decimal point is a double.
+static Eq_Value Eq_ParseLiteral(const std::string &token)
+{
+	const char *text = token.c_str();
+	BOOL negative = FALSE;
+	uint64_t x;
+	
+	if(*text == '-' || *text == '+'){
+		negative = (*text == '-');
+		text++;
+	}
+	if(token.find('.') != std::string::npos &&
+		token.find('x') == std::string::npos && token.find('X') == std::string::npos
+	){
+		double real = strtod(text, NULL);
+		return Eq_MakeReal(negative ? -real : real);
+	}
+	
+	x = strtoull(text, NULL, 0);
+	if(negative){
+		return Eq_MakeInt((int64_t)(0 - x));
+	} else if(x > (uint64_t)INT64_MAX){
+		return Eq_MakeUInt(x);
+	} else {
+		return Eq_MakeInt((int64_t)x);
+	}
 }
 
-BOOL StrInStrArray(const char *array[], int len, const char *item)
+// Returns the Eq_BinOp for a token, or -1 if it isn't one
+static int Eq_FindBinOp(const std::string &token)
 {
 	int i;
-	for(i = 0; i < len; i++){
-		if(streq(array[i], item)){
-			return TRUE;
+	for(i = 0; i < (int)(sizeof(Eq_BinOpNames)/sizeof(Eq_BinOpNames[0])); i++){
+		if(token == Eq_BinOpNames[i]){
+			return i;
 		}
 	}
-	return FALSE;
+	return -1;
 }
 
-// Computes a function queue in RPN order.
-template <typename T> T Eq_Compute(std::queue<std::string> input, const char *ModPath, BOOL IsFileOffset)
+// Anything that starts like a number is a number. Everything else is taken
+// as a variable name, which reads as 0 if there's no such variable.
+static BOOL Eq_IsLiteral(const std::string &token)
 {
-	const char *ops[] = {
-		"*", "/", "%", "+", "-", "<<", ">>", "&", "^", "|", "==",
-		"!=", "<", ">", "<=", ">=", "||", "&&"
-	};
-	std::stack<std::string> ArgStack;
-	std::string ModPathNew(ModPath ? ModPath : "");
+	size_t i = 0;
+	
+	if(token.empty()){return TRUE;}
+	if(token[0] == '-' || token[0] == '+'){i = 1;}
+	return i < token.length() && isdigit((unsigned char)token[i]);
+}
 
-	while(!input.empty()){
+static void Eq_Emit(Eq_Program *prog, enum Eq_OpCode Code, int Arg)
+{
+	Eq_Instr instr;
+	instr.Code = Code;
+	instr.Arg = Arg;
+	prog->Code.push_back(instr);
+}
+
+// Index of a variable in the program, added if it's new
+static int Eq_AddVar(Eq_Program *prog, const std::string &name)
+{
+	size_t i;
+	for(i = 0; i < prog->VarNames.size(); i++){
+		if(prog->VarNames[i] == name){
+			return (int)i;
+		}
+	}
+	prog->VarNames.push_back(name);
+	return (int)(prog->VarNames.size() - 1);
+}
+
+// Push a plain number or variable
+static void Eq_AddOperand(Eq_Program *prog, const std::string &token)
+{
+	if(Eq_IsLiteral(token)){
+		prog->Nums.push_back(Eq_ParseLiteral(token));
+		Eq_Emit(prog, EQOP_NUM, (int)(prog->Nums.size() - 1));
+	} else {
+		Eq_Emit(prog, EQOP_VAR, Eq_AddVar(prog, token));
+	}
+}
+
+// Compiles a function queue in RPN order.
+static Eq_Program * Eq_Compile(std::queue<std::string> input)
+{
+	Eq_Program *prog = new Eq_Program;
+	size_t depth = 0;
+	size_t i;
+	
+	prog->Valid = TRUE;
+	prog->Depth = 0;
+
+	while(!input.empty() && prog->Valid){
 		std::string token = input.front();
+		int op;
 		input.pop();
 		
-		// Determine type of current token
-
 		// Did a parenthesis sneak in somehow?
 		if(token == "(" || token == ")"){
-			//AlertMsg("Parenthesis found in PRN output. Equation parser is broken!", "DEBUG");
 			continue;
 		}
 		
 		// Is it a unary operator?
 		if(token == "~"){ // There's literally only one.
-			T Arg1 = CppStrToNum<T>(ArgStack.top());
-			ArgStack.pop();
-
-			Arg1 = ~Arg1;
-			ArgStack.push(CppNumToStr(Arg1));
+			if(depth < 1){
+				prog->Valid = FALSE;
+				break;
+			}
+			Eq_Emit(prog, EQOP_NOT, 0);
 			continue;
 		}
 		
 		// Is it a binary operator?
-		if(StrInStrArray( ops, (sizeof(ops)/sizeof(ops[0])), token.c_str() )){
-			T Arg1 = Eq_GetArgValue<T>(ArgStack.top(), IsFileOffset);
-			ArgStack.pop();
-			T Arg2 = Eq_GetArgValue<T>(ArgStack.top(), IsFileOffset);
-			ArgStack.pop();
-			
-			// Compute value.
-			ArgStack.push(CppNumToStr(Eq_Compute_DoOp<T>(Arg1, Arg2, token)));
+		op = Eq_FindBinOp(token);
+		if(op != -1){
+			if(depth < 2){
+				prog->Valid = FALSE;
+				break;
+			}
+			Eq_Emit(prog, EQOP_BINARY, op);
+			depth--;
 			continue;
 		}
 
-		// Must be a number if the only value remaining
-		// (Can't continue; will crash)
-		if(input.empty()){
-			ArgStack.push(token);
-			continue;
-		}
-			
+		// Everything else pushes one value
+		depth++;
+		prog->Depth = MAX(prog->Depth, depth);
+
 		// Check if the next operator is a dereferencer
-		std::string derefOp = input.front();
+		if(!input.empty() && input.front() == "$"){
+			input.pop();
 			
-		// Is it a known variable?
-		if (derefOp == "$") {
-			input.pop(); // Remove operator from stack;
-
-			if(input.empty()){
-				// Just get value; stack's empty
-				ArgStack.push(CppNumToStr(Eq_GetArgValue<T>(token, IsFileOffset)));
-				continue;
-			}
-
-			std::string VarOp = input.front();
-			if(VarOp == "exists"){
+			if(!input.empty() && input.front() == "exists"){
 				// Return if variable exists or not
 				input.pop();
-				ArgStack.push(CppNumToStr(Var_Exists(token.c_str())));
+				Eq_Emit(prog, EQOP_EXISTS, Eq_AddVar(prog, token));
 			} else {
 				// Just get value; that's what they want
-				ArgStack.push(CppNumToStr(Eq_GetArgValue<T>(token, IsFileOffset)));
-				continue;
+				Eq_AddOperand(prog, token);
 			}
+			continue;
 		}
 
-		// Check to make sure we have two operators remaining
-		if(input.size() <= 1){
-			ArgStack.push(token);
+		// File stuff. Needs the file operator after it.
+		if(input.size() >= 2 && (input.front() == "@" || input.front() == "#")){
+			Eq_File file;
+			std::string FileOp;
+			
+			file.Name = token;
+			file.InModDir = (input.front() == "#");
+			input.pop();
+			FileOp = input.front();
+			input.pop();
+			
+			if(FileOp == "exists"){
+				file.Op = EQFILE_EXISTS;
+			} else if(FileOp == "crc32"){
+				file.Op = EQFILE_CRC32;
+			} else if(FileOp == "len"){
+				file.Op = EQFILE_LEN;
+			} else {
+				file.Op = EQFILE_UNKNOWN;
+			}
+			prog->Files.push_back(file);
+			Eq_Emit(prog, EQOP_FILE, (int)(prog->Files.size() - 1));
 			continue;
 		}
-		
-		// Get file path
-		std::string FilePath;
-		if(derefOp == "@"){ // File in game dir
-			FilePath = (CONFIG.CURRDIR + ("/" + token));
-		} else if (derefOp == "#") { // Mod dir
-			std::string FilePath = (ModPathNew + ("/" + token));
+
+		// Other possiblities exhausted. Must be a number or variable.
+		Eq_AddOperand(prog, token);
+	}
+
+	// Should end up with exactly one result
+	if(depth != 1){
+		prog->Valid = FALSE;
+	}
+	
+	// Names won't move from here on, so the handles can point at them
+	prog->Vars.resize(prog->VarNames.size());
+	for(i = 0; i < prog->VarNames.size(); i++){
+		prog->Vars[i].UUID = prog->VarNames[i].c_str();
+		prog->Vars[i].Gen = 0;
+		prog->Vars[i].Var = NULL;
+	}
+	return prog;
+}
+
+// Compiled expressions by their text. Mods only use so many expressions,
+// but start over if it somehow gets too big. Keyed by the program's own
+// copy of the text, so looking one up doesn't have to build a string.
+#define EQ_CACHE_MAX 1024
+struct Eq_StrLess {
+	bool operator()(const char *a, const char *b) const {
+		return strcmp(a, b) < 0;
+	}
+};
+typedef std::map<const char *, Eq_Program *, Eq_StrLess> Eq_Cache;
+static Eq_Cache EQCACHE;
+
+// While a batch is running its items point into the cache, so anything
+// thrown out then is kept here until the last batch is done with it.
+static int EQCACHE_PINS = 0;
+static std::vector<Eq_Program *> EQRETIRED;
+
+static void Eq_ClearCache(void)
+{
+	Eq_Cache::iterator it;
+	for(it = EQCACHE.begin(); it != EQCACHE.end(); ++it){
+		if(EQCACHE_PINS > 0){
+			EQRETIRED.push_back(it->second);
+		} else {
+			delete it->second;
 		}
+	}
+	EQCACHE.clear();
+}
 
-		// File stuff
-		if(derefOp == "@" || derefOp == "#"){
-			input.pop();
+// Keep every program handed out from now until the matching Eq_Unpin
+static void Eq_Pin(void)
+{
+	EQCACHE_PINS++;
+}
 
-			if(input.empty()){
-				// Need additional operator
-				// (Maybe I'll support raw values later.)
-				CURRERROR = errWNG_MODCFG;
-				return 0;
-			}
+static void Eq_Unpin(void)
+{
+	size_t i;
+	if(--EQCACHE_PINS > 0){return;}
+	for(i = 0; i < EQRETIRED.size(); i++){
+		delete EQRETIRED[i];
+	}
+	EQRETIRED.clear();
+}
 
-			std::string FileOp = input.front();
-			input.pop();
-			BOOL Exists = File_Exists(FilePath.c_str(), FALSE, TRUE);
-			
-			if (FileOp == "exists") {
-				ArgStack.push(CppNumToStr(Exists));
-				continue;
+static Eq_Program * Eq_GetProgram(const char *eq)
+{
+	Eq_Cache::iterator it = EQCACHE.find(eq);
+	Eq_Program *prog;
+	
+	if(it != EQCACHE.end()){
+		return it->second;
+	}
+	if(EQCACHE.size() >= EQ_CACHE_MAX){
+		Eq_ClearCache();
+	}
+	
+	prog = Eq_Compile(Eq_Reorder(Eq_Tokenize(eq)));
+	prog->Text = eq;
+	EQCACHE[prog->Text.c_str()] = prog;
+	return prog;
+}
 
-			} else if (!Exists) {
-				// Return 0. File doesn't exist, right?
-				ArgStack.push("0");
-				continue;
+// A variable's value. Types smaller than 32 bits become signed, like C's
+// integer promotion.
+static Eq_Value Eq_VarToValue(const struct VarValue *cached, BOOL IsFileOffset)
+{
+	// Shallow copy; the strings still belong to the variable table
+	struct VarValue var = *cached;
+
+	// If this is TRUE, we need to see if variable name starts with "Start.",
+	// if the text immediately after it refers to a known space, and if so,
+	// convert the PE pointer to a file offset
+	if(IsFileOffset){
+		Var_DerefPointer(&var);
+	}
+	
+	switch(var.type){
+	case IEEE64:
+		return Eq_MakeReal(var.IEEE64);
+	case IEEE32:
+		return Eq_MakeReal(var.IEEE32);
+	case Int32:
+		return Eq_MakeInt(var.Int32);
+	case Int16:
+		return Eq_MakeInt(var.Int16);
+	case Int8:
+		return Eq_MakeInt(var.Int8);
+	case uInt32:
+	case uInt32Pointer:
+		return Eq_MakeUInt(var.uInt32);
+	case uInt16:
+		return Eq_MakeInt(var.uInt16);
+	case uInt8:
+		return Eq_MakeInt(var.uInt8);
+	default:
+		return Eq_MakeInt(0);
+	}
+}
+
+static std::string Eq_FilePath(const Eq_File &file, const char *ModPath)
+{
+	if(file.InModDir){ // Mod dir
+		return std::string(ModPath ? ModPath : "") + ("/" + file.Name);
+	} else { // File in game dir
+		return CONFIG.CURRDIR + ("/" + file.Name);
+	}
+}
+
+// Run a file function. FALSE if it isn't one.
+static BOOL Eq_FileValue(const Eq_File &file, const char *ModPath, Eq_Value *result)
+{
+	std::string FilePath = Eq_FilePath(file, ModPath);
+	BOOL Exists = File_Exists(FilePath.c_str(), FALSE, TRUE);
+	
+	if(file.Op == EQFILE_EXISTS){
+		*result = Eq_MakeInt(Exists);
+	} else if(!Exists){
+		// Return 0. File doesn't exist, right?
+		*result = Eq_MakeInt(0);
+	} else if(file.Op == EQFILE_CRC32){
+		*result = Eq_MakeUInt(File_CRC32(FilePath.c_str()));
+	} else if(file.Op == EQFILE_LEN){
+		*result = Eq_MakeInt(File_Length(FilePath.c_str()));
+	} else {
+		*result = Eq_MakeInt(0);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Where a running expression gets its variables and files from.
+// Eq_LiveSource looks them up as it goes. Eq_SnapSource reads values
+// fetched beforehand by Eq_ParseBatch, so it's safe on any thread.
+struct Eq_LiveSource {
+	Eq_Program *Prog;
+	const char *ModPath;
+	BOOL IsFileOffset;
+	
+	Eq_Value Var(int i){
+		const struct VarValue *var = Var_Resolve(&Prog->Vars[i]);
+		return var ? Eq_VarToValue(var, IsFileOffset) : Eq_MakeInt(0);
+	}
+	BOOL Exists(int i){
+		return Var_Resolve(&Prog->Vars[i]) != NULL;
+	}
+	BOOL File(int i, Eq_Value *result){
+		return Eq_FileValue(Prog->Files[i], ModPath, result);
+	}
+};
+
+struct Eq_SnapVar {
+	BOOL Exists;
+	Eq_Value Value;
+	Eq_Value Deref;       // Value with IsFileOffset set
+};
+
+struct Eq_SnapFile {
+	BOOL Valid;
+	Eq_Value Value;
+};
+
+struct Eq_SnapSource {
+	Eq_Program *Prog;
+	BOOL IsFileOffset;
+	std::vector<const Eq_SnapVar *> Vars;
+	std::vector<const Eq_SnapFile *> Files;
+	
+	Eq_Value Var(int i){
+		return IsFileOffset ? Vars[i]->Deref : Vars[i]->Value;
+	}
+	BOOL Exists(int i){
+		return Vars[i]->Exists;
+	}
+	BOOL File(int i, Eq_Value *result){
+		*result = Files[i]->Value;
+		return Files[i]->Valid;
+	}
+};
+
+// Evaluates a compiled, valid expression. Doesn't touch CURRERROR;
+// returns the error instead.
+template <class Source> enum errCode Eq_Exec(const Eq_Program *prog, Source &src, Eq_Value *result)
+{
+	Eq_Value local[16];
+	std::vector<Eq_Value> heap;
+	Eq_Value *stack = local;
+	size_t sp = 0;
+	size_t i;
+	
+	if(prog->Depth > sizeof(local)/sizeof(local[0])){
+		heap.resize(prog->Depth);
+		stack = &heap[0];
+	}
+
+	for(i = 0; i < prog->Code.size(); i++){
+		const Eq_Instr &instr = prog->Code[i];
+		
+		switch(instr.Code){
+		case EQOP_NUM:
+			stack[sp++] = prog->Nums[instr.Arg];
+			break;
+		case EQOP_VAR:
+			stack[sp++] = src.Var(instr.Arg);
+			break;
+		case EQOP_EXISTS:
+			stack[sp++] = Eq_MakeInt(src.Exists(instr.Arg));
+			break;
+		case EQOP_FILE:
+			if(!src.File(instr.Arg, &stack[sp++])){
+				return errWNG_MODCFG;
 			}
-			
-			if (FileOp == "crc32") {
-				// Yes, you'll get a negative checksum, but
-				// if you're just comparing this is fine.
-				ArgStack.push(CppNumToStr((T)crc32File(FilePath.c_str())));
-			} else if (FileOp == "len") {
-				ArgStack.push(CppNumToStr((T)filesize(FilePath.c_str())));
+			break;
+		case EQOP_NOT:
+			if(stack[sp-1].Type == EQ_UINT){
+				stack[sp-1].UInt = ~stack[sp-1].UInt;
 			} else {
-				CURRERROR = errWNG_MODCFG;
-				return 0;
+				stack[sp-1] = Eq_MakeInt(~Eq_ToInt(stack[sp-1]));
 			}
-			continue;
+			break;
+		case EQOP_BINARY:
+			if(!Eq_DoOp(stack[sp-2], stack[sp-1], instr.Arg, &stack[sp-2])){
+				// Division by zero
+				return errWNG_MODCFG;
+			}
+			sp--;
+			break;
 		}
-
-		// Other possiblities exhausted. Must be a number. Push onto stack
-		ArgStack.push(token);
-
 	}
 
 	// We got a final result
-	if(ArgStack.size() != 1) {
+	*result = stack[0];
+	return errNOERR;
+}
+
+// Evaluates a compiled expression, looking up variables as needed
+static BOOL Eq_Run(Eq_Program *prog, const char *ModPath, BOOL IsFileOffset, Eq_Value *result)
+{
+	Eq_LiveSource src;
+	enum errCode error;
+	
+	if(!prog->Valid){
 		// Mismatched input
 		AlertMsg("Mismatched expression input!", "Parser error");
 		CURRERROR = errWNG_MODCFG;
-		return 0;
+		return FALSE;
+	}
+	
+	src.Prog = prog;
+	src.ModPath = ModPath;
+	src.IsFileOffset = IsFileOffset;
+	error = Eq_Exec(prog, src, result);
+	if(error != errNOERR){
+		CURRERROR = error;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Batch evaluation. Every expression is compiled and every variable and
+// file it reads is fetched once, up front, on the calling thread. After
+// that the expressions only read that snapshot, so they're split between
+// worker threads when there are enough of them to be worth it. Workers
+// don't touch CURRERROR, the variable table or the expression cache.
+
+#define EQBATCH_MAX_THREADS 8
+#define EQBATCH_PER_THREAD 256
+
+struct Eq_BatchJob {
+	struct EqBatchItem *Items;
+	Eq_SnapSource *Sources;
+	size_t Start;
+	size_t End;
+};
+
+static void Eq_ParseBatch_Run(Eq_BatchJob *job)
+{
+	size_t i;
+	
+	for(i = job->Start; i < job->End; i++){
+		struct EqBatchItem *item = &job->Items[i];
+		Eq_SnapSource &src = job->Sources[i];
+		Eq_Value value = Eq_MakeInt(0);
+		
+		if(src.Prog->Valid){
+			item->Error = Eq_Exec(src.Prog, src, &value);
+		} else {
+			item->Error = errWNG_MODCFG;
+		}
+		if(item->Error != errNOERR){
+			value = Eq_MakeInt(0);
+		}
+		item->Int = (int)Eq_ToInt(value);
+		item->uInt = (unsigned int)Eq_ToUInt(value);
+		item->Double = Eq_ToReal(value);
+	}
+}
+
+#if defined(EQBATCH_THREADS)
+#if defined(HAVE_WINDOWS_H)
+static DWORD WINAPI Eq_ParseBatch_Thread(LPVOID arg)
+{
+	Eq_ParseBatch_Run((Eq_BatchJob *)arg);
+	return 0;
+}
+#else
+static void * Eq_ParseBatch_Thread(void *arg)
+{
+	Eq_ParseBatch_Run((Eq_BatchJob *)arg);
+	return NULL;
+}
+#endif
+#endif
+
+static const Eq_SnapVar * Eq_SnapshotVar(
+	std::map<std::string, Eq_SnapVar> &vars, const std::string &name
+){
+	std::map<std::string, Eq_SnapVar>::iterator it = vars.find(name);
+	const struct VarValue *var;
+	Eq_SnapVar snap;
+	
+	if(it != vars.end()){
+		return &it->second;
+	}
+	
+	var = Var_Lookup(name.c_str());
+	snap.Exists = (var != NULL);
+	if(var != NULL){
+		snap.Value = Eq_VarToValue(var, FALSE);
+		snap.Deref = Eq_VarToValue(var, TRUE);
+	} else {
+		snap.Value = snap.Deref = Eq_MakeInt(0);
+	}
+	return &vars.insert(std::make_pair(name, snap)).first->second;
+}
+
+static const Eq_SnapFile * Eq_SnapshotFile(
+	std::map<std::string, Eq_SnapFile> &files, const Eq_File &file, const char *ModPath
+){
+	std::string key = Eq_FilePath(file, ModPath);
+	std::map<std::string, Eq_SnapFile>::iterator it;
+	Eq_SnapFile snap;
+	
+	key += (char)('0' + file.Op);
+	it = files.find(key);
+	if(it != files.end()){
+		return &it->second;
+	}
+	
+	snap.Valid = Eq_FileValue(file, ModPath, &snap.Value);
+	return &files.insert(std::make_pair(key, snap)).first->second;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Eq_ParseBatch
+ *  Description:  Evaluates several expressions against one snapshot of the variables.
+ *                Each variable and file is read once for the whole batch, so all
+ *                items see the same values. Results and Error are set in each item.
+ *                Returns FALSE if any failed, with CURRERROR set from the first
+ *                failed item in the list.
+ * =====================================================================================
+ */
+BOOL Eq_ParseBatch(struct EqBatchItem *items, size_t count)
+{
+	std::map<std::string, Eq_SnapVar> vars;
+	std::map<std::string, Eq_SnapFile> files;
+	std::vector<Eq_SnapSource> sources(count);
+	Eq_BatchJob jobs[EQBATCH_MAX_THREADS];
+	size_t threads, i;
+	
+	CURRERROR = errNOERR;
+	TRACE_BEGIN("Eq_ParseBatch", NULL);
+	
+	// Take the snapshot. The cache may fill up part way through, so hang on
+	// to the programs until the workers are done.
+	Eq_Pin();
+	for(i = 0; i < count; i++){
+		Eq_SnapSource &src = sources[i];
+		size_t j;
+		
+		src.Prog = Eq_GetProgram(items[i].Eq);
+		src.IsFileOffset = items[i].IsFileOffset;
+		src.Vars.resize(src.Prog->VarNames.size());
+		for(j = 0; j < src.Prog->VarNames.size(); j++){
+			src.Vars[j] = Eq_SnapshotVar(vars, src.Prog->VarNames[j]);
+		}
+		src.Files.resize(src.Prog->Files.size());
+		for(j = 0; j < src.Prog->Files.size(); j++){
+			src.Files[j] = Eq_SnapshotFile(files, src.Prog->Files[j], items[i].ModPath);
+		}
+	}
+	if(CURRERROR != errNOERR){
+		// Couldn't read the variables
+		enum errCode error = CURRERROR;
+		for(i = 0; i < count; i++){
+			items[i].Error = error;
+			items[i].Int = 0;
+			items[i].uInt = 0;
+			items[i].Double = 0;
+		}
+		Eq_Unpin();
+		TRACE_END("Eq_ParseBatch");
+		return FALSE;
+	}
+	
+	// Split into even runs of items
+	threads = MIN(count / EQBATCH_PER_THREAD, EQBATCH_MAX_THREADS);
+	if(threads < 1){threads = 1;}
+	for(i = 0; i < threads; i++){
+		jobs[i].Items = items;
+		jobs[i].Sources = count ? &sources[0] : NULL;
+		jobs[i].Start = count * i / threads;
+		jobs[i].End = count * (i + 1) / threads;
+	}
+	
+	#if defined(EQBATCH_THREADS)
+	if(threads > 1){
+		#if defined(HAVE_WINDOWS_H)
+		HANDLE handles[EQBATCH_MAX_THREADS];
+		#else
+		pthread_t handles[EQBATCH_MAX_THREADS];
+		#endif
+		BOOL started[EQBATCH_MAX_THREADS];
+		
+		for(i = 0; i < threads; i++){
+			#if defined(HAVE_WINDOWS_H)
+			handles[i] = CreateThread(NULL, 0, Eq_ParseBatch_Thread, &jobs[i], 0, NULL);
+			started[i] = (handles[i] != NULL);
+			#else
+			started[i] = (pthread_create(
+				&handles[i], NULL, Eq_ParseBatch_Thread, &jobs[i]
+			) == 0);
+			#endif
+			// Couldn't get a thread; do it here instead
+			if(!started[i]){
+				Eq_ParseBatch_Run(&jobs[i]);
+			}
+		}
+		for(i = 0; i < threads; i++){
+			if(!started[i]){continue;}
+			#if defined(HAVE_WINDOWS_H)
+			WaitForSingleObject(handles[i], INFINITE);
+			CloseHandle(handles[i]);
+			#else
+			pthread_join(handles[i], NULL);
+			#endif
+		}
+	} else {
+		Eq_ParseBatch_Run(&jobs[0]);
 	}
-	else {
-		return Eq_GetArgValue<T>(ArgStack.top(), IsFileOffset);
+	#else
+	for(i = 0; i < threads; i++){
+		Eq_ParseBatch_Run(&jobs[i]);
+	}
+	#endif
+	
+	TRACE_END("Eq_ParseBatch");
+	for(i = 0; i < count; i++){
+		if(items[i].Error == errNOERR){continue;}
+		if(!sources[i].Prog->Valid){
+			// Mismatched input
+			AlertMsg("Mismatched expression input!", "Parser error");
+		}
+		if(CURRERROR == errNOERR){
+			CURRERROR = items[i].Error;
+		}
 	}
+	Eq_Unpin();
+	return CURRERROR == errNOERR;
 }
\ No newline at end of file
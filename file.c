@@ -248,15 +248,18 @@ char * File_FindPatchOwner(const char *PatchUUID)
 BOOL File_IsPE(const char *FilePath){
 	int handle = -1;
 	BOOL result = FALSE;
+	TRACE_BEGIN("File_IsPE", FilePath);
 
 	//:memory: check
 	if(strstr(FilePath, ":memory:")){
+		TRACE_END("File_IsPE");
 		return FALSE;
 	}
 	
 	//Open file
 	handle = File_OpenSafe(FilePath, _O_BINARY | _O_RDONLY);
 	if(handle == -1){
+		TRACE_END("File_IsPE");
 		return FALSE;
 	}
 	
@@ -293,6 +296,7 @@ BOOL File_IsPE(const char *FilePath){
 	
 File_IsPE_Return:
 	close(handle);
+	TRACE_END("File_IsPE");
 	return result;
 }
 
@@ -317,15 +321,18 @@ int File_PEToOff(const char *FilePath, uint32_t PELoc)
 	
 	uint32_t LastFileOff = 0;
 	uint32_t LastPEOff = 0;
+	TRACE_BEGIN("File_PEToOff", FilePath);
 	
 	//Check if PE or just some random file
 	if(!File_IsPE(FilePath)){
+		TRACE_END("File_PEToOff");
 		return result;
 	}
 	
 	//Open file
 	handle = File_OpenSafe(FilePath, _O_BINARY | _O_RDONLY);
 	if(handle == -1){
+		TRACE_END("File_PEToOff");
 		return result;
 	}
 	
@@ -392,6 +399,7 @@ int File_PEToOff(const char *FilePath, uint32_t PELoc)
 	}
 	
 	close(handle);
+	TRACE_END("File_PEToOff");
 	return result;
 }
 
@@ -415,15 +423,18 @@ int File_OffToPE(const char *FilePath, uint32_t FileLoc)
 	
 	uint32_t LastFileOff = 0;
 	uint32_t LastPEOff = 0;
+	TRACE_BEGIN("File_OffToPE", FilePath);
 	
 	//Check if PE or just some random file
 	if(!File_IsPE(FilePath)){
+		TRACE_END("File_OffToPE");
 		return result;
 	}
 	
 	//Open file
 	handle = File_OpenSafe(FilePath, _O_BINARY | _O_RDONLY);
 	if(handle == -1){
+		TRACE_END("File_OffToPE");
 		return result;
 	}
 	
@@ -484,10 +495,405 @@ int File_OffToPE(const char *FilePath, uint32_t FileLoc)
 	result = (FileLoc - LastFileOff) + LastPEOff;
 	
 	close(handle);
+	TRACE_END("File_OffToPE");
 	return result;
 }
 
 
+/// Dry-run overlay
+// While an overlay is active, nothing on disk is written to. Writes are kept as
+// copy-on-write extents keyed by file path, and reads through File_ReadBytes
+// see those extents layered on top of the real file.
+// A planning overlay (File_OverlayBeginPlan) is the same, except that files are
+// really created and deleted as asked, and the writes are handed back by
+// File_OverlayPlan to be flushed for real once everything is worked out.
+struct OverlayExtent {
+	int Offset;
+	int Len;
+	unsigned char *Bytes;
+};
+
+struct OverlayFile {
+	char *Path;
+	int Handle;         //Last handle given out by File_OpenSafe, or -1
+	BOOL Created;       //File_Create was called on it
+	BOOL Deleted;       //File_Delete was called on it
+	int Writes;
+	struct OverlayExtent *Extents;
+	int ExtentCount;
+	int ExtentCap;
+};
+
+static struct {
+	BOOL Active;
+	BOOL Plan;          //Writes will be flushed afterwards
+	struct OverlayFile *Files;
+	int FileCount;
+	int FileCap;
+} OVERLAY = {0};
+
+// Find the overlay entry for a path, creating it if asked to.
+static struct OverlayFile * File_OverlayFind(const char *Path, BOOL Create)
+{
+	struct OverlayFile *entry;
+	int i;
+
+	for(i = 0; i < OVERLAY.FileCount; i++){
+		if(streq(OVERLAY.Files[i].Path, Path)){
+			return &OVERLAY.Files[i];
+		}
+	}
+	if(!Create){return NULL;}
+
+	if(OVERLAY.FileCount == OVERLAY.FileCap){
+		struct OverlayFile *FilesNew;
+		int CapNew = OVERLAY.FileCap ? OVERLAY.FileCap * 2 : 4;
+		FilesNew = realloc(OVERLAY.Files, CapNew * sizeof(struct OverlayFile));
+		if(!FilesNew){
+			CURRERROR = errCRIT_MALLOC;
+			return NULL;
+		}
+		OVERLAY.Files = FilesNew;
+		OVERLAY.FileCap = CapNew;
+	}
+
+	entry = &OVERLAY.Files[OVERLAY.FileCount];
+	memset(entry, 0, sizeof(struct OverlayFile));
+	entry->Path = strdup(Path);
+	entry->Handle = -1;
+	OVERLAY.FileCount++;
+	return entry;
+}
+
+// Find the overlay entry a file handle was opened for.
+static struct OverlayFile * File_OverlayFindHandle(int filehandle)
+{
+	int i;
+	if(filehandle == -1){return NULL;}
+	for(i = 0; i < OVERLAY.FileCount; i++){
+		if(OVERLAY.Files[i].Handle == filehandle){
+			return &OVERLAY.Files[i];
+		}
+	}
+	return NULL;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_OverlayBegin
+ *  Description:  Starts redirecting all game file writes into memory.
+ *                Only one overlay can be active at a time.
+ * =====================================================================================
+ */
+BOOL File_OverlayBegin(void)
+{
+	if(OVERLAY.Active){
+		CURRERROR = errCRIT_FUNCT;
+		return FALSE;
+	}
+	OVERLAY.Active = TRUE;
+	return TRUE;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_OverlayBeginPlan
+ *  Description:  Starts collecting game file writes in memory so they can all be
+ *                flushed together later. Unlike a dry run, files are still created
+ *                and deleted on disk straight away.
+ * =====================================================================================
+ */
+BOOL File_OverlayBeginPlan(void)
+{
+	if(!File_OverlayBegin()){return FALSE;}
+	OVERLAY.Plan = TRUE;
+	return TRUE;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_OverlayActive
+ *  Description:  Returns TRUE if writes are currently being redirected to the overlay.
+ * =====================================================================================
+ */
+BOOL File_OverlayActive(void)
+{
+	return OVERLAY.Active;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_OverlayEnd
+ *  Description:  Discards the overlay and everything written to it.
+ * =====================================================================================
+ */
+void File_OverlayEnd(void)
+{
+	int i, j;
+	for(i = 0; i < OVERLAY.FileCount; i++){
+		for(j = 0; j < OVERLAY.Files[i].ExtentCount; j++){
+			safe_free(OVERLAY.Files[i].Extents[j].Bytes);
+		}
+		safe_free(OVERLAY.Files[i].Extents);
+		safe_free(OVERLAY.Files[i].Path);
+	}
+	safe_free(OVERLAY.Files);
+	OVERLAY.FileCount = 0;
+	OVERLAY.FileCap = 0;
+	OVERLAY.Active = FALSE;
+	OVERLAY.Plan = FALSE;
+}
+
+// Throw away the writes collected for a file
+static void File_OverlayDiscard(struct OverlayFile *entry)
+{
+	int i;
+	for(i = 0; i < entry->ExtentCount; i++){
+		safe_free(entry->Extents[i].Bytes);
+	}
+	entry->ExtentCount = 0;
+}
+
+// Compare extents by offset for qsort
+static int File_OverlayCompare(const void *a, const void *b)
+{
+	const struct OverlayExtent *lhs = a, *rhs = b;
+	return (lhs->Offset > rhs->Offset) - (lhs->Offset < rhs->Offset);
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_OverlayReport
+ *  Description:  Returns a JSON array describing every file the overlay has seen:
+ *                number of writes, distinct bytes touched and create/delete flags.
+ * =====================================================================================
+ */
+json_t * File_OverlayReport(void)
+{
+	json_t *out = json_array();
+	int i, j;
+
+	for(i = 0; i < OVERLAY.FileCount; i++){
+		struct OverlayFile *entry = &OVERLAY.Files[i];
+		struct OverlayExtent *sorted = NULL;
+		json_t *row;
+		int touched = 0, end = 0;
+
+		// Untouched files that were only opened aren't interesting
+		if(!entry->Writes && !entry->Created && !entry->Deleted){
+			continue;
+		}
+
+		// Union of extents is the number of distinct bytes written
+		if(entry->ExtentCount > 0){
+			sorted = malloc(entry->ExtentCount * sizeof(struct OverlayExtent));
+			if(!sorted){
+				CURRERROR = errCRIT_MALLOC;
+				json_decref(out);
+				return NULL;
+			}
+			memcpy(sorted, entry->Extents, entry->ExtentCount * sizeof(struct OverlayExtent));
+			qsort(sorted, entry->ExtentCount, sizeof(struct OverlayExtent), File_OverlayCompare);
+		}
+		for(j = 0; j < entry->ExtentCount; j++){
+			int start = MAX(sorted[j].Offset, end);
+			int stop = sorted[j].Offset + sorted[j].Len;
+			if(stop > start){
+				touched += stop - start;
+				end = stop;
+			}
+		}
+		safe_free(sorted);
+
+		row = json_object();
+		json_object_set_new(row, "Path", json_string(entry->Path));
+		json_object_set_new(row, "Writes", json_integer(entry->Writes));
+		json_object_set_new(row, "BytesTouched", json_integer(touched));
+		json_object_set_new(row, "Created", json_boolean(entry->Created));
+		json_object_set_new(row, "Deleted", json_boolean(entry->Deleted));
+		json_array_append_new(out, row);
+	}
+	return out;
+}
+
+// Lay one extent into the run that holds it
+static void File_OverlayApply(struct WriteBackFile *file, const struct OverlayExtent *ext)
+{
+	size_t lo = 0, hi = file->WriteCount;
+
+	//Last run starting at or before the extent
+	while(hi - lo > 1){
+		size_t mid = lo + (hi - lo) / 2;
+		if(file->Writes[mid].Offset <= ext->Offset){lo = mid;}
+		else{hi = mid;}
+	}
+	memcpy(
+		file->Writes[lo].Bytes + (ext->Offset - file->Writes[lo].Offset),
+		ext->Bytes, ext->Len
+	);
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_OverlayPlan
+ *  Description:  Turns what's been written to the overlay into a list of files for
+ *                File_WriteBack, one per file written to, in the order they were
+ *                first seen. Extents that overlap or touch become one write, with
+ *                later writes winning, and writes are sorted by offset. Name is
+ *                the file's path and Handle is -1; the caller opens it.
+ *                Returns NULL with count 0 if nothing was written, or on error.
+ * =====================================================================================
+ */
+struct WriteBackFile * File_OverlayPlan(size_t *count)
+{
+	struct WriteBackFile *files;
+	int i;
+
+	CURRERROR = errNOERR;
+	*count = 0;
+	files = calloc(OVERLAY.FileCount + 1, sizeof(struct WriteBackFile));
+	if(files == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+
+	for(i = 0; i < OVERLAY.FileCount; i++){
+		struct OverlayFile *entry = &OVERLAY.Files[i];
+		struct WriteBackFile *file = &files[*count];
+		struct OverlayExtent *sorted;
+		int j;
+
+		if(entry->ExtentCount == 0){continue;}
+		file->Handle = -1;
+		file->Name = strdup(entry->Path);
+		file->Writes = calloc(entry->ExtentCount, sizeof(struct WriteBackWrite));
+		sorted = malloc(entry->ExtentCount * sizeof(struct OverlayExtent));
+		(*count)++;
+		if(file->Name == NULL || file->Writes == NULL || sorted == NULL){
+			safe_free(sorted);
+			CURRERROR = errCRIT_MALLOC;
+			break;
+		}
+
+		//Work out the runs
+		memcpy(sorted, entry->Extents, entry->ExtentCount * sizeof(struct OverlayExtent));
+		qsort(sorted, entry->ExtentCount, sizeof(struct OverlayExtent), File_OverlayCompare);
+		for(j = 0; j < entry->ExtentCount; j++){
+			struct WriteBackWrite *last = file->WriteCount ?
+				&file->Writes[file->WriteCount - 1] : NULL;
+			if(last != NULL && sorted[j].Offset <= last->Offset + last->Len){
+				last->Len = MAX(last->Len, sorted[j].Offset + sorted[j].Len - last->Offset);
+			} else {
+				file->Writes[file->WriteCount].Offset = sorted[j].Offset;
+				file->Writes[file->WriteCount].Len = sorted[j].Len;
+				file->WriteCount++;
+			}
+		}
+		safe_free(sorted);
+
+		//Fill them in, oldest write first
+		for(j = 0; j < (int)file->WriteCount; j++){
+			file->Writes[j].Bytes = malloc(file->Writes[j].Len);
+			if(file->Writes[j].Bytes == NULL){
+				CURRERROR = errCRIT_MALLOC;
+				break;
+			}
+		}
+		if(CURRERROR != errNOERR){break;}
+		for(j = 0; j < entry->ExtentCount; j++){
+			File_OverlayApply(file, &entry->Extents[j]);
+		}
+	}
+
+	if(CURRERROR != errNOERR || *count == 0){
+		size_t k;
+		for(k = 0; k < *count; k++){
+			size_t j;
+			for(j = 0; j < files[k].WriteCount; j++){
+				safe_free(files[k].Writes[j].Bytes);
+			}
+			safe_free(files[k].Writes);
+			safe_free(files[k].Name);
+		}
+		safe_free(files);
+		*count = 0;
+	}
+	return files;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_ReadBytes
+ *  Description:  Reads datalen bytes from offset into data. If a dry-run overlay is
+ *                active, bytes written to the overlay are returned instead of the
+ *                bytes on disk. Returns the number of bytes read.
+ * =====================================================================================
+ */
+int File_ReadBytes(
+	int filehandle,
+	int offset,
+	unsigned char *data,
+	int datalen
+){
+	struct OverlayFile *entry;
+	int result, i;
+
+	lseek(filehandle, offset, SEEK_SET);
+	result = read(filehandle, data, datalen);
+
+	entry = OVERLAY.Active ? File_OverlayFindHandle(filehandle) : NULL;
+	if(!entry){return result;}
+
+	// Later writes win, so apply in order
+	for(i = 0; i < entry->ExtentCount; i++){
+		struct OverlayExtent *ext = &entry->Extents[i];
+		int start = MAX(ext->Offset, offset);
+		int stop = MIN(ext->Offset + ext->Len, offset + datalen);
+		if(stop <= start){continue;}
+
+		memcpy(data + (start - offset), ext->Bytes + (start - ext->Offset), stop - start);
+		result = MAX(result, stop - offset);
+	}
+	return result;
+}
+
+// Record a write in the overlay instead of touching the disk.
+static void File_OverlayWrite(
+	int filehandle,
+	int offset,
+	unsigned const char *data,
+	int datalen
+){
+	struct OverlayFile *entry = File_OverlayFindHandle(filehandle);
+	struct OverlayExtent *ext;
+
+	if(!entry || datalen <= 0){return;}
+
+	if(entry->ExtentCount == entry->ExtentCap){
+		struct OverlayExtent *ExtNew;
+		int CapNew = entry->ExtentCap ? entry->ExtentCap * 2 : 8;
+		ExtNew = realloc(entry->Extents, CapNew * sizeof(struct OverlayExtent));
+		if(!ExtNew){
+			CURRERROR = errCRIT_MALLOC;
+			return;
+		}
+		entry->Extents = ExtNew;
+		entry->ExtentCap = CapNew;
+	}
+
+	ext = &entry->Extents[entry->ExtentCount];
+	ext->Bytes = malloc(datalen);
+	if(!ext->Bytes){
+		CURRERROR = errCRIT_MALLOC;
+		return;
+	}
+	memcpy(ext->Bytes, data, datalen);
+	ext->Offset = offset;
+	ext->Len = datalen;
+	entry->ExtentCount++;
+	entry->Writes++;
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  File_Exists
@@ -605,6 +1011,128 @@ int File_WhitelistIndex(const char *FileName, json_t *whitelist)
 	return -1;
 }
 
+// Size and CRC32 of files, so expressions like "crc32 @ game.exe" don't
+// read the whole file every time. An entry is good as long as the file's
+// size and modification time haven't changed, and is dropped as soon as
+// the loader opens the file for writing or writes to it.
+struct FileInfo {
+	long Size;
+	time_t MTime;
+	BOOL HasCRC;
+	uint32_t CRC;
+};
+static struct HashTable *FILEINFO = NULL;
+
+// Files are told apart by device and inode, so different spellings of a
+// path share an entry. Windows has no inode numbers; the path will do.
+static void File_InfoKey(const char *FilePath, const struct stat *st, char *key, size_t keylen)
+{
+	if(st->st_ino != 0){
+		snprintf(key, keylen, "%lu:%lu",
+			(unsigned long)st->st_dev, (unsigned long)st->st_ino);
+	} else {
+		snprintf(key, keylen, "%s", FilePath);
+	}
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_InfoForget
+ *  Description:  Forgets the size and CRC32 of the file open as [handle], after
+ *                writing to it. Without inode numbers there's no telling which
+ *                file that is, so everything is forgotten.
+ * =====================================================================================
+ */
+void File_InfoForget(int handle)
+{
+	struct stat st;
+	char key[MAX_PATH + 64];
+	
+	if(FILEINFO == NULL || FILEINFO->Count == 0){return;}
+	if(fstat(handle, &st) != 0 || st.st_ino == 0){
+		HashTable_Clear(FILEINFO, free);
+		return;
+	}
+	File_InfoKey(NULL, &st, key, sizeof(key));
+	HashTable_Remove(FILEINFO, key, free);
+}
+
+static void File_InfoForgetPath(const char *FilePath)
+{
+	struct stat st;
+	char key[MAX_PATH + 64];
+	
+	if(FILEINFO == NULL || FILEINFO->Count == 0){return;}
+	if(stat(FilePath, &st) != 0){return;}
+	File_InfoKey(FilePath, &st, key, sizeof(key));
+	HashTable_Remove(FILEINFO, key, free);
+}
+
+// Current entry for a file, made or refreshed as needed. NULL if the file
+// can't be found.
+static struct FileInfo * File_InfoGet(const char *FilePath)
+{
+	struct FileInfo *info;
+	struct stat st;
+	char key[MAX_PATH + 64];
+	
+	if(stat(FilePath, &st) != 0){return NULL;}
+	File_InfoKey(FilePath, &st, key, sizeof(key));
+	
+	if(FILEINFO == NULL){
+		FILEINFO = HashTable_Create(8);
+		if(FILEINFO == NULL){return NULL;}
+	}
+	info = HashTable_Get(FILEINFO, key);
+	if(info != NULL && info->Size == (long)st.st_size && info->MTime == st.st_mtime){
+		return info;
+	}
+	
+	info = malloc(sizeof(struct FileInfo));
+	if(info == NULL || !HashTable_Set(FILEINFO, key, info, free)){
+		free(info);
+		return NULL;
+	}
+	info->Size = (long)st.st_size;
+	info->MTime = st.st_mtime;
+	info->HasCRC = FALSE;
+	info->CRC = 0;
+	return info;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_CRC32
+ *  Description:  crc32File, but only reads the file again once it's changed.
+ *                Returns 0 if the file can't be read.
+ * =====================================================================================
+ */
+uint32_t File_CRC32(const char *FilePath)
+{
+	struct FileInfo *info = File_InfoGet(FilePath);
+	
+	if(info == NULL){return crc32File(FilePath);}
+	if(!info->HasCRC){
+		TRACE_BEGIN("crc32File", FilePath);
+		info->CRC = crc32File(FilePath);
+		info->HasCRC = TRUE;
+		TRACE_END("crc32File");
+	}
+	return info->CRC;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_Length
+ *  Description:  Size of the file in bytes, or -1 if it can't be found.
+ * =====================================================================================
+ */
+long File_Length(const char *FilePath)
+{
+	struct FileInfo *info = File_InfoGet(FilePath);
+	return info ? info->Size : -1;
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  File_OpenSafe
@@ -632,10 +1160,27 @@ int File_OpenSafe(const char *filename, int flags)
 		return -1;
 	}
 	
+	//Dry run: never open for writing, and remember which file this is
+	if (OVERLAY.Active) {
+		flags &= ~(_O_RDWR | _O_WRONLY);
+	}
+	
 	handle = _open(filename, flags);
 	//Make sure file is indeed open. (No reason it shouldn't be.)
 	if (handle == -1){
 		CURRERROR = errCRIT_FILESYS;
+	} else if ((flags & _O_RDWR) || (flags & _O_WRONLY)) {
+		File_InfoForget(handle);
+	} else if (OVERLAY.Active) {
+		struct OverlayFile *entry = File_OverlayFindHandle(handle);
+		if (entry) {
+			//Handle was closed and reused
+			entry->Handle = -1;
+		}
+		entry = File_OverlayFind(filename, TRUE);
+		if (entry) {
+			entry->Handle = handle;
+		}
 	}
 	return handle;
 }
@@ -651,7 +1196,10 @@ int File_OpenSafe(const char *filename, int flags)
  */
 void File_Copy(const char *OldPath, const char *NewPath)
 {
+	TRACE_BEGIN("File_Copy", OldPath);
 	CopyFile(OldPath, NewPath, FALSE);
+	File_InfoForgetPath(NewPath);
+	TRACE_END("File_Copy");
 }
 
 #elif defined(HAVE_SYS_SENDFILE_H)
@@ -665,20 +1213,77 @@ void File_Copy(const char *OldPath, const char *NewPath)
 void File_Copy(const char *OldPath, const char *NewPath)
 {
 	int in = _open(OldPath, _O_RDONLY);
-	int out = _open(NewPath, _O_WRONLY);
-	int result;
-	int len = filesize(OldPath);
+	int out = _open(NewPath, _O_WRONLY | O_CREAT | O_TRUNC, S_IREAD | S_IWRITE);
+	long len = filesize(OldPath);
+	TRACE_BEGIN("File_Copy", OldPath);
 	
+	CURRERROR = errNOERR;
 	if(in == -1 || out == -1){
 		ErrNo2ErrCode();
+		if(in != -1){close(in);}
+		if(out != -1){close(out);}
+		TRACE_END("File_Copy");
 		return;
 	}
 	
-	result = sendfile(out, in, NULL, len);
+	//sendfile() can stop short, so keep going until it's all there
+	while(len > 0){
+		ssize_t result = sendfile(out, in, NULL, len);
+		if(result <= 0){
+			ErrNo2ErrCode();
+			if(CURRERROR == errNOERR){CURRERROR = errCRIT_FILESYS;}
+			break;
+		}
+		len -= result;
+	}
 
-	ErrNo2ErrCode();
 	close(in);
 	close(out);
+	File_InfoForgetPath(NewPath);
+	TRACE_END("File_Copy");
+	return;
+}
+
+#else
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_Copy
+ *  Description:  Copies a file from [OldPath] to [NewPath].
+ *                Streams through a fixed buffer, so any size file is fine.
+ * =====================================================================================
+ */
+void File_Copy(const char *OldPath, const char *NewPath)
+{
+	unsigned char buffer[64 * 1024];
+	int in = _open(OldPath, _O_BINARY | _O_RDONLY);
+	int out = _open(NewPath, _O_BINARY | _O_WRONLY | O_CREAT | O_TRUNC, S_IREAD | S_IWRITE);
+	int count;
+	TRACE_BEGIN("File_Copy", OldPath);
+	
+	CURRERROR = errNOERR;
+	if(in == -1 || out == -1){
+		ErrNo2ErrCode();
+		if(in != -1){close(in);}
+		if(out != -1){close(out);}
+		TRACE_END("File_Copy");
+		return;
+	}
+	
+	while((count = read(in, buffer, sizeof(buffer))) > 0){
+		if(write(out, buffer, count) != count){
+			count = -1;
+			break;
+		}
+	}
+	if(count < 0){
+		ErrNo2ErrCode();
+		if(CURRERROR == errNOERR){CURRERROR = errCRIT_FILESYS;}
+	}
+
+	close(in);
+	close(out);
+	File_InfoForgetPath(NewPath);
+	TRACE_END("File_Copy");
 	return;
 }
 #endif
@@ -694,6 +1299,14 @@ void File_Copy(const char *OldPath, const char *NewPath)
  */
 void File_Delete(const char *Path)
 {
+	if(OVERLAY.Active){
+		struct OverlayFile *entry = File_OverlayFind(Path, TRUE);
+		if(entry){entry->Deleted = TRUE;}
+		if(!OVERLAY.Plan){return;}
+		//Nothing planned for it matters now
+		if(entry){File_OverlayDiscard(entry);}
+	}
+	File_InfoForgetPath(Path);
 	DeleteFile(Path);
 }
 
@@ -707,6 +1320,14 @@ void File_Delete(const char *Path)
  */
 void File_Delete(const char *Path)
 {
+	if(OVERLAY.Active){
+		struct OverlayFile *entry = File_OverlayFind(Path, TRUE);
+		if(entry){entry->Deleted = TRUE;}
+		if(!OVERLAY.Plan){return;}
+		//Nothing planned for it matters now
+		if(entry){File_OverlayDiscard(entry);}
+	}
+	File_InfoForgetPath(Path);
 	unlink(Path);
 }
 
@@ -769,19 +1390,61 @@ BOOL File_MovTree(char *srcPath, char *dstPath)
  * ===  FUNCTION  ======================================================================
  *         Name:  File_Create
  *  Description:  Create the given file with the given length, filled with '\0' bytes.
+ *                The file is sized in one call, so it's sparse where the
+ *                filesystem allows.
  * =====================================================================================
  */
 BOOL File_Create(char *FilePath, int FileLen)
 {
-	int handle = _creat(FilePath, S_IREAD | S_IWRITE);
-	const unsigned char *pattern = (unsigned char *)"\0";
+	int handle;
+	TRACE_BEGIN("File_Create", FilePath);
+	
+	if(OVERLAY.Active && !OVERLAY.Plan){
+		struct OverlayFile *entry = File_OverlayFind(FilePath, TRUE);
+		if(entry){entry->Created = TRUE;}
+		TRACE_END("File_Create");
+		return entry != NULL;
+	}
 	
+	handle = _creat(FilePath, S_IREAD | S_IWRITE);
 	if(handle == -1){
 		ErrNo2ErrCode();
+		TRACE_END("File_Create");
+		return FALSE;
+	}
+
+	#ifdef HAVE_WINDOWS_H
+	if(_chsize(handle, FileLen) != 0){
+	#else
+	if(ftruncate(handle, FileLen) != 0){
+	#endif
+		ErrNo2ErrCode();
+		close(handle);
+		TRACE_END("File_Create");
+		return FALSE;
+	}
+	File_InfoForget(handle);
+	close(handle);
+	TRACE_END("File_Create");
+	return TRUE;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_Sync
+ *  Description:  Flushes everything written to an open file through to the disk.
+ * =====================================================================================
+ */
+BOOL File_Sync(int handle)
+{
+	#ifdef HAVE_WINDOWS_H
+	if(_commit(handle) != 0){
+	#else
+	if(fsync(handle) != 0){
+	#endif
+		CURRERROR = errCRIT_FILESYS;
 		return FALSE;
 	}
-	
-	File_WritePattern(handle, 0, pattern, 1, FileLen);
 	return TRUE;
 }
 
@@ -797,16 +1460,46 @@ void File_WriteBytes(
 	unsigned const char *data,
 	int datalen
 ){
+	if(OVERLAY.Active){
+		File_OverlayWrite(filehandle, offset, data, datalen);
+		return;
+	}
 	lseek(filehandle, offset, SEEK_SET);
 	write(filehandle, data, datalen);
+	File_InfoForget(filehandle);
 	return;
 }
 
+// Write all of data at offset, retrying short writes
+static BOOL File_WriteAt(
+	int filehandle,
+	int offset,
+	unsigned const char *data,
+	int datalen
+){
+	while(datalen > 0){
+		int count;
+		#ifdef HAVE_WINDOWS_H
+		if(lseek(filehandle, offset, SEEK_SET) == -1){return FALSE;}
+		count = write(filehandle, data, datalen);
+		#else
+		count = pwrite(filehandle, data, datalen, offset);
+		#endif
+		if(count <= 0){return FALSE;}
+		data += count;
+		offset += count;
+		datalen -= count;
+	}
+	return TRUE;
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  File_WritePattern
  *  Description:  Given an offset, length and byte pattern, it will write the pattern
  *                to the file until the length is filled.
+ *                The pattern is tiled into a 64KB buffer first, so a fill costs
+ *                one write per 64KB rather than one per repetition.
  * =====================================================================================
  */
 void File_WritePattern(
@@ -816,16 +1509,86 @@ void File_WritePattern(
 	int datalen,
 	int blocklen
 ){
-	int blockRemain = blocklen;
-	
-	while(blockRemain > 0){
-		File_WriteBytes(
-			filehandle,
-			offset,
-			data,
-			MIN(datalen, blockRemain)
-		);
-		blockRemain -= MIN(datalen, blockRemain);
-		offset += MIN(datalen, blockRemain);
+	unsigned char buffer[64 * 1024];
+	unsigned const char *tile = data;
+	int tileLen = datalen;
+	int pos;
+	TRACE_BEGIN("File_WritePattern", NULL);
+
+	if(datalen <= 0 || blocklen <= 0){
+		TRACE_END("File_WritePattern");
+		return;
+	}
+
+	// Repeat short patterns to a whole number of copies, so every chunk
+	// starts at the top of the pattern. Doubling keeps that true.
+	if(datalen < (int)sizeof(buffer)){
+		int filled = datalen;
+
+		tileLen = MIN(blocklen, (int)sizeof(buffer) - (int)sizeof(buffer) % datalen);
+		memcpy(buffer, data, MIN(datalen, tileLen));
+		while(filled < tileLen){
+			int count = MIN(filled, tileLen - filled);
+			memcpy(buffer + filled, buffer, count);
+			filled += count;
+		}
+		tile = buffer;
+	}
+
+	for(pos = 0; pos < blocklen; pos += tileLen){
+		int count = MIN(tileLen, blocklen - pos);
+		if(OVERLAY.Active){
+			File_OverlayWrite(filehandle, offset + pos, tile, count);
+		} else if(!File_WriteAt(filehandle, offset + pos, tile, count)){
+			CURRERROR = errCRIT_FILESYS;
+			break;
+		}
+	}
+	if(!OVERLAY.Active){
+		File_InfoForget(filehandle);
+	}
+	TRACE_END("File_WritePattern");
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_CopyRange
+ *  Description:  Copies datalen bytes from srcoffset in one open file to dstoffset
+ *                in another through a fixed size buffer. If both are the same
+ *                handle and the destination starts inside the source, the copy
+ *                runs back to front like memmove() so nothing is read after it
+ *                has been overwritten. Goes through File_ReadBytes/WriteBytes, so
+ *                dry runs see their own earlier writes.
+ * =====================================================================================
+ */
+BOOL File_CopyRange(
+	int srchandle,
+	int srcoffset,
+	int dsthandle,
+	int dstoffset,
+	int datalen
+){
+	unsigned char buffer[64 * 1024];
+	BOOL backwards;
+	int done = 0;
+	TRACE_BEGIN("File_CopyRange", NULL);
+	
+	CURRERROR = errNOERR;
+	backwards = srchandle == dsthandle &&
+		dstoffset > srcoffset && dstoffset < srcoffset + datalen;
+	
+	while(done < datalen){
+		int count = MIN(datalen - done, (int)sizeof(buffer));
+		int pos = backwards ? datalen - done - count : done;
+		
+		if(File_ReadBytes(srchandle, srcoffset + pos, buffer, count) != count){
+			CURRERROR = errCRIT_FILESYS;
+			TRACE_END("File_CopyRange");
+			return FALSE;
+		}
+		File_WriteBytes(dsthandle, dstoffset + pos, buffer, count);
+		done += count;
 	}
+	TRACE_END("File_CopyRange");
+	return TRUE;
 }
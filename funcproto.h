@@ -62,6 +62,7 @@ struct ModSpace {
 	//No SrcFileID (source file is usually in mod installer)
 	int SrcStart;
 	int SrcEnd;
+	char *SrcPath; //Copy/Move source. Streamed at write time; Bytes stays NULL.
 	
 	unsigned char *Bytes;
 	int Len;
@@ -91,6 +92,52 @@ struct VarValue {
     BOOL norepatch; // True to skip repatching step
 };
 
+// One expression for Eq_ParseBatch
+struct EqBatchItem {
+	const char *Eq;
+	const char *ModPath;
+	BOOL IsFileOffset;
+	
+	// Set by Eq_ParseBatch. The result as each type Eq_Parse_* gives.
+	int Int;
+	unsigned int uInt;
+	double Double;
+	enum errCode Error;
+};
+
+// A variable reference that's looked up once and kept until the variable
+// table changes. See Var_Resolve.
+struct VarHandle {
+	const char *UUID;
+	unsigned long Gen;
+	const struct VarValue *Var;
+};
+
+// Record header in the undo journal. Followed by Length bytes.
+struct JournalHeader {
+	uint32_t Magic;
+	int32_t File;
+	int32_t Offset;
+	int32_t Length;
+	char PatchID[64];
+};
+
+// Writes planned for one file, flushed by File_WriteBack
+struct WriteBackWrite {
+	int Offset;
+	int Len;
+	unsigned char *Bytes;
+	long Seq;                  //From Intent_Write
+};
+
+struct WriteBackFile {
+	int Handle;
+	char *Name;
+	struct WriteBackWrite *Writes;
+	size_t WriteCount;
+	enum errCode Error;        //Set by File_WriteBack
+};
+
 struct ProgConfig {
 	char *CURRDIR;   	//Current root directory of game
 	char *PROGDIR;   	//Directory program started in
@@ -100,6 +147,7 @@ struct ProgConfig {
 	unsigned long CHECKSUM;		//Checksum of loaded main file,
 	char *GAMEVER;		//ID for game version selected
 	char *GAMEUUID;         //UUID for the game selected
+	char *TRACEPATH;        //Where to write a timing trace, if anywhere
 };
 
 extern enum errCode CURRERROR;
@@ -118,6 +166,7 @@ extern const char PROGAUTHOR[];
 extern const char PROGSITE[];
 
 extern sqlite3 *CURRDB;                   //Current database holding patches
+extern BOOL TRACE_ON;                     //Timing trace is being recorded
 
 #endif
 
@@ -136,6 +185,7 @@ int GetUsedSpaceBytes(const char *ModUUID, int File);
 const char * SQL_ColName(sqlite3_stmt * stmt, int col);
 const char * SQL_ColText(sqlite3_stmt * stmt, int col);
 int SQL_GetNum(sqlite3_stmt *stmt);
+int64_t SQL_GetNum64(sqlite3_stmt *stmt);
 json_t * SQL_GetJSON(sqlite3_stmt *stmt);
 char * SQL_GetStr(sqlite3_stmt *stmt);
 unsigned char * SQL_GetBlob(sqlite3_stmt *stmt, int *noBytes);
@@ -148,6 +198,7 @@ BOOL SQL_Populate(json_t *GameCfg);
 json_t * JSON_Load(const char *fpath);
 unsigned long JSON_GetuInt(json_t *root, const char *name);
 signed long JSON_GetInt(json_t *root, const char *name);
+int64_t JSON_GetInt64(json_t *root, const char *name);
 double JSON_GetDouble(json_t *root, const char *name);
 char * JSON_GetStr(json_t *root, const char *name);
 int JSON_GetStrLen(json_t *root, const char *name);
@@ -156,6 +207,9 @@ json_t * JSON_FindArrElemByKeyValue(json_t *root, const char *key, json_t *value
 // Generic I/O helper functions
 BOOL File_Exists(const char *file, BOOL InFolder, BOOL ReadOnly);
 int File_WhitelistIndex(const char *FileName, json_t *whitelist);
+uint32_t File_CRC32(const char *FilePath);
+long File_Length(const char *FilePath);
+void File_InfoForget(int handle);
 int File_OpenSafe(const char *filename, int flags);
 void File_WriteBytes(
 	int filehandle, 
@@ -170,6 +224,13 @@ void File_WritePattern(
 	int datalen,
 	int blocklen
 );
+BOOL File_CopyRange(
+	int srchandle,
+	int srcoffset,
+	int dsthandle,
+	int dstoffset,
+	int datalen
+);
 unsigned char * Hex2Bytes(const char *hexstring, int *len);
 char * Bytes2Hex(unsigned const char *bytes, int len);
 
@@ -178,10 +239,87 @@ void File_Delete(const char *Path);
 BOOL File_MovTree(char *srcPath, char *dstPath);
 BOOL File_DelTree(char *DirPath);
 BOOL File_Create(char *FilePath, int FileLen);
+BOOL File_Sync(int handle);
+int File_ReadBytes(
+	int filehandle,
+	int offset,
+	unsigned char *data,
+	int datalen
+);
+
+// Parallel write-back functions
+BOOL File_WriteBack(struct WriteBackFile *files, size_t count);
+
+// Dry-run overlay functions
+BOOL File_OverlayBegin(void);
+BOOL File_OverlayBeginPlan(void);
+BOOL File_OverlayActive(void);
+void File_OverlayEnd(void);
+json_t * File_OverlayReport(void);
+struct WriteBackFile * File_OverlayPlan(size_t *count);
 #ifndef filesize
 long filesize(const char *filename);
 #endif
 
+// Undo journal functions
+int64_t Journal_Append(
+	const char *PatchID, int FileID, int Offset,
+	const unsigned char *data, int datalen
+);
+unsigned char * Journal_Read(int64_t pos, const char *Hash, struct JournalHeader *header);
+char * Journal_Store(
+	const char *PatchID, int FileID, int Offset,
+	const unsigned char *data, int datalen
+);
+char * Journal_StoreFile(
+	const char *PatchID, int FileID, int Offset,
+	int handle, int datalen
+);
+BOOL Journal_WriteOut(int64_t pos, const char *Hash, int handle, int offset);
+char * Journal_Hash(const unsigned char *data, int datalen);
+char * Journal_HashRange(int handle, int offset, int datalen);
+BOOL Journal_Release(const char *Hash);
+BOOL Journal_ReleaseMod(const char *ModUUID);
+int64_t Journal_Size(void);
+BOOL Journal_Truncate(int64_t size);
+BOOL Journal_Compact(BOOL Force);
+void Journal_Close(void);
+
+// Timing trace functions
+BOOL Trace_Init(void);
+BOOL Trace_Open(const char *path);
+void Trace_Close(void);
+void Trace_Event(char phase, const char *name, const char *detail);
+
+// Scoped timing spans. Just one branch each when tracing is off.
+#define TRACE_BEGIN(name, detail) \
+	do{ if(TRACE_ON){Trace_Event('B', name, detail);} }while(0)
+#define TRACE_END(name) \
+	do{ if(TRACE_ON){Trace_Event('E', name, NULL);} }while(0)
+
+// Intent log functions
+BOOL Intent_Begin(const char *Op, const char *ModUUID);
+long Intent_Write(int handle, const char *FilePath, int offset, int len);
+long Intent_WriteBatch(int handle, const char *FilePath, int offset, int len);
+BOOL Intent_Flush(void);
+void Intent_Swap(const char *BakPath, const char *FilePath);
+void Intent_Done(long Seq);
+BOOL Intent_End(void);
+void Intent_Close(void);
+BOOL Intent_Recover(void);
+
+// Dependency graph functions
+void Dep_Invalidate(void);
+BOOL Dep_Build(void);
+BOOL Dep_IsSatisfied(const char *UUID, int MinVersion);
+BOOL Dep_HasDependents(const char *UUID);
+char * Dep_GetDependents(const char *UUID);
+char * Dep_InstallOrder(void);
+BOOL Dep_AddMod(const char *UUID, int Version);
+BOOL Dep_AddEdge(const char *ParentUUID, const char *ChildUUID);
+void Dep_RemoveEdges(const char *ParentUUID);
+void Dep_RemoveMod(const char *UUID);
+
 // Mod loading functions
 BOOL Mod_CheckCompat(json_t *root);
 BOOL Mod_CheckConflict(json_t *root);
@@ -247,6 +385,20 @@ BOOL Mod_CreateRevertEntry(const struct ModSpace *input);
 BOOL ModOp_Clear(struct ModSpace *input, const char *ModUUID);
 BOOL ModOp_Add(struct ModSpace *input, const char *ModUUID);
 BOOL ModOp_Reserve(struct ModSpace *input, const char *ModUUID);
+BOOL ModOp_Move(struct ModSpace *input, const char *ModUUID);
+BOOL ModOp_Reloc(
+	struct ModSpace *input,
+	json_t *patchCurr,
+	const char *ModPath,
+	const char *ModUUID,
+	size_t PatchCount
+);
+BOOL ModOp_File(
+	json_t *patchCurr,
+	const char *ModPath,
+	const char *ModUUID,
+	size_t PatchCount
+);
 
 BOOL Mod_InstallPatch(
 	json_t *patchCurr,
@@ -257,6 +409,13 @@ BOOL Mod_InstallPatch(
 BOOL Mod_InstallSeries(const char *ModList);
 BOOL Mod_Install(json_t *root, const char *path);
 BOOL Mod_AddToDB(json_t *root, const char *path);
+json_t * Mod_InstallDryRun(json_t *root, const char *path);
+json_t * Mod_InstallSeriesDryRun(const char *ModList);
+json_t * Mod_PreflightSeries(const char *ModList);
+void Mod_PreflightAlert(json_t *report);
+char * Mod_StackFingerprint(void);
+BOOL Mod_ExportStack(const char *OutPath);
+int Mod_ApplyStack(const char *DiffPath);
 
 BOOL Mod_ClaimSpace(const char *PatchUUID, const char *ModUUID);
 BOOL Mod_UnClaimSpace(const char *PatchUUID);
@@ -270,6 +429,7 @@ BOOL Mod_Uninstall_Remove(const char *PatchUUID);
 //BOOL Mod_Uninstall_Restore(const char *PatchUUID);
 BOOL ModOp_UnMerge(json_t *row);
 BOOL ModOp_UnSplit(json_t *row);
+BOOL ModOp_UnDelete(json_t *row);
 BOOL ModOp_UnSpace(json_t *row, BOOL Revert);
 
 BOOL Mod_Install_VarRepatchFromExpr(
@@ -277,6 +437,12 @@ BOOL Mod_Install_VarRepatchFromExpr(
 	const char *ModPath,
 	size_t PatchNo
 );
+BOOL Mod_Install_VarRepatchStore(
+	json_t *patchCurr,
+	const char *ModPath,
+	const char *ModUUID,
+	size_t PatchNo
+);
 
 int Mod_GetVerCount(const char *PatchUUID);
 char * Mod_MakeBranchName(const char *PatchUUID);
@@ -315,6 +481,9 @@ struct ProgConfig * Profile_Clone();
 BOOL Profile_ChecksumAlert(
 	struct ProgConfig *LocalConfig
 );
+BOOL Profile_CacheBlacklist(json_t *GameCfg, const char *cfgpath, const char *gamever);
+BOOL Profile_IsBlacklisted(const char *UUID);
+void Profile_ClearBlacklist(void);
 
 // Variable functions
 enum VarType Var_GetType(const char *type);
@@ -327,6 +496,7 @@ struct VarValue Var_GetValue_JSON(json_t *VarObj, const char *ModUUID);
 
 BOOL Var_ClearEntry(const char *ModUUID);
 BOOL Var_UpdateEntry(struct VarValue result);
+BOOL Var_UpdateBatch(const struct VarValue *Vars, size_t Count);
 BOOL Var_MakeEntry(struct VarValue result);
 BOOL Var_MakeEntry_JSON(json_t *VarObj, const char *ModUUID);
 BOOL Var_Compare(
@@ -339,9 +509,15 @@ void Var_CreatePubList(json_t *PubList, const char *UUID);
 BOOL Var_WriteFile(struct VarValue input);
 BOOL Var_Exists(const char *ID);
 BOOL Var_RePatch(const char *VarUUID);
+BOOL Var_RePatchAll(const char **Vars, size_t Count);
+char * Var_RePatchOrder(const char *VarUUID);
 BOOL Var_UnPatch(const char *VarUUID, const char *ModPath);
 BOOL Var_UnPatchMod(const char *ModUUID);
 BOOL Var_DerefPointer(struct VarValue *var);
+const struct VarValue * Var_Lookup(const char *VarUUID);
+const struct VarValue * Var_Resolve(struct VarHandle *handle);
+void Var_Invalidate(void);
+void Var_SpacesChanged(void);
 
 int Var_GetInt(const struct VarValue *var);
 double Var_GetDouble(const struct VarValue *var);
@@ -350,6 +526,7 @@ void Var_Destructor(struct VarValue *var);
 int Eq_Parse_Int(const char * eq, const char *ModPath, BOOL IsFileOffset);
 unsigned int Eq_Parse_uInt(const char * eq, const char *ModPath, BOOL IsFileOffset);
 double Eq_Parse_Double(const char * eq, const char *ModPath, BOOL IsFileOffset);
+BOOL Eq_ParseBatch(struct EqBatchItem *items, size_t count);
 
 #ifdef __cplusplus
 }
@@ -26,6 +26,7 @@
 #include <limits.h>                // LONG_MAX, etc.
 #include "funcproto.h"             // Prototypes for all cross-plat functions
 #include "shims/crc32/crc32.h"     // CRC32 function.
+#include "shims/hash/hash.h"       // String-keyed hash table.
 #include "shims/zip/extract.h"     // Funct. to extract a ZIP
 #include SRMODLDR_INTERFACE_PATH
 
@@ -0,0 +1,434 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+#include "shims/hash/hash.h"
+
+// Intent log for the install or uninstall currently running. Lives next to
+// mods.db as mods.intent and only exists while an operation is under way:
+//     B <Install|Uninstall> <ModUUID>
+//     W <Seq> <Offset> <Len> <PreHash> <FilePath>    (before a write)
+//     D <Seq>                                        (after it)
+//     F <BakLen> <BakPath> <FilePath>                (before a file swap)
+// Finishing the operation deletes the file. If it's still there at startup
+// the program died part way through, and Intent_Recover puts things right:
+// an install is rolled back and an uninstall is finished. Either way only
+// the one interrupted mod is touched.
+//
+// Begin, write and swap records are synced to disk before the change they
+// describe, so they survive a power cut as well as the process being killed.
+// A batch of writes can be logged with Intent_WriteBatch and synced once with
+// Intent_Flush before the first of them happens.
+// Done records are only flushed; recovery doesn't depend on them.
+// BakLen is the length of BakPath, so paths with spaces still parse. It's 0
+// (and BakPath "-") when the swap creates a file that wasn't there before.
+
+static FILE *INTENT = NULL;
+static int INTENT_DEPTH = 0;    //Nested operations belong to the outermost
+static long INTENT_SEQ = 0;
+
+static char * Intent_GetPath(void)
+{
+	char *path = NULL;
+	asprintf(&path, "%s/mods.intent", CONFIG.CURRDIR);
+	if(path == NULL){
+		CURRERROR = errCRIT_MALLOC;
+	}
+	return path;
+}
+
+static BOOL Intent_Sync(void)
+{
+	if(fflush(INTENT) != 0){return FALSE;}
+	#ifdef HAVE_WINDOWS_H
+	return _commit(_fileno(INTENT)) == 0;
+	#else
+	return fsync(fileno(INTENT)) == 0;
+	#endif
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_Begin
+ *  Description:  Starts logging an operation (Op is "Install" or "Uninstall") on
+ *                ModUUID. Calls nest; only the outermost one is logged. Nothing is
+ *                logged during a dry run, since nothing is written.
+ * =====================================================================================
+ */
+BOOL Intent_Begin(const char *Op, const char *ModUUID)
+{
+	char *path;
+
+	if(INTENT_DEPTH++ > 0 || File_OverlayActive()){return TRUE;}
+
+	path = Intent_GetPath();
+	if(path == NULL){return FALSE;}
+	INTENT = fopen(path, "w");
+	safe_free(path);
+	if(INTENT == NULL){
+		ErrNo2ErrCode();
+		INTENT_DEPTH--;
+		return FALSE;
+	}
+
+	INTENT_SEQ = 0;
+	fprintf(INTENT, "B %s %s\n", Op, ModUUID);
+	Intent_Sync();
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_Write
+ *  Description:  Logs that len bytes of FilePath (open as handle) at offset are
+ *                about to be written, along with a hash of what's there now.
+ *                Returns the number to pass to Intent_Done, 0 if nothing is being
+ *                logged, or -1 on error.
+ * =====================================================================================
+ */
+long Intent_Write(int handle, const char *FilePath, int offset, int len)
+{
+	long Seq = Intent_WriteBatch(handle, FilePath, offset, len);
+	if(Seq > 0){Intent_Sync();}
+	return Seq;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_WriteBatch
+ *  Description:  Same as Intent_Write, but leaves the record unsynced. Call
+ *                Intent_Flush after the last of a batch and before any of the
+ *                writes it describes.
+ * =====================================================================================
+ */
+long Intent_WriteBatch(int handle, const char *FilePath, int offset, int len)
+{
+	char *Hash;
+
+	//Planned writes are logged when they're flushed
+	if(INTENT == NULL || File_OverlayActive()){return 0;}
+
+	Hash = Journal_HashRange(handle, offset, len);
+	if(Hash == NULL){return -1;}
+
+	INTENT_SEQ++;
+	fprintf(INTENT, "W %ld %d %d %s %s\n", INTENT_SEQ, offset, len, Hash, FilePath);
+	safe_free(Hash);
+	return INTENT_SEQ;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_Flush
+ *  Description:  Syncs everything logged so far to disk.
+ * =====================================================================================
+ */
+BOOL Intent_Flush(void)
+{
+	if(INTENT == NULL || File_OverlayActive()){return TRUE;}
+	if(!Intent_Sync()){
+		CURRERROR = errCRIT_FILESYS;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_Swap
+ *  Description:  Logs that FilePath is about to be replaced wholesale, with the
+ *                original moved to BakPath. BakPath is NULL if FilePath doesn't
+ *                exist yet. Must come before the original is touched.
+ * =====================================================================================
+ */
+void Intent_Swap(const char *BakPath, const char *FilePath)
+{
+	if(INTENT == NULL){return;}
+	if(BakPath == NULL){
+		fprintf(INTENT, "F 0 - %s\n", FilePath);
+	} else {
+		fprintf(INTENT, "F %lu %s %s\n", (unsigned long)strlen(BakPath), BakPath, FilePath);
+	}
+	Intent_Sync();
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_Done
+ *  Description:  Marks a write logged by Intent_Write as applied.
+ * =====================================================================================
+ */
+void Intent_Done(long Seq)
+{
+	if(INTENT == NULL || Seq <= 0){return;}
+	fprintf(INTENT, "D %ld\n", Seq);
+	fflush(INTENT);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_End
+ *  Description:  Finishes the operation started by the matching Intent_Begin. The
+ *                outermost one deletes the log.
+ * =====================================================================================
+ */
+BOOL Intent_End(void)
+{
+	char *path;
+
+	if(INTENT_DEPTH == 0 || --INTENT_DEPTH > 0 || INTENT == NULL){return TRUE;}
+
+	fclose(INTENT);
+	INTENT = NULL;
+
+	path = Intent_GetPath();
+	if(path == NULL){return FALSE;}
+	remove(path);
+	safe_free(path);
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_Close
+ *  Description:  Lets go of the log without finishing it, as if the program had
+ *                stopped here. Whatever was under way is recovered next start.
+ * =====================================================================================
+ */
+void Intent_Close(void)
+{
+	if(INTENT != NULL){
+		fclose(INTENT);
+		INTENT = NULL;
+	}
+	INTENT_DEPTH = 0;
+}
+
+// One logged write, as read back by Intent_Recover
+struct IntentWrite {
+	int Offset;
+	int Len;
+	char Hash[64];
+	char *FilePath;
+};
+
+// One logged file swap
+struct IntentSwap {
+	char *BakPath;             //NULL if the file was new
+	char *FilePath;
+};
+
+// Reads "<BakLen> <BakPath> <FilePath>" from the end of an F record
+static BOOL Intent_ParseSwap(const char *rec, struct IntentSwap *out)
+{
+	unsigned long BakLen;
+	int pos = 0;
+
+	if(sscanf(rec, "%lu %n", &BakLen, &pos) != 1 || pos == 0){return FALSE;}
+	rec += pos;
+	if(BakLen == 0){
+		if(rec[0] != '-' || rec[1] != ' '){return FALSE;}
+		out->BakPath = NULL;
+		rec += 2;
+	} else {
+		if(strlen(rec) <= BakLen || rec[BakLen] != ' '){return FALSE;}
+		out->BakPath = malloc(BakLen + 1);
+		if(out->BakPath == NULL){return FALSE;}
+		memcpy(out->BakPath, rec, BakLen);
+		out->BakPath[BakLen] = '\0';
+		rec += BakLen + 1;
+	}
+	out->FilePath = strdup(rec);
+	return TRUE;
+}
+
+// Puts back files an interrupted install swapped out before it got as far
+// as recording the swap in Spaces. Anything the uninstall already restored
+// has no backup left, so this only acts on the rest. Returns how many
+// couldn't be put back.
+static int Intent_UndoSwaps(struct IntentSwap *swaps, size_t count)
+{
+	int bad = 0;
+	size_t i = count;
+
+	//Newest first, in case one file was swapped twice
+	while(i-- > 0){
+		if(swaps[i].BakPath == NULL){
+			//File didn't exist before the install
+			if(File_Exists(swaps[i].FilePath, FALSE, FALSE)){
+				File_Delete(swaps[i].FilePath);
+			}
+		} else if(File_Exists(swaps[i].BakPath, FALSE, FALSE)){
+			if(File_Exists(swaps[i].FilePath, FALSE, FALSE)){
+				File_Delete(swaps[i].FilePath);
+			}
+			if(rename(swaps[i].BakPath, swaps[i].FilePath) != 0){bad++;}
+		}
+		CURRERROR = errNOERR; //File_Exists complains about missing files
+	}
+	return bad;
+}
+
+// After a rollback, every range the install wrote should hash the same as
+// before the first write to it. Returns how many don't.
+static int Intent_Verify(struct IntentWrite *writes, size_t count)
+{
+	struct HashTable *seen = HashTable_Create(count);
+	int bad = 0;
+	size_t i;
+
+	for(i = 0; i < count; i++){
+		char *Key = NULL;
+		char *Hash;
+		int handle;
+
+		//Only the first write saw the original bytes
+		asprintf(&Key, "%d:%d:%s", writes[i].Offset, writes[i].Len, writes[i].FilePath);
+		if(Key == NULL || HashTable_Has(seen, Key)){
+			safe_free(Key);
+			continue;
+		}
+		HashTable_Set(seen, Key, NULL, NULL);
+		safe_free(Key);
+
+		handle = File_OpenSafe(writes[i].FilePath, _O_BINARY | _O_RDONLY);
+		if(handle == -1){
+			CURRERROR = errNOERR;
+			bad++;
+			continue;
+		}
+		Hash = Journal_HashRange(handle, writes[i].Offset, writes[i].Len);
+		close(handle);
+		if(Hash == NULL || strneq(Hash, writes[i].Hash)){
+			bad++;
+		}
+		safe_free(Hash);
+	}
+
+	HashTable_Destroy(seen, NULL);
+	return bad;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Intent_Recover
+ *  Description:  Run at startup once the database is open. If the last install or
+ *                uninstall never finished, rolls the install back (or finishes the
+ *                uninstall) using the mod's own Revert rows, then checks every
+ *                range the install logged is back to its old contents.
+ *                Does nothing if there's no log.
+ * =====================================================================================
+ */
+BOOL Intent_Recover(void)
+{
+	FILE *log;
+	char *path;
+	char line[1024];
+	char Op[16] = "", ModUUID[512] = "";
+	struct IntentWrite *writes = NULL;
+	struct IntentSwap *swaps = NULL;
+	size_t count = 0, alloc = 0, swapCount = 0, swapAlloc = 0, i;
+	BOOL retval = TRUE;
+	int bad = 0;
+
+	CURRERROR = errNOERR;
+	path = Intent_GetPath();
+	if(path == NULL){return FALSE;}
+
+	log = fopen(path, "r");
+	if(log == NULL){
+		//Nothing was interrupted
+		safe_free(path);
+		return TRUE;
+	}
+
+	while(fgets(line, sizeof(line), log) != NULL){
+		struct IntentWrite curr;
+		long Seq;
+		int pathStart = 0;
+
+		line[strcspn(line, "\r\n")] = '\0';
+		if(line[0] == 'B'){
+			sscanf(line, "B %15s %511s", Op, ModUUID);
+		} else if(line[0] == 'F' && line[1] == ' '){
+			struct IntentSwap swap;
+			if(swapCount == swapAlloc){
+				struct IntentSwap *grown;
+				swapAlloc = swapAlloc ? swapAlloc * 2 : 4;
+				grown = realloc(swaps, swapAlloc * sizeof(struct IntentSwap));
+				if(grown == NULL){
+					CURRERROR = errCRIT_MALLOC;
+					retval = FALSE;
+					break;
+				}
+				swaps = grown;
+			}
+			if(Intent_ParseSwap(line + 2, &swap)){
+				swaps[swapCount++] = swap;
+			}
+		} else if(
+			line[0] == 'W' &&
+			sscanf(line, "W %ld %d %d %63s %n", &Seq, &curr.Offset, &curr.Len,
+				curr.Hash, &pathStart) == 4 && pathStart > 0
+		){
+			if(count == alloc){
+				struct IntentWrite *grown;
+				alloc = alloc ? alloc * 2 : 16;
+				grown = realloc(writes, alloc * sizeof(struct IntentWrite));
+				if(grown == NULL){
+					CURRERROR = errCRIT_MALLOC;
+					retval = FALSE;
+					break;
+				}
+				writes = grown;
+			}
+			curr.FilePath = strdup(line + pathStart);
+			writes[count++] = curr;
+		}
+		//D records are informational; recovery redoes or undoes the lot
+	}
+	fclose(log);
+
+	//Start clean. Mod_Uninstall logs itself, so if we die again during
+	//recovery the next start finishes that uninstall.
+	remove(path);
+	safe_free(path);
+
+	if(retval && ModUUID[0] != '\0'){
+		char *msg = NULL;
+		BOOL Install = (strcmp(Op, "Install") == 0);
+
+		if(!Mod_Uninstall(ModUUID)){
+			retval = FALSE;
+		} else if(Install){
+			bad = Intent_UndoSwaps(swaps, swapCount) +
+				Intent_Verify(writes, count);
+		}
+
+		if(Install){
+			asprintf(&msg, "The last install of %s didn't finish. It has been "
+				"rolled back.%s", ModUUID, bad ?
+				"\n\nSome of the files it was changing couldn't be restored "
+				"and may need to be reinstalled." : "");
+		} else {
+			asprintf(&msg, "The last uninstall of %s didn't finish. It has "
+				"now been completed.", ModUUID);
+		}
+		AlertMsg(msg, "Recovered Interrupted Operation");
+		safe_free(msg);
+	}
+
+	for(i = 0; i < count; i++){
+		safe_free(writes[i].FilePath);
+	}
+	safe_free(writes);
+	for(i = 0; i < swapCount; i++){
+		safe_free(swaps[i].BakPath);
+		safe_free(swaps[i].FilePath);
+	}
+	safe_free(swaps);
+	return retval;
+}
@@ -93,6 +93,10 @@ int Interface_Init(int argc, char *argv[])
         safe_free(FilePath);
     }*/
     
+    // Also drop any leftovers from a previous run's database and intent log
+    remove("mods.db-wal");
+    remove("mods.db-shm");
+    remove("mods.intent");
     File_Delete("mods.db");
     
     ErrNo2ErrCode();
@@ -186,3 +190,16 @@ int Interface_RunProgram()
 {
 	return 0;
 }
+
+/*
+* ===  FUNCTION  ======================================================================
+*         Name:  Interface_SaveVars
+*  Description:  Saves the edits made in a mod's variable dialog. Takes the values
+*                the dialog would have read from its controls.
+*                [Thunk to Var_UpdateBatch]
+* =====================================================================================
+*/
+BOOL Interface_SaveVars(const struct VarValue *Vars, size_t Count)
+{
+	return Var_UpdateBatch(Vars, Count);
+}
@@ -4,6 +4,13 @@
 
 HBITMAP prevBitmap = NULL; //Preview bitmap.
 
+// Values read from the variable dialog, saved together on OK
+struct Dlg_VarBatch {
+	struct VarValue *Vars;
+	size_t Count;
+	size_t Cap;
+};
+
 /* 
  * ===  CALLBACK FUNCTION  =============================================================
  *         Name:  Dlg_Var_Resize
@@ -86,13 +93,15 @@ BOOL CALLBACK Dlg_Var_Resize(HWND hCtl, LPARAM width)
 /* 
  * ===  CALLBACK FUNCTION  =============================================================
  *         Name:  Dlg_Var_Save
- *  Description:  Saves the contents of the variable dialog to the SQL DB upon exit
+ *  Description:  Reads the value of one control of the variable dialog into the
+ *                Dlg_VarBatch pointed to by lParam, to be saved upon exit
  *       Caller:  EnumChildWindows()
  * =====================================================================================
  */
 BOOL CALLBACK Dlg_Var_Save(HWND hCtl, LPARAM lParam)
 {
 	// For each control:
+	struct Dlg_VarBatch *batch = (struct Dlg_VarBatch *)lParam;
 	char *VarUUID = NULL;
 	char *CtlType = NULL;
 	struct VarValue newVar, oldVar;
@@ -145,18 +154,20 @@ BOOL CALLBACK Dlg_Var_Save(HWND hCtl, LPARAM lParam)
 		newVar.uInt32 = SendMessage(hCtl, CB_GETITEMDATA, index, 0);
 	}
 	
-	// Restore the variable in the SQL
-	Var_UpdateEntry(newVar);
-
-	// Write new value to file
-	//Var_WriteFile(newVar); // Sets CURRERROR to errUSR_CONFIRM if reinstall required
-
-	// Reinstall needed patches
-	Var_RePatch(newVar.UUID);
-	
-	// Free junk we've made
-	Var_Destructor(&newVar);
+	// Queue the variable up. The batch owns it now.
 	//OldVar is a memcopy of NewVar, so we don't need to free anything from that.
+	if(batch->Count == batch->Cap){
+		struct VarValue *VarsNew;
+		batch->Cap = batch->Cap ? batch->Cap * 2 : 16;
+		VarsNew = realloc(batch->Vars, batch->Cap * sizeof(struct VarValue));
+		if(!VarsNew){
+			CURRERROR = errCRIT_MALLOC;
+			Var_Destructor(&newVar);
+			return FALSE;
+		}
+		batch->Vars = VarsNew;
+	}
+	batch->Vars[batch->Count++] = newVar;
 	
 	return TRUE;
 }
@@ -415,8 +426,20 @@ LRESULT CALLBACK Dlg_Var(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		switch(lParam){
 		case IDOK:{
 			// This is forecd to come from BigWin
+			struct Dlg_VarBatch batch = {0};
+			size_t i;
+			
 			CURRERROR = errNOERR;
-			EnumChildWindows(hwnd, Dlg_Var_Save, 0);
+			EnumChildWindows(hwnd, Dlg_Var_Save, (LPARAM)&batch);
+			
+			// Save them all at once; patches using several are reinstalled once
+			if(CURRERROR == errNOERR){
+				Interface_SaveVars(batch.Vars, batch.Count);
+			}
+			for(i = 0; i < batch.Count; i++){
+				Var_Destructor(&batch.Vars[i]);
+			}
+			safe_free(batch.Vars);
 
 			// Check for failure
 			if (CURRERROR == errUSR_CONFIRM) {
@@ -1995,6 +2018,8 @@ INT_PTR CALLBACK Dlg_Main(HWND hwnd, UINT Message, WPARAM wParam, LPARAM lParam)
 			
 			SQL_Populate(GameCfg);
 			SendMessage(hwnd, WMX_ERROR, 0, 0);
+			Intent_Recover();
+			SendMessage(hwnd, WMX_ERROR, 0, 0);
 			json_decref(GameCfg);
 			
 			//Update main dialog
@@ -165,4 +165,17 @@ int Interface_RunProgram()
 	CloseHandle(ProgInfo.hProcess);
 	CloseHandle(ProgInfo.hThread);
 	return 0;
-}
\ No newline at end of file
+}
+
+/*
+* ===  FUNCTION  ======================================================================
+*         Name:  Interface_SaveVars
+*  Description:  Saves the edits made in a mod's variable dialog. All of them
+*                go in at once, so a patch that uses several of them is only
+*                reinstalled once.
+* =====================================================================================
+*/
+BOOL Interface_SaveVars(const struct VarValue *Vars, size_t Count)
+{
+	return Var_UpdateBatch(Vars, Count);
+}
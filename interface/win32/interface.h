@@ -30,6 +30,7 @@ int Interface_Init(int argc, char *argv[]);			// Set classes/outputs/etc. for in
 int Interface_EditConfig(void);	// Bring up profile editor
 int Interface_MainLoop(void);   	// Bring up main dialog with mods
 int Interface_RunProgram(void);	// Run program in profile
+BOOL Interface_SaveVars(const struct VarValue *Vars, size_t Count); // Save variable dialog edits
 // ViewModInfo();       // View mod name/desc (do we need?)
 // EditModVars();   	// Bring up variable dialog for mod
 // ViewCopyInfo();  	// Bring up About dialog (or equiv)
@@ -0,0 +1,925 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+
+// Undo journal. Every range a patch overwrites is appended here as a
+// JournalHeader followed by the original bytes. Records are content
+// addressed: RevertBlobs maps a hash of the bytes to the record offset
+// and a reference count, and Revert rows only keep the hash. Identical
+// payloads (NOP runs, zero padding) are stored once. Lives next to mods.db.
+
+#define JOURNAL_MAGIC 0x4A4C4D53 //"SMLJ"
+#define JOURNAL_CHUNK (32 * 1024)  //Payloads are streamed through this much memory
+
+static int JOURNAL = -1;
+
+// Running state of Journal_Hash, so payloads can be hashed a chunk at a time
+struct JournalHash {
+	int Length;
+	unsigned long CRC;
+	uint64_t FNV;
+};
+
+static char * Journal_GetPath(void)
+{
+	char *path = NULL;
+	asprintf(&path, "%s/undo.journal", CONFIG.CURRDIR);
+	if(path == NULL){
+		CURRERROR = errCRIT_MALLOC;
+	}
+	return path;
+}
+
+// Content hash of a payload: length, CRC32 and 64-bit FNV-1a, as hex.
+// Collisions are still checked for byte-by-byte in Journal_Store.
+static void Journal_HashInit(struct JournalHash *state)
+{
+	state->Length = 0;
+	state->CRC = 0;
+	state->FNV = 14695981039346656037ULL;
+}
+
+static void Journal_HashUpdate(
+	struct JournalHash *state, const unsigned char *data, int datalen
+){
+	int i;
+	for(i = 0; i < datalen; i++){
+		state->FNV ^= data[i];
+		state->FNV *= 1099511628211ULL;
+	}
+	if(datalen > 0){
+		state->CRC = crc32(state->CRC, data, datalen);
+	}
+	state->Length += datalen;
+}
+
+static char * Journal_HashFinal(const struct JournalHash *state)
+{
+	char *Hash = NULL;
+	asprintf(&Hash, "%x-%08lx%08lx%08lx", state->Length, state->CRC,
+		(unsigned long)(state->FNV >> 32), (unsigned long)(state->FNV & 0xFFFFFFFF)
+	);
+	if(Hash == NULL){
+		CURRERROR = errCRIT_MALLOC;
+	}
+	return Hash;
+}
+
+char * Journal_Hash(const unsigned char *data, int datalen)
+{
+	struct JournalHash state;
+	Journal_HashInit(&state);
+	Journal_HashUpdate(&state, data, datalen);
+	return Journal_HashFinal(&state);
+}
+
+// Generation of the journal file the database points into. Every
+// compaction bumps it in the same transaction as the new offsets.
+static long Journal_GetGeneration(void)
+{
+	sqlite3_stmt *command;
+	long gen;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_prepare_v2(CURRDB,
+		"SELECT Generation FROM JournalInfo;", -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return -1;
+	}
+	gen = SQL_GetNum(command);
+	sqlite3_finalize(command);
+	if(CURRERROR != errNOERR){return -1;}
+	return MAX(gen, 0);
+}
+
+// Where Journal_Compact builds generation gen before it replaces the journal
+static char * Journal_GetTempPath(const char *path, long gen)
+{
+	char *tmppath = NULL;
+	asprintf(&tmppath, "%s.%ld.tmp", path, gen);
+	if(tmppath == NULL){
+		CURRERROR = errCRIT_MALLOC;
+	}
+	return tmppath;
+}
+
+// Put a compacted journal in place of the old one in a single step
+static BOOL Journal_Replace(const char *tmppath, const char *path)
+{
+	#ifdef HAVE_WINDOWS_H
+	if(!MoveFileExA(tmppath, path, MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH)){
+	#else
+	if(rename(tmppath, path) != 0){
+	#endif
+		CURRERROR = errCRIT_FILESYS;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Finish or undo a compaction that was cut short. If the new offsets were
+// committed the database already points into the new file, so it has to
+// replace the old one; if they weren't, the new file is just thrown away.
+static BOOL Journal_Recover(const char *path)
+{
+	char *done = NULL, *stale = NULL;
+	long gen;
+	BOOL retval = TRUE;
+
+	gen = Journal_GetGeneration();
+	if(gen == -1){return FALSE;}
+
+	done = Journal_GetTempPath(path, gen);
+	stale = Journal_GetTempPath(path, gen + 1);
+	if(done == NULL || stale == NULL){
+		retval = FALSE;
+	} else {
+		if(File_Exists(done, FALSE, FALSE)){
+			retval = Journal_Replace(done, path);
+		} else {
+			CURRERROR = errNOERR;
+		}
+		remove(stale);
+	}
+	safe_free(done);
+	safe_free(stale);
+	return retval;
+}
+
+// Open journal for the current profile if not already open
+static BOOL Journal_Open(void)
+{
+	char *path;
+	if(JOURNAL != -1){return TRUE;}
+
+	path = Journal_GetPath();
+	if(path == NULL){return FALSE;}
+	if(!Journal_Recover(path)){
+		safe_free(path);
+		return FALSE;
+	}
+
+	JOURNAL = _open(path, _O_BINARY|_O_RDWR|O_CREAT, 0644);
+	safe_free(path);
+	if(JOURNAL == -1){
+		CURRERROR = errCRIT_FILESYS;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// lseek with a 64-bit offset, so the journal can grow past 2GB on Win32
+static int64_t Journal_Seek(int handle, int64_t pos, int whence)
+{
+	#ifdef HAVE_WINDOWS_H
+	return _lseeki64(handle, pos, whence);
+	#else
+	return lseek(handle, (off_t)pos, whence);
+	#endif
+}
+
+// Read or write exactly len bytes, retrying on short transfers
+static BOOL Journal_ReadAll(int handle, int64_t pos, void *data, int len)
+{
+	unsigned char *ptr = data;
+	if(Journal_Seek(handle, pos, SEEK_SET) == -1){return FALSE;}
+	while(len > 0){
+		int count = read(handle, ptr, len);
+		if(count <= 0){return FALSE;}
+		ptr += count;
+		len -= count;
+	}
+	return TRUE;
+}
+
+static BOOL Journal_WriteAll(int handle, const void *data, int len)
+{
+	const unsigned char *ptr = data;
+	while(len > 0){
+		int count = write(handle, ptr, len);
+		if(count <= 0){return FALSE;}
+		ptr += count;
+		len -= count;
+	}
+	return TRUE;
+}
+
+// Append a record whose payload comes from data or, if data is NULL, from
+// datalen bytes of handle starting at Offset. The payload only ever passes
+// through a JOURNAL_CHUNK buffer.
+static int64_t Journal_AppendFrom(
+	const char *PatchID, int FileID, int Offset,
+	const unsigned char *data, int handle, int datalen
+){
+	struct JournalHeader header;
+	unsigned char buffer[JOURNAL_CHUNK];
+	int64_t pos;
+	int done;
+
+	if(!Journal_Open()){return -1;}
+
+	memset(&header, 0, sizeof(header));
+	header.Magic = JOURNAL_MAGIC;
+	header.File = FileID;
+	header.Offset = Offset;
+	header.Length = datalen;
+	if(PatchID != NULL){
+		//Informational only; the Revert table is the real index
+		strncpy(header.PatchID, PatchID, sizeof(header.PatchID) - 1);
+	}
+
+	pos = Journal_Seek(JOURNAL, 0, SEEK_END);
+	if(pos == -1 || !Journal_WriteAll(JOURNAL, &header, sizeof(header))){
+		CURRERROR = errCRIT_FILESYS;
+		return -1;
+	}
+
+	for(done = 0; done < datalen; done += JOURNAL_CHUNK){
+		int count = MIN(datalen - done, JOURNAL_CHUNK);
+		const unsigned char *chunk = data + done;
+
+		if(data == NULL){
+			//Past the end of the file reads as zeroes, as it always has
+			memset(buffer, 0, count);
+			File_ReadBytes(handle, Offset + done, buffer, count);
+			chunk = buffer;
+		}
+		if(!Journal_WriteAll(JOURNAL, chunk, count)){
+			CURRERROR = errCRIT_FILESYS;
+			Journal_Truncate(pos);
+			return -1;
+		}
+	}
+	return pos;
+}
+
+// Read len bytes, starting done bytes in, of a payload that comes from data
+// or, if data is NULL, from handle starting at Offset. Past the end of the
+// file reads as zeroes, as it always has.
+static void Journal_ReadSource(
+	const unsigned char *data, int handle, int Offset, int done,
+	unsigned char *buffer, int len
+){
+	if(data != NULL){
+		memcpy(buffer, data + done, len);
+		return;
+	}
+	memset(buffer, 0, len);
+	File_ReadBytes(handle, Offset + done, buffer, len);
+}
+
+// Hash a payload source exactly as Journal_AppendFrom would store it
+static char * Journal_HashSource(
+	const unsigned char *data, int handle, int Offset, int datalen
+){
+	struct JournalHash state;
+	unsigned char buffer[JOURNAL_CHUNK];
+	int done;
+
+	if(data != NULL){
+		return Journal_Hash(data, datalen);
+	}
+	Journal_HashInit(&state);
+	for(done = 0; done < datalen; done += JOURNAL_CHUNK){
+		int count = MIN(datalen - done, JOURNAL_CHUNK);
+		Journal_ReadSource(NULL, handle, Offset, done, buffer, count);
+		Journal_HashUpdate(&state, buffer, count);
+	}
+	return Journal_HashFinal(&state);
+}
+
+// Compare the payload of the record at pos with a payload source
+static BOOL Journal_SameSource(
+	int64_t pos, const unsigned char *data, int handle, int Offset, int datalen
+){
+	struct JournalHeader header;
+	unsigned char buffer1[JOURNAL_CHUNK / 2];
+	unsigned char buffer2[JOURNAL_CHUNK / 2];
+	int done;
+
+	if(!Journal_ReadAll(JOURNAL, pos, &header, sizeof(header)) ||
+		header.Magic != JOURNAL_MAGIC || header.Length != datalen
+	){
+		return FALSE;
+	}
+	pos += sizeof(header);
+	for(done = 0; done < datalen; done += sizeof(buffer1)){
+		int count = MIN(datalen - done, (int)sizeof(buffer1));
+		if(!Journal_ReadAll(JOURNAL, pos + done, buffer1, count)){
+			return FALSE;
+		}
+		Journal_ReadSource(data, handle, Offset, done, buffer2, count);
+		if(memcmp(buffer1, buffer2, count) != 0){
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+// Does a payload's hash match the key it's stored under? Keys made for a
+// hash collision have the record offset tacked on the end.
+static BOOL Journal_HashMatches(const char *Hash, const char *DataHash)
+{
+	size_t len = strlen(DataHash);
+	return strncmp(Hash, DataHash, len) == 0 &&
+		(Hash[len] == '\0' || Hash[len] == '-');
+}
+
+// Copy the record at pos onto the end of handle a chunk at a time, checking
+// the payload against Hash as it goes. Returns the new offset or -1.
+static int64_t Journal_CopyRecord(int handle, int64_t pos, const char *Hash)
+{
+	struct JournalHeader header;
+	struct JournalHash state;
+	unsigned char buffer[JOURNAL_CHUNK];
+	char *DataHash;
+	int64_t newpos;
+	int done;
+
+	if(!Journal_ReadAll(JOURNAL, pos, &header, sizeof(header)) ||
+		header.Magic != JOURNAL_MAGIC || header.Length < 0
+	){
+		CURRERROR = errCRIT_FILESYS;
+		return -1;
+	}
+	pos += sizeof(header);
+
+	newpos = Journal_Seek(handle, 0, SEEK_END);
+	if(newpos == -1 || !Journal_WriteAll(handle, &header, sizeof(header))){
+		CURRERROR = errCRIT_FILESYS;
+		return -1;
+	}
+
+	Journal_HashInit(&state);
+	for(done = 0; done < header.Length; done += JOURNAL_CHUNK){
+		int count = MIN(header.Length - done, JOURNAL_CHUNK);
+		if(!Journal_ReadAll(JOURNAL, pos + done, buffer, count) ||
+			!Journal_WriteAll(handle, buffer, count)
+		){
+			CURRERROR = errCRIT_FILESYS;
+			return -1;
+		}
+		Journal_HashUpdate(&state, buffer, count);
+	}
+
+	DataHash = Journal_HashFinal(&state);
+	if(DataHash == NULL){return -1;}
+	if(Hash != NULL && !Journal_HashMatches(Hash, DataHash)){
+		//Journal was damaged. Don't carry garbage forward.
+		CURRERROR = errCRIT_FILESYS;
+		newpos = -1;
+	}
+	safe_free(DataHash);
+	return newpos;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Close
+ *  Description:  Closes the journal. Call when the profile (and so CURRDIR) changes.
+ * =====================================================================================
+ */
+void Journal_Close(void)
+{
+	if(JOURNAL != -1){
+		close(JOURNAL);
+		JOURNAL = -1;
+	}
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Append
+ *  Description:  Appends the original bytes of a range to the journal. Returns the
+ *                offset of the new record, or -1 on error.
+ * =====================================================================================
+ */
+int64_t Journal_Append(
+	const char *PatchID, int FileID, int Offset,
+	const unsigned char *data, int datalen
+){
+	CURRERROR = errNOERR;
+
+	if(datalen < 0 || (datalen > 0 && data == NULL)){
+		CURRERROR = errCRIT_ARGMNT;
+		return -1;
+	}
+	return Journal_AppendFrom(PatchID, FileID, Offset, data, -1, datalen);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Read
+ *  Description:  Reads the record at pos. Returns a malloc'd copy of the bytes and
+ *                fills in header, or NULL on error. If Hash is given, the bytes
+ *                must hash to it or the record is treated as corrupt.
+ * =====================================================================================
+ */
+unsigned char * Journal_Read(int64_t pos, const char *Hash, struct JournalHeader *header)
+{
+	unsigned char *data;
+	CURRERROR = errNOERR;
+
+	if(!Journal_Open()){return NULL;}
+
+	if(!Journal_ReadAll(JOURNAL, pos, header, sizeof(struct JournalHeader)) ||
+		header->Magic != JOURNAL_MAGIC || header->Length < 0
+	){
+		//Journal doesn't match the database
+		CURRERROR = errCRIT_FILESYS;
+		return NULL;
+	}
+
+	data = malloc(header->Length + 1);
+	if(data == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+	if(!Journal_ReadAll(JOURNAL, pos + sizeof(struct JournalHeader), data, header->Length)){
+		CURRERROR = errCRIT_FILESYS;
+		safe_free(data);
+		return NULL;
+	}
+
+	if(Hash != NULL){
+		char *DataHash = Journal_Hash(data, header->Length);
+		if(DataHash == NULL || !Journal_HashMatches(Hash, DataHash)){
+			//Journal was damaged. Don't write garbage back into the game.
+			if(DataHash != NULL){CURRERROR = errCRIT_FILESYS;}
+			safe_free(DataHash);
+			safe_free(data);
+			return NULL;
+		}
+		safe_free(DataHash);
+	}
+	return data;
+}
+
+// Shared body of Journal_Store and Journal_StoreFile. The payload is hashed
+// first and only appended if no identical one is stored yet; otherwise the
+// stored one gains a reference and nothing is written.
+static char * Journal_StoreFrom(
+	const char *PatchID, int FileID, int Offset,
+	const unsigned char *data, int handle, int datalen
+){
+	sqlite3_stmt *command;
+	const char *query1 = "SELECT Journal FROM RevertBlobs WHERE Hash = ?;";
+	const char *query2 = "UPDATE RevertBlobs SET Refs = Refs + 1 WHERE Hash = ?;";
+	const char *query3 = "INSERT INTO RevertBlobs "
+		"('Hash', 'Journal', 'Len', 'Refs') VALUES (?, ?, ?, 1);";
+	char *Hash;
+	int64_t pos, oldpos;
+	CURRERROR = errNOERR;
+
+	if(!Journal_Open()){return NULL;}
+	Hash = Journal_HashSource(data, handle, Offset, datalen);
+	if(Hash == NULL){return NULL;}
+
+	//Already have it?
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, Hash, -1, SQLITE_STATIC)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		safe_free(Hash);
+		return NULL;
+	}
+	oldpos = SQL_GetNum64(command);
+	sqlite3_finalize(command);
+	if(CURRERROR != errNOERR){
+		safe_free(Hash);
+		return NULL;
+	}
+
+	if(oldpos != -1 && Journal_SameSource(oldpos, data, handle, Offset, datalen)){
+		if(SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_prepare_v2(CURRDB, query2, -1, &command, NULL)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_bind_text(command, 1, Hash, -1, SQLITE_STATIC)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+		) != 0){
+			CURRERROR = errCRIT_DBASE;
+			safe_free(Hash);
+			return NULL;
+		}
+		return Hash;
+	}
+
+	pos = Journal_AppendFrom(PatchID, FileID, Offset, data, handle, datalen);
+	if(pos == -1){
+		safe_free(Hash);
+		return NULL;
+	}
+
+	if(oldpos != -1){
+		//Genuine collision (or a bad record). Store under a key of its own.
+		char *UniqueHash = NULL;
+		asprintf(&UniqueHash, "%s-%lx%08lx", Hash,
+			(unsigned long)(pos >> 32), (unsigned long)(pos & 0xFFFFFFFF)
+		);
+		safe_free(Hash);
+		Hash = UniqueHash;
+		if(Hash == NULL){
+			CURRERROR = errCRIT_MALLOC;
+			Journal_Truncate(pos);
+			return NULL;
+		}
+	}
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query3, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, Hash, -1, SQLITE_STATIC) ||
+		sqlite3_bind_int64(command, 2, pos) ||
+		sqlite3_bind_int(command, 3, datalen)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		Journal_Truncate(pos);
+		safe_free(Hash);
+		return NULL;
+	}
+	return Hash;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Store
+ *  Description:  Stores a payload in the journal by content, or takes another
+ *                reference to an identical one already there. Returns the hash to
+ *                keep in the Revert table, or NULL on error.
+ * =====================================================================================
+ */
+char * Journal_Store(
+	const char *PatchID, int FileID, int Offset,
+	const unsigned char *data, int datalen
+){
+	if(datalen < 0 || (datalen > 0 && data == NULL)){
+		CURRERROR = errCRIT_ARGMNT;
+		return NULL;
+	}
+	return Journal_StoreFrom(PatchID, FileID, Offset, data, -1, datalen);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_StoreFile
+ *  Description:  Like Journal_Store, but the payload is datalen bytes of an open
+ *                file starting at Offset. Streamed, so the range can be any size.
+ * =====================================================================================
+ */
+char * Journal_StoreFile(
+	const char *PatchID, int FileID, int Offset,
+	int handle, int datalen
+){
+	if(datalen < 0 || handle == -1){
+		CURRERROR = errCRIT_ARGMNT;
+		return NULL;
+	}
+	return Journal_StoreFrom(PatchID, FileID, Offset, NULL, handle, datalen);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_HashRange
+ *  Description:  Hashes datalen bytes of an open file starting at offset, the same
+ *                way Journal_Store hashes payloads. Returns NULL on error.
+ * =====================================================================================
+ */
+char * Journal_HashRange(int handle, int offset, int datalen)
+{
+	struct JournalHash state;
+	unsigned char buffer[JOURNAL_CHUNK];
+	int done;
+
+	Journal_HashInit(&state);
+	for(done = 0; done < datalen; done += JOURNAL_CHUNK){
+		int count = MIN(datalen - done, JOURNAL_CHUNK);
+		int got = File_ReadBytes(handle, offset + done, buffer, count);
+		if(got < 0){
+			CURRERROR = errCRIT_FILESYS;
+			return NULL;
+		}
+		//Past the end of the file reads as nothing
+		Journal_HashUpdate(&state, buffer, got);
+		if(got < count){break;}
+	}
+	return Journal_HashFinal(&state);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_WriteOut
+ *  Description:  Writes the payload of the record at pos into an open file at
+ *                offset, a chunk at a time. The record is checked against Hash
+ *                in full before anything is written.
+ * =====================================================================================
+ */
+BOOL Journal_WriteOut(int64_t pos, const char *Hash, int handle, int offset)
+{
+	struct JournalHeader header;
+	struct JournalHash state;
+	unsigned char buffer[JOURNAL_CHUNK];
+	char *DataHash;
+	int done;
+	CURRERROR = errNOERR;
+
+	if(!Journal_Open()){return FALSE;}
+
+	if(!Journal_ReadAll(JOURNAL, pos, &header, sizeof(header)) ||
+		header.Magic != JOURNAL_MAGIC || header.Length < 0
+	){
+		CURRERROR = errCRIT_FILESYS;
+		return FALSE;
+	}
+	pos += sizeof(header);
+
+	//Verify pass
+	Journal_HashInit(&state);
+	for(done = 0; done < header.Length; done += JOURNAL_CHUNK){
+		int count = MIN(header.Length - done, JOURNAL_CHUNK);
+		if(!Journal_ReadAll(JOURNAL, pos + done, buffer, count)){
+			CURRERROR = errCRIT_FILESYS;
+			return FALSE;
+		}
+		Journal_HashUpdate(&state, buffer, count);
+	}
+	DataHash = Journal_HashFinal(&state);
+	if(DataHash == NULL){return FALSE;}
+	if(Hash != NULL && !Journal_HashMatches(Hash, DataHash)){
+		safe_free(DataHash);
+		CURRERROR = errCRIT_FILESYS;
+		return FALSE;
+	}
+	safe_free(DataHash);
+
+	//Write pass
+	for(done = 0; done < header.Length; done += JOURNAL_CHUNK){
+		int count = MIN(header.Length - done, JOURNAL_CHUNK);
+		if(!Journal_ReadAll(JOURNAL, pos + done, buffer, count)){
+			CURRERROR = errCRIT_FILESYS;
+			return FALSE;
+		}
+		File_WriteBytes(handle, offset + done, buffer, count);
+	}
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Release
+ *  Description:  Drops one reference to a stored payload. The journal record
+ *                itself is reclaimed by Journal_Compact.
+ * =====================================================================================
+ */
+BOOL Journal_Release(const char *Hash)
+{
+	sqlite3_stmt *command;
+	const char *query1 = "UPDATE RevertBlobs SET Refs = Refs - 1 WHERE Hash = ?;";
+	const char *query2 = "DELETE FROM RevertBlobs WHERE Hash = ? AND Refs <= 0;";
+	CURRERROR = errNOERR;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, Hash, -1, SQLITE_STATIC)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query2, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, Hash, -1, SQLITE_STATIC)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_ReleaseMod
+ *  Description:  Drops the references held by every Revert row of a mod in bulk.
+ *                Call before deleting those rows.
+ * =====================================================================================
+ */
+BOOL Journal_ReleaseMod(const char *ModUUID)
+{
+	sqlite3_stmt *command;
+	const char *query1 =
+		"UPDATE RevertBlobs SET Refs = Refs - ("
+			"SELECT COUNT(*) FROM Revert WHERE Revert.Hash = RevertBlobs.Hash "
+			"AND Revert.PatchUUID IN (SELECT PatchID FROM Spaces WHERE Mod = ?)"
+		");";
+	const char *query2 = "DELETE FROM RevertBlobs WHERE Refs <= 0;";
+	CURRERROR = errNOERR;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, ModUUID, -1, SQLITE_STATIC)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		query2, NULL, NULL, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Size
+ *  Description:  Returns the size of the journal in bytes, or -1 on error.
+ * =====================================================================================
+ */
+int64_t Journal_Size(void)
+{
+	if(!Journal_Open()){return -1;}
+	return Journal_Seek(JOURNAL, 0, SEEK_END);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Truncate
+ *  Description:  Drops everything after size. Used to throw away records from a
+ *                dry run or an ignored insert.
+ * =====================================================================================
+ */
+BOOL Journal_Truncate(int64_t size)
+{
+	if(!Journal_Open()){return FALSE;}
+
+	#ifdef HAVE_WINDOWS_H
+	if(_chsize_s(JOURNAL, size) != 0){
+	#else
+	if(ftruncate(JOURNAL, (off_t)size) != 0){
+	#endif
+		CURRERROR = errCRIT_FILESYS;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Journal_Compact
+ *  Description:  Rewrites the journal with only the records RevertBlobs still
+ *                points to, then updates those offsets. Unless Force is set this
+ *                only happens once at least half of the journal is dead space.
+ *                The new file is synced and the new offsets committed before it
+ *                replaces the old one, so a crash at any point leaves a journal
+ *                the database agrees with (see Journal_Recover).
+ *                Does nothing inside a transaction, since the swap has to follow
+ *                a real commit; the next uninstall will get to it.
+ * =====================================================================================
+ */
+BOOL Journal_Compact(BOOL Force)
+{
+	sqlite3_stmt *command;
+	json_t *out, *row;
+	size_t i;
+	int64_t size, live;
+	long gen;
+	char *path = NULL, *tmppath = NULL;
+	int tmp = -1;
+	BOOL retval = FALSE;
+	CURRERROR = errNOERR;
+
+	if(!sqlite3_get_autocommit(CURRDB)){return TRUE;}
+
+	size = Journal_Size();
+	if(size == -1){return FALSE;}
+
+	//Find everything still in use
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_prepare_v2(CURRDB,
+		"SELECT Hash, Journal, Len FROM RevertBlobs ORDER BY Journal ASC;",
+		-1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	out = SQL_GetJSON(command);
+	sqlite3_finalize(command);
+
+	live = 0;
+	json_array_foreach(out, i, row){
+		live += sizeof(struct JournalHeader) + JSON_GetInt(row, "Len");
+	}
+
+	if(size <= live || (!Force && size - live < live)){
+		json_decref(out);
+		return TRUE;
+	}
+	if(json_array_size(out) == 0){
+		json_decref(out);
+		return Journal_Truncate(0);
+	}
+
+	//Copy live records into the next generation's file
+	gen = Journal_GetGeneration();
+	if(gen == -1){goto Journal_Compact_Return;}
+	gen++;
+
+	path = Journal_GetPath();
+	if(path == NULL){goto Journal_Compact_Return;}
+	tmppath = Journal_GetTempPath(path, gen);
+	if(tmppath == NULL){goto Journal_Compact_Return;}
+
+	tmp = _open(tmppath, _O_BINARY|_O_RDWR|O_CREAT|O_TRUNC, 0644);
+	if(tmp == -1){
+		CURRERROR = errCRIT_FILESYS;
+		goto Journal_Compact_Return;
+	}
+
+	json_array_foreach(out, i, row){
+		char *Hash = JSON_GetStr(row, "Hash");
+		int64_t newpos = Journal_CopyRecord(tmp, JSON_GetInt64(row, "Journal"), Hash);
+
+		safe_free(Hash);
+		if(newpos == -1){goto Journal_Compact_Return;}
+		json_object_set_new(row, "NewJournal", json_integer(newpos));
+	}
+
+	//It has to be on disk before anything points into it
+	if(!File_Sync(tmp)){goto Journal_Compact_Return;}
+
+	//Point the database at the new offsets and generation
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"SAVEPOINT JournalCompact;", NULL, NULL, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		goto Journal_Compact_Return;
+	}
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_prepare_v2(CURRDB,
+		"UPDATE RevertBlobs SET Journal = ? WHERE Hash = ?;", -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+	} else {
+		json_array_foreach(out, i, row){
+			char *Hash = JSON_GetStr(row, "Hash");
+			if(SQL_HandleErrors(__FILE__, __LINE__,
+				sqlite3_bind_int64(command, 1, JSON_GetInt64(row, "NewJournal")) ||
+				sqlite3_bind_text(command, 2, Hash, -1, SQLITE_TRANSIENT)
+			) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+			) != 0){
+				CURRERROR = errCRIT_DBASE;
+				safe_free(Hash);
+				break;
+			}
+			safe_free(Hash);
+			sqlite3_reset(command);
+		}
+		sqlite3_finalize(command);
+	}
+	if(CURRERROR == errNOERR && (SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_exec(CURRDB, "DELETE FROM JournalInfo;", NULL, NULL, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_prepare_v2(CURRDB,
+		"INSERT INTO JournalInfo ('Generation') VALUES (?);", -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_bind_int64(command, 1, gen)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+	) != 0)){
+		CURRERROR = errCRIT_DBASE;
+	}
+	if(CURRERROR == errNOERR && SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_exec(CURRDB, "RELEASE JournalCompact;", NULL, NULL, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+	}
+	if(CURRERROR != errNOERR){
+		sqlite3_exec(CURRDB, "ROLLBACK TO JournalCompact; RELEASE JournalCompact;",
+			NULL, NULL, NULL);
+		goto Journal_Compact_Return;
+	}
+
+	//Committed, so the new file is the journal now. If it can't be moved into
+	//place yet, Journal_Recover will do it the next time the journal is opened.
+	close(tmp);
+	tmp = -1;
+	Journal_Close();
+	if(!Journal_Replace(tmppath, path)){goto Journal_Compact_Return;}
+	retval = TRUE;
+
+Journal_Compact_Return:
+	if(tmp != -1){
+		close(tmp);
+		remove(tmppath);
+	}
+	safe_free(path);
+	safe_free(tmppath);
+	json_decref(out);
+	return retval;
+}
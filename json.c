@@ -91,6 +91,31 @@ signed long JSON_GetInt(json_t *root, const char *name)
 	}
 }
 
+/*
+* ===  FUNCTION  ======================================================================
+*         Name:  JSON_GetInt64
+*  Description:  Like JSON_GetInt, but keeps all 64 bits even where long doesn't
+* =====================================================================================
+*/
+int64_t JSON_GetInt64(json_t *root, const char *name)
+{
+	json_t *object = json_object_get(root, name);
+
+	if (json_is_string(object)) {
+		#ifdef HAVE_WINDOWS_H
+		return _strtoi64(json_string_value(object), NULL, 0);
+		#else
+		return strtoll(json_string_value(object), NULL, 0);
+		#endif
+	}
+	else if (json_is_number(object)) {
+		return (int64_t)json_integer_value(object);
+	}
+	else {
+		return 0;
+	}
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  JSON_GetDouble
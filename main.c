@@ -349,8 +349,10 @@ long filesize(const char *filename){
 #elif HAVE_STAT_H
 long filesize(const char *filename){
 	struct stat out;
-	stat(filename, &out);
-	ErrNo2ErrCode();
+	if(stat(filename, &out) != 0){
+		ErrNo2ErrCode();
+		return -1;
+	}
 	return out.st_size;
 }
 #else
@@ -372,18 +374,137 @@ void memcpy_rev(unsigned char *dst, const unsigned char *src, size_t n)
 }
 
 
+// Schema version SQL_Load creates, kept in PRAGMA user_version.
+//     1: Revert held each patch's original bytes in OldBytes
+//     2: Original bytes live in undo.journal, keyed through RevertBlobs
+//     3: Revert rows carry their own File, and a patch can have several
+#define SQL_SCHEMA_VERSION 3
+
+// Does the table have the column? Only used to tell schema versions apart.
+static BOOL SQL_HasColumn(const char *Table, const char *Column)
+{
+	sqlite3_stmt *command = NULL;
+	char *query = NULL;
+	BOOL retval;
+
+	asprintf(&query, "SELECT `%s` FROM `%s` LIMIT 0;", Column, Table);
+	if(query == NULL){return FALSE;}
+	retval = (sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL) == SQLITE_OK);
+	sqlite3_finalize(command);
+	safe_free(query);
+	return retval;
+}
+
+// Move version 1 revert data into the undo journal. SQL_Load has already
+// renamed the old table to Revert_v1 and created the new ones. Start./End.
+// variables come from the space map now, so their stored copies go too.
+static BOOL SQL_Upgrade_v1(void)
+{
+	sqlite3_stmt *select = NULL, *insert = NULL;
+	const char *query1 = "SELECT PatchUUID, Start, OldBytes, "
+		"(SELECT File FROM Spaces WHERE PatchID = PatchUUID LIMIT 1) "
+		"FROM Revert_v1;";
+	const char *query2 = "INSERT INTO Revert "
+		"('PatchUUID', 'File', 'Start', 'Len', 'Hash') VALUES (?, ?, ?, ?, ?);";
+	int result;
+	BOOL retval = FALSE;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query1, -1, &select, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query2, -1, &insert, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		goto SQL_Upgrade_v1_Return;
+	}
+
+	while((result = sqlite3_step(select)) == SQLITE_ROW){
+		const char *PatchUUID = (const char *)sqlite3_column_text(select, 0);
+		int Start = sqlite3_column_int(select, 1);
+		const unsigned char *OldBytes = sqlite3_column_blob(select, 2);
+		int Len = sqlite3_column_bytes(select, 2);
+		int FileID = sqlite3_column_int(select, 3);
+		char *Hash;
+
+		Hash = Journal_Store(PatchUUID, FileID, Start, OldBytes, Len);
+		if(Hash == NULL){goto SQL_Upgrade_v1_Return;}
+		if(SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_bind_text(insert, 1, PatchUUID, -1, SQLITE_TRANSIENT) ||
+			sqlite3_bind_int(insert, 2, FileID) ||
+			sqlite3_bind_int(insert, 3, Start) ||
+			sqlite3_bind_int(insert, 4, Len) ||
+			sqlite3_bind_text(insert, 5, Hash, -1, SQLITE_TRANSIENT)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(insert)
+		) != 0){
+			CURRERROR = errCRIT_DBASE;
+			safe_free(Hash);
+			goto SQL_Upgrade_v1_Return;
+		}
+		sqlite3_reset(insert);
+		safe_free(Hash);
+	}
+	if(result != SQLITE_DONE){
+		SQL_HandleErrors(__FILE__, __LINE__, result);
+		CURRERROR = errCRIT_DBASE;
+		goto SQL_Upgrade_v1_Return;
+	}
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"DROP TABLE Revert_v1;"
+		"DELETE FROM Variables WHERE Mod = 'MODLOADER@invisibleup' AND "
+		"(UUID LIKE 'Start.%' OR UUID LIKE 'End.%');",
+		NULL, NULL, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		goto SQL_Upgrade_v1_Return;
+	}
+	retval = TRUE;
+
+SQL_Upgrade_v1_Return:
+	sqlite3_finalize(select);
+	sqlite3_finalize(insert);
+	return retval;
+}
+
+// Give version 2 Revert rows their file. SQL_Load has already renamed the
+// old table to Revert_v2. Version 2 only kept one row per patch, so the
+// file is the one its Add or Clear space is in.
+static BOOL SQL_Upgrade_v2(void)
+{
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"INSERT INTO Revert (PatchUUID, File, Start, Len, Hash) "
+		"SELECT PatchUUID, IFNULL(("
+			"SELECT File FROM Spaces WHERE PatchID = PatchUUID AND "
+			"UPPER(Type) IN ('ADD', 'CLEAR') ORDER BY RowID LIMIT 1"
+		"), 0), Start, Len, Hash FROM Revert_v2 ORDER BY RowID;"
+		"DROP TABLE Revert_v2;",
+		NULL, NULL, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  SQL_Load
  *  Description:  Opens the database and creates the tables if they don't exist.
- *
- *                In the future this will need to handle upgrading the DB schema to
- *                new versions.
+ *                Databases from older versions are upgraded to SQL_SCHEMA_VERSION
+ *                in one transaction; if that fails, or the database is from a
+ *                newer version, it's left alone and loading fails.
  * =====================================================================================
  */
 BOOL SQL_Load(){
     char *DBPath = NULL;
+	sqlite3_stmt *command;
+	int Version;
+	BOOL Upgrade, UpgradeV2;
+	TRACE_BEGIN("SQL_Load", NULL);
 	CURRERROR = errNOERR;
+	Dep_Invalidate();
+	Var_Invalidate();
+	Journal_Close();
 	//chdir(CONFIG.CURRDIR);
     
     asprintf(&DBPath, "%s/mods.db", CONFIG.CURRDIR);
@@ -395,9 +516,50 @@ BOOL SQL_Load(){
 	) != 0 || SQL_HandleErrors(__FILE__, __LINE__,                       
 		sqlite3_exec(CURRDB, 
             "PRAGMA application_id = 2695796694;" // Randomly generated number
-            "PRAGMA user_version = 1;"
-            "PRAGMA journal_mode=MEMORY;" // If it crashes, you're in a pickle anyways...
-            "PRAGMA mmap_size=16777216;"
+            "PRAGMA journal_mode=WAL;" // Survives a crash mid-install; see intent.c
+            "PRAGMA synchronous=FULL;"  // Intent log relies on commits being on disk
+            "PRAGMA mmap_size=16777216;",
+            NULL, NULL, NULL
+		)
+	) != 0){
+        safe_free(DBPath);
+		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Load");
+		return FALSE;
+	}
+	safe_free(DBPath);
+
+	//Which schema is this?
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, "PRAGMA user_version;", -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Load");
+		return FALSE;
+	}
+	Version = SQL_GetNum(command);
+	sqlite3_finalize(command);
+	if(Version > SQL_SCHEMA_VERSION){
+		AlertMsg("The mod database was made by a newer version of the mod loader.\n"
+			"Please use that version, or delete mods.db after restoring a clean copy "
+			"of the game.", "Database Too New");
+		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Load");
+		return FALSE;
+	}
+	//Version 1 never bumped user_version, so look at the table itself
+	Upgrade = Version < SQL_SCHEMA_VERSION && SQL_HasColumn("Revert", "OldBytes");
+	UpgradeV2 = Version < SQL_SCHEMA_VERSION && SQL_HasColumn("Revert", "Hash") &&
+		!SQL_HasColumn("Revert", "File");
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB, 
+			"BEGIN TRANSACTION;", NULL, NULL, NULL)
+	) != 0 || (Upgrade && SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB, 
+			"ALTER TABLE Revert RENAME TO Revert_v1;", NULL, NULL, NULL)
+	) != 0) || (UpgradeV2 && SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB, 
+			"ALTER TABLE Revert RENAME TO Revert_v2;", NULL, NULL, NULL)
+	) != 0) || SQL_HandleErrors(__FILE__, __LINE__,                       
+		sqlite3_exec(CURRDB, 
 			"CREATE TABLE IF NOT EXISTS 'Spaces'( "
 			"`ID`           	TEXT NOT NULL,"
 			"`Version`  		INTEGER NOT NULL,"
@@ -422,9 +584,16 @@ BOOL SQL_Load(){
 			"`ParentUUID`     	TEXT NOT NULL,"
 			"`ChildUUID`      	TEXT NOT NULL);"
 			"CREATE TABLE IF NOT EXISTS `Revert` ("
-			"`PatchUUID`		TEXT NOT NULL UNIQUE," // NOT Space ID
+			"`PatchUUID`		TEXT NOT NULL," // NOT Space ID. A Move has two.
+			"`File`             INTEGER NOT NULL,"
 			"`Start`            INTEGER NOT NULL,"
-			"`OldBytes`			TEXT NOT NULL);"
+			"`Len`              INTEGER NOT NULL,"
+			"`Hash`				TEXT NOT NULL);" // Key into RevertBlobs
+			"CREATE TABLE IF NOT EXISTS `RevertBlobs` ("
+			"`Hash`				TEXT NOT NULL UNIQUE PRIMARY KEY,"
+			"`Journal`			INTEGER NOT NULL," // Offset in undo.journal
+			"`Len`              INTEGER NOT NULL,"
+			"`Refs`				INTEGER NOT NULL);"
 			"CREATE TABLE IF NOT EXISTS `Files` ("
 			"`ID`				INTEGER NOT NULL UNIQUE,"
 			"`Path`				TEXT NOT NULL);"
@@ -444,17 +613,34 @@ BOOL SQL_Load(){
 			"`Var`              TEXT NOT NULL,"
 			"`ModPath`          TEXT NOT NULL,"
 			"`Patch`            INTEGER NOT NULL,"
-			"`OldVal`           INTEGER NOT NULL);",
+			"`OldVal`           INTEGER NOT NULL);"
+			"CREATE TABLE IF NOT EXISTS `VarRepatchPatch` (" // Patches to replay
+			"`ModPath`          TEXT NOT NULL,"
+			"`Patch`            INTEGER NOT NULL,"
+			"`Mod`              TEXT NOT NULL,"
+			"`Body`             TEXT NOT NULL," // Compact JSON of the patch
+			"PRIMARY KEY(`ModPath`, `Patch`));"
+			"CREATE TABLE IF NOT EXISTS `JournalInfo` (" // See Journal_Compact
+			"`Generation`       INTEGER NOT NULL);",
             NULL, NULL, NULL
 		)
+	) != 0 || (Upgrade && !SQL_Upgrade_v1()) || (UpgradeV2 && !SQL_Upgrade_v2()) ||
+	SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_exec(CURRDB, "PRAGMA user_version = 3; COMMIT;", // SQL_SCHEMA_VERSION
+			NULL, NULL, NULL)
 	) != 0){
-        safe_free(DBPath);
+		sqlite3_exec(CURRDB, "ROLLBACK;", NULL, NULL, NULL);
+		Journal_Close();
+		if(Upgrade || UpgradeV2){
+			AlertMsg("The mod database is from an older version of the mod loader "
+				"and could not be upgraded. It has not been changed.", 
+				"Database Upgrade Failed");
+		}
 		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Load");
 		return FALSE;
 	}
 	
-	safe_free(DBPath);
-	
 	//Add mod loader version var
 	{
 		struct VarValue varCurr;
@@ -483,6 +669,7 @@ BOOL SQL_Load(){
 		Var_Destructor(&varCurr);
 	}
 	
+	TRACE_END("SQL_Load");
 	return TRUE;
 }
 
@@ -507,11 +694,11 @@ BOOL SQL_Populate(json_t *GameCfg)
 	const char *query4 = "UPDATE Spaces SET Type = 'Add' WHERE "
 	                     "Mod = 'MODLOADER@invisibleup' AND Type = 'Clear'";
 	sqlite3_stmt *command;
-
 	ProgDialog_Handle ProgDialog;
 
+	TRACE_BEGIN("SQL_Populate", NULL);
 	if (CURRERROR == errNOERR) { ErrNo2ErrCode(); }
-	if (CURRERROR != errNOERR) { return FALSE; }
+	if (CURRERROR != errNOERR) { TRACE_END("SQL_Populate"); return FALSE; }
 
 	CURRERROR = errNOERR;
 	asprintf(&ModDir, "%s/mods", CONFIG.CURRDIR);
@@ -521,24 +708,27 @@ BOOL SQL_Populate(json_t *GameCfg)
 		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
 	) != 0){
 		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Populate");
 		return FALSE;
 	}
 	
 	spaceCount = SQL_GetNum(command);
-	if(CURRERROR != errNOERR){return FALSE;}
+	if(CURRERROR != errNOERR){TRACE_END("SQL_Populate"); return FALSE;}
 	
 	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
 		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Populate");
 		return FALSE;
 	}
 	command = NULL;
-	if(spaceCount != 0){return TRUE;}
+	if(spaceCount != 0){TRACE_END("SQL_Populate"); return TRUE;}
 	
 	// To decrease disk I/O and increase speed
 	if(SQL_HandleErrors(__FILE__, __LINE__, 
 		sqlite3_exec(CURRDB, "BEGIN TRANSACTION", NULL, NULL, NULL)
 	) != 0){
 		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Populate");
 		return FALSE;
 	}
 
@@ -593,37 +783,9 @@ BOOL SQL_Populate(json_t *GameCfg)
 			safe_free(NewSpc.PatchID);
 			json_decref(out);
 			ProgDialog_Kill(ProgDialog);
+			TRACE_END("SQL_Populate");
 			return FALSE;
 		}
-
-		// Create vars for patch location
-		{
-			struct VarValue varCurr;
-			
-			// Start
-			varCurr.type = uInt32Pointer;
-			asprintf(&varCurr.UUID, "Start.%s", NewSpc.PatchID); 
-			varCurr.desc = strdup("Start byte of patch.");
-			varCurr.publicType = strdup("");
-			varCurr.mod = strdup("MODLOADER@invisibleup");
-			varCurr.persist = FALSE;
-			varCurr.uInt32 = File_OffToPE(FilePath, NewSpc.Start);
-
-			Var_MakeEntry(varCurr);
-			Var_Destructor(&varCurr);
-
-			// End
-			varCurr.type = uInt32Pointer;
-			asprintf(&varCurr.UUID, "End.%s", NewSpc.PatchID); 
-			varCurr.desc = strdup("End byte of patch.");
-			varCurr.publicType = strdup("");
-			varCurr.mod = strdup("MODLOADER@invisibleup");
-			varCurr.persist = FALSE;
-			varCurr.uInt32 = File_OffToPE(FilePath, NewSpc.End);
-
-			Var_MakeEntry(varCurr);
-			Var_Destructor(&varCurr);
-		}
 		
 		safe_free(NewSpc.Bytes);
 		safe_free(NewSpc.ID);
@@ -638,6 +800,7 @@ BOOL SQL_Populate(json_t *GameCfg)
 		sqlite3_exec(CURRDB, query4, NULL, NULL, NULL)
 	) != 0){
 		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Populate");
 		return FALSE;
 	}
 
@@ -646,11 +809,13 @@ BOOL SQL_Populate(json_t *GameCfg)
 		sqlite3_exec(CURRDB, "COMMIT TRANSACTION", NULL, NULL, NULL)
 	) != 0){
 		CURRERROR = errCRIT_DBASE;
+		TRACE_END("SQL_Populate");
 		return FALSE;
 	}
 
 	ProgDialog_Kill(ProgDialog);
 
+	TRACE_END("SQL_Populate");
 	return TRUE;
 }
 
@@ -775,6 +940,11 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	// Start timing trace, if asked for
+	if (!Trace_Init()) {
+		ErrCracker(CURRERROR);
+	}
+
 	// Load program preferences/locations
 	GameCfg = JSON_Load(CONFIG.GAMECONFIG);
 	if (!GameCfg) {
@@ -782,6 +952,9 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	// Parse the blacklist once for this profile
+	Profile_CacheBlacklist(GameCfg, CONFIG.GAMECONFIG, CONFIG.GAMEVER);
+
 	// Load SQL stuff
 	if (!SQL_Load()) {
 		ErrCracker(CURRERROR);
@@ -794,6 +967,11 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	// Undo or finish an install/uninstall that was cut short last time
+	if (!Intent_Recover()) {
+		ErrCracker(CURRERROR);
+	}
+
 	json_decref(GameCfg);
 
 	// Display main dialog/inteface
@@ -812,6 +990,7 @@ int main(int argc, char *argv[])
 	}
 
 	sqlite3_close(CURRDB);
+	Trace_Close();
 	return result;
 }
 
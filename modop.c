@@ -8,6 +8,20 @@
 
 // Mod installation operations and the like.
 
+// Failures collected during a dry run. NULL when not dry running.
+static json_t *DRYRUN_FAILURES = NULL;
+
+// Record a failed patch (or mod, if PatchNo is -1) in the dry run report
+static void Mod_DryRunFail(const char *ModUUID, const char *PatchID, long PatchNo)
+{
+	json_t *row = json_object();
+	json_object_set_new(row, "Mod", json_string(ModUUID ? ModUUID : ""));
+	json_object_set_new(row, "Patch", json_string(PatchID ? PatchID : ""));
+	json_object_set_new(row, "PatchNo", json_integer(PatchNo));
+	json_object_set_new(row, "Error", json_integer(CURRERROR));
+	json_array_append_new(DRYRUN_FAILURES, row);
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  Mod_CheckCompat
@@ -86,46 +100,16 @@ BOOL Mod_CheckConflict(json_t *root)
 	char *name = JSON_GetStr(root, "Name");
 	CURRERROR = errNOERR;
 
-	// Is it on the blacklist?
-	// This is more complicated than I had hoped for. Oh well.
-	{
-		json_t *GameCfg, *GameVerList, *GameVer;
-		unsigned int i;
-		GameCfg = JSON_Load(CONFIG.GAMECONFIG);
-
-		//Find game version
-		GameVerList = json_object_get(GameCfg, "Whitelist");
-		json_array_foreach(GameVerList, i, GameVer){
-			char *CurrVer = JSON_GetStr(GameVer, "Name");
-			json_t *ModList, *CurrMod;
-			unsigned int j;
-
-			if(!streq(CurrVer, CONFIG.GAMEVER)){
-				// Keep searching
-				safe_free(CurrVer);
-				continue;
-			} 
-
-			//Now iterate through blacklist
-			ModList = json_object_get(GameVer, "Mods");
-			json_array_foreach(ModList, j, CurrMod){
-				const char *CurrItem = json_string_value(CurrMod);
-				if(streq(CurrItem, UUID)){
-					//A hit!
-					char *buf = NULL;
-					asprintf (&buf, "%s is implicitly installed in base executable.", name);
-					AlertMsg (buf, "Mod Already Installed");
-					safe_free(buf);
-					CURRERROR = errWNG_MODCFG;
-					return FALSE;
-				}
-			}
-
-			safe_free(CurrVer);
-			break;
-		}
-		
-		json_decref(GameCfg);
+	// Is it on the blacklist? (Cached per profile)
+	if(Profile_IsBlacklisted(UUID)){
+		char *buf = NULL;
+		asprintf (&buf, "%s is implicitly installed in base executable.", name);
+		AlertMsg (buf, "Mod Already Installed");
+		safe_free(buf);
+		safe_free(UUID);
+		safe_free(name);
+		CURRERROR = errWNG_MODCFG;
+		return FALSE;
 	}
 	
 	//Ban if using reserved name MODLOADER@invisibleup as well
@@ -267,27 +251,12 @@ BOOL Mod_CheckDep(json_t *root)
 		int ModCount;
 		{
 			// For each listed dependency, find it in installed mod list
-			sqlite3_stmt *command;
-			const char *query = "SELECT EXISTS ("
-				"SELECT * FROM Mods WHERE UUID = ? AND Version >= ?)";
-
 			char *UUID = JSON_GetStr(value, "UUID");
 			unsigned long ver = JSON_GetuInt(value, "Version");
 			
-			if(SQL_HandleErrors(__FILE__, __LINE__, 
-				sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-			) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-				sqlite3_bind_text(command, 1, UUID, -1, SQLITE_STATIC) ||
-				sqlite3_bind_int(command, 2, ver)
-			) != 0){CURRERROR = errCRIT_DBASE; return FALSE;}
-			   
-			ModCount = SQL_GetNum(command);
-			if(CURRERROR != errNOERR){return FALSE;}
-			
-			if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
-				CURRERROR = errCRIT_DBASE; return FALSE;
-			}
+			ModCount = Dep_IsSatisfied(UUID, ver);
 			safe_free(UUID);
+			if(CURRERROR != errNOERR){return FALSE;}
 		}
 		
 		if (ModCount == 0){
@@ -304,6 +273,7 @@ BOOL Mod_CheckDep(json_t *root)
 				CURRERROR = errCRIT_DBASE; return FALSE;
 			}
 			command = NULL;
+			Dep_RemoveEdges(ParentUUID);
 			safe_free(ParentUUID);
 			return FALSE;
 		}
@@ -325,6 +295,11 @@ BOOL Mod_CheckDep(json_t *root)
 				CURRERROR = errCRIT_DBASE; return FALSE;
 			}
 			command = NULL;
+			if(!Dep_AddEdge(ParentUUID, UUID)){
+				safe_free(UUID);
+				safe_free(ParentUUID);
+				return FALSE;
+			}
 			safe_free(UUID);
 		}
 	}
@@ -365,34 +340,15 @@ void Mod_CheckDepAlert(json_t *root){
 		int ModCount;
 		
 		{
-			sqlite3_stmt *command;
-			const char *query = "SELECT COUNT(*) FROM Mods "
-			                    "WHERE UUID = ? AND Version >= ?";
 			char *UUID = JSON_GetStr(value, "UUID");
 			unsigned long ver = JSON_GetuInt(value, "Version");
 			
-			if(SQL_HandleErrors(__FILE__, __LINE__, 
-				sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-			) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-				sqlite3_bind_text(command, 1, UUID, -1, SQLITE_STATIC) ||
-				sqlite3_bind_int(command, 2, ver)
-			) != 0){
-				CURRERROR = errCRIT_DBASE;
-				safe_free(UUID);
-				safe_free(message);
-				return;
-			}
-			   
-			ModCount = SQL_GetNum(command);
-			if(CURRERROR != errNOERR){return;}
-			
-			if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
-				CURRERROR = errCRIT_DBASE;
-				safe_free(UUID);
+			ModCount = Dep_IsSatisfied(UUID, ver);
+			safe_free(UUID);
+			if(CURRERROR != errNOERR){
 				safe_free(message);
 				return;
 			}
-			safe_free(UUID);
 		}
 		
 		if (ModCount == 0){ //If mod not installed
@@ -602,12 +558,20 @@ BOOL ModOp_Clear(struct ModSpace *input, const char *ModUUID){
 	} else if(input->FileID != 0){
 		// Write data in place (so if something did use this, it would blow up)
 		int handle = File_OpenSafe(FilePath, _O_BINARY|_O_RDWR);
+		long seq;
 		if (handle == -1) {
 			CURRERROR = errWNG_BADFILE;
 			retval = FALSE;
 			goto ModOp_Clear_Return;
 		}
+		seq = Intent_Write(handle, FilePath, input->Start, input->Len);
+		if(seq == -1){
+			close(handle);
+			safe_free(pattern);
+			goto ModOp_Clear_Return;
+		}
 		File_WritePattern(handle, input->Start, pattern, patternlen, input->Len);
+		Intent_Done(seq);
 		close(handle);
 	}
 	safe_free(pattern);
@@ -621,6 +585,101 @@ ModOp_Clear_Return:
 	return retval;
 }
 
+// Write the contents of a patch to its reserved space.
+// Bytes are written as-is. Copy/Move sources are streamed from SrcPath, or,
+// if FromRevert is set and the source is this same file, from the revert
+// record ModOp_Clear made of the source before it was overwritten.
+static BOOL ModOp_Add_Write(const struct ModSpace *input, BOOL FromRevert)
+{
+	int handle = -1;
+	char *FilePath = NULL;
+	BOOL retval = FALSE;
+	long seq;
+
+	if(input->FileID == 0){
+		//Only write if not using memory pseudofile
+		return TRUE;
+	}
+
+	FilePath = File_GetPath(input->FileID);
+	if(strndef(FilePath)){return FALSE;}
+
+	handle = File_OpenSafe(FilePath, _O_BINARY|_O_RDWR);
+	if(handle == -1){
+		goto ModOp_Add_Write_Return;
+	}
+	seq = Intent_Write(handle, FilePath, input->Start, input->Len);
+	if(seq == -1){
+		goto ModOp_Add_Write_Return;
+	}
+
+	if(input->Bytes != NULL){
+		File_WriteBytes(handle, input->Start, input->Bytes, input->Len);
+		retval = TRUE;
+
+	} else if(input->SrcPath == NULL){
+		CURRERROR = errCRIT_ARGMNT;
+
+	} else if(FromRevert && streq(input->SrcPath, FilePath)){
+		sqlite3_stmt *command;
+		//The source is the first range the Move captured, by its Clear
+		const char *query = "SELECT RevertBlobs.Journal, RevertBlobs.Hash "
+		                    "FROM Revert JOIN RevertBlobs "
+		                    "ON RevertBlobs.Hash = Revert.Hash WHERE PatchUUID = ? "
+		                    "ORDER BY Revert.RowID LIMIT 1";
+		json_t *out;
+		char *Hash;
+
+		if(SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_bind_text(command, 1, input->PatchID, -1, SQLITE_STATIC)
+		) != 0){
+			CURRERROR = errCRIT_DBASE;
+			goto ModOp_Add_Write_Return;
+		}
+		out = SQL_GetJSON(command);
+		sqlite3_finalize(command);
+
+		if(json_array_size(out) == 0){
+			//Source was never captured
+			CURRERROR = errCRIT_DBASE;
+			json_decref(out);
+			goto ModOp_Add_Write_Return;
+		}
+		Hash = JSON_GetStr(json_array_get(out, 0), "Hash");
+		retval = Journal_WriteOut(
+			JSON_GetInt64(json_array_get(out, 0), "Journal"),
+			Hash, handle, input->Start
+		);
+		safe_free(Hash);
+		json_decref(out);
+
+	} else if(streq(input->SrcPath, FilePath)){
+		//Same handle, so File_CopyRange can handle any overlap
+		retval = File_CopyRange(
+			handle, input->SrcStart, handle, input->Start, input->Len
+		);
+
+	} else {
+		int srchandle = File_OpenSafe(input->SrcPath, _O_BINARY|_O_RDONLY);
+		if(srchandle == -1){
+			goto ModOp_Add_Write_Return;
+		}
+		retval = File_CopyRange(
+			srchandle, input->SrcStart, handle, input->Start, input->Len
+		);
+		close(srchandle);
+	}
+
+	if(retval){Intent_Done(seq);}
+
+ModOp_Add_Write_Return:
+	if(handle != -1){close(handle);}
+	safe_free(FilePath);
+	return retval;
+}
+
 /* 
  * ===  FUNCTION  ======================================================================
  *         Name:  ModOp_Add
@@ -639,21 +698,146 @@ BOOL ModOp_Add(struct ModSpace *input, const char *ModUUID){
 	//Create revert table entry
 	Mod_CreateRevertEntry(input);
 	
-	if(input->FileID != 0){
-		//Only write if not using memory pseudofile
-		int handle = -1;
-		char *FilePath = NULL;
+	return ModOp_Add_Write(input, FALSE);
+}
 
-		FilePath = File_GetPath(input->FileID);
-		if(strndef(FilePath)){return FALSE;}
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  ModOp_Move
+ *  Description:  Move operation for mod installation.
+ *                Clears the source range, then adds its old contents elsewhere.
+ *                The destination may land on (part of) the freed source, so the
+ *                data is streamed back out of the revert record for the source
+ *                rather than from the file itself.
+ * =====================================================================================
+ */
+BOOL ModOp_Move(struct ModSpace *input, const char *ModUUID){
+	// Make a new modspace representing the source chunk. ModOp_Clear
+	// replaces (and frees) its ID, so it needs its own copy.
+	struct ModSpace srcInput = *input;
+	BOOL Cleared;
+	srcInput.Start = srcInput.SrcStart;
+	srcInput.End = srcInput.SrcEnd;
+	srcInput.ID = strdup(input->ID);
+	if(srcInput.ID == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	
+	// Remove the source
+	Cleared = ModOp_Clear(&srcInput, ModUUID);
+	safe_free(srcInput.ID);
+	if(!Cleared){
+		return FALSE;
+	}
+	
+	// Add new one in new location
+	if(!ModOp_Reserve(input, ModUUID)){
+		return FALSE;
+	}
+	Mod_CreateRevertEntry(input);
+	
+	return ModOp_Add_Write(input, TRUE);
+}
 
-		handle = File_OpenSafe(FilePath, _O_BINARY|_O_RDWR);
-		File_WriteBytes(handle, input->Start, input->Bytes, input->Len);
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  ModOp_Reloc
+ *  Description:  Copy operation with a relocation table.
+ *                Reserves space like Copy, reads the payload from (SrcFile) once,
+ *                applies every entry of (Relocs) to it in memory and writes the
+ *                result in one go. Each entry is [Offset, Type, Value]:
+ *                  Offset - Position of a 32-bit field in the payload
+ *                  Type   - "Abs32" stores Value as-is, "Rel32" stores it relative
+ *                           to the end of the field (CALL/JMP style)
+ *                  Value  - Expression, as with AddType "Expression"
+ * =====================================================================================
+ */
+BOOL ModOp_Reloc(
+	struct ModSpace *input,
+	json_t *patchCurr,
+	const char *ModPath,
+	const char *ModUUID,
+	size_t PatchCount
+){
+	json_t *Relocs, *reloc;
+	char *FilePath = NULL;
+	int handle;
+	size_t i;
+	BOOL retval = FALSE;
+	
+	Relocs = json_object_get(patchCurr, "Relocs");
+	if(Relocs != NULL && !json_is_array(Relocs)){
+		AlertMsg("`Relocs` must be an array.", "JSON Error");
+		CURRERROR = errWNG_MODCFG;
+		return FALSE;
+	}
+	
+	if(!ModOp_Reserve(input, ModUUID)){
+		return FALSE;
+	}
+	Mod_CreateRevertEntry(input);
+	
+	// Load the payload once
+	input->Bytes = calloc(MAX(input->Len, 1), sizeof(char));
+	if(input->Bytes == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	handle = File_OpenSafe(input->SrcPath, _O_BINARY | _O_RDONLY);
+	if(handle == -1){
+		CURRERROR = errCRIT_FUNCT;
+		return FALSE;
+	}
+	if(File_ReadBytes(handle, input->SrcStart, input->Bytes, input->Len) != input->Len){
+		CURRERROR = errCRIT_FUNCT;
 		close(handle);
-
-		safe_free(FilePath);
+		return FALSE;
 	}
-	return TRUE;
+	close(handle);
+	
+	FilePath = File_GetPath(input->FileID);
+	if(strndef(FilePath)){
+		return FALSE;
+	}
+	
+	// Apply fixups
+	json_array_foreach(Relocs, i, reloc){
+		int Offset = (int)json_integer_value(json_array_get(reloc, 0));
+		const char *Type = json_string_value(json_array_get(reloc, 1));
+		const char *Value = json_string_value(json_array_get(reloc, 2));
+		uint32_t val;
+		
+		if(
+			!json_is_integer(json_array_get(reloc, 0)) || strndef(Value) ||
+			Offset < 0 || Offset > input->Len - 4
+		){
+			AlertMsg("Relocation is malformed or outside of the patch.", "JSON Error");
+			CURRERROR = errWNG_MODCFG;
+			goto ModOp_Reloc_Return;
+		}
+		
+		val = Eq_Parse_uInt(Value, ModPath, FALSE);
+		if(CURRERROR != errNOERR){
+			goto ModOp_Reloc_Return;
+		}
+		Mod_Install_VarRepatchFromExpr(Value, ModPath, PatchCount);
+		
+		if(strieq(Type, "Rel32")){
+			val -= File_OffToPE(FilePath, input->Start + Offset + 4);
+		} else if(!strndef(Type) && !strieq(Type, "Abs32")){
+			AlertMsg("Unknown relocation type", Type);
+			CURRERROR = errWNG_MODCFG;
+			goto ModOp_Reloc_Return;
+		}
+		memcpy(input->Bytes + Offset, &val, sizeof(val));
+	}
+	
+	retval = ModOp_Add_Write(input, FALSE);
+	
+ModOp_Reloc_Return:
+	safe_free(FilePath);
+	return retval;
 }
 
 // Returns an ID dependant on the value of the equation.
@@ -739,13 +923,19 @@ BOOL Mod_GetPatchInfo_SetRange(
 		return TRUE;
 
 	} else {
-		// Parse both expressions
-		*Start = Eq_Parse_uInt(StartEq, ModPath, TRUE);
-		*End = Eq_Parse_uInt(EndEq, ModPath, TRUE);
-
-		if(CURRERROR != errNOERR){
+		// Parse both expressions, against the same variables
+		struct EqBatchItem range[2];
+		memset(range, 0, sizeof(range));
+		range[0].Eq = StartEq;
+		range[1].Eq = EndEq;
+		range[0].ModPath = range[1].ModPath = ModPath;
+		range[0].IsFileOffset = range[1].IsFileOffset = TRUE;
+
+		if(!Eq_ParseBatch(range, 2)){
 			return FALSE;
 		}
+		*Start = range[0].uInt;
+		*End = range[1].uInt;
 
 		// Convert if FileType is set to "PE"
 		if(streq(FileType, "PE") && FileID != 0){
@@ -832,6 +1022,7 @@ struct ModSpace Mod_GetPatchInfo(
 
 	CURRERROR = errNOERR;
 	input.Valid = FALSE;
+	TRACE_BEGIN("Mod_GetPatchInfo", NULL);
 	
 	// Get Mode
 	Mode = JSON_GetStr(patchCurr, "Mode");
@@ -894,8 +1085,8 @@ struct ModSpace Mod_GetPatchInfo(
 	}
 	
 	///Set Bytes, Len, SrcStart, SrcEnd (if applicable)
-	//Copy/Move
-	if(strieq(Mode, "Move")|| strieq(Mode, "Copy")){
+	//Copy/Move/Reloc
+	if(strieq(Mode, "Move")|| strieq(Mode, "Copy") || strieq(Mode, "Reloc")){
 		char *SrcFile = NULL;
 		char *SrcPath = NULL;
 		char *SrcLoc = NULL;
@@ -948,30 +1139,14 @@ struct ModSpace Mod_GetPatchInfo(
 			input.Len = input.SrcEnd - input.SrcStart;
 		//}
 		
-		// Allocate space for bytes
-		input.Bytes = calloc(input.Len, sizeof(char));
-		if(input.Bytes == NULL){
-			CURRERROR = errCRIT_MALLOC;
+		// Bytes from SrcStart to SrcEnd are streamed when the patch is
+		// written, so just check they're there and remember where.
+		if(input.SrcStart < 0 || input.Len < 0 || input.SrcEnd > filesize(SrcPath)){
+			CURRERROR = errCRIT_FUNCT;
 			goto Mod_GetPatchInfo_Src_Failure;
 		}
-		
-		// Set value of Bytes to value of bytes from SrcStart to SrcEnd
-		{
-			int fhandle = File_OpenSafe(SrcPath, _O_BINARY | _O_RDONLY);
-			if(fhandle == -1){
-				safe_free(input.Bytes);
-				CURRERROR = errCRIT_FUNCT;
-				goto Mod_GetPatchInfo_Src_Failure;
-			}
-			
-			lseek(fhandle, input.SrcStart, SEEK_SET);
-			if (read(fhandle, input.Bytes, input.Len) != input.Len){
-				safe_free(input.Bytes);
-				CURRERROR = errCRIT_FUNCT;
-				goto Mod_GetPatchInfo_Src_Failure;
-			}
-			close(fhandle);
-		}
+		input.SrcPath = SrcPath;
+		SrcPath = NULL;
 
 	Mod_GetPatchInfo_Src_Failure:
 		safe_free(SrcStartEq);
@@ -1066,6 +1241,7 @@ struct ModSpace Mod_GetPatchInfo(
 Mod_GetPatchInfo_Failure:
 	safe_free(input.ID);
 	safe_free(input.Bytes);
+	safe_free(input.SrcPath);
 	safe_free(input.PatchID);
 	
 Mod_GetPatchInfo_Return:
@@ -1074,6 +1250,7 @@ Mod_GetPatchInfo_Return:
 	safe_free(Mode);
 	safe_free(FileName);
 	safe_free(FilePath);
+	TRACE_END("Mod_GetPatchInfo");
 	return input;
 }
 
@@ -1160,6 +1337,175 @@ BOOL ModOp_Reserve(struct ModSpace *input, const char *ModUUID){
 	return TRUE;
 }
 
+// Where ModOp_File keeps the original of a replaced file
+static char * ModOp_FileBackupPath(int FileID, const char *PatchID)
+{
+	char *BakPath = NULL;
+	asprintf(&BakPath, "%s/BACKUP/%d.%s", CONFIG.CURRDIR, FileID, PatchID);
+	if(BakPath == NULL){
+		CURRERROR = errCRIT_MALLOC;
+	}
+	return BakPath;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  ModOp_File
+ *  Description:  Replaces a whole file with SrcFile. The original is moved into
+ *                BACKUP once and the replacement is streamed in with File_Copy,
+ *                so nothing goes through hex strings or the undo journal. Recorded
+ *                as a Delete space for the original and a New space for the new file.
+ * =====================================================================================
+ */
+BOOL ModOp_File(
+	json_t *patchCurr,
+	const char *ModPath,
+	const char *ModUUID,
+	size_t PatchCount
+){
+	char *FileName = JSON_GetStr(patchCurr, "File");
+	char *SrcFile = JSON_GetStr(patchCurr, "SrcFile");
+	char *SrcLoc = JSON_GetStr(patchCurr, "SrcFileLoc");
+	char *FilePath = NULL, *SrcPath = NULL, *BakPath = NULL;
+	struct ModSpace space = {0};
+	int OrigLen = -1, NewLen;
+	BOOL retval = FALSE;
+	
+	CURRERROR = errNOERR;
+	space.FileID = -1;
+	
+	space.PatchID = JSON_GetStr(patchCurr, "ID");
+	if(strndef(space.PatchID)){
+		safe_free(space.PatchID);
+		asprintf(&space.PatchID, "Patch-%lu.%s", (unsigned long) PatchCount, ModUUID);
+	}
+	
+	if(strndef(FileName) || strndef(SrcFile)){
+		AlertMsg("`File` and `SrcFile` must be defined for file patches.", "JSON Error");
+		CURRERROR = errWNG_MODCFG;
+		goto ModOp_File_Return;
+	}
+	
+	asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, FileName);
+	if(strieq(SrcLoc, "Mod")){
+		//Mod archive
+		asprintf(&SrcPath, "%s%s", ModPath, SrcFile);
+	} else {
+		//Game installation directory
+		asprintf(&SrcPath, "%s/%s", CONFIG.CURRDIR, SrcFile);
+	}
+	
+	if(!File_Exists(SrcPath, FALSE, TRUE)){
+		AlertMsg("SrcFile does not exist!", "Mod configuration error");
+		CURRERROR = errWNG_MODCFG;
+		goto ModOp_File_Return;
+	}
+	NewLen = filesize(SrcPath);
+	
+	// Find original, if there is one
+	if(File_Exists(FilePath, FALSE, FALSE)){
+		sqlite3_stmt *command;
+		const char *query = "SELECT EXISTS(SELECT * FROM Spaces "
+		                    "WHERE File = ? AND Mod != 'MODLOADER@invisibleup');";
+		int Patched;
+		
+		space.FileID = File_GetID(FileName);
+		if(space.FileID == -1){goto ModOp_File_Return;}
+		
+		// Byte patches to the old file would be silently thrown away
+		if(SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_bind_int(command, 1, space.FileID)
+		) != 0){
+			CURRERROR = errCRIT_DBASE;
+			goto ModOp_File_Return;
+		}
+		Patched = SQL_GetNum(command);
+		sqlite3_finalize(command);
+		if(CURRERROR != errNOERR){goto ModOp_File_Return;}
+		
+		if(Patched){
+			AlertMsg("Another mod has already patched this file.", FileName);
+			CURRERROR = errWNG_MODCFG;
+			goto ModOp_File_Return;
+		}
+		
+		OrigLen = filesize(FilePath);
+		BakPath = ModOp_FileBackupPath(space.FileID, space.PatchID);
+		if(BakPath == NULL){goto ModOp_File_Return;}
+	}
+	CURRERROR = errNOERR; //File_Exists complains about missing files
+	
+	if(File_OverlayActive()){
+		// Dry run. Just record what would happen. (New files can't get an
+		// ID without existing, so they won't show up as allocations.)
+		if(OrigLen != -1){File_Delete(FilePath);}
+		File_Create(FilePath, NewLen);
+		
+	} else {
+		// The Spaces rows come after the swap, so log it first. Recovery
+		// uses this to put the original back if we die in between.
+		Intent_Swap(BakPath, FilePath);
+		
+		// Keep the original. It's in the same directory tree, so just rename it.
+		if(OrigLen != -1){
+			char *BakDir = NULL;
+			asprintf(&BakDir, "%s/BACKUP", CONFIG.CURRDIR);
+			mkdir(BakDir);
+			safe_free(BakDir);
+			
+			if(rename(FilePath, BakPath) != 0){
+				CURRERROR = errCRIT_FILESYS;
+				goto ModOp_File_Return;
+			}
+		}
+		
+		// Stream in the replacement
+		File_Copy(SrcPath, FilePath);
+		if(CURRERROR != errNOERR || filesize(FilePath) != NewLen){
+			File_Delete(FilePath);
+			if(OrigLen != -1){rename(BakPath, FilePath);}
+			CURRERROR = errCRIT_FILESYS;
+			goto ModOp_File_Return;
+		}
+		
+		if(OrigLen == -1){
+			space.FileID = File_GetID(FileName);
+			if(space.FileID == -1){goto ModOp_File_Return;}
+		}
+	}
+	
+	// Record the swap
+	if(space.FileID != -1){
+		if(OrigLen != -1){
+			asprintf(&space.ID, "Delete.%s", space.PatchID);
+			space.Start = 0;
+			space.End = OrigLen;
+			if(!Mod_MakeSpace(&space, ModUUID, "Delete")){goto ModOp_File_Return;}
+			safe_free(space.ID);
+		}
+		
+		asprintf(&space.ID, "File.%s", space.PatchID);
+		space.Start = 0;
+		space.End = NewLen;
+		if(!Mod_MakeSpace(&space, ModUUID, "New")){goto ModOp_File_Return;}
+	}
+	
+	retval = TRUE;
+	
+ModOp_File_Return:
+	safe_free(FileName);
+	safe_free(SrcFile);
+	safe_free(SrcLoc);
+	safe_free(FilePath);
+	safe_free(SrcPath);
+	safe_free(BakPath);
+	safe_free(space.ID);
+	safe_free(space.PatchID);
+	return retval;
+}
+
 // Convienece wrapper to test if a value exists in a patch.
 BOOL Mod_PatchKeyExists(json_t *patchCurr, const char *KeyName, BOOL ShowAlert)
 {
@@ -1330,74 +1676,60 @@ BOOL Mod_Verify(json_t *root)
 	return TRUE;
 }
 
-// Creates a VarRepatch entry from an expression
+// Creates VarRepatch entries for the variables an expression uses. A variable
+// the patch already depends on (say, from both its End and Len) isn't added
+// again, so a change to it replays the patch once.
 BOOL Mod_Install_VarRepatchFromExpr(
 	const char *ExprStr,
 	const char *ModPath,
 	size_t PatchNo
 ){
-	char **Vars = NULL;
-	int i = 0;
-	int allocCnt = 64;
-	char *pch;
+	sqlite3_stmt *command;
+	const char *query = "INSERT INTO VarRepatch (Var, ModPath, Patch, OldVal) "
+		"SELECT ?1, ?2, ?3, ?4 WHERE NOT EXISTS ("
+			"SELECT * FROM VarRepatch WHERE Var = ?1 AND ModPath = ?2 AND Patch = ?3"
+		");";
+	const char *pch;
 
 	if(strndef(ExprStr)){
 		return TRUE;
 	}
-
-	Vars = calloc(allocCnt, sizeof(char *));
-	if (!Vars) {
-		CURRERROR = errCRIT_MALLOC;
-		return FALSE;
-	}
-
 	pch = strstr(ExprStr, "$ ");
-	while(pch != NULL){
+	if(pch == NULL){
+		return TRUE;
+	}
 
-		char *varname = pch + strlen("$ ");
-		char *space = strchr(varname, ' ');
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 2, ModPath, -1, SQLITE_STATIC) ||
+		sqlite3_bind_int(command, 3, PatchNo)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+
+	while(pch != NULL){
+		const char *varname = pch + strlen("$ ");
+		const char *space = strchr(varname, ' ');
+		char *Var;
+		struct VarValue result;
+		
 		if(space == NULL){
 			// End of string
-			space = pch + strlen(pch);
-		}
-
-		Vars[i] = calloc(space - varname + 1, sizeof(char));
-		strncpy(Vars[i], varname, (space - varname));
-
-		i += 1;
-		if(i > allocCnt){
-			allocCnt *= 2;
-			Vars = realloc(Vars, allocCnt * sizeof(char *));
-			if(Vars == NULL){
-				CURRERROR = errCRIT_MALLOC;
-				return FALSE;
-			}
+			space = varname + strlen(varname);
 		}
-
-		pch = strstr(pch + 1, "$ ");
-	}
-	
-	i -= 1; // We'll be over by one just because of how the loop works...
-	
-	while(i >= 0) {
-		sqlite3_stmt *command;
-		char *query = "INSERT INTO VarRepatch "
-					  "(Var, ModPath, Patch, OldVal) VALUES (?, ?, ?, ?);";
-		struct VarValue result = Var_GetValue_SQL(Vars[i]);
-		
-		//Compose SQL
-		if(SQL_HandleErrors(__FILE__, __LINE__, 
-			sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-			sqlite3_bind_text(command, 1, Vars[i], -1, SQLITE_STATIC) ||
-			sqlite3_bind_text(command, 2, ModPath, -1, SQLITE_STATIC) ||
-			sqlite3_bind_int(command, 3, PatchNo)
-		) != 0){
-			CURRERROR = errCRIT_DBASE;
+		Var = calloc(space - varname + 1, sizeof(char));
+		if(Var == NULL){
+			sqlite3_finalize(command);
+			CURRERROR = errCRIT_MALLOC;
 			return FALSE;
 		}
+		strncpy(Var, varname, (space - varname));
+		result = Var_GetValue_SQL(Var);
 
 		//Swap out OldVal for appropriate type.
+		sqlite3_bind_text(command, 1, Var, -1, SQLITE_STATIC);
 		switch(result.type){
 		case IEEE64:
 			sqlite3_bind_double(command, 4, result.IEEE64); break;
@@ -1422,19 +1754,85 @@ BOOL Mod_Install_VarRepatchFromExpr(
 			
 		if(SQL_HandleErrors(__FILE__, __LINE__, 
 			sqlite3_step(command)
-		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-			sqlite3_finalize(command)
 		) != 0){
+			Var_Destructor(&result);
+			safe_free(Var);
+			sqlite3_finalize(command);
 			CURRERROR = errCRIT_DBASE;
 			return FALSE;
 		}
+		sqlite3_reset(command);
 
 		Var_Destructor(&result);
-		safe_free(Vars[i]);
-		i -= 1;
+		safe_free(Var);
+		pch = strstr(pch + 1, "$ ");
+	}
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_Install_VarRepatchStore
+ *  Description:  If the patch picked up any VarRepatch entries, keep a compact copy
+ *                of it so Var_RePatch can replay it without reloading the mod's
+ *                info.json.
+ * =====================================================================================
+ */
+BOOL Mod_Install_VarRepatchStore(
+	json_t *patchCurr,
+	const char *ModPath,
+	const char *ModUUID,
+	size_t PatchNo
+){
+	sqlite3_stmt *command;
+	const char *query1 = "SELECT EXISTS(SELECT * FROM VarRepatch "
+		"WHERE ModPath = ? AND Patch = ?);";
+	const char *query2 = "INSERT OR REPLACE INTO VarRepatchPatch "
+		"(ModPath, Patch, Mod, Body) VALUES (?, ?, ?, ?);";
+	char *Body;
+	int used;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, ModPath, -1, SQLITE_STATIC) ||
+		sqlite3_bind_int(command, 2, PatchNo)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	used = SQL_GetNum(command);
+	sqlite3_finalize(command);
+	if(CURRERROR != errNOERR){return FALSE;}
+	if(!used){return TRUE;}
+
+	Body = json_dumps(patchCurr, JSON_COMPACT);
+	if(Body == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query2, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, ModPath, -1, SQLITE_STATIC) ||
+		sqlite3_bind_int(command, 2, PatchNo) ||
+		sqlite3_bind_text(command, 3, ModUUID, -1, SQLITE_STATIC) ||
+		sqlite3_bind_text(command, 4, Body, -1, SQLITE_STATIC)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+	) != 0){
+		safe_free(Body);
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
 	}
 
-	safe_free(Vars);
+	safe_free(Body);
 	return TRUE;
 }
 
@@ -1515,8 +1913,7 @@ BOOL Mod_Install_Minipatch(
 			
 			// We need to somehow open and read a single byte from the EXE.
 			handle = File_OpenSafe(FilePath, _O_BINARY | _O_RDONLY);
-			lseek(handle, OpLoc, SEEK_SET);
-			read(handle, &OpByte, 1);
+			File_ReadBytes(handle, OpLoc, &OpByte, 1);
 			close(handle);
 
 			memcpy(&AbsPos, CurrInput.Bytes, 4);
@@ -1532,8 +1929,7 @@ BOOL Mod_Install_Minipatch(
 			
 			// We need to somehow open and read a single byte from the EXE.
 			handle = File_OpenSafe(FilePath, _O_BINARY | _O_RDONLY);
-			lseek(handle, CurrInput.Start, SEEK_SET);
-			read(handle, &OldVal, 4);
+			File_ReadBytes(handle, CurrInput.Start, (unsigned char *)&OldVal, 4);
 			close(handle);
 
 			memcpy(&NewVal, CurrInput.Bytes, 4);
@@ -1580,10 +1976,11 @@ BOOL Mod_InstallPatch(
 ){
 	BOOL retval = TRUE;
 	char *Mode = JSON_GetStr(patchCurr, "Mode");
-	struct ModSpace input;
+	struct ModSpace input = {0};
 
 	memset(&input, 0, sizeof(struct ModSpace));
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("Mod_InstallPatch", Mode);
 
 	if(!Mode){
 		AlertMsg("`Mode` not defined for patch.", "Mod Config Error");
@@ -1593,15 +1990,21 @@ BOOL Mod_InstallPatch(
 	}
 	
 	// Change directory back to game's root in case it was changed.
-	chdir(CONFIG.CURRDIR);
-	ErrNo2ErrCode();
-	if(CURRERROR != errNOERR){
+	// (errno is only meaningful if chdir fails; SQLite leaves it dirty.)
+	if(chdir(CONFIG.CURRDIR) != 0){
+		ErrNo2ErrCode();
 		retval = FALSE;
 		goto Mod_InstallPatch_End;
 	}
 
 	Mod_PatchKeyExists(patchCurr, "File", TRUE);
 	
+	// Whole-file replacement doesn't deal in byte ranges
+	if(strieq(Mode, "File")){
+		retval = ModOp_File(patchCurr, path, ModUUID, i);
+		goto Mod_InstallPatch_End;
+	}
+	
 	// Fill input struct
 	input = Mod_GetPatchInfo(patchCurr, path, ModUUID, i);
 	if(input.Valid == FALSE){
@@ -1642,8 +2045,7 @@ BOOL Mod_InstallPatch(
         
         // We need to somehow open and read a single byte from the EXE.
         handle = File_OpenSafe(FilePath, _O_BINARY | _O_RDONLY);
-        lseek(handle, OpLoc, SEEK_SET);
-        read(handle, &OpByte, 1);
+        File_ReadBytes(handle, OpLoc, &OpByte, 1);
         close(handle);
         
         if(
@@ -1666,7 +2068,7 @@ BOOL Mod_InstallPatch(
 	// Clear
 	} else if(strieq(Mode, "Clear")){
 		retval = ModOp_Clear(&input, ModUUID);
-	// Add or Copy (Copy sets bytes beforehand to emulate Add)
+	// Add or Copy (Copy sets a source to stream from instead of bytes)
 	} else if(strieq(Mode, "Add") || strieq(Mode, "Copy")){
 		retval = ModOp_Add(&input, ModUUID);
 	// Reserve
@@ -1674,20 +2076,10 @@ BOOL Mod_InstallPatch(
 		retval = ModOp_Reserve(&input, ModUUID);
 	// Move
 	} else if(strieq(Mode, "Move")){
-		// This is gonna get kinda weird.
-		// Make a new modspace representing the source chunk
-		struct ModSpace srcInput = input;
-		srcInput.Start = srcInput.SrcStart;
-		srcInput.End = srcInput.SrcEnd;
-		
-		// Remove the source
-		retval = ModOp_Clear(&srcInput, ModUUID);
-		if(retval == FALSE){
-			goto Mod_InstallPatch_End;
-		}
-		
-		// Add new one in new location
-		retval = ModOp_Add(&input, ModUUID); //Add to Dest
+		retval = ModOp_Move(&input, ModUUID);
+	// Copy with relocations
+	} else if(strieq(Mode, "Reloc")){
+		retval = ModOp_Reloc(&input, patchCurr, path, ModUUID, i);
 	// Unknown mode
 	} else {
 		AlertMsg("Unknown patch mode", Mode);
@@ -1699,45 +2091,14 @@ BOOL Mod_InstallPatch(
 		goto Mod_InstallPatch_End;
 	}
 
-	// Create vars for patch location
-	{
-		struct VarValue varCurr;
-		char *FilePath;
-
-		FilePath = File_GetPath(input.FileID);
-		if(strndef(FilePath)){
-			retval = FALSE;
-			goto Mod_InstallPatch_End;
-		}
-		
-		// Start
-		varCurr.type = uInt32Pointer;
-		asprintf(&varCurr.UUID, "Start.%s", input.PatchID); 
-		varCurr.desc = strdup("Start byte of patch.");
-		varCurr.publicType = strdup("");
-		varCurr.mod = strdup(ModUUID);
-		varCurr.persist = FALSE;
-        varCurr.norepatch = TRUE;
-		varCurr.uInt32 = File_OffToPE(FilePath, input.Start);
-
-		Var_MakeEntry(varCurr);
-		Var_Destructor(&varCurr);
-
-		// End
-		varCurr.type = uInt32Pointer;
-		asprintf(&varCurr.UUID, "End.%s", input.PatchID); 
-		varCurr.desc = strdup("End byte of patch.");
-		varCurr.publicType = strdup("");
-		varCurr.mod = strdup(ModUUID);
-		varCurr.persist = FALSE;
-        varCurr.norepatch = TRUE;
-		varCurr.uInt32 = File_OffToPE(FilePath, input.End);
-
-		Var_MakeEntry(varCurr);
-		Var_Destructor(&varCurr);
-
-		safe_free(FilePath);
+	// Remember the patch if a variable change will need to replay it
+	if(!Mod_Install_VarRepatchStore(patchCurr, path, ModUUID, i)){
+		retval = FALSE;
+		goto Mod_InstallPatch_End;
 	}
+
+	// Start.<PatchID> and End.<PatchID> are read from the space map by
+	// Var_Lookup; nothing to store.
 	
 	// Install "Mini Patches"
 	/*{
@@ -1756,8 +2117,115 @@ BOOL Mod_InstallPatch(
 Mod_InstallPatch_End:
     safe_free(Mode);
 	safe_free(input.Bytes);
+	safe_free(input.SrcPath);
 	safe_free(input.ID);
     safe_free(input.PatchID);
+	TRACE_END("Mod_InstallPatch");
+	return retval;
+}
+
+// Let go of a file's planned writes, marking them done if they were written
+static void Mod_FreeWriteBack(struct WriteBackFile *file, BOOL Written)
+{
+	size_t i;
+	for(i = 0; i < file->WriteCount; i++){
+		if(Written && file->Error == errNOERR){Intent_Done(file->Writes[i].Seq);}
+		safe_free(file->Writes[i].Bytes);
+	}
+	safe_free(file->Writes);
+	if(file->Handle != -1){close(file->Handle);}
+	safe_free(file->Name);
+}
+
+// List the files File_WriteBack couldn't write, in the order it was given them
+static void Mod_WriteBackAlert(
+	const struct WriteBackFile *files, size_t count,
+	const char *Intro, const char *Title
+){
+	char *msg = strdup(Intro);
+	size_t i;
+
+	for(i = 0; i < count && msg != NULL; i++){
+		char *temp = NULL;
+		if(files[i].Error == errNOERR){continue;}
+		asprintf(&temp, "%s\n%s", msg, files[i].Name);
+		safe_free(msg);
+		msg = temp;
+	}
+	if(msg == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return;
+	}
+	AlertMsg(msg, Title);
+	safe_free(msg);
+}
+
+// Does the mod replace any whole files?
+static BOOL Mod_Install_HasFilePatch(json_t *patchArray)
+{
+	json_t *patchCurr;
+	size_t i;
+	
+	json_array_foreach(patchArray, i, patchCurr){
+		const char *Mode = json_string_value(json_object_get(patchCurr, "Mode"));
+		if(strieq(Mode, "File")){return TRUE;}
+	}
+	return FALSE;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_Install_WriteBack
+ *  Description:  Ends a planning overlay and flushes everything the install wrote
+ *                to it through File_WriteBack, one worker per file. Every write is
+ *                logged, and the log synced once, before anything is written,
+ *                same as an uninstall.
+ * =====================================================================================
+ */
+static BOOL Mod_Install_WriteBack(void)
+{
+	struct WriteBackFile *Files;
+	size_t FileCount = 0, i;
+	BOOL retval = TRUE, Written = FALSE;
+	
+	Files = File_OverlayPlan(&FileCount);
+	File_OverlayEnd();
+	if(Files == NULL){return CURRERROR == errNOERR;}
+	
+	for(i = 0; i < FileCount && retval; i++){
+		size_t j;
+		Files[i].Handle = File_OpenSafe(Files[i].Name, _O_BINARY|_O_RDWR);
+		if(Files[i].Handle == -1){
+			retval = FALSE;
+			break;
+		}
+		for(j = 0; j < Files[i].WriteCount; j++){
+			struct WriteBackWrite *curr = &Files[i].Writes[j];
+			curr->Seq = Intent_WriteBatch(Files[i].Handle, Files[i].Name, curr->Offset, curr->Len);
+			if(curr->Seq == -1){
+				retval = FALSE;
+				break;
+			}
+		}
+	}
+	
+	if(retval && !Intent_Flush()){retval = FALSE;}
+	if(retval){
+		Written = TRUE;
+		if(!File_WriteBack(Files, FileCount)){
+			enum errCode err = CURRERROR;
+			Mod_WriteBackAlert(Files, FileCount,
+				"These files couldn't be patched:\n", "Install Error"
+			);
+			CURRERROR = err;
+			retval = FALSE;
+		}
+	}
+	
+	for(i = 0; i < FileCount; i++){
+		Mod_FreeWriteBack(&Files[i], Written);
+	}
+	safe_free(Files);
 	return retval;
 }
 
@@ -1774,12 +2242,14 @@ BOOL Mod_Install(json_t *root, const char *path)
 	size_t i;
 	char *ModUUID = JSON_GetStr(root, "UUID");
 	BOOL retval = TRUE;
+	BOOL Planned = FALSE;
 	
 	//Define system-specific progress dialog
 	ProgDialog_Handle ProgDialog;
 	
 	//Clear errors
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("Mod_Install", ModUUID);
 	
 	//Init progress dialog
 	patchArray = json_object_get(root, "patches");
@@ -1789,9 +2259,33 @@ BOOL Mod_Install(json_t *root, const char *path)
 	);
 	if(CURRERROR != errNOERR){
 		ProgDialog_Kill(ProgDialog);
+		safe_free(ModUUID);
+		TRACE_END("Mod_Install");
+		return FALSE;
+	}
+	
+	//Log the install so a crash part way through can be rolled back
+	if(!Intent_Begin("Install", ModUUID)){
+		ProgDialog_Kill(ProgDialog);
+		safe_free(ModUUID);
+		TRACE_END("Mod_Install");
 		return FALSE;
 	}
 	
+	//Collect every write and flush them all at the end, a worker per file.
+	//Not for dry runs (already collecting) or whole-file swaps, which have
+	//to happen in order with the writes around them.
+	if(!File_OverlayActive() && !Mod_Install_HasFilePatch(patchArray)){
+		if(!File_OverlayBeginPlan()){
+			Intent_End();
+			ProgDialog_Kill(ProgDialog);
+			safe_free(ModUUID);
+			TRACE_END("Mod_Install");
+			return FALSE;
+		}
+		Planned = TRUE;
+	}
+	
 	//Start SQL transaction (huge speedup!)
 //	sqlite3_exec(CURRDB, "BEGIN TRANSACTION", NULL, 0, NULL);
 	
@@ -1849,8 +2343,13 @@ BOOL Mod_Install(json_t *root, const char *path)
 		if(retval == FALSE || CURRERROR != errNOERR){
 			char *msg = NULL;
 			char *ID = JSON_GetStr(patchCurr, "ID");
-			asprintf(&msg, "Mod configuration error on patch #%lu\nID: %s", i + 1, ID);
-			AlertMsg(msg, "JSON error");
+			if(DRYRUN_FAILURES){
+				//Dry runs report failures instead of complaining
+				Mod_DryRunFail(ModUUID, ID, i);
+			} else {
+				asprintf(&msg, "Mod configuration error on patch #%lu\nID: %s", i + 1, ID);
+				AlertMsg(msg, "JSON error");
+			}
 			safe_free(ID);
 			safe_free(msg);
 			goto Mod_Install_Cleanup;
@@ -1859,6 +2358,17 @@ BOOL Mod_Install(json_t *root, const char *path)
 	
 Mod_Install_Cleanup:
 	safe_free(ModUUID);
+	
+	//Whatever got planned has Spaces and Revert rows, so write it even if a
+	//later patch failed
+	if(Planned){
+		enum errCode PatchError = CURRERROR;
+		if(!Mod_Install_WriteBack()){
+			retval = FALSE;
+		} else {
+			CURRERROR = PatchError;
+		}
+	}
 
 	if(CURRERROR != errCRIT_MALLOC){
 		Mod_AddToDB(root, path);
@@ -1866,8 +2376,10 @@ Mod_Install_Cleanup:
 	
 	if(CURRERROR != errNOERR){retval = FALSE;}
 	ProgDialog_Kill(ProgDialog);
+	Intent_End();
 	
 //	sqlite3_exec(CURRDB, "END TRANSACTION", NULL, 0, NULL);
+	TRACE_END("Mod_Install");
 	return retval;
 }
 
@@ -1905,6 +2417,16 @@ BOOL Mod_AddToDB(json_t *root, const char *path){
 	}
 	command = NULL;
 	
+	if(!Dep_AddMod(uuid, ver)){
+		safe_free(uuid);
+		safe_free(name);
+		safe_free(desc);
+		safe_free(auth);
+		safe_free(date);
+		safe_free(cat);
+		return FALSE;
+	}
+	
 	safe_free(uuid);
 	safe_free(name);
 	safe_free(desc);
@@ -1916,26 +2438,12 @@ BOOL Mod_AddToDB(json_t *root, const char *path){
 
 BOOL Mod_FindDep(const char *ModUUID)
 {
-	int modCount;
-	sqlite3_stmt *command;
-	const char *query = "SELECT EXISTS(SELECT * FROM Dependencies "
-		"JOIN Mods ON Dependencies.ParentUUID = Mods.UUID "
-		"WHERE Dependencies.ChildUUID = ?)";
-		
+	BOOL result;
 	CURRERROR = errNOERR;
-	if(SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_bind_text(command, 1, ModUUID, -1, SQLITE_STATIC)
-	) != 0){CURRERROR = errCRIT_DBASE; return FALSE;}
 	
-	modCount = SQL_GetNum(command);
+	result = Dep_HasDependents(ModUUID);
 	if(CURRERROR != errNOERR){return FALSE;}
-	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
-		CURRERROR = errCRIT_DBASE; return FALSE;
-	}
-	
-	return modCount != 0 ? TRUE : FALSE;
+	return result;
 }
 
 void Mod_FindDepAlert(const char *ModUUID){
@@ -2010,6 +2518,7 @@ BOOL Mod_Uninstall_Remove(const char *PatchUUID)
 	sqlite3_stmt *command;
 	const char *query = "DELETE FROM Spaces WHERE ID = ? AND Version = ?;";
 	CURRERROR = errNOERR;
+	Var_SpacesChanged();
 
 	if(SQL_HandleErrors(__FILE__, __LINE__, 
 		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
@@ -2056,6 +2565,89 @@ BOOL ModOp_UnNew(json_t *row)
 	return ModOp_UnSplit(row);
 }
 
+// Put back the original of a file replaced by ModOp_File
+BOOL ModOp_UnDelete(json_t *row)
+{
+	int File = JSON_GetInt(row, "File");
+	char *PatchID = JSON_GetStr(row, "PatchID");
+	char *FilePath = File_GetPath(File);
+	char *BakPath = NULL;
+	BOOL retval = FALSE;
+	
+	if(strndef(FilePath) || strndef(PatchID)){goto ModOp_UnDelete_Return;}
+	BakPath = ModOp_FileBackupPath(File, PatchID);
+	if(BakPath == NULL){goto ModOp_UnDelete_Return;}
+	
+	if(rename(BakPath, FilePath) != 0){
+		CURRERROR = errCRIT_FILESYS;
+		goto ModOp_UnDelete_Return;
+	}
+	retval = TRUE;
+	
+ModOp_UnDelete_Return:
+	safe_free(PatchID);
+	safe_free(FilePath);
+	safe_free(BakPath);
+	return retval;
+}
+
+// Write back the original bytes held by one Revert row
+static BOOL ModOp_UnRevert(json_t *row)
+{
+	int filehandle, offset = JSON_GetInt(row, "Start");
+	unsigned char *bytes;
+	struct JournalHeader header;
+	char *Hash = JSON_GetStr(row, "Hash");
+	char *FileName = File_GetName(JSON_GetuInt(row, "File"));
+	char *FilePath = NULL;
+	BOOL retval = FALSE;
+
+	// Open file handle
+	if(FileName == NULL){
+		CURRERROR = errCRIT_DBASE;
+		goto ModOp_UnRevert_Return;
+	}
+	asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, FileName);
+	filehandle = File_OpenSafe(FilePath, _O_BINARY|_O_RDWR);
+	if(filehandle == -1){goto ModOp_UnRevert_Return;}
+
+	bytes = Journal_Read(JSON_GetInt64(row, "Journal"), Hash, &header);
+	if(bytes == NULL){
+		close(filehandle);
+		goto ModOp_UnRevert_Return;
+	}
+	
+	// Restore the backup if it exists and the target file doesn't
+	// (Are we still doing this?)
+	{
+		char *BakPath = NULL;
+		asprintf(&BakPath, "%s/BACKUP/%s", CONFIG.CURRDIR, FileName);
+		
+		if(
+			File_Exists(BakPath, FALSE, FALSE) &&
+			!File_Exists(FilePath, FALSE, FALSE) &&
+			CURRERROR == errWNG_READONLY
+		){
+			File_MovTree(BakPath, FilePath);
+		}
+		
+		CURRERROR = errNOERR; //Reset error.
+		safe_free(BakPath);
+	}
+	
+	// Write back data
+	File_WriteBytes(filehandle, offset, bytes, header.Length);
+	safe_free(bytes);
+	close(filehandle);
+	retval = TRUE;
+
+ModOp_UnRevert_Return:
+	safe_free(Hash);
+	safe_free(FilePath);
+	safe_free(FileName);
+	return retval;
+}
+
 // Write back the old bytes and then remove the space.
 // Used for Add and Clear
 BOOL ModOp_UnSpace(json_t *input, BOOL Revert)
@@ -2066,98 +2658,52 @@ BOOL ModOp_UnSpace(json_t *input, BOOL Revert)
 	
 	if(Revert){
 		sqlite3_stmt *command;
-		const char *query1 = "SELECT OldBytes FROM Revert WHERE PatchUUID = ?";
-        const char *query3 = "SELECT Start FROM Revert WHERE PatchUUID = ?";
-		                     //"ORDER BY Version DESC LIMIT 1;";
+		const char *query1 = "SELECT Revert.File, Revert.Start, Revert.Hash, "
+		                     "RevertBlobs.Journal FROM Revert JOIN RevertBlobs "
+		                     "ON RevertBlobs.Hash = Revert.Hash WHERE PatchUUID = ? "
+		                     "ORDER BY Revert.RowID DESC";
 		const char *query2 = "DELETE FROM Revert WHERE PatchUUID = ?";
 		                     /*"AND Version = ( "
 		                         "SELECT MAX(Version) FROM Revert "
 		                         "WHERE PatchUUID = ? "
 		                     ");";*/
 
-		int filehandle, offset, datalen;
-		unsigned char *bytes;
-		char *FileName = File_GetName(JSON_GetuInt(input, "File"));
-		char *FilePath = NULL;
-
-		// Open file handle
-		if(FileName == NULL){
-			CURRERROR = errCRIT_DBASE;
-			return FALSE;
-		}
-		asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, FileName);
-		filehandle = File_OpenSafe(FilePath, _O_BINARY|_O_RDWR);
-
-		if(filehandle == -1){
-			return FALSE;
-		} // Failure.
+		json_t *out, *row;
+		size_t i;
 
-		// Retrieve raw bytes
+		// Find the old bytes in the journal
 		if(SQL_HandleErrors(__FILE__, __LINE__, 
 			sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
 		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
 			sqlite3_bind_text(command, 1, PatchUUID, -1, SQLITE_STATIC)
 		) != 0){
 			CURRERROR = errCRIT_DBASE;
+			safe_free(PatchUUID);
+			safe_free(SpaceUUID);
 			return FALSE;
 		}
 
-        bytes = SQL_GetBlob(command, &datalen);
-		
-		if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
-			CURRERROR = errCRIT_DBASE;
-			return FALSE;
-		}
-		
-		
-		// Retrive Start
-		
-        if(SQL_HandleErrors(__FILE__, __LINE__, 
-			sqlite3_prepare_v2(CURRDB, query3, -1, &command, NULL)
-		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-			sqlite3_bind_text(command, 1, PatchUUID, -1, SQLITE_STATIC)
-		) != 0){
-			CURRERROR = errCRIT_DBASE;
-			return FALSE;
-		}
-
-        offset = SQL_GetNum(command);
+		out = SQL_GetJSON(command);
 		
 		if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
 			CURRERROR = errCRIT_DBASE;
+			json_decref(out);
+			safe_free(PatchUUID);
+			safe_free(SpaceUUID);
 			return FALSE;
 		}
 
-		// Convert data string from hex to raw bytes
-		//bytes = Hex2Bytes(ByteStr, &datalen);
-		//safe_free(ByteStr);
-		
-		// Restore the backup if it exists and the target file doesn't
-		// (Are we still doing this?)
-		{
-			char *BakPath = NULL;
-			asprintf(&BakPath, "%s/BACKUP/%s", CONFIG.CURRDIR, FileName);
-			
-			if(
-				File_Exists(BakPath, FALSE, FALSE) &&
-				!File_Exists(FilePath, FALSE, FALSE) &&
-				CURRERROR == errWNG_READONLY
-			){
-				File_MovTree(BakPath, FilePath);
+		// Newest first, so where a patch's ranges overlap (a Move onto its
+		// own source) the oldest bytes are the ones left behind
+		json_array_foreach(out, i, row){
+			if(!ModOp_UnRevert(row)){
+				json_decref(out);
+				safe_free(PatchUUID);
+				safe_free(SpaceUUID);
+				return FALSE;
 			}
-			
-			CURRERROR = errNOERR; //Reset error.
-			safe_free(BakPath);
 		}
 		
-		// Write back data
-		File_WriteBytes(filehandle, offset, bytes, datalen);
-		
-		safe_free(bytes);
-		safe_free(FilePath);
-		safe_free(FileName);
-		close(filehandle);
-		
 		// Remove the old bytes from the newest version
 		if(SQL_HandleErrors(__FILE__, __LINE__, 
 			sqlite3_prepare_v2(CURRDB, query2, -1, &command, NULL)
@@ -2167,9 +2713,25 @@ BOOL ModOp_UnSpace(json_t *input, BOOL Revert)
 		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
 		) != 0){
 			CURRERROR = errCRIT_DBASE;
+			json_decref(out);
+			safe_free(PatchUUID);
+			safe_free(SpaceUUID);
 			return FALSE;
 		}
 		command = NULL;
+		
+		json_array_foreach(out, i, row){
+			char *Hash = JSON_GetStr(row, "Hash");
+			BOOL Released = Journal_Release(Hash);
+			safe_free(Hash);
+			if(!Released){
+				json_decref(out);
+				safe_free(PatchUUID);
+				safe_free(SpaceUUID);
+				return FALSE;
+			}
+		}
+		json_decref(out);
 	}
 	
 	// Remove the space
@@ -2244,6 +2806,14 @@ BOOL Mod_Uninstall_Space(json_t *row, char **LastPatch)
 			goto Mod_Uninstall_Space_Cleanup;
 		}
 
+	} else if (
+		strieq(SpaceType, "Delete")
+	){
+		if(!ModOp_UnDelete(row) || !ModOp_UnSplit(row)){
+			retval = FALSE;
+			goto Mod_Uninstall_Space_Cleanup;
+		}
+
 	} else if (
 		strieq(SpaceType, "Split")
 	){
@@ -2261,61 +2831,423 @@ Mod_Uninstall_Space_Cleanup:
 	return retval;
 }
 
-// Uninstall a single mod
+// One Revert row, as loaded for a batched uninstall
+struct RevertRow {
+	int File;
+	int Start;
+	int Len;
+	int Order;               //When the row was captured. Oldest bytes win.
+	unsigned char *Bytes;
+};
+
+// Sort by file, then offset
+static int Mod_RevertCompareStart(const void *a, const void *b)
+{
+	const struct RevertRow *lhs = a;
+	const struct RevertRow *rhs = b;
+	if(lhs->File != rhs->File){
+		return (lhs->File > rhs->File) - (lhs->File < rhs->File);
+	}
+	return (lhs->Start > rhs->Start) - (lhs->Start < rhs->Start);
+}
+
+// Sort newest first so older original bytes are copied in last
+static int Mod_RevertCompareOrder(const void *a, const void *b)
+{
+	const struct RevertRow *lhs = a;
+	const struct RevertRow *rhs = b;
+	return (lhs->Order < rhs->Order) - (lhs->Order > rhs->Order);
+}
+
+// Run a statement with the mod UUID as its only parameter
+static BOOL Mod_Uninstall_Exec(const char *query, const char *ModUUID)
+{
+	sqlite3_stmt *command;
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, ModUUID, -1, SQLITE_STATIC)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_Uninstall_GetReverts
+ *  Description:  Loads every Revert row belonging to a mod in one query, reading
+ *                the journal back to front, then sorts them by file and offset.
+ *                Files the mod created are skipped, as they're about to be deleted
+ *                anyways. Returns NULL if there are none.
+ * =====================================================================================
+ */
+static struct RevertRow * Mod_Uninstall_GetReverts(const char *ModUUID, size_t *Count)
+{
+	sqlite3_stmt *command;
+	const char *query =
+		"SELECT Revert.File, Revert.Start, Revert.Hash, RevertBlobs.Journal, "
+		"Revert.RowID AS Ord FROM Spaces "
+		"JOIN Revert ON Revert.PatchUUID = Spaces.PatchID "
+		"JOIN RevertBlobs ON RevertBlobs.Hash = Revert.Hash "
+		"WHERE Spaces.Mod = ?1 AND Revert.File != 0 AND "
+		"UPPER(Spaces.Type) IN ('ADD', 'CLEAR') AND Revert.File NOT IN ("
+			"SELECT File FROM Spaces WHERE Mod = ?1 AND UPPER(Type) = 'NEW'"
+		") GROUP BY Revert.RowID "
+		"ORDER BY RevertBlobs.Journal DESC;";
+	struct RevertRow *rows = NULL;
+	size_t cap = 0;
+	int result;
+	
+	*Count = 0;
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, ModUUID, -1, SQLITE_STATIC)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return NULL;
+	}
+	
+	while((result = sqlite3_step(command)) == SQLITE_ROW){
+		struct RevertRow *row;
+		struct JournalHeader header;
+		
+		if(*Count == cap){
+			struct RevertRow *rowsNew;
+			cap = cap ? cap * 2 : 16;
+			rowsNew = realloc(rows, cap * sizeof(struct RevertRow));
+			if(rowsNew == NULL){
+				CURRERROR = errCRIT_MALLOC;
+				break;
+			}
+			rows = rowsNew;
+		}
+		
+		row = &rows[*Count];
+		row->File = sqlite3_column_int(command, 0);
+		row->Start = sqlite3_column_int(command, 1);
+		row->Order = sqlite3_column_int(command, 4);
+		row->Bytes = Journal_Read(
+			sqlite3_column_int64(command, 3),
+			(const char *)sqlite3_column_text(command, 2), &header
+		);
+		if(row->Bytes == NULL){break;}
+		row->Len = header.Length;
+		(*Count)++;
+	}
+	
+	if(CURRERROR == errNOERR && result != SQLITE_DONE){
+		SQL_HandleErrors(__FILE__, __LINE__, result);
+		CURRERROR = errCRIT_DBASE;
+	}
+	sqlite3_finalize(command);
+	
+	if(CURRERROR != errNOERR){
+		size_t i;
+		for(i = 0; i < *Count; i++){
+			safe_free(rows[i].Bytes);
+		}
+		safe_free(rows);
+		*Count = 0;
+		return NULL;
+	}
+	
+	if(*Count > 1){
+		qsort(rows, *Count, sizeof(struct RevertRow), Mod_RevertCompareStart);
+	}
+	return rows;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_Uninstall_PlanReverts
+ *  Description:  Works out the writes that put back Revert rows that all belong to
+ *                one file, sorted by Start, and logs them. Rows that overlap or touch
+ *                are merged into one buffer. Where rows overlap the oldest patch wins,
+ *                since it's the one that saw the original bytes.
+ *                The file is left open in out->Handle for File_WriteBack, and the
+ *                log still has to be synced with Intent_Flush.
+ * =====================================================================================
+ */
+static BOOL Mod_Uninstall_PlanReverts(
+	struct RevertRow *rows, size_t count, struct WriteBackFile *out
+){
+	char *FileName = File_GetName(rows[0].File);
+	char *FilePath = NULL;
+	size_t i = 0;
+	
+	if(FileName == NULL){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, FileName);
+	out->Name = FileName;
+	
+	// Restore the backup if it exists and the target file doesn't
+	// (Are we still doing this?)
+	{
+		char *BakPath = NULL;
+		asprintf(&BakPath, "%s/BACKUP/%s", CONFIG.CURRDIR, FileName);
+		
+		if(
+			File_Exists(BakPath, FALSE, FALSE) &&
+			!File_Exists(FilePath, FALSE, FALSE) &&
+			CURRERROR == errWNG_READONLY
+		){
+			File_MovTree(BakPath, FilePath);
+		}
+		
+		CURRERROR = errNOERR; //Reset error.
+		safe_free(BakPath);
+	}
+	
+	// Worst case is one write per row
+	out->Writes = calloc(count, sizeof(struct WriteBackWrite));
+	out->Handle = File_OpenSafe(FilePath, _O_BINARY|_O_RDWR);
+	if(out->Writes == NULL || out->Handle == -1){
+		if(out->Writes == NULL){CURRERROR = errCRIT_MALLOC;}
+		safe_free(FilePath);
+		return FALSE;
+	}
+	
+	while(i < count){
+		size_t j, runEnd = i + 1;
+		int start = rows[i].Start;
+		int end = rows[i].Start + rows[i].Len;
+		struct WriteBackWrite *curr = &out->Writes[out->WriteCount];
+		
+		// Find every row that overlaps or touches this one
+		while(runEnd < count && rows[runEnd].Start <= end){
+			end = MAX(end, rows[runEnd].Start + rows[runEnd].Len);
+			runEnd++;
+		}
+		
+		curr->Offset = start;
+		curr->Len = end - start;
+		curr->Bytes = malloc(curr->Len + 1);
+		curr->Seq = Intent_WriteBatch(out->Handle, FilePath, start, curr->Len);
+		if(curr->Bytes == NULL || curr->Seq == -1){
+			if(curr->Bytes == NULL){CURRERROR = errCRIT_MALLOC;}
+			safe_free(curr->Bytes);
+			safe_free(FilePath);
+			return FALSE;
+		}
+		out->WriteCount++;
+		
+		qsort(&rows[i], runEnd - i, sizeof(struct RevertRow), Mod_RevertCompareOrder);
+		for(j = i; j < runEnd; j++){
+			memcpy(curr->Bytes + (rows[j].Start - start), rows[j].Bytes, rows[j].Len);
+		}
+		i = runEnd;
+	}
+	
+	safe_free(FilePath);
+	return TRUE;
+}
+
+// Uninstall a single mod
 BOOL Mod_Uninstall(const char *ModUUID)
 {
 	BOOL retval = TRUE;
-	size_t i;
-	json_t *out, *row;
-	sqlite3_stmt *command;
-	const char *query = "SELECT * FROM Spaces WHERE Mod = ? "
-	                    "ORDER BY ROWID DESC";
-	char *LastPatch = NULL;
+	size_t i, RevertCount = 0;
+	struct RevertRow *Reverts = NULL;
+	json_t *NewFiles = NULL, *OldFiles = NULL, *row;
 	
 	// Define progress dialog (handle type is interface-specific)
 	ProgDialog_Handle ProgDialog;
 	
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("Mod_Uninstall", ModUUID);
 	
 	chdir(CONFIG.CURRDIR); // In case path was changed during installation or w/e.
 	
 	//Check for dependencies
 	if(Mod_FindDep(ModUUID) == TRUE){
 		Mod_FindDepAlert(ModUUID);
+		TRACE_END("Mod_Uninstall");
 		return FALSE;
 	};
 
-	//Get the spaces created by the mod
-	if (SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_bind_text(command, 1, ModUUID, -1, SQLITE_STATIC)
-	) != 0) {
-		CURRERROR = errCRIT_DBASE;
+	//Get the old bytes to write back
+	Reverts = Mod_Uninstall_GetReverts(ModUUID, &RevertCount);
+	if(CURRERROR != errNOERR){
+		TRACE_END("Mod_Uninstall");
 		return FALSE;
 	}
-
-	out = SQL_GetJSON(command);
-	sqlite3_finalize(command);
+	
+	//Get the files created by the mod
+	{
+		sqlite3_stmt *command;
+		const char *query = "SELECT DISTINCT File FROM Spaces "
+		                    "WHERE Mod = ? AND UPPER(Type) = 'NEW';";
+		if (SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_bind_text(command, 1, ModUUID, -1, SQLITE_STATIC)
+		) != 0) {
+			CURRERROR = errCRIT_DBASE;
+			for(i = 0; i < RevertCount; i++){
+				safe_free(Reverts[i].Bytes);
+			}
+			safe_free(Reverts);
+			TRACE_END("Mod_Uninstall");
+			return FALSE;
+		}
+		NewFiles = SQL_GetJSON(command);
+		sqlite3_finalize(command);
+	}
+	
+	//Get the files replaced by the mod
+	{
+		sqlite3_stmt *command;
+		const char *query = "SELECT File, PatchID FROM Spaces "
+		                    "WHERE Mod = ? AND UPPER(Type) = 'DELETE' "
+		                    "ORDER BY RowID DESC;";
+		if (SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+			sqlite3_bind_text(command, 1, ModUUID, -1, SQLITE_STATIC)
+		) != 0) {
+			CURRERROR = errCRIT_DBASE;
+			for(i = 0; i < RevertCount; i++){
+				safe_free(Reverts[i].Bytes);
+			}
+			safe_free(Reverts);
+			json_decref(NewFiles);
+			TRACE_END("Mod_Uninstall");
+			return FALSE;
+		}
+		OldFiles = SQL_GetJSON(command);
+		sqlite3_finalize(command);
+	}
 
 	// Init progress box
-	ProgDialog = ProgDialog_Init(json_array_size(out), "Uninstalling Mod...");
+	ProgDialog = ProgDialog_Init(
+		RevertCount + json_array_size(NewFiles) + json_array_size(OldFiles),
+		"Uninstalling Mod..."
+	);
 	
-	// Parse rows
-	json_array_foreach(out, i, row){
-
-		if(!Mod_Uninstall_Space(row, &LastPatch)){
-			goto Mod_Uninstall_Cleanup;
+	// From here on, a crash means finishing the uninstall on next start
+	if(!Intent_Begin("Uninstall", ModUUID)){
+		for(i = 0; i < RevertCount; i++){
+			safe_free(Reverts[i].Bytes);
 		}
+		safe_free(Reverts);
+		json_decref(NewFiles);
+		json_decref(OldFiles);
+		ProgDialog_Kill(ProgDialog);
+		TRACE_END("Mod_Uninstall");
+		return FALSE;
+	}
+	
+	// Work out the old bytes to write back one file at a time, then write
+	// all the files at once
+	{
+		struct WriteBackFile *Files = NULL;
+		size_t FileCount = 0;
+		BOOL Written = FALSE;
+		
+		if(RevertCount > 0){
+			//Worst case is one file per row
+			Files = calloc(RevertCount, sizeof(struct WriteBackFile));
+			if(Files == NULL){
+				CURRERROR = errCRIT_MALLOC;
+				retval = FALSE;
+			}
+		}
+		
+		i = 0;
+		while(retval && i < RevertCount){
+			size_t fileEnd = i + 1;
+			while(fileEnd < RevertCount && Reverts[fileEnd].File == Reverts[i].File){
+				fileEnd++;
+			}
+			
+			Files[FileCount].Handle = -1;
+			if(!Mod_Uninstall_PlanReverts(&Reverts[i], fileEnd - i, &Files[FileCount++])){
+				retval = FALSE;
+			}
+			i = fileEnd;
+		}
+		
+		if(retval && !Intent_Flush()){retval = FALSE;}
+		if(retval){
+			Written = TRUE;
+			if(!File_WriteBack(Files, FileCount)){
+				Mod_WriteBackAlert(Files, FileCount,
+					"The original contents of these files couldn't be written back:\n",
+					"Uninstall Error"
+				);
+				retval = FALSE;
+			}
+			ProgDialog_Update(ProgDialog, RevertCount);
+		}
+		
+		for(i = 0; i < FileCount; i++){
+			Mod_FreeWriteBack(&Files[i], Written);
+		}
+		safe_free(Files);
+	}
+	
+	for(i = 0; i < RevertCount; i++){
+		safe_free(Reverts[i].Bytes);
+	}
+	safe_free(Reverts);
+	
+	// Delete created files
+	json_array_foreach(NewFiles, i, row){
+		char *FilePath;
+		
+		if(retval == FALSE){break;}
+		FilePath = File_GetPath(JSON_GetInt(row, "File"));
+		if(strndef(FilePath)){
+			retval = FALSE;
+			break;
+		}
+		File_Delete(FilePath); // DANGEROUS!
+		safe_free(FilePath);
 		ProgDialog_Update(ProgDialog, 1);
 	}
-
-	json_decref(out);
+	json_decref(NewFiles);
+	
+	// Put replaced files back
+	json_array_foreach(OldFiles, i, row){
+		if(retval == FALSE){break;}
+		retval = ModOp_UnDelete(row);
+		ProgDialog_Update(ProgDialog, 1);
+	}
+	json_decref(OldFiles);
 
 	if(retval == FALSE){
 		goto Mod_Uninstall_Cleanup;
 	}
 	
+	// Drop the mod's spaces and revert entries. Before deleting, unclaim the
+	// previous version of every space the mod re-versioned.
+	Var_SpacesChanged();
+	if(
+		!Mod_Uninstall_Exec(
+			"UPDATE Spaces SET UsedBy = NULL WHERE EXISTS ("
+				"SELECT * FROM Spaces AS ModSpaces WHERE ModSpaces.Mod = ? AND "
+				"ModSpaces.ID = Spaces.ID AND ModSpaces.Version = Spaces.Version + 1"
+			");", ModUUID
+		) || !Journal_ReleaseMod(ModUUID) || !Mod_Uninstall_Exec(
+			"DELETE FROM Revert WHERE PatchUUID IN ("
+				"SELECT PatchID FROM Spaces WHERE Mod = ?"
+			");", ModUUID
+		) || !Mod_Uninstall_Exec(
+			"DELETE FROM Spaces WHERE Mod = ?;", ModUUID
+		) || !Mod_Uninstall_Exec(
+			"DELETE FROM VarRepatchPatch WHERE Mod = ?;", ModUUID
+		)
+	){
+		retval = FALSE;
+		goto Mod_Uninstall_Cleanup;
+	}
+	
 	// Mod has now been uninstalled.
 	// Unmark used spaces
 	{
@@ -2370,12 +3302,27 @@ BOOL Mod_Uninstall(const char *ModUUID)
 		command = NULL;
 	}
 	
+	Dep_RemoveMod(ModUUID);
+	
 	// Remove mod variables
 	Var_ClearEntry(ModUUID);
 	
+	// Reclaim journal space if enough of it is now unused. The mod is gone
+	// either way; a journal that stays big just gets another go next time.
+	if(!Journal_Compact(FALSE)){
+		AlertMsg(
+			"The mod was uninstalled, but the undo journal couldn't be\n"
+			"compacted. It will be tried again on the next uninstall.",
+			"Uninstall Warning"
+		);
+		CURRERROR = errNOERR;
+	}
+	
 Mod_Uninstall_Cleanup:
 	// Kill progress box
 	ProgDialog_Kill(ProgDialog);
+	Intent_End();
+	TRACE_END("Mod_Uninstall");
 	return retval;
 }
 
@@ -2541,6 +3488,21 @@ BOOL Mod_InstallSeries(const char *ModList)
 	const char *modPath = ModList;
 	BOOL retval = TRUE;
 	
+	// Turn away a stack that overwrites itself before touching anything
+	{
+		json_t *report = Mod_PreflightSeries(ModList);
+		if(report == NULL){
+			return FALSE;
+		}
+		if(!json_is_true(json_object_get(report, "Result"))){
+			Mod_PreflightAlert(report);
+			json_decref(report);
+			CURRERROR = errWNG_MODCFG;
+			return FALSE;
+		}
+		json_decref(report);
+	}
+	
 	while(*modPath != '\0' && retval == TRUE){
 		//For each string...
 		char *jsonPath = NULL;
@@ -2603,3 +3565,163 @@ BOOL Mod_Reinstall(const char *ModUUID)
 	safe_free(retList);
 	return TRUE;
 }
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_DryRun
+ *  Description:  Runs Mod_Install (or every mod in a double-null-terminated list)
+ *                inside a throwaway SQL savepoint with all file writes sent to an
+ *                in-memory overlay. Nothing on disk changes. Returns a report:
+ *                    Result:       TRUE if everything would install
+ *                    Allocations:  Spaces rows the install would create
+ *                    Files:        Per-file writes, bytes touched, create/delete
+ *                    BytesTouched: Total distinct bytes written
+ *                    Failures:     Mod, patch ID/index and error code per failure
+ * =====================================================================================
+ */
+static json_t * Mod_DryRun(json_t *root, const char *path, const char *ModList)
+{
+	json_t *report, *files, *file;
+	sqlite3_stmt *command;
+	const char *query1 = "SELECT IFNULL(MAX(RowID), 0) FROM Spaces;";
+	const char *query2 = "SELECT ID, Type, File, Mod, PatchID, Start, End, Len "
+	                     "FROM Spaces WHERE RowID > ? ORDER BY RowID;";
+	int LastRow;
+	int64_t JournalEnd;
+	size_t i;
+	json_int_t BytesTouched = 0;
+	BOOL retval = TRUE;
+	
+	CURRERROR = errNOERR;
+	
+	//Nested dry runs aren't a thing
+	if(DRYRUN_FAILURES != NULL){
+		CURRERROR = errCRIT_FUNCT;
+		return NULL;
+	}
+	
+	//Remember where the space table ends so new allocations can be listed
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
+	) != 0){CURRERROR = errCRIT_DBASE; return NULL;}
+	LastRow = SQL_GetNum(command);
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
+		CURRERROR = errCRIT_DBASE; return NULL;
+	}
+	command = NULL;
+	
+	//Same for the undo journal, which isn't covered by the savepoint
+	JournalEnd = Journal_Size();
+	if(JournalEnd == -1){return NULL;}
+	
+	//Everything from here on is rolled back. Keep the changes in memory.
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"PRAGMA cache_spill = OFF; SAVEPOINT DryRun;", NULL, NULL, NULL)
+	) != 0){CURRERROR = errCRIT_DBASE; return NULL;}
+	
+	if(!File_OverlayBegin()){
+		sqlite3_exec(CURRDB, "ROLLBACK TO DryRun; RELEASE DryRun; "
+			"PRAGMA cache_spill = ON;", NULL, NULL, NULL);
+		Dep_Invalidate();
+		Var_Invalidate();
+		Journal_Truncate(JournalEnd);
+		return NULL;
+	}
+	DRYRUN_FAILURES = json_array();
+	
+	if(ModList == NULL){
+		//Single mod
+		if(!Mod_CheckDep(root)){
+			char *UUID = JSON_GetStr(root, "UUID");
+			Mod_DryRunFail(UUID, NULL, -1);
+			safe_free(UUID);
+			retval = FALSE;
+		} else {
+			retval = Mod_Install(root, path);
+		}
+	} else {
+		//Same walk as Mod_InstallSeries
+		const char *modPath = ModList;
+		while(*modPath != '\0' && retval == TRUE){
+			char *jsonPath = NULL;
+			json_t *modRoot;
+			
+			asprintf(&jsonPath, "%s/%s", modPath, "info.json");
+			modRoot = JSON_Load(jsonPath);
+			safe_free(jsonPath);
+			
+			if(!modRoot){
+				CURRERROR = errWNG_MODCFG;
+				Mod_DryRunFail(modPath, NULL, -1);
+				retval = FALSE;
+			} else if(!Mod_CheckDep(modRoot)){
+				char *UUID = JSON_GetStr(modRoot, "UUID");
+				Mod_DryRunFail(UUID, NULL, -1);
+				safe_free(UUID);
+				retval = FALSE;
+			} else {
+				retval = Mod_Install(modRoot, modPath);
+			}
+			
+			json_decref(modRoot);
+			modPath += strlen(modPath) + 1;
+		}
+	}
+	
+	//Build the report before throwing everything away
+	report = json_object();
+	
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query2, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_int(command, 1, LastRow)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+	} else {
+		json_object_set_new(report, "Allocations", SQL_GetJSON(command));
+		sqlite3_finalize(command);
+		command = NULL;
+	}
+	
+	files = File_OverlayReport();
+	json_array_foreach(files, i, file){
+		BytesTouched += json_integer_value(json_object_get(file, "BytesTouched"));
+	}
+	json_object_set_new(report, "Files", files);
+	json_object_set_new(report, "BytesTouched", json_integer(BytesTouched));
+	
+	retval = retval && json_array_size(DRYRUN_FAILURES) == 0;
+	json_object_set_new(report, "Result", json_boolean(retval));
+	json_object_set_new(report, "Failures", DRYRUN_FAILURES);
+	DRYRUN_FAILURES = NULL;
+	
+	//Undo
+	File_OverlayEnd();
+	Dep_Invalidate();
+	Var_Invalidate();
+	Journal_Truncate(JournalEnd);
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"ROLLBACK TO DryRun; RELEASE DryRun; PRAGMA cache_spill = ON;",
+		NULL, NULL, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		json_decref(report);
+		return NULL;
+	}
+	
+	//Failures are in the report; they aren't errors of the dry run itself
+	CURRERROR = errNOERR;
+	return report;
+}
+
+// Simulate installing a single mod. See Mod_DryRun.
+json_t * Mod_InstallDryRun(json_t *root, const char *path)
+{
+	return Mod_DryRun(root, path, NULL);
+}
+
+// Simulate installing every mod in the given double-null-terminated list.
+json_t * Mod_InstallSeriesDryRun(const char *ModList)
+{
+	return Mod_DryRun(NULL, NULL, ModList);
+}
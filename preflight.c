@@ -0,0 +1,524 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+
+// Conflict check for a whole stack of mods, run before anything is written.
+//
+// Every patch that names a fixed byte range is collected, sorted by file and
+// start, and swept once. Ranges come in two kinds:
+//     Claims: Repl and Clear targets, and the source a Move clears
+//     Fills:  Copy, Move and Reloc targets, which land in cleared space
+// Two claims or two fills from different mods overlapping is a conflict. A
+// fill inside another mod's claim is fine; that's what clearing space is for.
+// Overlaps within one mod are the mod's own business.
+//
+// Add and Clear spaces of mods that are already installed are claims too, so
+// a new stack can't land on top of them. Reinstalling a mod doesn't conflict
+// with its own old copy.
+//
+// Ranges that depend on something not known yet (a variable or patch from a
+// mod that isn't installed) can't be checked and are listed as unresolved.
+
+enum PreflightKind {PREFLIGHT_CLAIM, PREFLIGHT_FILL, PREFLIGHT_KINDS};
+
+struct PreflightRange {
+	char *File;
+	int Start;
+	int End;                      //Exclusive
+	enum PreflightKind Kind;
+	const char *Mod;              //Owned by Preflight.Mods
+	char *PatchID;
+	long PatchNo;
+};
+
+struct Preflight {
+	struct PreflightRange *Ranges;
+	size_t Count;
+	size_t Alloc;
+	char **Mods;
+	size_t ModCount;
+	json_t *Unresolved;
+};
+
+// A patch as it appears in the report
+static json_t * Preflight_PatchJSON(const char *Mod, const char *PatchID, long PatchNo)
+{
+	json_t *row = json_object();
+	json_object_set_new(row, "Mod", json_string(Mod ? Mod : ""));
+	json_object_set_new(row, "Patch", json_string(PatchID ? PatchID : ""));
+	json_object_set_new(row, "PatchNo", json_integer(PatchNo));
+	return row;
+}
+
+// TRUE if every variable the expression reads already exists. Missing ones
+// would silently evaluate to 0.
+static BOOL Preflight_VarsKnown(const char *Eq)
+{
+	const char *pch = strstr(Eq, "$ ");
+
+	while(pch != NULL){
+		const char *varname = pch + strlen("$ ");
+		size_t len = strcspn(varname, " ");
+		char *Var = calloc(len + 1, sizeof(char));
+		BOOL known;
+
+		if(Var == NULL){return FALSE;}
+		strncpy(Var, varname, len);
+		known = Var_Exists(Var);
+		safe_free(Var);
+		if(!known){return FALSE;}
+
+		pch = strstr(varname, "$ ");
+	}
+	return TRUE;
+}
+
+// Work out [Start, End) for a patch's range. Same rules as
+// Mod_GetPatchInfo_SetRange, minus anything that touches the database.
+// Returns FALSE if it can't be known before install.
+static BOOL Preflight_Range(
+	const char *StartEq, const char *EndEq, const char *FilePath,
+	const char *FileType, const char *ModPath, int *Start, int *End
+){
+	struct EqBatchItem range[2];
+	memset(range, 0, sizeof(range));
+
+	if(strndef(StartEq)){
+		// Whole file
+		if(!File_Exists(FilePath, FALSE, TRUE)){return FALSE;}
+		*Start = 0;
+		*End = filesize(FilePath);
+		return TRUE;
+	}
+
+	// Start with no End is a reference to another patch
+	if(strndef(EndEq)){return FALSE;}
+
+	if(!Preflight_VarsKnown(StartEq) || !Preflight_VarsKnown(EndEq)){
+		return FALSE;
+	}
+
+	range[0].Eq = StartEq;
+	range[1].Eq = EndEq;
+	range[0].ModPath = range[1].ModPath = ModPath;
+	range[0].IsFileOffset = range[1].IsFileOffset = TRUE;
+	if(!Eq_ParseBatch(range, 2)){
+		CURRERROR = errNOERR;
+		return FALSE;
+	}
+	*Start = range[0].uInt;
+	*End = range[1].uInt;
+
+	if(streq(FileType, "PE")){
+		*Start = File_PEToOff(FilePath, *Start);
+		*End = File_PEToOff(FilePath, *End);
+	}
+	return TRUE;
+}
+
+static BOOL Preflight_AddRange(
+	struct Preflight *pf, const char *File, int Start, int End,
+	enum PreflightKind Kind, const char *Mod, const char *PatchID, long PatchNo
+){
+	struct PreflightRange *range;
+
+	// Nothing written, nothing to collide with
+	if(End <= Start){return TRUE;}
+
+	if(pf->Count == pf->Alloc){
+		size_t alloc = pf->Alloc ? pf->Alloc * 2 : 64;
+		struct PreflightRange *grown = realloc(pf->Ranges, alloc * sizeof(*grown));
+		if(grown == NULL){
+			CURRERROR = errCRIT_MALLOC;
+			return FALSE;
+		}
+		pf->Ranges = grown;
+		pf->Alloc = alloc;
+	}
+
+	range = &pf->Ranges[pf->Count];
+	range->File = strdup(File);
+	range->PatchID = strdup(PatchID);
+	if(range->File == NULL || range->PatchID == NULL){
+		safe_free(range->File);
+		safe_free(range->PatchID);
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	range->Start = Start;
+	range->End = End;
+	range->Kind = Kind;
+	range->Mod = Mod;
+	range->PatchNo = PatchNo;
+	pf->Count++;
+	return TRUE;
+}
+
+// Collect the fixed ranges of one patch
+static BOOL Preflight_AddPatch(
+	struct Preflight *pf, json_t *patch, const char *ModPath,
+	const char *ModUUID, size_t PatchNo
+){
+	char *Mode = JSON_GetStr(patch, "Mode");
+	char *FileName = JSON_GetStr(patch, "File");
+	char *FileType = JSON_GetStr(patch, "FileType");
+	char *StartEq = JSON_GetStr(patch, "Start");
+	char *EndEq = JSON_GetStr(patch, "End");
+	char *PatchID = JSON_GetStr(patch, "ID");
+	char *FilePath = NULL;
+	BOOL IsClaim, IsFill;
+	BOOL retval = TRUE;
+	int Start, End;
+
+	IsClaim = strieq(Mode, "Repl") || strieq(Mode, "Clear");
+	IsFill = strieq(Mode, "Copy") || strieq(Mode, "Move") || strieq(Mode, "Reloc");
+	if((!IsClaim && !IsFill) || strndef(FileName)){
+		goto Preflight_AddPatch_Return;
+	}
+
+	if(strndef(PatchID)){
+		safe_free(PatchID);
+		asprintf(&PatchID, "Patch-%lu.%s", (unsigned long)PatchNo, ModUUID);
+	}
+	asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, FileName);
+
+	if(!Preflight_Range(StartEq, EndEq, FilePath, FileType, ModPath, &Start, &End)){
+		json_array_append_new(pf->Unresolved,
+			Preflight_PatchJSON(ModUUID, PatchID, PatchNo));
+		goto Preflight_AddPatch_Return;
+	}
+	retval = Preflight_AddRange(pf, FileName, Start, End,
+		IsClaim ? PREFLIGHT_CLAIM : PREFLIGHT_FILL, ModUUID, PatchID, PatchNo);
+
+	// A Move also clears its source (if it's in the game's files)
+	if(retval && strieq(Mode, "Move")){
+		char *SrcFile = JSON_GetStr(patch, "SrcFile");
+		char *SrcLoc = JSON_GetStr(patch, "SrcFileLoc");
+		char *SrcType = JSON_GetStr(patch, "SrcFileType");
+		char *SrcStartEq = JSON_GetStr(patch, "SrcStart");
+		char *SrcEndEq = JSON_GetStr(patch, "SrcEnd");
+		char *SrcPath = NULL;
+
+		if(strndef(SrcFile)){
+			safe_free(SrcFile);
+			SrcFile = strdup(FileName);
+		}
+		asprintf(&SrcPath, "%s/%s", CONFIG.CURRDIR, SrcFile);
+
+		if(!strieq(SrcLoc, "Mod")){
+			if(Preflight_Range(SrcStartEq, SrcEndEq, SrcPath, SrcType, ModPath, &Start, &End)){
+				retval = Preflight_AddRange(pf, SrcFile, Start, End,
+					PREFLIGHT_CLAIM, ModUUID, PatchID, PatchNo);
+			} else {
+				json_array_append_new(pf->Unresolved,
+					Preflight_PatchJSON(ModUUID, PatchID, PatchNo));
+			}
+		}
+
+		safe_free(SrcFile);
+		safe_free(SrcLoc);
+		safe_free(SrcType);
+		safe_free(SrcStartEq);
+		safe_free(SrcEndEq);
+		safe_free(SrcPath);
+	}
+
+Preflight_AddPatch_Return:
+	safe_free(Mode);
+	safe_free(FileName);
+	safe_free(FileType);
+	safe_free(StartEq);
+	safe_free(EndEq);
+	safe_free(PatchID);
+	safe_free(FilePath);
+	return retval;
+}
+
+// Claim everything installed mods already wrote or cleared. Only the latest
+// version of a patch's own space counts; the leftovers of a split keep the
+// splitting mod's name but aren't its data. PatchNo is -1 since the patch
+// isn't part of the list being checked.
+static BOOL Preflight_AddInstalled(struct Preflight *pf)
+{
+	sqlite3_stmt *command;
+	const char *query =
+		"SELECT Spaces.Mod, Files.Path, Spaces.Start, Spaces.End, "
+		"IFNULL(Spaces.PatchID, Spaces.ID) FROM Spaces "
+		"JOIN Files ON Files.ID = Spaces.File "
+		"WHERE Spaces.Mod != 'MODLOADER@invisibleup' "
+		"AND UPPER(Spaces.Type) IN ('ADD', 'CLEAR') "
+		"AND Spaces.ID = Spaces.PatchID AND Spaces.Version = "
+		"(SELECT MAX(Version) FROM Spaces AS Latest WHERE Latest.ID = Spaces.ID) "
+		"ORDER BY Spaces.Mod;";
+	BOOL retval = TRUE;
+	int result;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+
+	while((result = sqlite3_step(command)) == SQLITE_ROW){
+		const char *Mod = (const char *)sqlite3_column_text(command, 0);
+
+		// One copy of each mod's UUID, shared by all of its ranges
+		if(pf->ModCount == 0 || !streq(pf->Mods[pf->ModCount - 1], Mod)){
+			char **grown = realloc(pf->Mods, (pf->ModCount + 1) * sizeof(char *));
+			if(grown == NULL){
+				CURRERROR = errCRIT_MALLOC;
+				retval = FALSE;
+				break;
+			}
+			pf->Mods = grown;
+			pf->Mods[pf->ModCount] = strdup(Mod);
+			if(pf->Mods[pf->ModCount] == NULL){
+				CURRERROR = errCRIT_MALLOC;
+				retval = FALSE;
+				break;
+			}
+			pf->ModCount++;
+		}
+
+		retval = Preflight_AddRange(pf,
+			(const char *)sqlite3_column_text(command, 1),
+			sqlite3_column_int(command, 2), sqlite3_column_int(command, 3),
+			PREFLIGHT_CLAIM, pf->Mods[pf->ModCount - 1],
+			(const char *)sqlite3_column_text(command, 4), -1
+		);
+		if(!retval){break;}
+	}
+	if(retval && result != SQLITE_DONE){
+		SQL_HandleErrors(__FILE__, __LINE__, result);
+		CURRERROR = errCRIT_DBASE;
+		retval = FALSE;
+	}
+	sqlite3_finalize(command);
+	return retval;
+}
+
+static int Preflight_Compare(const void *a, const void *b)
+{
+	const struct PreflightRange *lhs = a, *rhs = b;
+	int cmp = strcmp(lhs->File, rhs->File);
+	if(cmp != 0){return cmp;}
+	if(lhs->Start != rhs->Start){return (lhs->Start > rhs->Start) - (lhs->Start < rhs->Start);}
+	return (lhs->End > rhs->End) - (lhs->End < rhs->End);
+}
+
+// Sort, then sweep each file from low to high addresses keeping the ranges
+// still open. Every open range of the same kind overlaps the new one.
+static BOOL Preflight_Sweep(struct Preflight *pf, json_t *Conflicts)
+{
+	size_t *active[PREFLIGHT_KINDS];
+	size_t activeCount[PREFLIGHT_KINDS] = {0};
+	size_t i, j, k;
+
+	qsort(pf->Ranges, pf->Count, sizeof(struct PreflightRange), Preflight_Compare);
+
+	for(k = 0; k < PREFLIGHT_KINDS; k++){
+		active[k] = malloc((pf->Count + 1) * sizeof(size_t));
+		if(active[k] == NULL){
+			while(k > 0){k--; safe_free(active[k]);}
+			CURRERROR = errCRIT_MALLOC;
+			return FALSE;
+		}
+	}
+
+	for(i = 0; i < pf->Count; i++){
+		struct PreflightRange *curr = &pf->Ranges[i];
+		size_t *open = active[curr->Kind];
+		size_t *openCount = &activeCount[curr->Kind];
+
+		// New file; nothing carries over
+		if(i > 0 && strcmp(curr->File, pf->Ranges[i-1].File) != 0){
+			for(k = 0; k < PREFLIGHT_KINDS; k++){activeCount[k] = 0;}
+		}
+
+		// Drop ranges that ended before this one starts
+		for(j = 0; j < *openCount;){
+			if(pf->Ranges[open[j]].End <= curr->Start){
+				open[j] = open[--(*openCount)];
+			} else {
+				j++;
+			}
+		}
+
+		// Whatever's left overlaps
+		for(j = 0; j < *openCount; j++){
+			struct PreflightRange *prev = &pf->Ranges[open[j]];
+			json_t *row, *patches;
+
+			if(streq(prev->Mod, curr->Mod)){continue;}
+
+			row = json_object();
+			patches = json_array();
+			json_array_append_new(patches,
+				Preflight_PatchJSON(prev->Mod, prev->PatchID, prev->PatchNo));
+			json_array_append_new(patches,
+				Preflight_PatchJSON(curr->Mod, curr->PatchID, curr->PatchNo));
+			json_object_set_new(row, "File", json_string(curr->File));
+			json_object_set_new(row, "Start", json_integer(curr->Start));
+			json_object_set_new(row, "End", json_integer(MIN(prev->End, curr->End)));
+			json_object_set_new(row, "Patches", patches);
+			json_array_append_new(Conflicts, row);
+		}
+
+		open[(*openCount)++] = i;
+	}
+
+	for(k = 0; k < PREFLIGHT_KINDS; k++){
+		safe_free(active[k]);
+	}
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_PreflightSeries
+ *  Description:  Checks every mod in a double-null-terminated list of mod
+ *                directories for patches that would overwrite each other or
+ *                what installed mods already wrote or cleared. Reads the mods'
+ *                info.json and the Spaces table; nothing is written. Returns a
+ *                report:
+ *                    Result:     TRUE if no conflicts were found
+ *                    Conflicts:  File, overlapping Start/End and the two patches
+ *                                (Mod, Patch ID, PatchNo) per conflict; an
+ *                                installed patch has PatchNo -1
+ *                    Unresolved: Patches whose range isn't known until install
+ *                Returns NULL on a critical error.
+ * =====================================================================================
+ */
+json_t * Mod_PreflightSeries(const char *ModList)
+{
+	struct Preflight pf = {0};
+	const char *modPath = ModList;
+	json_t *report = NULL, *Conflicts;
+	BOOL retval = TRUE;
+	size_t i;
+
+	CURRERROR = errNOERR;
+	TRACE_BEGIN("Mod_PreflightSeries", NULL);
+	pf.Unresolved = json_array();
+	Conflicts = json_array();
+
+	// What's already installed has to be checked against too
+	retval = Preflight_AddInstalled(&pf);
+
+	while(retval && *modPath != '\0'){
+		char *jsonPath = NULL;
+		json_t *root, *patches, *patch;
+		char *UUID, **grown;
+
+		asprintf(&jsonPath, "%s/%s", modPath, "info.json");
+		root = JSON_Load(jsonPath);
+		safe_free(jsonPath);
+
+		UUID = JSON_GetStr(root, "UUID");
+		if(root == NULL || UUID == NULL){
+			// Mod_Install will complain about this one properly
+			json_decref(root);
+			modPath += strlen(modPath) + 1;
+			continue;
+		}
+
+		grown = realloc(pf.Mods, (pf.ModCount + 1) * sizeof(char *));
+		if(grown == NULL){
+			safe_free(UUID);
+			json_decref(root);
+			CURRERROR = errCRIT_MALLOC;
+			retval = FALSE;
+			break;
+		}
+		pf.Mods = grown;
+		pf.Mods[pf.ModCount++] = UUID;
+
+		patches = json_object_get(root, "patches");
+		json_array_foreach(patches, i, patch){
+			if(!Preflight_AddPatch(&pf, patch, modPath, UUID, i)){
+				retval = FALSE;
+				break;
+			}
+		}
+
+		json_decref(root);
+		modPath += strlen(modPath) + 1;
+	}
+
+	if(retval){
+		retval = Preflight_Sweep(&pf, Conflicts);
+	}
+
+	if(retval){
+		report = json_object();
+		json_object_set_new(report, "Result",
+			json_boolean(json_array_size(Conflicts) == 0));
+		json_object_set(report, "Conflicts", Conflicts);
+		json_object_set(report, "Unresolved", pf.Unresolved);
+	}
+
+	json_decref(Conflicts);
+	json_decref(pf.Unresolved);
+	for(i = 0; i < pf.Count; i++){
+		safe_free(pf.Ranges[i].File);
+		safe_free(pf.Ranges[i].PatchID);
+	}
+	safe_free(pf.Ranges);
+	for(i = 0; i < pf.ModCount; i++){
+		safe_free(pf.Mods[i]);
+	}
+	safe_free(pf.Mods);
+
+	TRACE_END("Mod_PreflightSeries");
+	return report;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_PreflightAlert
+ *  Description:  Tells the user which patches in a Mod_PreflightSeries report
+ *                conflict. Lists the first few; there could be hundreds.
+ * =====================================================================================
+ */
+void Mod_PreflightAlert(json_t *report)
+{
+	json_t *Conflicts = json_object_get(report, "Conflicts");
+	json_t *row;
+	char *buf = NULL;
+	size_t i;
+
+	asprintf(&buf, "These mods can't be installed together. "
+		"%d pair(s) of patches write to the same bytes:\n",
+		(int)json_array_size(Conflicts));
+
+	json_array_foreach(Conflicts, i, row){
+		json_t *patches = json_object_get(row, "Patches");
+		json_t *a = json_array_get(patches, 0), *b = json_array_get(patches, 1);
+		char *line = NULL;
+
+		if(i == 5){
+			asprintf(&line, "%s...", buf);
+		} else {
+			asprintf(&line, "%s\n%s (%s) and %s (%s) at %s 0x%X-0x%X",
+				buf,
+				json_string_value(json_object_get(a, "Patch")),
+				json_string_value(json_object_get(a, "Mod")),
+				json_string_value(json_object_get(b, "Patch")),
+				json_string_value(json_object_get(b, "Mod")),
+				json_string_value(json_object_get(row, "File")),
+				(unsigned)json_integer_value(json_object_get(row, "Start")),
+				(unsigned)json_integer_value(json_object_get(row, "End")));
+		}
+		safe_free(buf);
+		buf = line;
+		if(i == 5){break;}
+	}
+
+	AlertMsg(buf, "Mod Conflict");
+	safe_free(buf);
+}
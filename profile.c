@@ -29,6 +29,13 @@ void Profile_Save(
 		"RunPath", runpath,
 		"GameVer", gamever
 	);
+	json_t *Old = json_load_file(profile, 0, NULL);
+	
+	//Keep anything else the user put in there (TracePath, etc.)
+	if(Old != NULL){
+		json_object_update_missing(Config, Old);
+		json_decref(Old);
+	}
 	json_dump_file(Config, profile, 0);
 	json_decref(Config);
 	return;
@@ -167,6 +174,7 @@ struct ProgConfig * Profile_Load(char *fpath)
 	LocalConfig->PROGDIR = strdup(CONFIG.PROGDIR);
 	LocalConfig->GAMEVER = JSON_GetStr(Profile, "GameVer");
 	LocalConfig->CHECKSUM = JSON_GetuInt(Profile, "Checksum");
+	LocalConfig->TRACEPATH = JSON_GetStr(Profile, "TracePath");
 	
 	//Load game config
 //	chdir(CONFIG.PROGDIR);
@@ -181,6 +189,9 @@ struct ProgConfig * Profile_Load(char *fpath)
 	//Get game UUID
 	LocalConfig->GAMEUUID = JSON_GetStr(GameCfg, "GameUUID");
 	
+	//Parse the blacklist now while we have the config loaded
+	Profile_CacheBlacklist(GameCfg, LocalConfig->GAMECONFIG, LocalConfig->GAMEVER);
+	
 	// Verify cheksum
 	if (!Profile_ChecksumAlert(LocalConfig)) {
 		json_decref(GameCfg);
@@ -195,6 +206,95 @@ struct ProgConfig * Profile_Load(char *fpath)
 	return LocalConfig;
 }
 
+/// Blacklist cache
+// Mods listed in the "Mods" array of the profile's game version are built into
+// the base executable. The list is parsed once per profile instead of once per
+// conflict check.
+static struct HashTable *BLACKLIST = NULL;
+static char *BLACKLIST_CFG = NULL;
+static char *BLACKLIST_VER = NULL;
+
+/*
+* ===  FUNCTION  ======================================================================
+*         Name:  Profile_ClearBlacklist()
+*  Description:  Drops the cached blacklist. It is rebuilt on next use.
+* =====================================================================================
+*/
+void Profile_ClearBlacklist(void)
+{
+	HashTable_Destroy(BLACKLIST, NULL);
+	BLACKLIST = NULL;
+	safe_free(BLACKLIST_CFG);
+	safe_free(BLACKLIST_VER);
+}
+
+/*
+* ===  FUNCTION  ======================================================================
+*         Name:  Profile_CacheBlacklist()
+*  Description:  Builds the blacklist lookup for game version gamever from an
+*                already-loaded game config.
+* =====================================================================================
+*/
+BOOL Profile_CacheBlacklist(json_t *GameCfg, const char *cfgpath, const char *gamever)
+{
+	json_t *GameVerList, *GameVer;
+	size_t i;
+
+	Profile_ClearBlacklist();
+	BLACKLIST = HashTable_Create(0);
+	if(!BLACKLIST){
+		return FALSE;
+	}
+	BLACKLIST_CFG = strdup(cfgpath ? cfgpath : "");
+	BLACKLIST_VER = strdup(gamever ? gamever : "");
+
+	//Find game version
+	GameVerList = json_object_get(GameCfg, "Whitelist");
+	json_array_foreach(GameVerList, i, GameVer){
+		json_t *ModList, *CurrMod;
+		size_t j;
+
+		if(!streq(json_string_value(json_object_get(GameVer, "Name")), gamever)){
+			// Keep searching
+			continue;
+		}
+
+		//Add everything in the blacklist
+		ModList = json_object_get(GameVer, "Mods");
+		json_array_foreach(ModList, j, CurrMod){
+			const char *CurrItem = json_string_value(CurrMod);
+			if(CurrItem && !HashTable_Set(BLACKLIST, CurrItem, NULL, NULL)){
+				Profile_ClearBlacklist();
+				return FALSE;
+			}
+		}
+		break;
+	}
+	return TRUE;
+}
+
+/*
+* ===  FUNCTION  ======================================================================
+*         Name:  Profile_IsBlacklisted()
+*  Description:  Returns TRUE if the mod UUID is built into the current game version.
+*                Reloads the cache if the loaded profile has changed since it was built.
+* =====================================================================================
+*/
+BOOL Profile_IsBlacklisted(const char *UUID)
+{
+	if(
+		!BLACKLIST ||
+		strcmp(BLACKLIST_CFG, CONFIG.GAMECONFIG ? CONFIG.GAMECONFIG : "") != 0 ||
+		strcmp(BLACKLIST_VER, CONFIG.GAMEVER ? CONFIG.GAMEVER : "") != 0
+	){
+		json_t *GameCfg = JSON_Load(CONFIG.GAMECONFIG);
+		BOOL result = Profile_CacheBlacklist(GameCfg, CONFIG.GAMECONFIG, CONFIG.GAMEVER);
+		json_decref(GameCfg);
+		if(!result){return FALSE;}
+	}
+	return UUID && HashTable_Has(BLACKLIST, UUID);
+}
+
 /*
 * ===  FUNCTION  ======================================================================
 *         Name:  Profile_ChecksumAlert()
@@ -410,6 +510,7 @@ void Profile_EmptyStruct(struct ProgConfig *LocalConfig)
 	safe_free(LocalConfig->RUNPATH);
 	safe_free(LocalConfig->GAMEVER);
 	safe_free(LocalConfig->GAMEUUID);
+	safe_free(LocalConfig->TRACEPATH);
 	return;
 }
 
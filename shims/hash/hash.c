@@ -0,0 +1,183 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Small open-addressing (linear probe) hash table with string keys.
+
+#include "hash.h"
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// FNV-1a
+unsigned long HashTable_HashStr(const char *Key)
+{
+	unsigned long hash = 2166136261UL;
+	while(*Key){
+		hash ^= (unsigned char)*Key++;
+		hash *= 16777619UL;
+	}
+	return hash & 0xFFFFFFFFUL;
+}
+
+struct HashTable * HashTable_Create(size_t SizeHint)
+{
+	struct HashTable *table = calloc(1, sizeof(struct HashTable));
+	size_t Cap = 16;
+	
+	if(!table){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+	
+	// Keep load factor under 1/2
+	while(Cap < SizeHint * 2){Cap *= 2;}
+	
+	table->Entries = calloc(Cap, sizeof(struct HashEntry));
+	if(!table->Entries){
+		CURRERROR = errCRIT_MALLOC;
+		safe_free(table);
+		return NULL;
+	}
+	table->Cap = Cap;
+	return table;
+}
+
+void HashTable_Clear(struct HashTable *table, HashTable_Free FreeFunc)
+{
+	size_t i;
+	if(!table){return;}
+	
+	for(i = 0; i < table->Cap; i++){
+		if(table->Entries[i].Used == 1 && FreeFunc){
+			FreeFunc(table->Entries[i].Value);
+		}
+		safe_free(table->Entries[i].Key);
+		table->Entries[i].Used = 0;
+		table->Entries[i].Value = NULL;
+	}
+	table->Count = 0;
+	table->Removed = 0;
+}
+
+void HashTable_Destroy(struct HashTable *table, HashTable_Free FreeFunc)
+{
+	if(!table){return;}
+	HashTable_Clear(table, FreeFunc);
+	safe_free(table->Entries);
+	free(table);
+}
+
+// Returns the slot holding Key, or -1
+static long HashTable_Find(const struct HashTable *table, const char *Key)
+{
+	size_t i, mask;
+	if(!table || !Key){return -1;}
+	
+	mask = table->Cap - 1;
+	i = HashTable_HashStr(Key) & mask;
+	while(table->Entries[i].Used != 0){
+		if(table->Entries[i].Used == 1 && streq(table->Entries[i].Key, Key)){
+			return i;
+		}
+		i = (i + 1) & mask;
+	}
+	return -1;
+}
+
+void * HashTable_Get(const struct HashTable *table, const char *Key)
+{
+	long i = HashTable_Find(table, Key);
+	return i == -1 ? NULL : table->Entries[i].Value;
+}
+
+int HashTable_Has(const struct HashTable *table, const char *Key)
+{
+	return HashTable_Find(table, Key) != -1;
+}
+
+// Double size and reinsert everything
+static int HashTable_Grow(struct HashTable *table)
+{
+	struct HashEntry *Old = table->Entries;
+	size_t OldCap = table->Cap, i;
+	size_t Cap = table->Count * 4 > OldCap ? OldCap * 2 : OldCap;
+	
+	table->Entries = calloc(Cap, sizeof(struct HashEntry));
+	if(!table->Entries){
+		table->Entries = Old;
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	table->Cap = Cap;
+	table->Removed = 0;
+	
+	for(i = 0; i < OldCap; i++){
+		size_t j;
+		if(Old[i].Used == 1){
+			j = HashTable_HashStr(Old[i].Key) & (Cap - 1);
+			while(table->Entries[j].Used != 0){j = (j + 1) & (Cap - 1);}
+			table->Entries[j] = Old[i];
+		} else {
+			safe_free(Old[i].Key);
+		}
+	}
+	free(Old);
+	return TRUE;
+}
+
+// Insert or replace. Returns FALSE on allocation failure.
+int HashTable_Set(struct HashTable *table, const char *Key, void *Value, HashTable_Free FreeFunc)
+{
+	size_t i, mask;
+	long found;
+	
+	if(!table || !Key){
+		CURRERROR = errCRIT_ARGMNT;
+		return FALSE;
+	}
+	
+	found = HashTable_Find(table, Key);
+	if(found != -1){
+		if(FreeFunc && table->Entries[found].Value != Value){
+			FreeFunc(table->Entries[found].Value);
+		}
+		table->Entries[found].Value = Value;
+		return TRUE;
+	}
+	
+	if((table->Count + table->Removed + 1) * 2 > table->Cap){
+		if(!HashTable_Grow(table)){return FALSE;}
+	}
+	
+	mask = table->Cap - 1;
+	i = HashTable_HashStr(Key) & mask;
+	while(table->Entries[i].Used == 1){i = (i + 1) & mask;}
+	
+	if(table->Entries[i].Used == -1){
+		table->Removed--;
+		safe_free(table->Entries[i].Key);
+	}
+	table->Entries[i].Key = strdup(Key);
+	if(!table->Entries[i].Key){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	table->Entries[i].Value = Value;
+	table->Entries[i].Used = 1;
+	table->Count++;
+	return TRUE;
+}
+
+int HashTable_Remove(struct HashTable *table, const char *Key, HashTable_Free FreeFunc)
+{
+	long i = HashTable_Find(table, Key);
+	if(i == -1){return FALSE;}
+	
+	if(FreeFunc){FreeFunc(table->Entries[i].Value);}
+	safe_free(table->Entries[i].Key);
+	table->Entries[i].Value = NULL;
+	table->Entries[i].Used = -1;
+	table->Count--;
+	table->Removed++;
+	return TRUE;
+}
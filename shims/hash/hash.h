@@ -0,0 +1,40 @@
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+// String-keyed hash table. Keys are copied; values are owned by the caller
+// unless a destructor is passed to HashTable_Destroy / HashTable_Remove.
+struct HashEntry {
+	char *Key;
+	void *Value;
+	int Used;       // 0 = empty, 1 = in use, -1 = removed
+};
+
+struct HashTable {
+	struct HashEntry *Entries;
+	size_t Cap;
+	size_t Count;
+	size_t Removed;
+};
+
+typedef void (*HashTable_Free)(void *Value);
+
+struct HashTable * HashTable_Create(size_t SizeHint);
+void HashTable_Destroy(struct HashTable *table, HashTable_Free FreeFunc);
+void HashTable_Clear(struct HashTable *table, HashTable_Free FreeFunc);
+void * HashTable_Get(const struct HashTable *table, const char *Key);
+int HashTable_Has(const struct HashTable *table, const char *Key);
+int HashTable_Set(struct HashTable *table, const char *Key, void *Value, HashTable_Free FreeFunc);
+int HashTable_Remove(struct HashTable *table, const char *Key, HashTable_Free FreeFunc);
+unsigned long HashTable_HashStr(const char *Key);
+
+#define HashTable_Foreach(table, i, entry) \
+	for(i = 0; (table) && i < (table)->Cap; i++) \
+		if(((entry) = &(table)->Entries[i])->Used == 1)
+
+#ifdef __cplusplus
+}
+#endif
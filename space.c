@@ -129,6 +129,7 @@ BOOL Mod_RenameSpace(const char *OldID, const char *NewID)
 	const char *query3 = "UPDATE Spaces SET End = REPLACE(End, ?, ?)";
 	int SQLResult;
 	
+	Var_SpacesChanged();
 	SQLResult = sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL);
 	
 	sqlite3_bind_text(command, 1, OldID, -1, SQLITE_STATIC);
@@ -570,6 +571,7 @@ BOOL Mod_SplitSpace(
 		"VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
 
 	CURRERROR = errNOERR;
+	Var_SpacesChanged();
 		
 	//Get patch data for OldID
 	OldPatch = Mod_GetSpace(OldID);
@@ -818,6 +820,7 @@ BOOL Mod_MakeSpace(struct ModSpace *input, const char *ModUUID, const char *Type
 	int PEStart, PEEnd, Ver;
 
 	CURRERROR = errNOERR;
+	Var_SpacesChanged();
 
 	//Convert input.Start and input.End to PE format if needed
 	//FilePath = File_GetPath(input->FileID);
@@ -872,13 +875,15 @@ BOOL Mod_MakeSpace(struct ModSpace *input, const char *ModUUID, const char *Type
 // Read existing bytes into revert table and write new bytes in
 BOOL Mod_CreateRevertEntry(const struct ModSpace *input)
 {
-	unsigned char *OldBytesRaw = NULL;
-	char *OldBytes = NULL;
 	char *FilePath = NULL;
+	char *Hash = NULL;
 	int handle = -1;
 	sqlite3_stmt *command;
-	const char *query = "INSERT OR IGNORE INTO Revert "
-		"('PatchUUID', 'Start', 'OldBytes') VALUES (?, ?, ?);";
+	const char *query1 = "SELECT EXISTS(SELECT * FROM Revert "
+		"WHERE PatchUUID = ? AND File = ? AND Start = ?);";
+	const char *query2 = "INSERT INTO Revert "
+		"('PatchUUID', 'File', 'Start', 'Len', 'Hash') VALUES (?, ?, ?, ?, ?);";
+	int HasEntry;
 	BOOL retval = FALSE;
 	
 	//If using virtual memory file, exit.
@@ -887,11 +892,22 @@ BOOL Mod_CreateRevertEntry(const struct ModSpace *input)
 		goto Mod_CreateRevertEntry_Return;
 	}
 	
-	//Read the old bytes
-	OldBytesRaw = calloc(input->Len, sizeof(char));
-	//Quick error checking
-	if(OldBytesRaw == NULL){
-		CURRERROR = errCRIT_MALLOC;
+	//Only the first capture of a range counts. A Move captures two ranges.
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_prepare_v2(CURRDB, query1, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_bind_text(command, 1, input->PatchID, -1, SQLITE_STATIC) ||
+		sqlite3_bind_int(command, 2, input->FileID) ||
+		sqlite3_bind_int(command, 3, input->Start)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		goto Mod_CreateRevertEntry_Return;
+	}
+	HasEntry = SQL_GetNum(command);
+	sqlite3_finalize(command);
+	if(CURRERROR != errNOERR){goto Mod_CreateRevertEntry_Return;}
+	if(HasEntry){
+		retval = TRUE;
 		goto Mod_CreateRevertEntry_Return;
 	}
 	
@@ -907,37 +923,55 @@ BOOL Mod_CreateRevertEntry(const struct ModSpace *input)
 		goto Mod_CreateRevertEntry_Return;
 	}
 
-	//Actually read the file. (I actually forgot this.)
-	lseek(handle, input->Start, SEEK_SET);
-	read(handle, OldBytesRaw, input->Len);
+	//The blob's reference and the Revert row that holds it go in together
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"SAVEPOINT RevertEntry;", NULL, NULL, NULL)
+	) != 0){
+		close(handle);
+		CURRERROR = errCRIT_DBASE;
+		goto Mod_CreateRevertEntry_Return;
+	}
+
+	//Stream the old bytes into the undo journal (once per unique payload);
+	//keep only the hash
+	Hash = Journal_StoreFile(
+		input->PatchID, input->FileID, input->Start, handle, input->Len
+	);
 	close(handle);
 	handle = -1;
-	
-	//Convert to hex string
-	//OldBytes = Bytes2Hex(OldBytesRaw, input->Len);
-	//safe_free(OldBytesRaw);
+	if(Hash == NULL){
+		goto Mod_CreateRevertEntry_Rollback;
+	}
 	
 	//Construct & Execute SQL Statement
 	if(SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+		sqlite3_prepare_v2(CURRDB, query2, -1, &command, NULL)
 	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
 		sqlite3_bind_text(command, 1, input->PatchID, -1, SQLITE_STATIC) ||
-		sqlite3_bind_int(command, 2, input->Start) ||
-		sqlite3_bind_blob(command, 3, OldBytesRaw, input->Len, SQLITE_STATIC)
+		sqlite3_bind_int(command, 2, input->FileID) ||
+		sqlite3_bind_int(command, 3, input->Start) ||
+		sqlite3_bind_int(command, 4, input->Len) ||
+		sqlite3_bind_text(command, 5, Hash, -1, SQLITE_STATIC)
 	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_step(command)
-	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)) != 0){
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"RELEASE RevertEntry;", NULL, NULL, NULL)
+	) != 0){
 		CURRERROR = errCRIT_DBASE;
-		goto Mod_CreateRevertEntry_Return;
+		goto Mod_CreateRevertEntry_Rollback;
 	}
-	
-	safe_free(OldBytesRaw);
 	command = NULL;
-	retval = TRUE;
 	
+	retval = TRUE;
+	goto Mod_CreateRevertEntry_Return;
+
+Mod_CreateRevertEntry_Rollback:
+	sqlite3_exec(CURRDB, "ROLLBACK TO RevertEntry; RELEASE RevertEntry;",
+		NULL, NULL, NULL);
 	
 Mod_CreateRevertEntry_Return:
-	safe_free(OldBytes);
 	safe_free(FilePath);
+	safe_free(Hash);
 	
 	return retval;
 }
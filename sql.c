@@ -45,6 +45,7 @@ json_t * SQL_GetJSON(sqlite3_stmt *stmt)
 	int i, errorNo;
 	json_t *result = json_array();
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("SQL_GetJSON", sqlite3_sql(stmt));
 	
 	///Compose the JSON array
 	errorNo = sqlite3_step(stmt);
@@ -64,6 +65,7 @@ json_t * SQL_GetJSON(sqlite3_stmt *stmt)
 				AlertMsg("SQL->JSON ERROR!", coltext);
 				safe_free(colname);
 				safe_free(coltext);
+				TRACE_END("SQL_GetJSON");
 				return json_array();
 			}
 			
@@ -83,6 +85,7 @@ json_t * SQL_GetJSON(sqlite3_stmt *stmt)
 					"SQL->JSON ERROR!");
 				safe_free(colname);
 				safe_free(coltext);
+				TRACE_END("SQL_GetJSON");
 				return json_array();
 			}
 			 
@@ -112,6 +115,7 @@ json_t * SQL_GetJSON(sqlite3_stmt *stmt)
 	//End array
 	sqlite3_reset(stmt);
 	
+	TRACE_END("SQL_GetJSON");
 	return result;
 }
 
@@ -126,6 +130,7 @@ int SQL_GetNum(sqlite3_stmt *stmt)
 {
 	int errorNo, result = -1;
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("SQL_GetNum", sqlite3_sql(stmt));
 	
         errorNo = sqlite3_step(stmt);
         if (errorNo == SQLITE_ROW) {
@@ -138,6 +143,32 @@ int SQL_GetNum(sqlite3_stmt *stmt)
 	}
 	
 	sqlite3_reset(stmt);
+	TRACE_END("SQL_GetNum");
+	return result;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  SQL_GetNum64
+ *  Description:  Like SQL_GetNum, but keeps all 64 bits (ex: a journal offset)
+ * =====================================================================================
+ */
+int64_t SQL_GetNum64(sqlite3_stmt *stmt)
+{
+	int errorNo;
+	int64_t result = -1;
+	CURRERROR = errNOERR;
+	TRACE_BEGIN("SQL_GetNum64", sqlite3_sql(stmt));
+	
+	errorNo = sqlite3_step(stmt);
+	if (errorNo == SQLITE_ROW) {
+		result = sqlite3_column_int64(stmt, 0);
+	} else if (errorNo != SQLITE_DONE){
+		CURRERROR = errCRIT_DBASE;
+	}
+	
+	sqlite3_reset(stmt);
+	TRACE_END("SQL_GetNum64");
 	return result;
 }
 
@@ -153,17 +184,20 @@ char * SQL_GetStr(sqlite3_stmt *stmt)
 	int errorNo;
 	char *result = NULL;
 	CURRERROR = errNOERR;
+	TRACE_BEGIN("SQL_GetStr", sqlite3_sql(stmt));
 	
         errorNo = sqlite3_step(stmt);
         if (errorNo == SQLITE_ROW) {
             result = strdup(SQL_ColText(stmt, 0));
         } else if (errorNo == SQLITE_DONE){
+			TRACE_END("SQL_GetStr");
 			return NULL;
 	} else {
 		CURRERROR = errCRIT_DBASE;
 	}
 	
 	sqlite3_reset(stmt);
+	TRACE_END("SQL_GetStr");
 	return result;
 }
 
@@ -0,0 +1,711 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+
+// Stack diff. A snapshot of what the installed mods did to the game files,
+// so the same stack can be put back on pristine files without running any
+// installs. Layout:
+//     StackDiffHeader
+//     FileCount x (StackDiffFile, Name, Backup, RangeCount x (StackDiffRange, bytes))
+// Patched files list every byte range any mod changed (from the Revert rows)
+// with the modded bytes, sorted by offset, plus a CRC of the file as it was
+// before any mod touched it. Files a mod created or replaced are stored
+// whole. The header carries a fingerprint of the installed mods and
+// variables; if that or any CRC doesn't match, the diff is stale.
+
+#define STACKDIFF_MAGIC 0x444C4D53 //"SMLD"
+#define STACKDIFF_VERSION 1
+#define STACKDIFF_CHUNK (32 * 1024)
+
+enum StackDiffKind {
+	STACKDIFF_RANGES,   //Byte ranges of an existing file
+	STACKDIFF_WHOLE,    //File created, or replaced, by a mod
+	STACKDIFF_GONE      //File deleted by a mod
+};
+
+struct StackDiffHeader {
+	uint32_t Magic;
+	uint32_t Version;
+	char Fingerprint[64];
+	int32_t FileCount;
+};
+
+struct StackDiffFile {
+	int32_t Kind;
+	int32_t Size;             //Size of the file, modded and pristine
+	uint32_t PristineCRC;     //STACKDIFF_RANGES only
+	int32_t RangeCount;
+	int32_t NameLen;          //Path relative to the game directory
+	int32_t BackupLen;        //Where the replaced original goes, if any
+};
+
+struct StackDiffRange {
+	int32_t Start;
+	int32_t Len;
+};
+
+// A run of changed bytes in one file
+struct StackDiffRun {
+	int Start;
+	int Len;
+	unsigned char *Pristine;
+};
+
+// One Revert row of the file being exported
+struct StackDiffRevert {
+	int Start;
+	int Len;
+	int Order;                //When the row was captured. Oldest bytes win.
+	unsigned char *Bytes;
+};
+
+static int StackDiff_CompareOrder(const void *a, const void *b)
+{
+	const struct StackDiffRevert *lhs = a;
+	const struct StackDiffRevert *rhs = b;
+	return (lhs->Order < rhs->Order) - (lhs->Order > rhs->Order);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_StackFingerprint
+ *  Description:  Hash of every installed mod and version and every variable and
+ *                value. Two databases with the same fingerprint describe the same
+ *                patched files.
+ * =====================================================================================
+ */
+char * Mod_StackFingerprint(void)
+{
+	sqlite3_stmt *command;
+	const char *query =
+		"SELECT COALESCE(group_concat(Line, char(10)), '') FROM ("
+			"SELECT 'M ' || UUID || ' ' || Version AS Line FROM Mods "
+			"UNION ALL SELECT 'V ' || UUID || ' ' || Type || ' ' || hex(Value) "
+			"FROM Variables ORDER BY Line"
+		");";
+	char *State, *Fingerprint;
+
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return NULL;
+	}
+	State = SQL_GetStr(command);
+	sqlite3_finalize(command);
+	if(State == NULL){
+		CURRERROR = errCRIT_DBASE;
+		return NULL;
+	}
+
+	Fingerprint = Journal_Hash((unsigned char *)State, strlen(State));
+	safe_free(State);
+	return Fingerprint;
+}
+
+// Free a list of runs
+static void StackDiff_FreeRuns(struct StackDiffRun *runs, size_t count)
+{
+	size_t i;
+	for(i = 0; i < count; i++){
+		safe_free(runs[i].Pristine);
+	}
+	safe_free(runs);
+}
+
+// Collect every range of a file that some patch changed, merged into runs,
+// each with the bytes that were there before any mod.
+static struct StackDiffRun * StackDiff_GetRuns(int File, size_t *Count)
+{
+	sqlite3_stmt *command;
+	const char *query =
+		"SELECT Revert.Start, Revert.Hash, RevertBlobs.Journal, "
+		"Revert.RowID AS Ord FROM Spaces "
+		"JOIN Revert ON Revert.PatchUUID = Spaces.PatchID "
+		"JOIN RevertBlobs ON RevertBlobs.Hash = Revert.Hash "
+		"WHERE Revert.File = ? AND UPPER(Spaces.Type) IN ('ADD', 'CLEAR') "
+		"GROUP BY Revert.RowID ORDER BY Revert.Start;";
+	struct StackDiffRevert *reverts = NULL;
+	struct StackDiffRun *runs = NULL;
+	size_t revertCount = 0, revertAlloc = 0, i;
+	int result;
+
+	*Count = 0;
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_bind_int(command, 1, File)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return NULL;
+	}
+
+	while((result = sqlite3_step(command)) == SQLITE_ROW){
+		struct JournalHeader header;
+		struct StackDiffRevert *row;
+
+		if(revertCount == revertAlloc){
+			struct StackDiffRevert *grown;
+			revertAlloc = revertAlloc ? revertAlloc * 2 : 16;
+			grown = realloc(reverts, revertAlloc * sizeof(struct StackDiffRevert));
+			if(grown == NULL){
+				CURRERROR = errCRIT_MALLOC;
+				break;
+			}
+			reverts = grown;
+		}
+
+		row = &reverts[revertCount];
+		row->Start = sqlite3_column_int(command, 0);
+		row->Order = sqlite3_column_int(command, 3);
+		row->Bytes = Journal_Read(
+			sqlite3_column_int64(command, 2),
+			(const char *)sqlite3_column_text(command, 1), &header
+		);
+		if(row->Bytes == NULL){break;}
+		row->Len = header.Length;
+		revertCount++;
+	}
+	if(CURRERROR == errNOERR && result != SQLITE_DONE){
+		SQL_HandleErrors(__FILE__, __LINE__, result);
+		CURRERROR = errCRIT_DBASE;
+	}
+	sqlite3_finalize(command);
+
+	// Merge rows that overlap or touch; where they overlap the oldest wins
+	i = 0;
+	while(CURRERROR == errNOERR && i < revertCount){
+		size_t j, runEnd = i + 1;
+		int start = reverts[i].Start;
+		int end = reverts[i].Start + reverts[i].Len;
+		struct StackDiffRun *run;
+
+		while(runEnd < revertCount && reverts[runEnd].Start <= end){
+			end = MAX(end, reverts[runEnd].Start + reverts[runEnd].Len);
+			runEnd++;
+		}
+
+		// Worst case is one run per row
+		if(runs == NULL){
+			runs = calloc(revertCount, sizeof(struct StackDiffRun));
+			if(runs == NULL){
+				CURRERROR = errCRIT_MALLOC;
+				break;
+			}
+		}
+		run = &runs[*Count];
+		run->Start = start;
+		run->Len = end - start;
+		run->Pristine = malloc(run->Len + 1);
+		if(run->Pristine == NULL){
+			CURRERROR = errCRIT_MALLOC;
+			break;
+		}
+		(*Count)++;
+
+		qsort(&reverts[i], runEnd - i, sizeof(struct StackDiffRevert), StackDiff_CompareOrder);
+		for(j = i; j < runEnd; j++){
+			memcpy(run->Pristine + (reverts[j].Start - start), reverts[j].Bytes, reverts[j].Len);
+		}
+		i = runEnd;
+	}
+
+	for(i = 0; i < revertCount; i++){
+		safe_free(reverts[i].Bytes);
+	}
+	safe_free(reverts);
+
+	if(CURRERROR != errNOERR){
+		StackDiff_FreeRuns(runs, *Count);
+		*Count = 0;
+		return NULL;
+	}
+	return runs;
+}
+
+// CRC of a file with every run put back to its pristine bytes. Reads the
+// file once, front to back.
+static BOOL StackDiff_PristineCRC(
+	int handle, int size, const struct StackDiffRun *runs, size_t count,
+	uint32_t *crc
+){
+	unsigned char buffer[STACKDIFF_CHUNK];
+	unsigned long result = 0;
+	int pos = 0;
+	size_t i = 0;
+
+	while(pos < size){
+		int stop = (i < count) ? MIN(runs[i].Start, size) : size;
+
+		while(pos < stop){
+			int len = MIN(stop - pos, STACKDIFF_CHUNK);
+			if(File_ReadBytes(handle, pos, buffer, len) != len){
+				CURRERROR = errCRIT_FILESYS;
+				return FALSE;
+			}
+			result = crc32(result, buffer, len);
+			pos += len;
+		}
+
+		if(i < count){
+			int len = MIN(runs[i].Len, size - pos);
+			if(len > 0){
+				result = crc32(result, runs[i].Pristine, len);
+				pos += len;
+			}
+			i++;
+		}
+	}
+
+	*crc = (uint32_t)result;
+	return TRUE;
+}
+
+// Copy len bytes of handle at offset to the diff
+static BOOL StackDiff_CopyOut(FILE *out, int handle, int offset, int len)
+{
+	unsigned char buffer[STACKDIFF_CHUNK];
+	int done;
+
+	for(done = 0; done < len; done += STACKDIFF_CHUNK){
+		int count = MIN(len - done, STACKDIFF_CHUNK);
+		if(
+			File_ReadBytes(handle, offset + done, buffer, count) != count ||
+			fwrite(buffer, 1, count, out) != (size_t)count
+		){
+			CURRERROR = errCRIT_FILESYS;
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+// Write one file's entry. Files with nothing to record are skipped.
+static BOOL StackDiff_ExportFile(
+	FILE *out, int File, BOOL IsNew, const char *DeletedBy, int32_t *FileCount
+){
+	struct StackDiffFile entry;
+	struct StackDiffRun *runs = NULL;
+	size_t runCount = 0, i;
+	char *FileName = File_GetName(File);
+	char *FilePath = NULL, *Backup = NULL;
+	int handle = -1;
+	BOOL retval = FALSE;
+
+	if(FileName == NULL){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, FileName);
+	if(IsNew && DeletedBy != NULL){
+		//Same place ModOp_File keeps it
+		asprintf(&Backup, "BACKUP/%d.%s", File, DeletedBy);
+	} else {
+		Backup = strdup("");
+	}
+	if(FilePath == NULL || Backup == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		goto StackDiff_ExportFile_Return;
+	}
+
+	memset(&entry, 0, sizeof(entry));
+	if(IsNew){
+		entry.Kind = STACKDIFF_WHOLE;
+		entry.Size = filesize(FilePath);
+		entry.RangeCount = 1;
+	} else if(DeletedBy != NULL){
+		entry.Kind = STACKDIFF_GONE;
+	} else {
+		runs = StackDiff_GetRuns(File, &runCount);
+		if(CURRERROR != errNOERR){goto StackDiff_ExportFile_Return;}
+		if(runCount == 0){
+			retval = TRUE;
+			goto StackDiff_ExportFile_Return;
+		}
+		entry.Kind = STACKDIFF_RANGES;
+		entry.Size = filesize(FilePath);
+		entry.RangeCount = runCount;
+	}
+	entry.NameLen = strlen(FileName);
+	entry.BackupLen = strlen(Backup);
+
+	if(entry.Kind != STACKDIFF_GONE){
+		handle = File_OpenSafe(FilePath, _O_BINARY|_O_RDONLY);
+		if(handle == -1 || entry.Size < 0){
+			CURRERROR = errWNG_BADFILE;
+			goto StackDiff_ExportFile_Return;
+		}
+	}
+	if(entry.Kind == STACKDIFF_RANGES && !StackDiff_PristineCRC(
+		handle, entry.Size, runs, runCount, &entry.PristineCRC
+	)){
+		goto StackDiff_ExportFile_Return;
+	}
+
+	if(
+		fwrite(&entry, sizeof(entry), 1, out) != 1 ||
+		fwrite(FileName, 1, entry.NameLen, out) != (size_t)entry.NameLen ||
+		fwrite(Backup, 1, entry.BackupLen, out) != (size_t)entry.BackupLen
+	){
+		CURRERROR = errCRIT_FILESYS;
+		goto StackDiff_ExportFile_Return;
+	}
+
+	if(entry.Kind == STACKDIFF_WHOLE){
+		struct StackDiffRange range = {0, entry.Size};
+		if(fwrite(&range, sizeof(range), 1, out) != 1){
+			CURRERROR = errCRIT_FILESYS;
+			goto StackDiff_ExportFile_Return;
+		}
+		if(!StackDiff_CopyOut(out, handle, 0, entry.Size)){
+			goto StackDiff_ExportFile_Return;
+		}
+	}
+
+	for(i = 0; i < runCount; i++){
+		struct StackDiffRange range = {runs[i].Start, runs[i].Len};
+		if(fwrite(&range, sizeof(range), 1, out) != 1){
+			CURRERROR = errCRIT_FILESYS;
+			goto StackDiff_ExportFile_Return;
+		}
+		if(!StackDiff_CopyOut(out, handle, runs[i].Start, runs[i].Len)){
+			goto StackDiff_ExportFile_Return;
+		}
+	}
+
+	(*FileCount)++;
+	retval = TRUE;
+
+StackDiff_ExportFile_Return:
+	if(handle != -1){close(handle);}
+	StackDiff_FreeRuns(runs, runCount);
+	safe_free(FileName);
+	safe_free(FilePath);
+	safe_free(Backup);
+	return retval;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_ExportStack
+ *  Description:  Writes a stack diff of the installed mods to OutPath. Every patched
+ *                file is read once to get its pristine CRC and modded bytes.
+ * =====================================================================================
+ */
+BOOL Mod_ExportStack(const char *OutPath)
+{
+	sqlite3_stmt *command;
+	const char *query =
+		"SELECT File, MAX(UPPER(Type) = 'NEW') AS New, "
+		"MAX(CASE WHEN UPPER(Type) = 'DELETE' THEN PatchID END) AS DeletedBy "
+		"FROM Spaces WHERE File != 0 AND Mod != 'MODLOADER@invisibleup' "
+		"GROUP BY File ORDER BY File;";
+	struct StackDiffHeader header;
+	char *Fingerprint;
+	FILE *out;
+	BOOL retval = TRUE;
+	int result;
+
+	CURRERROR = errNOERR;
+	TRACE_BEGIN("Mod_ExportStack", OutPath);
+
+	Fingerprint = Mod_StackFingerprint();
+	if(Fingerprint == NULL){
+		TRACE_END("Mod_ExportStack");
+		return FALSE;
+	}
+	memset(&header, 0, sizeof(header));
+	header.Magic = STACKDIFF_MAGIC;
+	header.Version = STACKDIFF_VERSION;
+	strncpy(header.Fingerprint, Fingerprint, sizeof(header.Fingerprint) - 1);
+	safe_free(Fingerprint);
+
+	out = fopen(OutPath, "wb");
+	if(out == NULL){
+		ErrNo2ErrCode();
+		TRACE_END("Mod_ExportStack");
+		return FALSE;
+	}
+	//FileCount is filled in at the end
+	fwrite(&header, sizeof(header), 1, out);
+
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		fclose(out);
+		remove(OutPath);
+		TRACE_END("Mod_ExportStack");
+		return FALSE;
+	}
+	while((result = sqlite3_step(command)) == SQLITE_ROW){
+		const char *DeletedBy = (const char *)sqlite3_column_text(command, 2);
+		if(!StackDiff_ExportFile(
+			out, sqlite3_column_int(command, 0),
+			sqlite3_column_int(command, 1), DeletedBy, &header.FileCount
+		)){
+			retval = FALSE;
+			break;
+		}
+	}
+	if(retval && result != SQLITE_DONE){
+		SQL_HandleErrors(__FILE__, __LINE__, result);
+		CURRERROR = errCRIT_DBASE;
+		retval = FALSE;
+	}
+	sqlite3_finalize(command);
+
+	if(retval && (
+		fseek(out, 0, SEEK_SET) != 0 ||
+		fwrite(&header, sizeof(header), 1, out) != 1
+	)){
+		CURRERROR = errCRIT_FILESYS;
+		retval = FALSE;
+	}
+	if(fclose(out) != 0 && retval){
+		CURRERROR = errCRIT_FILESYS;
+		retval = FALSE;
+	}
+	if(!retval){remove(OutPath);}
+
+	TRACE_END("Mod_ExportStack");
+	return retval;
+}
+
+// Read a file entry and its two strings
+static BOOL StackDiff_ReadEntry(
+	FILE *in, struct StackDiffFile *entry, char **Name, char **Backup
+){
+	*Name = NULL;
+	*Backup = NULL;
+	if(
+		fread(entry, sizeof(*entry), 1, in) != 1 ||
+		entry->NameLen <= 0 || entry->BackupLen < 0 || entry->RangeCount < 0
+	){
+		CURRERROR = errWNG_BADFILE;
+		return FALSE;
+	}
+	*Name = calloc(entry->NameLen + 1, 1);
+	*Backup = calloc(entry->BackupLen + 1, 1);
+	if(*Name == NULL || *Backup == NULL){
+		CURRERROR = errCRIT_MALLOC;
+	} else if(
+		fread(*Name, 1, entry->NameLen, in) != (size_t)entry->NameLen ||
+		fread(*Backup, 1, entry->BackupLen, in) != (size_t)entry->BackupLen
+	){
+		CURRERROR = errWNG_BADFILE;
+	}
+	if(CURRERROR != errNOERR){
+		safe_free(*Name);
+		safe_free(*Backup);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Stream the payloads of an entry's ranges into handle, or skip past them
+// if handle is -1
+static BOOL StackDiff_ApplyRanges(FILE *in, const struct StackDiffFile *entry, int handle)
+{
+	unsigned char buffer[STACKDIFF_CHUNK];
+	int i;
+
+	for(i = 0; i < entry->RangeCount; i++){
+		struct StackDiffRange range;
+		int done;
+
+		if(fread(&range, sizeof(range), 1, in) != 1 || range.Len < 0){
+			CURRERROR = errWNG_BADFILE;
+			return FALSE;
+		}
+		if(handle == -1){
+			if(fseek(in, range.Len, SEEK_CUR) != 0){
+				CURRERROR = errWNG_BADFILE;
+				return FALSE;
+			}
+			continue;
+		}
+		for(done = 0; done < range.Len; done += STACKDIFF_CHUNK){
+			int count = MIN(range.Len - done, STACKDIFF_CHUNK);
+			if(fread(buffer, 1, count, in) != (size_t)count){
+				CURRERROR = errWNG_BADFILE;
+				return FALSE;
+			}
+			File_WriteBytes(handle, range.Start + done, buffer, count);
+		}
+	}
+	return TRUE;
+}
+
+// Put one file entry in place
+static BOOL StackDiff_ApplyFile(
+	FILE *in, const struct StackDiffFile *entry, const char *Name, const char *Backup
+){
+	char *FilePath = NULL;
+	int handle = -1;
+	BOOL retval = FALSE;
+
+	asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, Name);
+	if(FilePath == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+
+	switch(entry->Kind){
+	case STACKDIFF_RANGES:
+		handle = File_OpenSafe(FilePath, _O_BINARY|_O_RDWR);
+		break;
+
+	case STACKDIFF_WHOLE:
+		// Keep the original where uninstalling will look for it
+		if(Backup[0] != '\0' && File_Exists(FilePath, FALSE, FALSE)){
+			char *BakPath = NULL, *BakDir = NULL;
+			asprintf(&BakPath, "%s/%s", CONFIG.CURRDIR, Backup);
+			asprintf(&BakDir, "%s/BACKUP", CONFIG.CURRDIR);
+			mkdir(BakDir);
+			if(!File_Exists(BakPath, FALSE, FALSE)){
+				rename(FilePath, BakPath);
+			}
+			safe_free(BakPath);
+			safe_free(BakDir);
+		}
+		CURRERROR = errNOERR; //File_Exists complains about missing files
+		handle = _open(FilePath, _O_BINARY|_O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		break;
+
+	case STACKDIFF_GONE:
+		if(File_Exists(FilePath, FALSE, FALSE)){
+			File_Delete(FilePath);
+		}
+		CURRERROR = errNOERR;
+		retval = TRUE;
+		goto StackDiff_ApplyFile_Return;
+
+	default:
+		CURRERROR = errWNG_BADFILE;
+		goto StackDiff_ApplyFile_Return;
+	}
+
+	if(handle == -1){
+		CURRERROR = errWNG_BADFILE;
+		goto StackDiff_ApplyFile_Return;
+	}
+	retval = StackDiff_ApplyRanges(in, entry, handle);
+
+StackDiff_ApplyFile_Return:
+	if(handle != -1){close(handle);}
+	safe_free(FilePath);
+	return retval;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Mod_ApplyStack
+ *  Description:  Puts a stack diff made by Mod_ExportStack back onto the game files.
+ *                Meant for pristine files and a database that still lists the same
+ *                mods. First checks the fingerprint and every patched file's CRC,
+ *                then writes everything in one pass over the diff.
+ *                Returns 1 if applied, 0 if the diff doesn't fit the current state
+ *                (nothing is written; install the mods normally instead), or -1 on
+ *                error.
+ * =====================================================================================
+ */
+int Mod_ApplyStack(const char *DiffPath)
+{
+	struct StackDiffHeader header;
+	char *Fingerprint = NULL;
+	FILE *in;
+	long body;
+	int retval = 1;
+	int i;
+
+	CURRERROR = errNOERR;
+	TRACE_BEGIN("Mod_ApplyStack", DiffPath);
+
+	in = fopen(DiffPath, "rb");
+	if(in == NULL){
+		ErrNo2ErrCode();
+		TRACE_END("Mod_ApplyStack");
+		return -1;
+	}
+	if(
+		fread(&header, sizeof(header), 1, in) != 1 ||
+		header.Magic != STACKDIFF_MAGIC || header.FileCount < 0
+	){
+		CURRERROR = errWNG_BADFILE;
+		retval = -1;
+		goto Mod_ApplyStack_Return;
+	}
+	header.Fingerprint[sizeof(header.Fingerprint) - 1] = '\0';
+
+	// Made by a different version or from a different set of mods
+	Fingerprint = Mod_StackFingerprint();
+	if(Fingerprint == NULL){
+		retval = -1;
+		goto Mod_ApplyStack_Return;
+	}
+	if(header.Version != STACKDIFF_VERSION || strneq(Fingerprint, header.Fingerprint)){
+		retval = 0;
+		goto Mod_ApplyStack_Return;
+	}
+
+	// Every patched file must be pristine
+	body = ftell(in);
+	for(i = 0; i < header.FileCount && retval == 1; i++){
+		struct StackDiffFile entry;
+		char *Name, *Backup;
+
+		if(!StackDiff_ReadEntry(in, &entry, &Name, &Backup)){
+			retval = -1;
+			break;
+		}
+		if(entry.Kind == STACKDIFF_RANGES){
+			char *FilePath = NULL;
+			asprintf(&FilePath, "%s/%s", CONFIG.CURRDIR, Name);
+			if(
+				FilePath == NULL || filesize(FilePath) != entry.Size ||
+				crc32File(FilePath) != entry.PristineCRC
+			){
+				retval = 0;
+			}
+			safe_free(FilePath);
+		}
+		safe_free(Name);
+		safe_free(Backup);
+		if(retval == 1 && !StackDiff_ApplyRanges(in, &entry, -1)){
+			retval = -1;
+		}
+	}
+	if(retval != 1){goto Mod_ApplyStack_Return;}
+
+	// Now write it all
+	fseek(in, body, SEEK_SET);
+	for(i = 0; i < header.FileCount; i++){
+		struct StackDiffFile entry;
+		char *Name, *Backup;
+		BOOL result;
+
+		if(!StackDiff_ReadEntry(in, &entry, &Name, &Backup)){
+			retval = -1;
+			break;
+		}
+		result = StackDiff_ApplyFile(in, &entry, Name, Backup);
+		safe_free(Name);
+		safe_free(Backup);
+		if(!result){
+			retval = -1;
+			break;
+		}
+	}
+
+Mod_ApplyStack_Return:
+	if(retval == 0){CURRERROR = errNOERR;}
+	safe_free(Fingerprint);
+	fclose(in);
+	TRACE_END("Mod_ApplyStack");
+	return retval;
+}
@@ -0,0 +1,79 @@
+// Tests that file checksums in expressions are reused until the file changes
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// Number of times the file was actually read in the trace
+static int CountHashes(const char *TracePath)
+{
+	json_t *trace, *event;
+	size_t i;
+	int count = 0;
+
+	trace = json_load_file(TracePath, 0, NULL);
+	json_array_foreach(trace, i, event){
+		const char *name = json_string_value(json_object_get(event, "name"));
+		const char *ph = json_string_value(json_object_get(event, "ph"));
+		if(name && ph && streq(name, "crc32File") && streq(ph, "B")){
+			count++;
+		}
+	}
+	json_decref(trace);
+	return count;
+}
+
+int Test_File_CRC32_Cache()
+{
+	unsigned char data[4096];
+	unsigned char patch = 0x55;
+	unsigned int before, after;
+	BOOL result = TRUE;
+	FILE *file;
+	int handle, hashes, i;
+
+	for(i = 0; i < (int)sizeof(data); i++){
+		data[i] = (unsigned char)i;
+	}
+	file = fopen("crccache.bin", "wb");
+	fwrite(data, 1, sizeof(data), file);
+	fclose(file);
+
+	if(!Trace_Open("crccache_trace.json")){
+		fprintf(stderr, "Function Trace_Open returned FALSE.\n");
+		return FALSE;
+	}
+
+	// Same file, many times over
+	for(i = 0; i < 20; i++){
+		before = Eq_Parse_uInt("crc32 @ crccache.bin", NULL, FALSE);
+		if(before != crc32File("crccache.bin") ||
+			Eq_Parse_Int("len @ crccache.bin", NULL, FALSE) != (int)sizeof(data)
+		){
+			fprintf(stderr, "Wrong checksum or length on run %d.\n", i);
+			result = FALSE;
+			break;
+		}
+	}
+
+	// Same size, probably the same second, but the loader wrote to it
+	handle = File_OpenSafe("crccache.bin", _O_BINARY|_O_RDWR);
+	File_WriteBytes(handle, 100, &patch, 1);
+	close(handle);
+	after = Eq_Parse_uInt("crc32 @ crccache.bin", NULL, FALSE);
+	Trace_Close();
+
+	if(after == before || after != crc32File("crccache.bin")){
+		fprintf(stderr, "Checksum wasn't updated after a write.\n");
+		result = FALSE;
+	}
+
+	hashes = CountHashes("crccache_trace.json");
+	if(hashes != 2){
+		fprintf(stderr, "File was hashed %d times, expected 2.\n", hashes);
+		result = FALSE;
+	}
+
+	remove("crccache_trace.json");
+	remove("crccache.bin");
+	return result;
+}
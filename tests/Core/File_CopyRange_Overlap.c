@@ -0,0 +1,57 @@
+// Tests if File_CopyRange handles overlapping ranges like memmove()
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+#define COPYRANGE_LEN 200000
+
+// Copy [src, src+len) to dst within the file and the reference buffer
+static BOOL File_CopyRange_Check(
+	int handle, unsigned char *expected, unsigned char *actual,
+	int src, int dst, int len
+){
+	if(!File_CopyRange(handle, src, handle, dst, len)){
+		fprintf(stderr, "File_CopyRange(%d -> %d) returned FALSE.\n", src, dst);
+		return FALSE;
+	}
+	memmove(expected + dst, expected + src, len);
+
+	File_ReadBytes(handle, 0, actual, COPYRANGE_LEN);
+	if(memcmp(expected, actual, COPYRANGE_LEN) != 0){
+		fprintf(stderr, "File_CopyRange(%d -> %d) doesn't match memmove.\n", src, dst);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int Test_File_CopyRange_Overlap()
+{
+	unsigned char *expected = malloc(COPYRANGE_LEN);
+	unsigned char *actual = malloc(COPYRANGE_LEN);
+	BOOL result = FALSE;
+	int handle = -1;
+	int i;
+
+	if(expected == NULL || actual == NULL){goto Test_File_CopyRange_Return;}
+	for(i = 0; i < COPYRANGE_LEN; i++){
+		expected[i] = (unsigned char)(i * 7 % 251);
+	}
+
+	handle = _open("copyrange.bin", _O_BINARY|_O_RDWR|O_CREAT|O_TRUNC, 0644);
+	if(handle == -1){goto Test_File_CopyRange_Return;}
+	File_WriteBytes(handle, 0, expected, COPYRANGE_LEN);
+
+	// Destination inside source (back to front), then source inside destination,
+	// both spanning several buffers
+	result = File_CopyRange_Check(handle, expected, actual, 1000, 71000, 120000) &&
+		File_CopyRange_Check(handle, expected, actual, 70001, 3, 129999);
+
+Test_File_CopyRange_Return:
+	if(handle != -1){
+		close(handle);
+		remove("copyrange.bin");
+	}
+	safe_free(expected);
+	safe_free(actual);
+	return result;
+}
@@ -0,0 +1,75 @@
+// Tests that File_OverlayPlan merges overlapping and touching writes, keeps
+// the latest bytes, and that a planning overlay really creates and deletes
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_File_OverlayPlan_Merge()
+{
+	struct WriteBackFile *files;
+	size_t count = 0, i;
+	int handle;
+	BOOL result = TRUE;
+
+	File_Create("plan.bin", 32);
+	File_Create("plangone.bin", 32);
+
+	File_OverlayBeginPlan();
+	handle = File_OpenSafe("plan.bin", _O_BINARY|_O_RDWR);
+	File_WriteBytes(handle, 0, (const unsigned char *)"AAAA", 4);
+	File_WriteBytes(handle, 2, (const unsigned char *)"BBBB", 4);
+	File_WriteBytes(handle, 12, (const unsigned char *)"DD", 2);
+	File_WriteBytes(handle, 10, (const unsigned char *)"CC", 2);
+	close(handle);
+
+	// Writes to a file that's then deleted go nowhere
+	handle = File_OpenSafe("plangone.bin", _O_BINARY|_O_RDWR);
+	File_WriteBytes(handle, 0, (const unsigned char *)"EEEE", 4);
+	close(handle);
+	File_Delete("plangone.bin");
+	if(File_Exists("plangone.bin", FALSE, FALSE)){
+		fprintf(stderr, "File_Delete didn't delete during planning.\n");
+		result = FALSE;
+	}
+	File_Create("plannew.bin", 8);
+	if(!File_Exists("plannew.bin", FALSE, FALSE)){
+		fprintf(stderr, "File_Create didn't create during planning.\n");
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+
+	files = File_OverlayPlan(&count);
+	File_OverlayEnd();
+
+	if(files == NULL || count != 1 || !streq(files[0].Name, "plan.bin")){
+		fprintf(stderr, "Expected one planned file, got %d.\n", (int)count);
+		result = FALSE;
+	} else if(
+		files[0].WriteCount != 2 ||
+		files[0].Writes[0].Offset != 0 || files[0].Writes[0].Len != 6 ||
+		memcmp(files[0].Writes[0].Bytes, "AABBBB", 6) != 0 ||
+		files[0].Writes[1].Offset != 10 || files[0].Writes[1].Len != 4 ||
+		memcmp(files[0].Writes[1].Bytes, "CCDD", 4) != 0
+	){
+		fprintf(stderr, "Planned writes weren't merged correctly.\n");
+		result = FALSE;
+	}
+
+	// Nothing was written yet
+	if(!Proto_Checksum("plan.bin", 0x190A55AD, TRUE)){
+		result = FALSE;
+	}
+
+	for(i = 0; i < count; i++){
+		size_t j;
+		for(j = 0; j < files[i].WriteCount; j++){
+			safe_free(files[i].Writes[j].Bytes);
+		}
+		safe_free(files[i].Writes);
+		safe_free(files[i].Name);
+	}
+	safe_free(files);
+	remove("plan.bin");
+	remove("plannew.bin");
+	return result;
+}
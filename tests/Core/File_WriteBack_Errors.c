@@ -0,0 +1,73 @@
+// Tests that File_WriteBack writes every file and reports failures in order
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+#define WRITEBACK_FILES 4
+
+int Test_File_WriteBack_Errors()
+{
+	struct WriteBackFile files[WRITEBACK_FILES];
+	struct WriteBackWrite writes[WRITEBACK_FILES][2];
+	unsigned char payload[WRITEBACK_FILES][2][16];
+	char names[WRITEBACK_FILES][32];
+	BOOL result = TRUE;
+	int i, j;
+
+	memset(files, 0, sizeof(files));
+	for(i = 0; i < WRITEBACK_FILES; i++){
+		snprintf(names[i], sizeof(names[i]), "writeback%d.bin", i);
+		files[i].Name = names[i];
+		files[i].Handle = _open(names[i], _O_BINARY|_O_RDWR|O_CREAT|O_TRUNC, 0644);
+		files[i].Writes = writes[i];
+		files[i].WriteCount = 2;
+		for(j = 0; j < 2; j++){
+			memset(payload[i][j], 'A' + i * 2 + j, 16);
+			writes[i][j].Offset = j * 100;
+			writes[i][j].Len = 16;
+			writes[i][j].Bytes = payload[i][j];
+		}
+	}
+
+	// Files 1 and 3 can't be written
+	close(files[1].Handle);
+	files[1].Handle = -1;
+	close(files[3].Handle);
+	files[3].Handle = _open(names[3], _O_BINARY|_O_RDONLY);
+
+	if(File_WriteBack(files, WRITEBACK_FILES)){
+		fprintf(stderr, "File_WriteBack didn't report the broken files.\n");
+		result = FALSE;
+	}
+	if(CURRERROR != errCRIT_FILESYS){
+		fprintf(stderr, "CURRERROR is %d, expected %d.\n", CURRERROR, errCRIT_FILESYS);
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+
+	for(i = 0; i < WRITEBACK_FILES; i++){
+		BOOL broken = (i == 1 || i == 3);
+		if((files[i].Error != errNOERR) != broken){
+			fprintf(stderr, "File %d has error %d.\n", i, files[i].Error);
+			result = FALSE;
+		}
+		if(broken){continue;}
+
+		// Both writes should be there
+		for(j = 0; j < 2; j++){
+			unsigned char actual[16];
+			if(File_ReadBytes(files[i].Handle, j * 100, actual, 16) != 16 ||
+				memcmp(actual, payload[i][j], 16) != 0
+			){
+				fprintf(stderr, "Write %d of file %d is missing.\n", j, i);
+				result = FALSE;
+			}
+		}
+	}
+
+	for(i = 0; i < WRITEBACK_FILES; i++){
+		if(files[i].Handle != -1){close(files[i].Handle);}
+		remove(names[i]);
+	}
+	return result;
+}
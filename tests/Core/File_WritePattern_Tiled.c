@@ -0,0 +1,61 @@
+// Tests that pattern fills land on the right bytes and File_Create sizes files
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+#define PATTERN_FILE "pattern.bin"
+#define PATTERN_FILELEN (256 * 1024)
+#define PATTERN_START 3
+#define PATTERN_LEN 150001  // Odd, and more than two 64KB chunks
+
+int Test_File_WritePattern_Tiled()
+{
+	const unsigned char ud2[2] = {0x0F, 0x0B};
+	unsigned char *actual;
+	int handle, i;
+	BOOL result = TRUE;
+
+	if(!File_Create(PATTERN_FILE, PATTERN_FILELEN)){
+		fprintf(stderr, "File_Create failed.\n");
+		return FALSE;
+	}
+	if(filesize(PATTERN_FILE) != PATTERN_FILELEN){
+		fprintf(stderr, "File_Create made a file %ld bytes long, expected %d.\n",
+			filesize(PATTERN_FILE), PATTERN_FILELEN);
+		remove(PATTERN_FILE);
+		return FALSE;
+	}
+
+	handle = _open(PATTERN_FILE, _O_BINARY|_O_RDWR);
+	actual = malloc(PATTERN_FILELEN);
+	if(handle == -1 || !actual){
+		fprintf(stderr, "Could not open the new file.\n");
+		if(handle != -1){close(handle);}
+		safe_free(actual);
+		remove(PATTERN_FILE);
+		return FALSE;
+	}
+
+	File_WritePattern(handle, PATTERN_START, ud2, 2, PATTERN_LEN);
+	if(File_ReadBytes(handle, 0, actual, PATTERN_FILELEN) != PATTERN_FILELEN){
+		fprintf(stderr, "Could not read the file back.\n");
+		result = FALSE;
+	}
+
+	// Zeros either side, UD2 repeated in between (ending on a half)
+	for(i = 0; result && i < PATTERN_FILELEN; i++){
+		unsigned char expected = 0;
+		if(i >= PATTERN_START && i < PATTERN_START + PATTERN_LEN){
+			expected = ud2[(i - PATTERN_START) % 2];
+		}
+		if(actual[i] != expected){
+			fprintf(stderr, "Byte %d is %02X, expected %02X.\n", i, actual[i], expected);
+			result = FALSE;
+		}
+	}
+
+	close(handle);
+	safe_free(actual);
+	remove(PATTERN_FILE);
+	return result;
+}
@@ -0,0 +1,76 @@
+// Tests that a batch of expressions gives the same results as one at a time
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+#define BATCH_SIZE 1000
+
+int Test_Eq_ParseBatch()
+{
+	struct EqBatchItem items[BATCH_SIZE];
+	struct VarValue var = {0};
+	BOOL result = TRUE;
+	int i;
+
+	var.desc = "Description";
+	var.UUID = "Batch.test@invisibleup";
+	var.mod = "test@invisibleup";
+	var.type = uInt16;
+	var.uInt16 = 40;
+	var.norepatch = TRUE;
+	if(!Var_MakeEntry(var)){
+		fprintf(stderr, "Var_MakeEntry failed.\n");
+		return FALSE;
+	}
+
+	// Big enough to be split between threads
+	memset(items, 0, sizeof(items));
+	for(i = 0; i < BATCH_SIZE; i++){
+		switch(i % 4){
+		case 0: items[i].Eq = "$ Batch.test@invisibleup + 2"; break;
+		case 1: items[i].Eq = "exists $ Batch.test@invisibleup"; break;
+		case 2: items[i].Eq = "7.5 * 2"; break;
+		case 3: items[i].Eq = "$ Missing.test@invisibleup - 1"; break;
+		}
+	}
+	items[501].Eq = "1 / 0";
+	items[998].Eq = "1 2";
+
+	if(Eq_ParseBatch(items, BATCH_SIZE)){
+		fprintf(stderr, "Batch with bad expressions succeeded.\n");
+		result = FALSE;
+	}
+	if(CURRERROR != errWNG_MODCFG){
+		fprintf(stderr, "CURRERROR is %d, expected %d.\n", CURRERROR, errWNG_MODCFG);
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+
+	for(i = 0; i < BATCH_SIZE; i++){
+		BOOL bad = (i == 501 || i == 998);
+		if((items[i].Error != errNOERR) != bad){
+			fprintf(stderr, "Item %d has error %d.\n", i, items[i].Error);
+			result = FALSE;
+			continue;
+		}
+		if(bad){continue;}
+
+		// Must match evaluating it on its own
+		if(items[i].Int != Eq_Parse_Int(items[i].Eq, NULL, FALSE) ||
+			items[i].uInt != Eq_Parse_uInt(items[i].Eq, NULL, FALSE) ||
+			items[i].Double != Eq_Parse_Double(items[i].Eq, NULL, FALSE)
+		){
+			fprintf(stderr, "Item %d (%s) doesn't match.\n", i, items[i].Eq);
+			result = FALSE;
+		}
+	}
+
+	if(items[0].Int != 42 || items[1].Int != 1 ||
+		items[2].Double != 15.0 || items[3].Int != -1
+	){
+		fprintf(stderr, "Wrong results: %d %d %f %d\n",
+			items[0].Int, items[1].Int, items[2].Double, items[3].Int);
+		result = FALSE;
+	}
+	return result;
+}
@@ -0,0 +1,54 @@
+// Tests that a batch with more distinct expressions than the program cache
+// holds still runs every item against a live program
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+#define EVICT_SIZE 2500
+
+int Test_Eq_ParseBatch_Evict()
+{
+	struct EqBatchItem *items;
+	char (*text)[32];
+	BOOL result = TRUE;
+	int i;
+
+	items = calloc(EVICT_SIZE, sizeof(struct EqBatchItem));
+	text = malloc(EVICT_SIZE * sizeof(*text));
+	if(items == NULL || text == NULL){
+		safe_free(items);
+		safe_free(text);
+		return FALSE;
+	}
+
+	// All different, so the cache has to be cleared part way through
+	for(i = 0; i < EVICT_SIZE; i++){
+		snprintf(text[i], sizeof(text[i]), "%d * 3 + 1", i);
+		items[i].Eq = text[i];
+	}
+
+	if(!Eq_ParseBatch(items, EVICT_SIZE)){
+		fprintf(stderr, "Eq_ParseBatch returned FALSE.\n");
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+
+	for(i = 0; i < EVICT_SIZE; i++){
+		if(items[i].Error != errNOERR || items[i].Int != i * 3 + 1){
+			fprintf(stderr, "Item %d gave %d (error %d), expected %d.\n",
+				i, items[i].Int, items[i].Error, i * 3 + 1);
+			result = FALSE;
+			break;
+		}
+	}
+
+	// And the cache still works afterwards
+	if(Eq_Parse_Int("5 * 3 + 1", NULL, FALSE) != 16){
+		fprintf(stderr, "Single expression after the batch failed.\n");
+		result = FALSE;
+	}
+
+	safe_free(items);
+	safe_free(text);
+	return result;
+}
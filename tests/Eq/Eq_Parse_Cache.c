@@ -0,0 +1,73 @@
+// Tests that compiled expressions still follow changes to the variables
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Eq_Parse_Cache()
+{
+	struct VarValue var = {0};
+	int i;
+	var.desc = "Description";
+	var.UUID = "Scale.test@invisibleup";
+	var.mod = "test@invisibleup";
+	var.type = Int32;
+	var.Int32 = 2;
+	var.norepatch = TRUE;
+
+	// Same text, same answer
+	for(i = 0; i < 3; i++){
+		if(Eq_Parse_Int("( 0x10 + 1 )", NULL, FALSE) != 17){
+			fprintf(stderr, "Constant expression changed on run %d.\n", i);
+			return FALSE;
+		}
+	}
+
+	// Missing variables read as 0
+	if(Eq_Parse_Int("$ Scale.test@invisibleup * 3", NULL, FALSE) != 0 ||
+		Eq_Parse_Int("exists $ Scale.test@invisibleup", NULL, FALSE) != 0
+	){
+		fprintf(stderr, "Missing variable didn't read as 0.\n");
+		return FALSE;
+	}
+
+	if(!Var_MakeEntry(var)){
+		fprintf(stderr, "Var_MakeEntry failed.\n");
+		return FALSE;
+	}
+	if(Eq_Parse_Int("$ Scale.test@invisibleup * 3", NULL, FALSE) != 6 ||
+		Eq_Parse_Int("exists $ Scale.test@invisibleup", NULL, FALSE) != 1
+	){
+		fprintf(stderr, "New variable wasn't seen.\n");
+		return FALSE;
+	}
+
+	var.Int32 = 5;
+	if(!Var_MakeEntry(var)){
+		fprintf(stderr, "Second Var_MakeEntry failed.\n");
+		return FALSE;
+	}
+	if(Eq_Parse_Int("$ Scale.test@invisibleup * 3", NULL, FALSE) != 15){
+		fprintf(stderr, "Updated variable wasn't seen.\n");
+		return FALSE;
+	}
+
+	if(!Var_ClearEntry(var.mod)){
+		fprintf(stderr, "Var_ClearEntry failed.\n");
+		return FALSE;
+	}
+	if(Eq_Parse_Int("$ Scale.test@invisibleup * 3", NULL, FALSE) != 0){
+		fprintf(stderr, "Removed variable was still seen.\n");
+		return FALSE;
+	}
+
+	// Bad expressions are reported every time, not just the first
+	for(i = 0; i < 2; i++){
+		Eq_Parse_Int("1 2", NULL, FALSE);
+		if(CURRERROR != errWNG_MODCFG){
+			fprintf(stderr, "Mismatched expression not reported on run %d.\n", i);
+			return FALSE;
+		}
+	}
+	CURRERROR = errNOERR;
+	return TRUE;
+}
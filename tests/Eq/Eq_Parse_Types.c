@@ -0,0 +1,58 @@
+// Tests integer, unsigned and floating-point arithmetic in expressions
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Eq_Parse_Types()
+{
+	BOOL result = TRUE;
+
+	// Left side first
+	if(Eq_Parse_Int("10 - 3", NULL, FALSE) != 7 ||
+		Eq_Parse_Int("12 / 4", NULL, FALSE) != 3 ||
+		Eq_Parse_Int("1 << 4", NULL, FALSE) != 16 ||
+		Eq_Parse_Int("2 < 3", NULL, FALSE) != 1
+	){
+		fprintf(stderr, "Operands were swapped.\n");
+		result = FALSE;
+	}
+	if(Eq_Parse_Int("7 % 4", NULL, FALSE) != 3){
+		fprintf(stderr, "7 %% 4 isn't 3.\n");
+		result = FALSE;
+	}
+
+	// Intermediate values aren't limited to 32 bits
+	if(Eq_Parse_Int("0x100000000 >> 4", NULL, FALSE) != 0x10000000){
+		fprintf(stderr, "64-bit intermediate was cut off.\n");
+		result = FALSE;
+	}
+	if(Eq_Parse_uInt("0xFFFFFFFF + 1", NULL, FALSE) != 0){
+		fprintf(stderr, "Unsigned result didn't wrap.\n");
+		result = FALSE;
+	}
+	if(Eq_Parse_Int("-1 < 0x80000000", NULL, FALSE) != 1){
+		fprintf(stderr, "Signed/unsigned comparison is wrong.\n");
+		result = FALSE;
+	}
+
+	// Doubles
+	if(Eq_Parse_Double("1.5 * 3", NULL, FALSE) != 4.5 ||
+		Eq_Parse_Double("7.0 / 2", NULL, FALSE) != 3.5 ||
+		Eq_Parse_Double("7 / 2", NULL, FALSE) != 3
+	){
+		fprintf(stderr, "Floating-point result is wrong.\n");
+		result = FALSE;
+	}
+	if(Eq_Parse_Int("2.9 * 2", NULL, FALSE) != 5){
+		fprintf(stderr, "Double wasn't truncated when returned as int.\n");
+		result = FALSE;
+	}
+
+	// Division by zero is an error, not a crash
+	if(Eq_Parse_Int("1 / 0", NULL, FALSE) != 0 || CURRERROR != errWNG_MODCFG){
+		fprintf(stderr, "Division by zero wasn't reported.\n");
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+	return result;
+}
@@ -0,0 +1,64 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Dep_InstallOrder()
+{
+    json_t *mod, *child;
+    char *modpath, *order;
+    BOOL result = TRUE;
+
+    asprintf(&modpath, "%s/test/Mod_/dependency.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    child = json_pack("{s:s, s:s, s:i}",
+        "UUID", "variable@test", "Name", "variable", "Version", 1);
+
+    // Everything here gets rolled back afterwards
+    sqlite3_exec(CURRDB, "SAVEPOINT DepTest;", NULL, NULL, NULL);
+    Dep_Invalidate();
+
+    if(Mod_CheckDep(mod)){
+        fprintf(stderr, "Dependency satisfied before it was installed.\n");
+        result = FALSE;
+    }
+
+    // Install dependency, then the mod that needs it
+    Mod_AddToDB(child, "");
+    if(!Mod_CheckDep(mod)){
+        fprintf(stderr, "Dependency not satisfied after it was installed.\n");
+        result = FALSE;
+    }
+    Mod_AddToDB(mod, modpath);
+
+    if(!Mod_FindDep("variable@test")){
+        fprintf(stderr, "variable@test has no dependents.\n");
+        result = FALSE;
+    }
+
+    order = Dep_InstallOrder();
+    if(order == NULL ||
+        !streq(order, "variable@test") ||
+        !streq(order + strlen(order) + 1, "dependency@test")
+    ){
+        fprintf(stderr, "Install order is wrong.\n");
+        result = FALSE;
+    }
+    safe_free(order);
+
+    // Cycles must be refused
+    Dep_AddEdge("variable@test", "dependency@test");
+    order = Dep_InstallOrder();
+    if(order != NULL || CURRERROR != errWNG_MODCFG){
+        fprintf(stderr, "Dependency cycle not detected.\n");
+        result = FALSE;
+    }
+    safe_free(order);
+    CURRERROR = errNOERR;
+
+    sqlite3_exec(CURRDB, "ROLLBACK TO DepTest; RELEASE DepTest;", NULL, NULL, NULL);
+    Dep_Invalidate();
+
+    safe_free(modpath);
+    json_decref(mod);
+    json_decref(child);
+    return result;
+}
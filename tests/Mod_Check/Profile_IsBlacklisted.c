@@ -0,0 +1,35 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Profile_IsBlacklisted()
+{
+    char *OldVer;
+    BOOL result = TRUE;
+
+    if(!Profile_IsBlacklisted("blacklisted@test")){
+        fprintf(stderr, "blacklisted@test not found in blacklist.\n");
+        result = FALSE;
+    }
+
+    if(Profile_IsBlacklisted("repl@test")){
+        fprintf(stderr, "repl@test wrongly found in blacklist.\n");
+        result = FALSE;
+    }
+
+    // Switching game version must invalidate the cache
+    OldVer = CONFIG.GAMEVER;
+    CONFIG.GAMEVER = strdup("othertestver");
+    if(Profile_IsBlacklisted("blacklisted@test")){
+        fprintf(stderr, "Blacklist not invalidated on profile change.\n");
+        result = FALSE;
+    }
+    safe_free(CONFIG.GAMEVER);
+    CONFIG.GAMEVER = OldVer;
+
+    if(!Profile_IsBlacklisted("blacklisted@test")){
+        fprintf(stderr, "Blacklist not rebuilt after profile change.\n");
+        result = FALSE;
+    }
+
+    return result;
+}
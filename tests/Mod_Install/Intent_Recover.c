@@ -0,0 +1,83 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// Installs a mod, then drops the intent log before the install is finished,
+// as a crash would. Recovery must roll the install back. Then does the same
+// for an uninstall, which recovery must finish.
+int Test_Intent_Recover()
+{
+	json_t *mod;
+    char *modpath;
+    FILE *log;
+    BOOL result = TRUE;
+
+    asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    if(!mod){
+        safe_free(modpath);
+        return FALSE;
+    }
+
+    // Wrap the install in an outer operation that never ends
+    Intent_Begin("Install", "repl@test");
+    result = Mod_Install(mod, modpath);
+    Intent_Close();
+
+    if(result == FALSE){
+        fprintf(stderr, "Mod installation returned FALSE.\n");
+        json_decref(mod);
+        safe_free(modpath);
+        return FALSE;
+    }
+    if(Proto_Checksum("test.bin", 0xE20EEA22, FALSE)){
+        fprintf(stderr, "Install didn't change test.bin.\n");
+        result = FALSE;
+    }
+
+    if(!Intent_Recover()){
+        fprintf(stderr, "Function Intent_Recover returned FALSE.\n");
+        result = FALSE;
+    }
+    if(Var_Exists("Active.repl@test")){
+        fprintf(stderr, "Interrupted install was not rolled back.\n");
+        result = FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    // Log must be gone once recovered
+    log = fopen("mods.intent", "r");
+    if(log != NULL){
+        fprintf(stderr, "Intent log still exists after recovery.\n");
+        fclose(log);
+        result = FALSE;
+    }
+
+    // Now an uninstall that dies before it starts writing
+    if(!Mod_Install(mod, modpath)){
+        fprintf(stderr, "Mod reinstallation returned FALSE.\n");
+        json_decref(mod);
+        safe_free(modpath);
+        return FALSE;
+    }
+    json_decref(mod);
+    safe_free(modpath);
+
+    Intent_Begin("Uninstall", "repl@test");
+    Intent_Close();
+
+    if(!Intent_Recover()){
+        fprintf(stderr, "Function Intent_Recover returned FALSE.\n");
+        result = FALSE;
+    }
+    if(Var_Exists("Active.repl@test")){
+        fprintf(stderr, "Interrupted uninstall was not finished.\n");
+        result = FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -0,0 +1,65 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// A file patch logs its swap, moves the original into BACKUP and copies the
+// replacement in, then dies before the Spaces rows exist. Recovery has
+// nothing in the database to go on, so it must use the logged swap to put
+// the original back, and delete a file the install created from nothing.
+int Test_Intent_Recover_Swap()
+{
+    char *FilePath = NULL, *BakPath = NULL, *BakDir = NULL, *NewPath = NULL;
+    FILE *log;
+    int handle;
+    BOOL result = TRUE;
+
+    asprintf(&FilePath, "%s/test.bin", CONFIG.CURRDIR);
+    asprintf(&BakDir, "%s/BACKUP", CONFIG.CURRDIR);
+    asprintf(&BakPath, "%s/BACKUP/swap test.bin", CONFIG.CURRDIR);
+    asprintf(&NewPath, "%s/swap new.bin", CONFIG.CURRDIR);
+    mkdir(BakDir);
+
+    Intent_Begin("Install", "file_replace@test");
+    Intent_Swap(BakPath, FilePath);
+    if(rename(FilePath, BakPath) != 0){
+        fprintf(stderr, "Couldn't move test.bin aside.\n");
+        result = FALSE;
+    }
+    File_Create(FilePath, 16);
+    handle = File_OpenSafe(FilePath, _O_BINARY | _O_RDWR);
+    File_WritePattern(handle, 0, (const unsigned char *)"\xAA", 1, 16);
+    close(handle);
+
+    Intent_Swap(NULL, NewPath);
+    File_Create(NewPath, 16);
+    Intent_Close();
+
+    if(!Intent_Recover()){
+        fprintf(stderr, "Function Intent_Recover returned FALSE.\n");
+        result = FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+    if(File_Exists(BakPath, FALSE, FALSE)){
+        fprintf(stderr, "Backup was left behind.\n");
+        result = FALSE;
+    }
+    if(File_Exists(NewPath, FALSE, FALSE)){
+        fprintf(stderr, "Created file was not removed.\n");
+        result = FALSE;
+    }
+    CURRERROR = errNOERR;
+
+    log = fopen("mods.intent", "r");
+    if(log != NULL){
+        fprintf(stderr, "Intent log still exists after recovery.\n");
+        fclose(log);
+        result = FALSE;
+    }
+
+    safe_free(FilePath);
+    safe_free(BakPath);
+    safe_free(BakDir);
+    safe_free(NewPath);
+    return result;
+}
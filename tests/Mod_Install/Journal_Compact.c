@@ -0,0 +1,61 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Journal_Compact()
+{
+	json_t *mod;
+    char *modpath;
+    sqlite3_stmt *command;
+    const unsigned char junk[16] = {0};
+    int64_t pos;
+    BOOL result = TRUE;
+
+    // Start with a dead record in front
+    Journal_Truncate(0);
+    Journal_Append("junk", 1, 0, junk, sizeof(junk));
+
+    asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    result = Mod_Install(mod, modpath);
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        return result;
+    }
+
+    if(!Journal_Compact(TRUE)){
+        fprintf(stderr, "Function Journal_Compact returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Only the 4-byte revert record should be left, moved to the front
+    if(Journal_Size() != (int64_t)sizeof(struct JournalHeader) + 4){
+        fprintf(stderr, "Journal is %ld bytes after compaction.\n", (long)Journal_Size());
+        result = FALSE;
+    }
+
+    sqlite3_prepare_v2(CURRDB, "SELECT Journal FROM RevertBlobs;", -1, &command, NULL);
+    pos = SQL_GetNum64(command);
+    sqlite3_finalize(command);
+    if(pos != 0){
+        fprintf(stderr, "Revert entry points to %ld, expected 0.\n", (long)pos);
+        result = FALSE;
+    }
+
+    // Uninstalling must still restore the file, then empty the journal
+    if(!Mod_Uninstall("repl@test")){
+        fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+        return FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+    if(Journal_Size() != 0){
+        fprintf(stderr, "Journal is %ld bytes after uninstall.\n", (long)Journal_Size());
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -0,0 +1,75 @@
+// Tests that a compaction cut short after its commit is finished on next open
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Journal_Compact_Recover()
+{
+	json_t *mod;
+	char *modpath, *tmppath = NULL, *path = NULL;
+	const unsigned char junk[16] = {0};
+	int64_t size;
+	BOOL result;
+
+	asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+	mod = JSON_Load(modpath);
+	result = Mod_Install(mod, modpath);
+	safe_free(modpath);
+	json_decref(mod);
+	if(result == FALSE){
+		fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+		return FALSE;
+	}
+
+	// Pretend generation 1 was committed, but the file never moved into place:
+	// the compacted journal is still the temp file, the real one is junk
+	size = Journal_Size();
+	Journal_Close();
+	asprintf(&path, "%s/undo.journal", CONFIG.CURRDIR);
+	asprintf(&tmppath, "%s/undo.journal.1.tmp", CONFIG.CURRDIR);
+	File_Copy(path, tmppath);
+	{
+		int handle = _open(path, _O_BINARY|_O_WRONLY|O_TRUNC);
+		write(handle, junk, sizeof(junk));
+		close(handle);
+	}
+	sqlite3_exec(CURRDB, "INSERT INTO JournalInfo (Generation) VALUES (1);",
+		NULL, NULL, NULL);
+
+	if(Journal_Size() != size){
+		fprintf(stderr, "Journal is %ld bytes, expected %ld.\n", (long)Journal_Size(), (long)size);
+		result = FALSE;
+	}
+	if(File_Exists(tmppath, FALSE, FALSE)){
+		fprintf(stderr, "Temp file is still there.\n");
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+
+	// A stale file from an uncommitted compaction is just thrown away
+	Journal_Close();
+	safe_free(tmppath);
+	asprintf(&tmppath, "%s/undo.journal.2.tmp", CONFIG.CURRDIR);
+	File_Copy(path, tmppath);
+	{
+		int handle = _open(tmppath, _O_BINARY|_O_WRONLY|O_TRUNC);
+		write(handle, junk, sizeof(junk));
+		close(handle);
+	}
+	if(Journal_Size() != size || File_Exists(tmppath, FALSE, FALSE)){
+		fprintf(stderr, "Stale temp file wasn't discarded.\n");
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+	safe_free(tmppath);
+	safe_free(path);
+
+	if(!Mod_Uninstall("repl@test")){
+		fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+		return FALSE;
+	}
+	if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+		result = FALSE;
+	}
+	return result;
+}
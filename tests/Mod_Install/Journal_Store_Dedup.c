@@ -0,0 +1,59 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Journal_Store_Dedup()
+{
+	json_t *mod;
+    char *modpath;
+    sqlite3_stmt *command;
+    int count;
+    BOOL result = TRUE;
+
+    Journal_Truncate(0);
+
+    asprintf(&modpath, "%s/test/Mod_/dedup.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    result = Mod_Install(mod, modpath);
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        return result;
+    }
+
+    // Both patches overwrote four zero bytes. Should be stored once.
+    sqlite3_prepare_v2(CURRDB,
+        "SELECT (SELECT COUNT(*) FROM Revert) * 100 + "
+        "(SELECT COUNT(*) FROM RevertBlobs) * 10 + "
+        "(SELECT MAX(Refs) FROM RevertBlobs);", -1, &command, NULL);
+    count = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(count != 212){
+        fprintf(stderr, "Expected 2 revert rows, 1 blob with 2 refs; got code %d.\n", count);
+        result = FALSE;
+    }
+    if(Journal_Size() != (int64_t)sizeof(struct JournalHeader) + 4){
+        fprintf(stderr, "Journal is %ld bytes.\n", (long)Journal_Size());
+        result = FALSE;
+    }
+
+    // Both ranges come back from the one record
+    if(!Mod_Uninstall("dedup@test")){
+        fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+        return FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    sqlite3_prepare_v2(CURRDB, "SELECT COUNT(*) FROM RevertBlobs;", -1, &command, NULL);
+    count = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(count != 0){
+        fprintf(stderr, "%d blobs left after uninstall.\n", count);
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -0,0 +1,82 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// Put test.bin back to its unmodded state behind the database's back
+static BOOL Test_ExportStack_Restore()
+{
+    unsigned char zeroes[1024] = {0};
+    int handle, i;
+
+    handle = File_OpenSafe("test.bin", _O_BINARY|_O_RDWR);
+    if(handle == -1){return FALSE;}
+    for(i = 0; i < 256; i++){
+        File_WriteBytes(handle, i * 1024, zeroes, 1024);
+    }
+    close(handle);
+    return Proto_Checksum("test.bin", 0xE20EEA22, TRUE);
+}
+
+int Test_Mod_ExportStack()
+{
+	json_t *mod;
+    char *modpath;
+    unsigned long modded;
+    BOOL result = TRUE;
+
+    asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    if(!mod){
+        safe_free(modpath);
+        return FALSE;
+    }
+    result = Mod_Install(mod, modpath);
+    safe_free(modpath);
+    json_decref(mod);
+    if(result == FALSE){
+        fprintf(stderr, "Mod installation returned FALSE.\n");
+        return FALSE;
+    }
+    modded = crc32File("test.bin");
+
+    if(!Mod_ExportStack("stack.diff")){
+        fprintf(stderr, "Function Mod_ExportStack returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Reapply onto restored files
+    if(!Test_ExportStack_Restore()){
+        fprintf(stderr, "Couldn't restore test.bin.\n");
+        remove("stack.diff");
+        return FALSE;
+    }
+    if(Mod_ApplyStack("stack.diff") != 1){
+        fprintf(stderr, "Stack diff wasn't applied to pristine files.\n");
+        result = FALSE;
+    } else if(crc32File("test.bin") != modded){
+        fprintf(stderr, "Applied stack diff doesn't match the install.\n");
+        result = FALSE;
+    }
+
+    // Files aren't pristine any more
+    if(Mod_ApplyStack("stack.diff") != 0){
+        fprintf(stderr, "Stack diff was applied to already modded files.\n");
+        result = FALSE;
+    }
+
+    // Different set of mods
+    if(!Mod_Uninstall("repl@test")){
+        fprintf(stderr, "Mod uninstallation returned FALSE.\n");
+        remove("stack.diff");
+        return FALSE;
+    }
+    if(Mod_ApplyStack("stack.diff") != 0){
+        fprintf(stderr, "Stack diff was applied to a different stack.\n");
+        result = FALSE;
+    }
+    remove("stack.diff");
+
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+    return result;
+}
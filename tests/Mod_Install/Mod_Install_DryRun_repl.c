@@ -0,0 +1,61 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Mod_Install_DryRun_repl()
+{
+	json_t *mod, *report;
+    char *modpath;
+    BOOL result = TRUE;
+
+    // Load first patch
+    asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+
+    report = Mod_InstallDryRun(mod, modpath);
+
+    // Unload
+    safe_free(modpath);
+    json_decref(mod);
+
+    // Test if function succeeded
+    if(report == NULL){
+        fprintf(stderr, "Function Mod_InstallDryRun returned NULL.\n");
+        return FALSE;
+    }
+
+    if(!json_is_true(json_object_get(report, "Result"))){
+        fprintf(stderr, "Dry run reported failure.\n");
+        result = FALSE;
+    }
+
+    if(json_array_size(json_object_get(report, "Failures")) != 0){
+        fprintf(stderr, "Dry run reported %d failures.\n",
+            (int)json_array_size(json_object_get(report, "Failures")));
+        result = FALSE;
+    }
+
+    if(json_array_size(json_object_get(report, "Allocations")) == 0){
+        fprintf(stderr, "Dry run reported no allocations.\n");
+        result = FALSE;
+    }
+
+    if(json_integer_value(json_object_get(report, "BytesTouched")) != 4){
+        fprintf(stderr, "Dry run touched %d bytes, expected 4.\n",
+            (int)json_integer_value(json_object_get(report, "BytesTouched")));
+        result = FALSE;
+    }
+    json_decref(report);
+
+    // Nothing should have actually been installed
+    if(Var_Exists("Active.repl@test")){
+        fprintf(stderr, "Dry run left mod in database.\n");
+        result = FALSE;
+    }
+
+    // File should be untouched
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -0,0 +1,49 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Mod_Install_UnitTest_copy()
+{
+	json_t *mod;
+    char *modpath;
+    unsigned char bytes[4];
+    const unsigned char expected[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+    int handle;
+    BOOL result = TRUE;
+
+    // Load mod
+    asprintf(&modpath, "%s/test/Mod_/copy.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+
+    result = Mod_Install(mod, modpath);
+
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Copied bytes should be at the destination
+    handle = File_OpenSafe("test.bin", _O_BINARY|_O_RDONLY);
+    if(handle == -1){return FALSE;}
+    File_ReadBytes(handle, 131072, bytes, 4);
+    close(handle);
+
+    if(memcmp(bytes, expected, 4) != 0){
+        fprintf(stderr, "Copy wrote %02X%02X%02X%02X, expected DEADBEEF.\n",
+            bytes[0], bytes[1], bytes[2], bytes[3]);
+        result = FALSE;
+    }
+
+    // Uninstall should bring the original back
+    if(!Mod_Uninstall("copy@test")){
+        fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+        return FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
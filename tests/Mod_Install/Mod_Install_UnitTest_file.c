@@ -0,0 +1,59 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Mod_Install_UnitTest_file()
+{
+	json_t *mod;
+    char *modpath, *modfile;
+    sqlite3_stmt *command;
+    int spaceCount;
+    BOOL result = TRUE;
+
+    // Load mod
+    asprintf(&modpath, "%s/test/Mod_/file_replace/", CONFIG.PROGDIR);
+    asprintf(&modfile, "%sinfo.json", modpath);
+    mod = JSON_Load(modfile);
+    if(!mod){
+        safe_free(modfile);
+        safe_free(modpath);
+        return FALSE;
+    }
+
+    result = Mod_Install(mod, modpath);
+
+    safe_free(modfile);
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        return FALSE;
+    }
+
+    // File should now be the 16-byte replacement
+    if(!Proto_Checksum("test.bin", 0x983C37B5, TRUE)){
+        result = FALSE;
+    }
+
+    // One Delete/New pair and nothing in the revert store
+    sqlite3_prepare_v2(CURRDB,
+        "SELECT (SELECT COUNT(*) FROM Spaces WHERE Mod = 'file_replace@test') * 10 + "
+        "(SELECT COUNT(*) FROM Revert);", -1, &command, NULL);
+    spaceCount = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(spaceCount != 20){
+        fprintf(stderr, "Expected 2 spaces and no revert rows, got code %d.\n", spaceCount);
+        result = FALSE;
+    }
+
+    // Uninstall should bring the original back
+    if(!Mod_Uninstall("file_replace@test")){
+        fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+        return FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -0,0 +1,67 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Mod_Install_UnitTest_reloc()
+{
+	json_t *mod;
+    char *modpath;
+    unsigned char bytes[16];
+    const unsigned char expected[16] = {
+        0x78, 0x56, 0x34, 0x12, 0x00, 0x00, 0x00, 0x00,
+        0xF4, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00
+    };
+    sqlite3_stmt *command;
+    int patchCount;
+    int handle, i;
+    BOOL result = TRUE;
+
+    // Load mod
+    asprintf(&modpath, "%s/test/Mod_/reloc.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+
+    result = Mod_Install(mod, modpath);
+
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Both fixups should be applied to the copied payload
+    // (Abs32 as-is, Rel32 relative to the end of the field)
+    handle = File_OpenSafe("test.bin", _O_BINARY|_O_RDONLY);
+    if(handle == -1){return FALSE;}
+    File_ReadBytes(handle, 131072, bytes, 16);
+    close(handle);
+
+    for(i = 0; i < 16; i++){
+        if(bytes[i] != expected[i]){
+            fprintf(stderr, "Byte %d is %02X, expected %02X.\n", i, bytes[i], expected[i]);
+            result = FALSE;
+        }
+    }
+
+    // The whole payload is one patch with one revert entry
+    sqlite3_prepare_v2(CURRDB,
+        "SELECT COUNT(*) FROM Revert WHERE PatchUUID LIKE '%reloc@test';",
+        -1, &command, NULL);
+    patchCount = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(patchCount != 2){
+        fprintf(stderr, "Expected 2 revert rows (clear + reloc), got %d.\n", patchCount);
+        result = FALSE;
+    }
+
+    // Uninstall should bring the original back
+    if(!Mod_Uninstall("reloc@test")){
+        fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+        return FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
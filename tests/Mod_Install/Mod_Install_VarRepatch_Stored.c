@@ -0,0 +1,81 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// Installs the variable_repatch host from a scratch copy, deletes the copy,
+// then installs the user mod. The host's patch must be replayed from the
+// database, and only once even though two of its fields use the variable.
+int Test_Mod_Install_VarRepatch_Stored()
+{
+	json_t *mod;
+    char *modpath, *modfile;
+    sqlite3_stmt *command;
+    int rowCount;
+    BOOL result = TRUE;
+
+    // Install host from a copy we can take away
+    asprintf(&modfile, "%s/test/Mod_/variable_repatch/host/info.json", CONFIG.PROGDIR);
+    mkdir("repatch_stored");
+    File_Copy(modfile, "repatch_stored/info.json");
+    safe_free(modfile);
+
+    mod = JSON_Load("repatch_stored/info.json");
+    if(!mod){
+        return FALSE;
+    }
+    result = Mod_Install(mod, "repatch_stored/");
+    json_decref(mod);
+
+    remove("repatch_stored/info.json");
+    remove("repatch_stored");
+
+    if(result == FALSE){
+        fprintf(stderr, "Host mod installation returned FALSE.\n");
+        return FALSE;
+    }
+
+    // One dependency row and one stored patch, not one per expression
+    sqlite3_prepare_v2(CURRDB,
+        "SELECT (SELECT COUNT(*) FROM VarRepatch WHERE ModPath = 'repatch_stored/') * 10 + "
+        "(SELECT COUNT(*) FROM VarRepatchPatch WHERE Mod = 'variable_repatch_host@test');",
+        -1, &command, NULL);
+    rowCount = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(rowCount != 11){
+        fprintf(stderr, "Expected 1 VarRepatch and 1 VarRepatchPatch row, found %d and %d.\n",
+            rowCount / 10, rowCount % 10);
+        return FALSE;
+    }
+
+    // Install user, which bumps the host's variable
+    asprintf(&modpath, "%s/test/Mod_/variable_repatch/user/", CONFIG.PROGDIR);
+    asprintf(&modfile, "%sinfo.json", modpath);
+    mod = JSON_Load(modfile);
+    if(!mod){
+        safe_free(modfile);
+        safe_free(modpath);
+        return FALSE;
+    }
+
+    result = Mod_Install(mod, modpath);
+
+    safe_free(modfile);
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "User mod installation returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Host patch should have been replayed without its info.json
+    {
+        struct VarValue var = Var_GetValue_SQL("End.ClearSpot.variable_repatch_host@test");
+        if(var.uInt8 != 4){
+            fprintf(stderr, "Value for End.ClearSpot.variable_repatch_host@test does not match! (Found %d, expected %d)\n", var.uInt8, 4);
+            result = FALSE;
+        }
+        Var_Destructor(&var);
+    }
+
+    return result;
+}
@@ -0,0 +1,77 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// Build a double-null-terminated list holding one preflight test mod
+static char * Test_Preflight_One(const char *name)
+{
+    char *list = NULL;
+    int len;
+
+    len = asprintf(&list, "%s/test/Mod_/preflight/%s%c",
+        CONFIG.PROGDIR, name, '\0');
+    if(len == -1){return NULL;}
+    return list;
+}
+
+int Test_Mod_Preflight_Installed()
+{
+    json_t *report, *conflict, *patches, *installed;
+    char *list;
+    BOOL result = TRUE;
+
+    // A replaces 0-8 and goes in first
+    list = Test_Preflight_One("a");
+    if(!Mod_InstallSeries(list)){
+        fprintf(stderr, "Function Mod_InstallSeries returned FALSE.\n");
+        safe_free(list);
+        return FALSE;
+    }
+
+    // Checking A again mustn't trip over its own installed copy
+    report = Mod_PreflightSeries(list);
+    safe_free(list);
+    if(report == NULL){
+        fprintf(stderr, "Function Mod_PreflightSeries returned NULL.\n");
+        return FALSE;
+    }
+    if(!json_is_true(json_object_get(report, "Result"))){
+        fprintf(stderr, "Preflight of installed A conflicts with itself.\n");
+        result = FALSE;
+    }
+    json_decref(report);
+
+    // B clears 4-12, on top of what A wrote
+    list = Test_Preflight_One("b");
+    report = Mod_PreflightSeries(list);
+    safe_free(list);
+    if(report == NULL){
+        fprintf(stderr, "Function Mod_PreflightSeries returned NULL.\n");
+        return FALSE;
+    }
+    if(json_is_true(json_object_get(report, "Result")) ||
+        json_array_size(json_object_get(report, "Conflicts")) != 1
+    ){
+        fprintf(stderr, "Preflight of B over installed A should report one conflict.\n");
+        json_decref(report);
+        return FALSE;
+    }
+
+    conflict = json_array_get(json_object_get(report, "Conflicts"), 0);
+    patches = json_object_get(conflict, "Patches");
+    installed = json_array_get(patches, 0);
+    if(
+        json_integer_value(json_object_get(conflict, "Start")) != 4 ||
+        json_integer_value(json_object_get(conflict, "End")) != 8 ||
+        !streq(json_string_value(json_object_get(installed, "Mod")),
+            "preflight_a@test") ||
+        json_integer_value(json_object_get(installed, "PatchNo")) != -1 ||
+        !streq(json_string_value(json_object_get(json_array_get(patches, 1), "Patch")),
+            "Middle.preflight_b@test")
+    ){
+        fprintf(stderr, "Conflict doesn't name bytes 4-8 of installed A and B.\n");
+        result = FALSE;
+    }
+    json_decref(report);
+
+    return result;
+}
@@ -0,0 +1,90 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// Build a double-null-terminated list of two preflight test mods
+static char * Test_Preflight_List(const char *first, const char *second)
+{
+    char *list = NULL;
+    int len;
+
+    len = asprintf(&list, "%s/test/Mod_/preflight/%s%c%s/test/Mod_/preflight/%s%c",
+        CONFIG.PROGDIR, first, '\0', CONFIG.PROGDIR, second, '\0');
+    if(len == -1){return NULL;}
+    return list;
+}
+
+int Test_Mod_Preflight_Series()
+{
+    json_t *report, *conflict, *patches;
+    char *list;
+    BOOL result = TRUE;
+
+    // A and C touch neighbouring bytes; C's second patch can't be placed yet
+    list = Test_Preflight_List("a", "c");
+    report = Mod_PreflightSeries(list);
+    safe_free(list);
+    if(report == NULL){
+        fprintf(stderr, "Function Mod_PreflightSeries returned NULL.\n");
+        return FALSE;
+    }
+    if(!json_is_true(json_object_get(report, "Result"))){
+        fprintf(stderr, "Preflight of A+C reported %d conflicts, expected none.\n",
+            (int)json_array_size(json_object_get(report, "Conflicts")));
+        result = FALSE;
+    }
+    if(json_array_size(json_object_get(report, "Unresolved")) != 1){
+        fprintf(stderr, "Preflight of A+C reported %d unresolved patches, expected 1.\n",
+            (int)json_array_size(json_object_get(report, "Unresolved")));
+        result = FALSE;
+    }
+    json_decref(report);
+
+    // A replaces 0-8, B clears 4-12
+    list = Test_Preflight_List("a", "b");
+    report = Mod_PreflightSeries(list);
+    if(report == NULL){
+        fprintf(stderr, "Function Mod_PreflightSeries returned NULL.\n");
+        safe_free(list);
+        return FALSE;
+    }
+    if(json_is_true(json_object_get(report, "Result")) ||
+        json_array_size(json_object_get(report, "Conflicts")) != 1
+    ){
+        fprintf(stderr, "Preflight of A+B should report exactly one conflict.\n");
+        json_decref(report);
+        safe_free(list);
+        return FALSE;
+    }
+
+    conflict = json_array_get(json_object_get(report, "Conflicts"), 0);
+    patches = json_object_get(conflict, "Patches");
+    if(
+        json_integer_value(json_object_get(conflict, "Start")) != 4 ||
+        json_integer_value(json_object_get(conflict, "End")) != 8 ||
+        !streq(json_string_value(json_object_get(json_array_get(patches, 0), "Patch")),
+            "Head.preflight_a@test") ||
+        !streq(json_string_value(json_object_get(json_array_get(patches, 1), "Patch")),
+            "Middle.preflight_b@test")
+    ){
+        fprintf(stderr, "Conflict doesn't name bytes 4-8 of Head and Middle.\n");
+        result = FALSE;
+    }
+    json_decref(report);
+
+    // The real thing must refuse before writing anything
+    if(Mod_InstallSeries(list)){
+        fprintf(stderr, "Mod_InstallSeries installed a conflicting stack.\n");
+        result = FALSE;
+    }
+    safe_free(list);
+
+    if(Var_Exists("Active.preflight_a@test")){
+        fprintf(stderr, "Preflight A was installed anyway.\n");
+        result = FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
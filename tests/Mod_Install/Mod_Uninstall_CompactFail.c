@@ -0,0 +1,63 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// Uninstalls a mod when the journal is due for compaction but compaction
+// can't write its temporary file. The uninstall must still succeed and
+// clear the mod's variables; the journal is just left as it was.
+int Test_Mod_Uninstall_CompactFail()
+{
+	json_t *mod;
+    char *modpath, *tmppath = NULL, *Hash;
+    unsigned char junk[4096] = {0};
+    const unsigned char keep[16] = {1};
+    int64_t before;
+    BOOL result = TRUE;
+
+    // Mostly dead journal, with one record that has to survive
+    Journal_Truncate(0);
+    Journal_Append("junk", 1, 0, junk, sizeof(junk));
+    Hash = Journal_Store("keep", 1, 0, keep, sizeof(keep));
+    if(Hash == NULL){
+        fprintf(stderr, "Function Journal_Store returned NULL.\n");
+        return FALSE;
+    }
+
+    asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    result = Mod_Install(mod, modpath);
+    safe_free(modpath);
+    json_decref(mod);
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        safe_free(Hash);
+        return FALSE;
+    }
+
+    // A directory where the compacted journal would go
+    asprintf(&tmppath, "%s/undo.journal.1.tmp", CONFIG.CURRDIR);
+    mkdir(tmppath);
+    before = Journal_Size();
+
+    if(!Mod_Uninstall("repl@test")){
+        fprintf(stderr, "Mod_Uninstall failed because compaction did.\n");
+        result = FALSE;
+    }
+    if(Var_Exists("Active.repl@test")){
+        fprintf(stderr, "Variables outlived the mod.\n");
+        result = FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+    if(Journal_Size() != before){
+        fprintf(stderr, "Journal went from %ld to %ld bytes.\n", (long)before, (long)Journal_Size());
+        result = FALSE;
+    }
+    CURRERROR = errNOERR;
+
+    rmdir(tmppath);
+    safe_free(tmppath);
+    Journal_Release(Hash);
+    safe_free(Hash);
+    return result;
+}
@@ -0,0 +1,64 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+// A Move captures both its source and its destination. Both have to be
+// put back on uninstall.
+int Test_Mod_Uninstall_move()
+{
+	json_t *mod;
+    char *modpath;
+    unsigned char bytes[4];
+    const unsigned char expected[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+    sqlite3_stmt *command;
+    int handle, rowCount;
+    BOOL result = TRUE;
+
+    // Load mod
+    asprintf(&modpath, "%s/test/Mod_/move.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+
+    result = Mod_Install(mod, modpath);
+
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Moved bytes should be at the destination
+    handle = File_OpenSafe("test.bin", _O_BINARY|_O_RDONLY);
+    if(handle == -1){return FALSE;}
+    File_ReadBytes(handle, 131072, bytes, 4);
+    close(handle);
+
+    if(memcmp(bytes, expected, 4) != 0){
+        fprintf(stderr, "Move wrote %02X%02X%02X%02X, expected DEADBEEF.\n",
+            bytes[0], bytes[1], bytes[2], bytes[3]);
+        result = FALSE;
+    }
+
+    // One Revert row for the source, one for the destination
+    sqlite3_prepare_v2(CURRDB,
+        "SELECT COUNT(*) FROM Revert WHERE PatchUUID IN "
+        "(SELECT PatchID FROM Spaces WHERE Mod = 'move@test' "
+        "AND UPPER(Type) = 'ADD' AND Start = 131072);", -1, &command, NULL);
+    rowCount = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(rowCount != 2){
+        fprintf(stderr, "Move has %d Revert rows, expected 2.\n", rowCount);
+        result = FALSE;
+    }
+
+    // Uninstall should bring the original back
+    if(!Mod_Uninstall("move@test")){
+        fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+        return FALSE;
+    }
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -0,0 +1,50 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Mod_Uninstall_repl()
+{
+	json_t *mod;
+    char *modpath;
+    sqlite3_stmt *command;
+    int rowCount;
+    BOOL result = TRUE;
+
+    // Install first patch
+    asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+
+    result = Mod_Install(mod, modpath);
+
+    // Unload
+    safe_free(modpath);
+    json_decref(mod);
+
+    if(result == FALSE){
+        fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+        return result;
+    }
+
+    // Remove it again
+    if(!Mod_Uninstall("repl@test")){
+        fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+        return FALSE;
+    }
+
+    // File should be back to all zeroes
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    // Nothing should be left behind
+    sqlite3_prepare_v2(CURRDB,
+        "SELECT (SELECT COUNT(*) FROM Spaces WHERE Mod = 'repl@test') + "
+        "(SELECT COUNT(*) FROM Revert);", -1, &command, NULL);
+    rowCount = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(rowCount != 0){
+        fprintf(stderr, "%d rows left after uninstall.\n", rowCount);
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -0,0 +1,98 @@
+// Tests that a version 1 database is upgraded in place, and a newer one refused
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+static int SchemaVersion(void)
+{
+	sqlite3_stmt *command;
+	int version;
+
+	sqlite3_prepare_v2(CURRDB, "PRAGMA user_version;", -1, &command, NULL);
+	version = SQL_GetNum(command);
+	sqlite3_finalize(command);
+	return version;
+}
+
+int Test_SQL_Upgrade_v1()
+{
+	json_t *mod;
+	char *modpath;
+	sqlite3_stmt *command;
+	int count;
+	BOOL result;
+
+	asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+	mod = JSON_Load(modpath);
+	result = Mod_Install(mod, modpath);
+	safe_free(modpath);
+	json_decref(mod);
+	if(result == FALSE){
+		fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+		return FALSE;
+	}
+
+	// Turn it back into what version 1 left behind: original bytes (all
+	// zeroes in test.bin) inline, no journal, stored Start./End. variables
+	Journal_Truncate(0);
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"CREATE TABLE Revert_old AS "
+			"SELECT PatchUUID, Start, zeroblob(Len) AS OldBytes FROM Revert;"
+		"DROP TABLE Revert; DROP TABLE RevertBlobs; DROP TABLE JournalInfo;"
+		"ALTER TABLE Revert_old RENAME TO Revert;"
+		"INSERT INTO Variables (UUID, Mod, Type, Value) VALUES "
+			"('Start.old@test', 'MODLOADER@invisibleup', 'uInt32Pointer', 0);"
+		"PRAGMA user_version = 1;",
+		NULL, NULL, NULL)
+	) != 0){
+		return FALSE;
+	}
+
+	sqlite3_close_v2(CURRDB);
+	if(!SQL_Load()){
+		fprintf(stderr, "SQL_Load couldn't upgrade the database.\n");
+		return FALSE;
+	}
+	if(SchemaVersion() != 3){
+		fprintf(stderr, "Database is version %d after upgrade.\n", SchemaVersion());
+		result = FALSE;
+	}
+
+	sqlite3_prepare_v2(CURRDB,
+		"SELECT (SELECT COUNT(*) FROM Revert WHERE Hash IS NOT NULL) * 100 + "
+		"(SELECT COUNT(*) FROM RevertBlobs) * 10 + "
+		"(SELECT COUNT(*) FROM Variables WHERE UUID = 'Start.old@test');",
+		-1, &command, NULL);
+	count = SQL_GetNum(command);
+	sqlite3_finalize(command);
+	if(count != 110){
+		fprintf(stderr, "Expected 1 Revert, 1 RevertBlobs and no Start. row; got %03d.\n",
+			count);
+		result = FALSE;
+	}
+
+	// The moved revert data has to actually restore the file
+	if(!Mod_Uninstall("repl@test")){
+		fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+		return FALSE;
+	}
+	if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+		result = FALSE;
+	}
+
+	// A database from a later version is left alone
+	sqlite3_exec(CURRDB, "PRAGMA user_version = 99;", NULL, NULL, NULL);
+	sqlite3_close_v2(CURRDB);
+	if(SQL_Load()){
+		fprintf(stderr, "SQL_Load accepted a newer database.\n");
+		result = FALSE;
+	}
+	CURRERROR = errNOERR;
+	if(SchemaVersion() != 99){
+		fprintf(stderr, "Newer database was changed to version %d.\n", SchemaVersion());
+		result = FALSE;
+	}
+	sqlite3_exec(CURRDB, "PRAGMA user_version = 3;", NULL, NULL, NULL);
+
+	return result;
+}
@@ -0,0 +1,68 @@
+// Tests that a version 2 database gets the file of each Revert row filled in
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_SQL_Upgrade_v2()
+{
+	json_t *mod;
+	char *modpath;
+	sqlite3_stmt *command;
+	int count;
+	BOOL result;
+
+	asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+	mod = JSON_Load(modpath);
+	result = Mod_Install(mod, modpath);
+	safe_free(modpath);
+	json_decref(mod);
+	if(result == FALSE){
+		fprintf(stderr, "Function Mod_Install returned FALSE.\n");
+		return FALSE;
+	}
+
+	// Turn it back into what version 2 left behind: one Revert row per
+	// patch, with no file of its own
+	if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+		"CREATE TABLE Revert_old ("
+			"`PatchUUID` TEXT NOT NULL UNIQUE, `Start` INTEGER NOT NULL,"
+			"`Len` INTEGER NOT NULL, `Hash` TEXT NOT NULL);"
+		"INSERT INTO Revert_old SELECT PatchUUID, Start, Len, Hash FROM Revert;"
+		"DROP TABLE Revert;"
+		"ALTER TABLE Revert_old RENAME TO Revert;"
+		"PRAGMA user_version = 2;",
+		NULL, NULL, NULL)
+	) != 0){
+		return FALSE;
+	}
+
+	sqlite3_close_v2(CURRDB);
+	if(!SQL_Load()){
+		fprintf(stderr, "SQL_Load couldn't upgrade the database.\n");
+		return FALSE;
+	}
+
+	sqlite3_prepare_v2(CURRDB,
+		"SELECT (SELECT COUNT(*) FROM Revert) * 10 + "
+		"(SELECT COUNT(*) FROM Revert WHERE File != 0 AND "
+			"File IN (SELECT File FROM Spaces WHERE PatchID = PatchUUID));",
+		-1, &command, NULL);
+	count = SQL_GetNum(command);
+	sqlite3_finalize(command);
+	if(count != 11){
+		fprintf(stderr, "Expected 1 Revert row with its file filled in; got %02d.\n",
+			count);
+		result = FALSE;
+	}
+
+	// The upgraded rows have to actually restore the file
+	if(!Mod_Uninstall("repl@test")){
+		fprintf(stderr, "Function Mod_Uninstall returned FALSE.\n");
+		return FALSE;
+	}
+	if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+		result = FALSE;
+	}
+
+	return result;
+}
@@ -0,0 +1,84 @@
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Trace_Install()
+{
+	json_t *mod, *trace, *event;
+    char *modpath;
+    size_t i;
+    int depth = 0;
+    BOOL sawInstall = FALSE, sawPatch = FALSE, sawUninstall = FALSE;
+    BOOL result = TRUE;
+
+    if(!Trace_Open("trace.json")){
+        fprintf(stderr, "Function Trace_Open returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Install and remove a patch with tracing on
+    asprintf(&modpath, "%s/test/Mod_/repl.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+
+    result = Mod_Install(mod, modpath) && Mod_Uninstall("repl@test");
+
+    safe_free(modpath);
+    json_decref(mod);
+    Trace_Close();
+
+    if(result == FALSE){
+        fprintf(stderr, "Install/uninstall failed with tracing on.\n");
+        remove("trace.json");
+        return result;
+    }
+
+    // Output must be a JSON array of events
+    trace = json_load_file("trace.json", 0, NULL);
+    remove("trace.json");
+    if(!json_is_array(trace)){
+        fprintf(stderr, "Trace is not a JSON array.\n");
+        json_decref(trace);
+        return FALSE;
+    }
+
+    // Spans must nest properly
+    json_array_foreach(trace, i, event){
+        const char *name = json_string_value(json_object_get(event, "name"));
+        const char *ph = json_string_value(json_object_get(event, "ph"));
+
+        if(name == NULL || ph == NULL ||
+            !json_is_number(json_object_get(event, "ts"))
+        ){
+            fprintf(stderr, "Trace event %d is malformed.\n", (int)i);
+            result = FALSE;
+            break;
+        }
+
+        if(strcmp(ph, "B") == 0){
+            depth++;
+            sawInstall |= strcmp(name, "Mod_Install") == 0;
+            sawPatch |= strcmp(name, "Mod_InstallPatch") == 0;
+            sawUninstall |= strcmp(name, "Mod_Uninstall") == 0;
+        } else if(--depth < 0){
+            fprintf(stderr, "Span ends before it begins at event %d.\n", (int)i);
+            result = FALSE;
+            break;
+        }
+    }
+    json_decref(trace);
+
+    if(result && depth != 0){
+        fprintf(stderr, "%d spans never ended.\n", depth);
+        result = FALSE;
+    }
+    if(result && !(sawInstall && sawPatch && sawUninstall)){
+        fprintf(stderr, "Trace is missing install/uninstall spans.\n");
+        result = FALSE;
+    }
+
+    // File should be back to all zeroes
+    if(!Proto_Checksum("test.bin", 0xE20EEA22, TRUE)){
+        result = FALSE;
+    }
+
+    return result;
+}
@@ -245,6 +245,278 @@ int Test_Caller(const char *input){
          return !result; 
     }
 
+    if(streq(input, "Mod_Install_DryRun_repl.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Install_DryRun_repl(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Install_DryRun_repl", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Profile_IsBlacklisted.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Profile_IsBlacklisted(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Profile_IsBlacklisted", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Dep_InstallOrder.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Dep_InstallOrder(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Dep_InstallOrder", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Uninstall_repl.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Uninstall_repl(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Uninstall_repl", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Journal_Compact.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Journal_Compact(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Journal_Compact", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Install_UnitTest_file.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Install_UnitTest_file(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Install_UnitTest_file", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Journal_Store_Dedup.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Journal_Store_Dedup(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Journal_Store_Dedup", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Install_UnitTest_copy.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Install_UnitTest_copy(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Install_UnitTest_copy", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "File_CopyRange_Overlap.c")){ 
+         clock_t start = clock(); 
+         int result = Test_File_CopyRange_Overlap(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "File_CopyRange_Overlap", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Install_UnitTest_reloc.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Install_UnitTest_reloc(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Install_UnitTest_reloc", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Trace_Install.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Trace_Install(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Trace_Install", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Install_VarRepatch_Stored.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Install_VarRepatch_Stored(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Install_VarRepatch_Stored", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Preflight_Series.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Preflight_Series(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Preflight_Series", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Intent_Recover.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Intent_Recover(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Intent_Recover", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_ExportStack.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_ExportStack(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_ExportStack", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "File_WriteBack_Errors.c")){ 
+         clock_t start = clock(); 
+         int result = Test_File_WriteBack_Errors(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "File_WriteBack_Errors", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Var_Cache.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Var_Cache(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Var_Cache", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Var_RePatchOrder.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Var_RePatchOrder(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Var_RePatchOrder", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Var_UpdateBatch.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Var_UpdateBatch(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Var_UpdateBatch", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Var_SpaceVars.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Var_SpaceVars(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Var_SpaceVars", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Eq_Parse_Cache.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Eq_Parse_Cache(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Eq_Parse_Cache", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Eq_Parse_Types.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Eq_Parse_Types(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Eq_Parse_Types", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Eq_ParseBatch.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Eq_ParseBatch(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Eq_ParseBatch", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "File_CRC32_Cache.c")){ 
+         clock_t start = clock(); 
+         int result = Test_File_CRC32_Cache(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "File_CRC32_Cache", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "File_WritePattern_Tiled.c")){ 
+         clock_t start = clock(); 
+         int result = Test_File_WritePattern_Tiled(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "File_WritePattern_Tiled", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "SQL_Upgrade_v1.c")){ 
+         clock_t start = clock(); 
+         int result = Test_SQL_Upgrade_v1(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "SQL_Upgrade_v1", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Journal_Compact_Recover.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Journal_Compact_Recover(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Journal_Compact_Recover", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Intent_Recover_Swap.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Intent_Recover_Swap(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Intent_Recover_Swap", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "File_OverlayPlan_Merge.c")){ 
+         clock_t start = clock(); 
+         int result = Test_File_OverlayPlan_Merge(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "File_OverlayPlan_Merge", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Eq_ParseBatch_Evict.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Eq_ParseBatch_Evict(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Eq_ParseBatch_Evict", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Uninstall_CompactFail.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Uninstall_CompactFail(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Uninstall_CompactFail", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Uninstall_move.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Uninstall_move(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Uninstall_move", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "SQL_Upgrade_v2.c")){ 
+         clock_t start = clock(); 
+         int result = Test_SQL_Upgrade_v2(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "SQL_Upgrade_v2", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
+    if(streq(input, "Mod_Preflight_Installed.c")){ 
+         clock_t start = clock(); 
+         int result = Test_Mod_Preflight_Installed(); 
+         clock_t end = clock(); 
+         const char *verdict = result ? "PASS" : "FAIL"; 
+         printf("[%s] %s (%f s)\n", verdict, "Mod_Preflight_Installed", ((float)(end-start))/CLOCKS_PER_SEC); 
+         return !result; 
+    }
 
     printf("[FAIL] %s not found\n", input);
     return 1;
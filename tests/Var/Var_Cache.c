@@ -0,0 +1,74 @@
+// Tests that the in-memory variable table follows every write to Variables
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Var_Cache()
+{
+    const struct VarValue *found;
+    struct VarValue var = {0};
+    var.desc = "Description";
+    var.UUID = "Cache.test@invisibleup";
+    var.mod = "test@invisibleup";
+    var.type = Int16;
+    var.Int16 = -300;
+    var.norepatch = TRUE;
+
+    // Load the table before writing, so the writes have to go through it
+    Var_Invalidate();
+    if(Var_Exists(var.UUID)){
+        fprintf(stderr, "Variable exists before it was made.\n");
+        return FALSE;
+    }
+
+    if(!Var_MakeEntry(var)){
+        fprintf(stderr, "Var_MakeEntry failed.\n");
+        return FALSE;
+    }
+    found = Var_Lookup(var.UUID);
+    if(found == NULL || found->type != Int16 || found->Int16 != -300 ||
+        strneq(found->mod, var.mod) || strneq(found->desc, var.desc)
+    ){
+        fprintf(stderr, "New variable is missing from the table.\n");
+        return FALSE;
+    }
+
+    // Making it again is an update
+    var.Int16 = 1234;
+    if(!Var_MakeEntry(var)){
+        fprintf(stderr, "Second Var_MakeEntry failed.\n");
+        return FALSE;
+    }
+    found = Var_Lookup(var.UUID);
+    if(found == NULL || found->Int16 != 1234){
+        fprintf(stderr, "Updated value not in table. (Found %d, expected %d)\n",
+            found ? found->Int16 : 0, 1234);
+        return FALSE;
+    }
+
+    // Changes behind the table's back show up once it's thrown away
+    if(SQL_HandleErrors(__FILE__, __LINE__, sqlite3_exec(CURRDB,
+        "UPDATE Variables SET Value = 7 WHERE UUID = 'Cache.test@invisibleup';",
+        NULL, NULL, NULL)
+    ) != 0){
+        return FALSE;
+    }
+    Var_Invalidate();
+    found = Var_Lookup(var.UUID);
+    if(found == NULL || found->Int16 != 7){
+        fprintf(stderr, "Table wasn't reloaded after Var_Invalidate.\n");
+        return FALSE;
+    }
+
+    // Clearing the mod's variables removes it
+    if(!Var_ClearEntry(var.mod)){
+        fprintf(stderr, "Var_ClearEntry failed.\n");
+        return FALSE;
+    }
+    if(Var_Exists(var.UUID)){
+        fprintf(stderr, "Variable still in table after Var_ClearEntry.\n");
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,84 @@
+// Tests that patches depending on a variable are scheduled once each, in
+// dependency order, and that dependency cycles are refused
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+static BOOL Test_RePatchOrder_Exec(const char *query)
+{
+    return SQL_HandleErrors(__FILE__, __LINE__,
+        sqlite3_exec(CURRDB, query, NULL, NULL, NULL)) == 0;
+}
+
+int Test_Var_RePatchOrder()
+{
+    const char *expected[] = {"B.cyc@test", "C.cyc@test", "A.cyc@test"};
+    char *order, *pos;
+    int i;
+
+    // A and B both use Knob. A also uses B's start and C uses B's end.
+    if(!Test_RePatchOrder_Exec(
+        "INSERT INTO Mods (UUID, Name, Version, Path) "
+            "VALUES ('cyc@test', 'Cycle', 1, 'cyc/');"
+        "INSERT INTO VarRepatchPatch (ModPath, Patch, Mod, Body) VALUES "
+            "('cyc/', 0, 'cyc@test', '{\"ID\": \"A.cyc@test\"}'),"
+            "('cyc/', 1, 'cyc@test', '{\"ID\": \"B.cyc@test\"}'),"
+            "('cyc/', 2, 'cyc@test', '{\"ID\": \"C.cyc@test\"}');"
+        "INSERT INTO VarRepatch (Var, ModPath, Patch, OldVal) VALUES "
+            "('Knob.cyc@test', 'cyc/', 0, 0),"
+            "('Knob.cyc@test', 'cyc/', 1, 0),"
+            "('Start.B.cyc@test', 'cyc/', 0, 0),"
+            "('End.B.cyc@test', 'cyc/', 2, 0);"
+    )){
+        return FALSE;
+    }
+
+    order = Var_RePatchOrder("Knob.cyc@test");
+    if(order == NULL){
+        fprintf(stderr, "Var_RePatchOrder returned NULL.\n");
+        return FALSE;
+    }
+    pos = order;
+    for(i = 0; i < 3; i++){
+        if(strneq(pos, expected[i])){
+            fprintf(stderr, "Patch %d is %s, expected %s.\n", i, pos, expected[i]);
+            safe_free(order);
+            return FALSE;
+        }
+        pos += strlen(pos) + 1;
+    }
+    if(*pos != '\0'){
+        fprintf(stderr, "Extra patch %s scheduled.\n", pos);
+        safe_free(order);
+        return FALSE;
+    }
+    safe_free(order);
+
+    // Now B uses A's start too, so they wait on each other
+    if(!Test_RePatchOrder_Exec(
+        "INSERT INTO VarRepatch (Var, ModPath, Patch, OldVal) "
+            "VALUES ('Start.A.cyc@test', 'cyc/', 1, 0);"
+    )){
+        return FALSE;
+    }
+
+    order = Var_RePatchOrder("Knob.cyc@test");
+    if(order != NULL){
+        fprintf(stderr, "Cycle between A and B was not found.\n");
+        safe_free(order);
+        return FALSE;
+    }
+    if(CURRERROR != errWNG_MODCFG){
+        fprintf(stderr, "CURRERROR is %d, expected %d.\n", CURRERROR, errWNG_MODCFG);
+        return FALSE;
+    }
+    CURRERROR = errNOERR;
+
+    if(Var_RePatch("Knob.cyc@test")){
+        fprintf(stderr, "Var_RePatch went ahead with a cycle.\n");
+        return FALSE;
+    }
+    CURRERROR = errNOERR;
+
+    return TRUE;
+}
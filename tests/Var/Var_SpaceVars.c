@@ -0,0 +1,83 @@
+// Tests that Start. and End. variables come from the space map instead of
+// being stored, and follow a patch when it moves
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+static BOOL Test_SpaceVars_Check(const char *VarUUID, uint32_t expected)
+{
+    const struct VarValue *found = Var_Lookup(VarUUID);
+    if(found == NULL || found->type != uInt32Pointer || found->uInt32 != expected){
+        fprintf(stderr, "%s is %u, expected %u.\n", VarUUID,
+            found ? (unsigned)found->uInt32 : 0, (unsigned)expected);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int Test_Var_SpaceVars()
+{
+    json_t *mod;
+    char *modpath;
+    sqlite3_stmt *command;
+    struct VarValue width;
+    int rowCount;
+    BOOL result = TRUE;
+
+    asprintf(&modpath, "%s/test/Mod_/variable_batch.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    if(!mod){
+        safe_free(modpath);
+        return FALSE;
+    }
+    result = Mod_Install(mod, modpath);
+    safe_free(modpath);
+    json_decref(mod);
+    if(result == FALSE){
+        fprintf(stderr, "Mod installation returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Nothing stored, for KnownSpaces or for patches
+    sqlite3_prepare_v2(CURRDB,
+        "SELECT COUNT(*) FROM Variables WHERE UUID LIKE 'Start.%' OR UUID LIKE 'End.%';",
+        -1, &command, NULL);
+    rowCount = SQL_GetNum(command);
+    sqlite3_finalize(command);
+    if(rowCount != 0){
+        fprintf(stderr, "Found %d Start/End rows in Variables.\n", rowCount);
+        result = FALSE;
+    }
+
+    result &= Test_SpaceVars_Check("Start.SectorB.MODLOADER@invisibleup", 65536);
+    result &= Test_SpaceVars_Check("End.SectorB.MODLOADER@invisibleup", 131072);
+    result &= Test_SpaceVars_Check("End.SectorC.MODLOADER@invisibleup", 262144);
+    result &= Test_SpaceVars_Check("Start.Area.variable_batch@test", 0);
+    result &= Test_SpaceVars_Check("End.Area.variable_batch@test", 1);
+    if(Eq_Parse_Int("$ End.SectorB.MODLOADER@invisibleup", NULL, FALSE) != 131072){
+        fprintf(stderr, "Expression didn't see End.SectorB.MODLOADER@invisibleup.\n");
+        result = FALSE;
+    }
+
+    // Grow the patch; its End must follow
+    width = Var_GetValue_SQL("Width.variable_batch@test");
+    width.uInt8 = 3;
+    if(!Var_UpdateEntry(width)){
+        fprintf(stderr, "Var_UpdateEntry failed.\n");
+        result = FALSE;
+    }
+    Var_Destructor(&width);
+    result &= Test_SpaceVars_Check("End.Area.variable_batch@test", 3);
+
+    // Gone with the patch
+    if(!Mod_Uninstall("variable_batch@test")){
+        fprintf(stderr, "Mod uninstallation returned FALSE.\n");
+        return FALSE;
+    }
+    if(Var_Exists("End.Area.variable_batch@test")){
+        fprintf(stderr, "End.Area.variable_batch@test outlived its patch.\n");
+        result = FALSE;
+    }
+
+    return result;
+}
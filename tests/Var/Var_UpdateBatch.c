@@ -0,0 +1,121 @@
+// Tests that a batch of variable changes is saved together and reinstalls
+// a patch using several of them only once
+
+#include "../../includes.h"
+#include "../../funcproto.h"
+
+int Test_Var_UpdateBatch()
+{
+    json_t *mod, *trace, *event;
+    char *modpath, *binpath = NULL, *movedpath = NULL;
+    struct VarValue vars[3];
+    const struct VarValue *found;
+    size_t i;
+    int installs = 0;
+    BOOL result = TRUE;
+
+    asprintf(&modpath, "%s/test/Mod_/variable_batch.json", CONFIG.PROGDIR);
+    mod = JSON_Load(modpath);
+    if(!mod){
+        safe_free(modpath);
+        return FALSE;
+    }
+    result = Mod_Install(mod, modpath);
+    safe_free(modpath);
+    json_decref(mod);
+    if(result == FALSE){
+        fprintf(stderr, "Mod installation returned FALSE.\n");
+        return FALSE;
+    }
+
+    // Change both sizes; Active stays the same
+    vars[0] = Var_GetValue_SQL("Width.variable_batch@test");
+    vars[1] = Var_GetValue_SQL("Height.variable_batch@test");
+    vars[2] = Var_GetValue_SQL("Active.variable_batch@test");
+    vars[0].uInt8 = 4;
+    vars[1].uInt8 = 2;
+
+    if(!Trace_Open("batch_trace.json")){
+        fprintf(stderr, "Function Trace_Open returned FALSE.\n");
+        result = FALSE;
+    }
+    if(!Interface_SaveVars(vars, 3)){
+        fprintf(stderr, "Function Interface_SaveVars returned FALSE.\n");
+        result = FALSE;
+    }
+    Trace_Close();
+
+    // The patch uses both, but must only be reinstalled once
+    trace = json_load_file("batch_trace.json", 0, NULL);
+    remove("batch_trace.json");
+    json_array_foreach(trace, i, event){
+        const char *name = json_string_value(json_object_get(event, "name"));
+        const char *ph = json_string_value(json_object_get(event, "ph"));
+        if(name && ph && streq(name, "Mod_InstallPatch") && streq(ph, "B")){
+            installs++;
+        }
+    }
+    json_decref(trace);
+    if(installs != 1){
+        fprintf(stderr, "Patch was reinstalled %d times, expected 1.\n", installs);
+        result = FALSE;
+    }
+
+    found = Var_Lookup("End.Area.variable_batch@test");
+    if(found == NULL || found->uInt32 != 8){
+        fprintf(stderr, "End of patch is %u, expected 8.\n",
+            found ? (unsigned)found->uInt32 : 0);
+        result = FALSE;
+    }
+
+    // One bad variable and nothing is saved
+    Var_Destructor(&vars[2]);
+    vars[2].UUID = "Missing.variable_batch@test";
+    vars[2].desc = vars[2].publicType = vars[2].mod = NULL;
+    vars[0].uInt8 = 9;
+    if(Interface_SaveVars(vars, 3)){
+        fprintf(stderr, "Batch with a missing variable was saved.\n");
+        result = FALSE;
+    }
+    CURRERROR = errNOERR;
+
+    found = Var_Lookup("Width.variable_batch@test");
+    if(found == NULL || found->uInt8 != 4){
+        fprintf(stderr, "Width is %d after a failed batch, expected 4.\n",
+            found ? found->uInt8 : 0);
+        result = FALSE;
+    }
+
+    // A patch that can't be reinstalled undoes the whole batch
+    asprintf(&binpath, "%s/test.bin", CONFIG.CURRDIR);
+    asprintf(&movedpath, "%s/test.bin.moved", CONFIG.CURRDIR);
+    rename(binpath, movedpath);
+    mkdir(binpath);
+    vars[0].uInt8 = 3;
+    if(Var_UpdateBatch(vars, 2)){
+        fprintf(stderr, "Batch was saved though its patch couldn't be reinstalled.\n");
+        result = FALSE;
+    }
+    CURRERROR = errNOERR;
+    rmdir(binpath);
+    rename(movedpath, binpath);
+    safe_free(binpath);
+    safe_free(movedpath);
+
+    found = Var_Lookup("Width.variable_batch@test");
+    if(found == NULL || found->uInt8 != 4){
+        fprintf(stderr, "Width is %d after a failed reinstall, expected 4.\n",
+            found ? found->uInt8 : 0);
+        result = FALSE;
+    }
+    found = Var_Lookup("End.Area.variable_batch@test");
+    if(found == NULL || found->uInt32 != 8){
+        fprintf(stderr, "End of patch is %u after a failed reinstall, expected 8.\n",
+            found ? (unsigned)found->uInt32 : 0);
+        result = FALSE;
+    }
+
+    Var_Destructor(&vars[0]);
+    Var_Destructor(&vars[1]);
+    return result;
+}
@@ -29,3 +29,37 @@ int Test_Mod_Install_UnitTest_repl();
 int Test_Mod_Install_UnitTest_clear_existing();
 int Test_Mod_Install_UnitTest_variable_simple();
 int Test_Mod_Install_UnitTest_VarRepatch();
+int Test_Mod_Install_DryRun_repl();
+int Test_Profile_IsBlacklisted();
+int Test_Dep_InstallOrder();
+int Test_Mod_Uninstall_repl();
+int Test_Journal_Compact();
+int Test_Mod_Install_UnitTest_file();
+int Test_Journal_Store_Dedup();
+int Test_Mod_Install_UnitTest_copy();
+int Test_File_CopyRange_Overlap();
+int Test_Mod_Install_UnitTest_reloc();
+int Test_Trace_Install();
+int Test_Mod_Install_VarRepatch_Stored();
+int Test_Mod_Preflight_Series();
+int Test_Intent_Recover();
+int Test_Mod_ExportStack();
+int Test_File_WriteBack_Errors();
+int Test_Var_Cache();
+int Test_Var_RePatchOrder();
+int Test_Var_UpdateBatch();
+int Test_Var_SpaceVars();
+int Test_Eq_Parse_Cache();
+int Test_Eq_Parse_Types();
+int Test_Eq_ParseBatch();
+int Test_File_CRC32_Cache();
+int Test_File_WritePattern_Tiled();
+int Test_SQL_Upgrade_v1();
+int Test_Journal_Compact_Recover();
+int Test_Intent_Recover_Swap();
+int Test_File_OverlayPlan_Merge();
+int Test_Eq_ParseBatch_Evict();
+int Test_Mod_Uninstall_CompactFail();
+int Test_Mod_Uninstall_move();
+int Test_SQL_Upgrade_v2();
+int Test_Mod_Preflight_Installed();
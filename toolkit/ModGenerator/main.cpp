@@ -297,6 +297,7 @@ public:
         std::string section;
         std::string symbol;
         unsigned long pos;
+        bool pcrel;
     };
     bfd *object;
     
@@ -472,6 +473,7 @@ public:
                 row.section = std::string(section->name);
                 row.symbol = std::string((*(*p)->sym_ptr_ptr)->name);
                 row.pos = (*p)->address;
+                row.pcrel = (*p)->howto != NULL && (*p)->howto->pc_relative;
                 relocs.push_back(row);
                 
                 //std::cout << row.section << "\t" << row.symbol << "\t" << row.pos << "\n";
@@ -577,9 +579,17 @@ public:
 
 class Patch {
 public:
+    // One entry of a RELOC patch's relocation table
+    struct Reloc {
+        unsigned long Offset;
+        std::string Type;
+        std::string Value;
+    };
+    
     std::string ID, Mode, File, FileType, SrcFile, SrcFileType,
                 SrcFileLoc, AddType, Value, Condition,
                 Start, End, Len, SrcStart, SrcEnd;
+    std::vector<Reloc> Relocs;
     
     Patch(){
         // Nothing!
@@ -718,6 +728,9 @@ private:
             out.push_back(Patch(funct, metadata.uuid));
         }
         
+        // Relocations are applied by the loader as part of this patch
+        size_t base = out.size() - 1;
+        
         /* Create list of additional (formerly "mini") patches needed */
         // Get reloc and symbol info from output obj
         std::vector<Function::relocinfo> reloc = funct.get_reloc();
@@ -730,24 +743,10 @@ private:
         for(int i = 0; i < reloc.size(); i++){
             bool match;
             
-            // Prepare patch
-            Patch row = out.back();
-            row.ID = CppNumToStr(i);
-            row.ID += ".";
-            row.ID += BaseUUID;
-            row.Mode = "REPL";
-            row.AddType = "Expression";
-            row.Start = "$ Start.";
-            row.Start += BaseUUID;
-            row.Start += " + ";
-            row.Start += CppNumToStr(reloc[i].pos);
-            row.End = "$ Start.";
-            row.End += BaseUUID;
-            row.End += " + ";
-            row.End += CppNumToStr(reloc[i].pos + 4);
-            //row.Start = CppNumToStr(strtoul(row.Start.c_str(), NULL, 10) + reloc[i].pos);
-            //row.End = CppNumToStr(strtoul(row.Start.c_str(), NULL, 10) + 4);
-            row.Len = "4";
+            // Prepare relocation table entry
+            Patch::Reloc row;
+            row.Offset = reloc[i].pos;
+            row.Type = reloc[i].pcrel ? "Rel32" : "Abs32";
             
             // If it's a known segment, handle that
             int sectID = -1;
@@ -793,7 +792,8 @@ private:
                 if(section_added[sectID] == false){
                     //std::cout << "Adding patch for " << section[sectID] << "...\n";
                     
-                    Patch sectPatch = out.back();
+                    Patch sectPatch = out[base];
+                    sectPatch.Relocs.clear();
                     sectPatch.ID = section[sectID];
                     sectPatch.ID += ".";
                     sectPatch.ID += BaseUUID;
@@ -817,7 +817,7 @@ private:
                 row.Value += " + ";
                 row.Value += CppNumToStr(offset);
                 
-                out.push_back(row);
+                out[base].Relocs.push_back(row);
                 continue;
             }
             
@@ -857,7 +857,7 @@ private:
                 row.Value += ".";
                 row.Value += metadata.uuid;
                 
-                out.push_back(row);
+                out[base].Relocs.push_back(row);
                 continue;
             }
 
@@ -883,7 +883,7 @@ private:
                 row.Value += ".";
                 row.Value += metadata.uuid;
                 
-                out.push_back(row);
+                out[base].Relocs.push_back(row);
                 continue;
             }
                 
@@ -912,7 +912,7 @@ private:
                 row.Value += ".";
                 row.Value += imports[import_entry].UUID;
                 
-                out.push_back(row);
+                out[base].Relocs.push_back(row);
                 continue;
             }
             
@@ -938,7 +938,7 @@ private:
                 row.Value += ".";
                 row.Value += metadata.uuid;
                 
-                out.push_back(row);
+                out[base].Relocs.push_back(row);
                 continue;
             }
 
@@ -949,7 +949,11 @@ private:
             row.Value += reloc[i].symbol;
             row.Value += ".MODLOADER@invisibleup";
             
-            out.push_back(row);
+            out[base].Relocs.push_back(row);
+        }
+        
+        if(!out[base].Relocs.empty()){
+            out[base].Mode = "RELOC";
         }
         
         return out;
@@ -1126,6 +1130,19 @@ public:
                 json_object_set_new(row, "Value", json_string(patches[i].Value.c_str()));
                 json_object_set_new(row, "Condition", json_string(patches[i].Condition.c_str()));
                 
+                // Relocation table as [Offset, Type, Value] triples
+                if(!patches[i].Relocs.empty()){
+                    json_t *relocs = json_array();
+                    for (int j = 0; j < patches[i].Relocs.size(); j++) {
+                        json_t *entry = json_array();
+                        json_array_append_new(entry, json_integer(patches[i].Relocs[j].Offset));
+                        json_array_append_new(entry, json_string(patches[i].Relocs[j].Type.c_str()));
+                        json_array_append_new(entry, json_string(patches[i].Relocs[j].Value.c_str()));
+                        json_array_append_new(relocs, entry);
+                    }
+                    json_object_set_new(row, "Relocs", relocs);
+                }
+                
                 json_array_append_new(ptchs, row);
             }
             
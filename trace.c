@@ -0,0 +1,134 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+#ifndef HAVE_WINDOWS_H
+#include <time.h>                  // clock_gettime()
+#endif
+
+// Timing spans in Chrome's trace event format (load the output in
+// chrome://tracing or Perfetto). Turned on by the SRMODLDR_TRACE environment
+// variable or a profile's "TracePath". When off, TRACE_BEGIN/TRACE_END are a
+// test of TRACE_ON and nothing else.
+
+BOOL TRACE_ON = FALSE;
+
+static FILE *TRACE = NULL;
+static BOOL TRACE_FIRST = TRUE;    //No comma before the first event
+
+// Microseconds on a monotonic clock
+static double Trace_Now(void)
+{
+	#ifdef HAVE_WINDOWS_H
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double)count.QuadPart * 1000000.0 / (double)freq.QuadPart;
+	#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec * 1000000.0 + (double)now.tv_nsec / 1000.0;
+	#endif
+}
+
+// Write str as the body of a JSON string
+static void Trace_WriteEscaped(const char *str)
+{
+	for(; *str != '\0'; str++){
+		unsigned char c = *str;
+		if(c == '"' || c == '\\'){
+			fputc('\\', TRACE);
+			fputc(c, TRACE);
+		} else if(c < 0x20){
+			fprintf(TRACE, "\\u%04x", c);
+		} else {
+			fputc(c, TRACE);
+		}
+	}
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Trace_Open
+ *  Description:  Starts writing trace events to the file at path, replacing it.
+ * =====================================================================================
+ */
+BOOL Trace_Open(const char *path)
+{
+	Trace_Close();
+
+	TRACE = fopen(path, "w");
+	if(TRACE == NULL){
+		ErrNo2ErrCode();
+		return FALSE;
+	}
+	fputs("[\n", TRACE);
+	TRACE_FIRST = TRUE;
+	TRACE_ON = TRUE;
+	return TRUE;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Trace_Init
+ *  Description:  Turns tracing on if the SRMODLDR_TRACE environment variable or the
+ *                profile asks for it. The environment variable wins.
+ * =====================================================================================
+ */
+BOOL Trace_Init(void)
+{
+	const char *path = getenv("SRMODLDR_TRACE");
+	if(strndef(path)){
+		path = CONFIG.TRACEPATH;
+	}
+	if(strndef(path)){
+		return TRUE;
+	}
+	return Trace_Open(path);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Trace_Close
+ *  Description:  Finishes and closes the trace file, if there is one.
+ *                (Chrome can read a trace without the closing bracket, so a
+ *                crash part way through still leaves something usable.)
+ * =====================================================================================
+ */
+void Trace_Close(void)
+{
+	TRACE_ON = FALSE;
+	if(TRACE != NULL){
+		fputs("\n]\n", TRACE);
+		fclose(TRACE);
+		TRACE = NULL;
+	}
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Trace_Event
+ *  Description:  Writes one event. Phase is 'B' to begin a span and 'E' to end the
+ *                innermost one. Detail, if given, shows up in the span's args.
+ *                Use the TRACE_BEGIN/TRACE_END macros rather than calling this.
+ * =====================================================================================
+ */
+void Trace_Event(char phase, const char *name, const char *detail)
+{
+	if(TRACE == NULL){return;}
+
+	fprintf(TRACE, "%s{\"name\":\"", TRACE_FIRST ? "" : ",\n");
+	Trace_WriteEscaped(name);
+	fprintf(TRACE, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1",
+		phase, Trace_Now());
+	if(detail != NULL){
+		fputs(",\"args\":{\"detail\":\"", TRACE);
+		Trace_WriteEscaped(detail);
+		fputs("\"}", TRACE);
+	}
+	fputc('}', TRACE);
+	TRACE_FIRST = FALSE;
+}
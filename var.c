@@ -6,35 +6,376 @@
 #include "funcproto.h"             // LOCAL: Function prototypes and structs
 #include "errormsgs.h"             // LOCAL: Canned error messages
 
-// Returns true if the given variable is saved in the SQL.
-BOOL Var_Exists(const char *VarUUID)
+// In-memory copy of the Variables table, keyed by UUID. Loaded on first use
+// and kept in step by every function here that writes to the table, so
+// expressions don't need a query per operand.
+static struct HashTable *VARCACHE = NULL;
+
+// Bumped whenever an entry in VARCACHE is replaced or removed, so a
+// VarHandle knows when the pointer it kept might be stale. Never 0.
+static unsigned long VARCACHE_GEN = 1;
+
+static void Var_CacheChanged(void)
+{
+	VARCACHE_GEN++;
+	if(VARCACHE_GEN == 0){VARCACHE_GEN = 1;}
+}
+
+static void Var_CacheFree(void *Value)
+{
+	struct VarValue *var = Value;
+	Var_Destructor(var);
+	free(var);
+}
+
+static char * Var_CacheStr(sqlite3_stmt *command, int col)
+{
+	const unsigned char *text = sqlite3_column_text(command, col);
+	return text ? strdup((const char *)text) : NULL;
+}
+
+// Turn a row of VARCACHE_QUERY into a VarValue
+#define VARCACHE_QUERY "SELECT UUID, Mod, Type, PublicType, Info, Value, Persist FROM Variables"
+static struct VarValue * Var_CacheRow(sqlite3_stmt *command)
+{
+	struct VarValue *var = calloc(1, sizeof(struct VarValue));
+	if(var == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+
+	var->UUID = Var_CacheStr(command, 0);
+	var->mod = Var_CacheStr(command, 1);
+	var->type = Var_GetType((const char *)sqlite3_column_text(command, 2));
+	var->publicType = Var_CacheStr(command, 3);
+	var->desc = Var_CacheStr(command, 4);
+	var->persist = sqlite3_column_int(command, 6) ? TRUE : FALSE;
+
+	switch(var->type){
+	case IEEE64:
+		var->IEEE64 = sqlite3_column_double(command, 5); break;
+	case IEEE32:
+		var->IEEE32 = (float)sqlite3_column_double(command, 5); break;
+	case Int32:
+		var->Int32  = (int32_t)sqlite3_column_int64(command, 5); break;
+	case Int16:
+		var->Int16  = (int16_t)sqlite3_column_int64(command, 5); break;
+	case Int8:
+		var->Int8   = (int8_t)sqlite3_column_int64(command, 5); break;
+	case uInt32:
+	case uInt32Pointer:
+		var->uInt32 = (uint32_t)sqlite3_column_int64(command, 5); break;
+	case uInt16:
+		var->uInt16 = (uint16_t)sqlite3_column_int64(command, 5); break;
+	case uInt8:
+		var->uInt8  = (uint8_t)sqlite3_column_int64(command, 5); break;
+	default:
+		var->uInt32 = 0;
+	}
+	return var;
+}
+
+// Load every variable, if not done already. One query.
+static BOOL Var_CacheLoad(void)
 {
-	int result;
 	sqlite3_stmt *command;
-	const char *query = 
-		"SELECT EXISTS ( SELECT * FROM Variables WHERE UUID = ? )";
-	CURRERROR = errNOERR;
-	
-	//Get SQL results and put into VarObj
-	if(SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
+	int result = SQLITE_DONE;
+
+	if(VARCACHE != NULL){return TRUE;}
+
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, VARCACHE_QUERY ";", -1, &command, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+
+	VARCACHE = HashTable_Create(64);
+	while(VARCACHE != NULL && (result = sqlite3_step(command)) == SQLITE_ROW){
+		struct VarValue *var = Var_CacheRow(command);
+		if(var == NULL || !HashTable_Set(VARCACHE, var->UUID, var, Var_CacheFree)){
+			if(var != NULL){Var_CacheFree(var);}
+			Var_Invalidate();
+			break;
+		}
+	}
+	sqlite3_finalize(command);
+
+	if(VARCACHE == NULL){
+		if(CURRERROR == errNOERR){CURRERROR = errCRIT_MALLOC;}
+		return FALSE;
+	}
+	if(result != SQLITE_DONE){
+		SQL_HandleErrors(__FILE__, __LINE__, result);
+		CURRERROR = errCRIT_DBASE;
+		Var_Invalidate();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Reread one variable after it was written. Nothing to do if the cache
+// hasn't been loaded yet.
+static BOOL Var_CacheRefresh(const char *VarUUID)
+{
+	sqlite3_stmt *command;
+	int result;
+
+	if(VARCACHE == NULL){return TRUE;}
+	Var_CacheChanged();
+
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, VARCACHE_QUERY " WHERE UUID = ?;", -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__,
 		sqlite3_bind_text(command, 1, VarUUID, -1, SQLITE_STATIC)
 	) != 0){
 		CURRERROR = errCRIT_DBASE;
+		Var_Invalidate();
 		return FALSE;
 	}
+
+	result = sqlite3_step(command);
+	if(result == SQLITE_ROW){
+		struct VarValue *var = Var_CacheRow(command);
+		if(var == NULL || !HashTable_Set(VARCACHE, var->UUID, var, Var_CacheFree)){
+			if(var != NULL){Var_CacheFree(var);}
+			Var_Invalidate();
+		}
+	} else if(result == SQLITE_DONE){
+		HashTable_Remove(VARCACHE, VarUUID, Var_CacheFree);
+	} else {
+		SQL_HandleErrors(__FILE__, __LINE__, result);
+		CURRERROR = errCRIT_DBASE;
+		Var_Invalidate();
+	}
+	sqlite3_finalize(command);
+	return VARCACHE != NULL;
+}
+
+// Start.<PatchID> and End.<PatchID> aren't stored; they're read from the
+// space the patch ended up in, so they can't go stale. Each patch's pair is
+// worked out once and kept here, keyed by PatchID, until Spaces changes.
+struct VarSpace {
+	struct VarValue Start;
+	struct VarValue End;
+	int StartOff;              //File offset of Start, for Var_DerefPointer
+};
+static struct HashTable *VARSPACES = NULL;
+
+static void Var_SpaceFree(void *Value)
+{
+	struct VarSpace *space = Value;
+	Var_Destructor(&space->Start);
+	Var_Destructor(&space->End);
+	free(space);
+}
+
+// A patch's own space has the patch's ID (or, for KnownSpaces, the ID with
+// .MODLOADER@invisibleup on the end). Its other rows are the leftovers of
+// the space it was split out of. A patch that took over a whole space only
+// has that space's row.
+#define VARSPACE_QUERY "SELECT File, Start, End, Mod FROM Spaces " \
+	"WHERE PatchID = ?1 AND Type != 'Split' " \
+	"ORDER BY (ID = ?1 OR ID || '.' || Mod = ?1) DESC, RowID DESC LIMIT 1;"
+
+// Fill in one of a space's variables
+static BOOL Var_SpaceFill(
+	struct VarValue *var, const char *PatchID, BOOL IsStart,
+	const char *mod, uint32_t Addr
+){
+	asprintf(&var->UUID, "%s.%s", IsStart ? "Start" : "End", PatchID);
+	var->desc = strdup(IsStart ? "Start byte of patch." : "End byte of patch.");
+	var->publicType = strdup("");
+	var->mod = mod ? strdup(mod) : NULL;
+	var->type = uInt32Pointer;
+	var->uInt32 = Addr;
+	if(var->UUID == NULL || var->desc == NULL || var->publicType == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Look up a patch's space. NULL if it has none, or on error.
+static struct VarSpace * Var_LoadSpace(const char *PatchID)
+{
+	sqlite3_stmt *command;
+	struct VarSpace *space;
+	char *FilePath, *mod;
+	int FileID, Start, End, result;
+	uint32_t StartAddr, EndAddr;
 	
-	result = SQL_GetNum(command);
-	
-	if(CURRERROR != errNOERR || SQL_HandleErrors(
-		__FILE__, __LINE__, sqlite3_finalize(command)
+	if(SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, VARSPACE_QUERY, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_bind_text(command, 1, PatchID, -1, SQLITE_STATIC)
 	) != 0){
 		CURRERROR = errCRIT_DBASE;
-		return FALSE;
+		return NULL;
+	}
+	
+	result = sqlite3_step(command);
+	if(result != SQLITE_ROW){
+		if(result != SQLITE_DONE){
+			SQL_HandleErrors(__FILE__, __LINE__, result);
+			CURRERROR = errCRIT_DBASE;
+		}
+		sqlite3_finalize(command);
+		return NULL;
 	}
+	FileID = sqlite3_column_int(command, 0);
+	Start = sqlite3_column_int(command, 1);
+	End = sqlite3_column_int(command, 2);
+	mod = Var_CacheStr(command, 3);
+	sqlite3_finalize(command);
+	
+	// Stored as file offsets, but these have always been addresses
+	FilePath = File_GetPath(FileID);
+	StartAddr = FilePath ? (uint32_t)File_OffToPE(FilePath, Start) : (uint32_t)Start;
+	EndAddr = FilePath ? (uint32_t)File_OffToPE(FilePath, End) : (uint32_t)End;
+	safe_free(FilePath);
 	
-	return (result != 0);
+	space = calloc(1, sizeof(struct VarSpace));
+	if(space == NULL){
+		CURRERROR = errCRIT_MALLOC;
+		safe_free(mod);
+		return NULL;
+	}
+	space->StartOff = Start;
+	if(
+		!Var_SpaceFill(&space->Start, PatchID, TRUE, mod, StartAddr) ||
+		!Var_SpaceFill(&space->End, PatchID, FALSE, mod, EndAddr)
+	){
+		Var_SpaceFree(space);
+		space = NULL;
+	}
+	safe_free(mod);
+	return space;
+}
+
+static const struct VarValue * Var_LookupSpace(const char *PatchID, BOOL IsStart)
+{
+	struct VarSpace *space;
+	
+	if(VARSPACES == NULL){
+		VARSPACES = HashTable_Create(16);
+		if(VARSPACES == NULL){
+			CURRERROR = errCRIT_MALLOC;
+			return NULL;
+		}
+	}
+	
+	space = HashTable_Get(VARSPACES, PatchID);
+	if(space == NULL){
+		space = Var_LoadSpace(PatchID);
+		if(space == NULL){return NULL;}
+		if(!HashTable_Set(VARSPACES, PatchID, space, Var_SpaceFree)){
+			Var_SpaceFree(space);
+			CURRERROR = errCRIT_MALLOC;
+			return NULL;
+		}
+	}
+	return IsStart ? &space->Start : &space->End;
+}
+
+// PatchID of a Start./End. variable, or NULL if it's an ordinary one
+static const char * Var_SpacePatchID(const char *VarUUID, BOOL *IsStart)
+{
+	if(strncmp(VarUUID, "Start.", strlen("Start.")) == 0){
+		*IsStart = TRUE;
+		return VarUUID + strlen("Start.");
+	}
+	if(strncmp(VarUUID, "End.", strlen("End.")) == 0){
+		*IsStart = FALSE;
+		return VarUUID + strlen("End.");
+	}
+	return NULL;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Var_SpacesChanged
+ *  Description:  Forgets every Start./End. variable worked out so far. Call after
+ *                adding, removing or renaming rows in Spaces.
+ * =====================================================================================
+ */
+void Var_SpacesChanged(void)
+{
+	HashTable_Destroy(VARSPACES, Var_SpaceFree);
+	VARSPACES = NULL;
+	Var_CacheChanged();
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Var_Invalidate
+ *  Description:  Throws away the in-memory variable table. Call when the database is
+ *                swapped out or rolled back behind its back.
+ * =====================================================================================
+ */
+void Var_Invalidate(void)
+{
+	HashTable_Destroy(VARCACHE, Var_CacheFree);
+	VARCACHE = NULL;
+	Var_SpacesChanged();
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Var_Lookup
+ *  Description:  Returns the variable with the given UUID, or NULL if there isn't
+ *                one. Start.<PatchID> and End.<PatchID> come from the patch's space.
+ *                The result belongs to the variable table and is only good until
+ *                a variable or space is written; copy it to keep it.
+ * =====================================================================================
+ */
+const struct VarValue * Var_Lookup(const char *VarUUID)
+{
+	BOOL IsStart;
+	const char *PatchID = Var_SpacePatchID(VarUUID, &IsStart);
+	
+	if(PatchID != NULL){
+		return Var_LookupSpace(PatchID, IsStart);
+	}
+	
+	if(!Var_CacheLoad()){return NULL;}
+	return HashTable_Get(VARCACHE, VarUUID);
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Var_Resolve
+ *  Description:  Like Var_Lookup, but remembers the result in the handle and reuses
+ *                it until the variable table changes. Set handle->UUID and zero the
+ *                rest before first use.
+ * =====================================================================================
+ */
+const struct VarValue * Var_Resolve(struct VarHandle *handle)
+{
+	const struct VarValue *var;
+	BOOL IsStart;
+	
+	if(handle->Gen == VARCACHE_GEN){return handle->Var;}
+	
+	var = Var_Lookup(handle->UUID);
+	
+	// Keep anything that came out of one of the tables. Changing either
+	// moves VARCACHE_GEN on.
+	if(Var_SpacePatchID(handle->UUID, &IsStart) ? var != NULL : VARCACHE != NULL){
+		handle->Var = var;
+		handle->Gen = VARCACHE_GEN;
+	} else {
+		handle->Var = NULL;
+		handle->Gen = 0;
+	}
+	return var;
+}
+
+// Returns true if the given variable is saved in the SQL.
+BOOL Var_Exists(const char *VarUUID)
+{
+	CURRERROR = errNOERR;
+	return Var_Lookup(VarUUID) != NULL;
 }
 
 //Effectively this function is a poor-man's string lookup table.
@@ -84,82 +425,30 @@ const char * Var_GetType_Str(enum VarType type)
 
 // Ditto, except it fetches directly from the SQL
 enum VarType Var_GetType_SQL(const char *VarUUID){
-	struct VarValue CurrVar;
-	enum VarType result;
-
-	CurrVar = Var_GetValue_SQL(VarUUID);
-	result = CurrVar.type;
-	Var_Destructor(&CurrVar);
-
-	return result;
+	const struct VarValue *CurrVar = Var_Lookup(VarUUID);
+	return CurrVar ? CurrVar->type : INVALID;
 }
 
 //Fetches bytes from stored SQL table
 struct VarValue Var_GetValue_SQL(const char *VarUUID){
 	struct VarValue result;
-	json_t *VarArr, *VarObj;
-	sqlite3_stmt *command;
-	char *query = "SELECT * FROM Variables WHERE UUID = ? LIMIT 1";
+	const struct VarValue *cached;
 	CURRERROR = errNOERR;
 	
-	//Get SQL results and put into VarObj
-	if(SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_bind_text(command, 1, VarUUID, -1, SQLITE_STATIC)
-	) != 0){
-		CURRERROR = errCRIT_DBASE;
-		result.type = INVALID;
-		return result;
-	}
-	
-	VarArr = SQL_GetJSON(command);
-
-	if(CURRERROR != errNOERR || SQL_HandleErrors(
-		__FILE__, __LINE__, sqlite3_finalize(command)
-	) != 0){
-		CURRERROR = errCRIT_DBASE;
+	cached = Var_Lookup(VarUUID);
+	if(cached == NULL){
+		memset(&result, 0, sizeof(result));
 		result.type = INVALID;
 		return result;
 	}
 	
-	VarObj = json_array_get(VarArr, 0);
-	
-	//Get type
-	result.type = Var_GetType(JSON_GetStr(VarObj, "Type"));
-	
-	//Get value
-	switch(result.type){
-	case IEEE64:
-		result.IEEE64 = (double)JSON_GetDouble(VarObj, "Value"); break;
-	case IEEE32:
-		result.IEEE32 = (float)JSON_GetDouble(VarObj, "Value"); break;
-	case Int32:
-		result.Int32  = (int32_t)JSON_GetInt(VarObj, "Value"); break;
-	case Int16:
-		result.Int16  = (int16_t)JSON_GetInt(VarObj, "Value"); break;
-	case Int8:
-		result.Int8   = (int8_t)JSON_GetInt(VarObj, "Value"); break;
-	case uInt32:
-	case uInt32Pointer:
-		result.uInt32 = (uint32_t)JSON_GetuInt(VarObj, "Value"); break;
-	case uInt16:
-		result.uInt16 = (uint16_t)JSON_GetuInt(VarObj, "Value"); break;
-	case uInt8:
-		result.uInt8  = (uint8_t)JSON_GetuInt(VarObj, "Value"); break;	
-    default:
-        result.uInt32 = 0;
-	}
-	
-	//Get UUID, desc, publicType
-	result.UUID = JSON_GetStr(VarObj, "UUID");
-	result.desc = JSON_GetStr(VarObj, "Info");
-	result.publicType = JSON_GetStr(VarObj, "PublicType");
-	result.mod = JSON_GetStr(VarObj, "Mod");
-    result.norepatch = FALSE;
-	result.persist = JSON_GetuInt(VarObj, "Persist") ? TRUE : FALSE;
-	
-	json_decref(VarArr);
+	//Caller gets its own copy of the strings
+	result = *cached;
+	result.UUID = cached->UUID ? strdup(cached->UUID) : NULL;
+	result.desc = cached->desc ? strdup(cached->desc) : NULL;
+	result.publicType = cached->publicType ? strdup(cached->publicType) : NULL;
+	result.mod = cached->mod ? strdup(cached->mod) : NULL;
+	result.norepatch = FALSE;
 	return result;
 }
 
@@ -537,10 +826,25 @@ BOOL Var_ClearEntry(const char *ModUUID)
 		) != 0 || SQL_HandleErrors(__FILE__, __LINE__, sqlite3_finalize(command)
 		) != 0){
 			CURRERROR = errCRIT_DBASE;
+			Var_Invalidate();
 			return FALSE;
 		}
 	}
 	
+	//Same again for the in-memory copy
+	{
+		struct HashEntry *entry;
+		size_t i;
+		
+		Var_CacheChanged();
+		HashTable_Foreach(VARCACHE, i, entry){
+			const struct VarValue *var = entry->Value;
+			if(!var->persist && var->mod && strcmp(var->mod, ModUUID) == 0){
+				HashTable_Remove(VARCACHE, entry->Key, Var_CacheFree);
+			}
+		}
+	}
+	
 	return TRUE;
 }
 
@@ -589,6 +893,7 @@ BOOL Var_UpdateEntry(struct VarValue result)
 		CURRERROR = errCRIT_DBASE; return FALSE;
 	}
 	command = NULL;
+	if(!Var_CacheRefresh(result.UUID)){return FALSE;}
 
 	// Reinstall effected patches
     if(result.norepatch == FALSE){
@@ -598,96 +903,82 @@ BOOL Var_UpdateEntry(struct VarValue result)
 	return TRUE;
 }
 
-BOOL Var_RePatch(const char *VarUUID) {
-	const char *query = "SELECT * FROM VarRepatch WHERE Var = ?";
-	sqlite3_stmt *command;
-	json_t *out, *row;
-	size_t i;
-
-	if (SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-	) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-		sqlite3_bind_text(command, 1, VarUUID, -1, SQLITE_STATIC)
-	) != 0) {
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Var_UpdateBatch
+ *  Description:  Saves several variables in one transaction, then reinstalls every
+ *                patch that depends on any of them exactly once. Variables whose
+ *                value didn't change are left alone. If any of them can't be saved,
+ *                or a patch can't be reinstalled, none of them are.
+ * =====================================================================================
+ */
+BOOL Var_UpdateBatch(const struct VarValue *Vars, size_t Count)
+{
+	const char **Changed;
+	size_t i, ChangedCount = 0;
+	BOOL retval = TRUE;
+	
+	CURRERROR = errNOERR;
+	if(Count == 0){return TRUE;}
+	
+	Changed = malloc(Count * sizeof(const char *));
+	if(!Changed){
+		CURRERROR = errCRIT_MALLOC;
+		return FALSE;
+	}
+	
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_exec(CURRDB, "SAVEPOINT VarBatch;", NULL, NULL, NULL)
+	) != 0){
 		CURRERROR = errCRIT_DBASE;
+		free(Changed);
 		return FALSE;
 	}
-	out = SQL_GetJSON(command);
-	sqlite3_finalize(command);
-
-	json_array_foreach(out, i, row) {
-
-		json_t *mod, *patchArray, *patch;
-		char *modUUID, *modPath, *jsonPath;
-		int patchNo;
-
-		// Load selected mod JSON
-		modPath = JSON_GetStr(row, "ModPath");
-		patchNo = JSON_GetInt(row, "Patch");
-		asprintf(&jsonPath, "%sinfo.json", modPath);
-
-		mod = JSON_Load(jsonPath);
-		if (mod == NULL) {
-			CURRERROR = errCRIT_DBASE;
-			return FALSE;
-		}
-		safe_free(jsonPath);
-
-		modUUID = JSON_GetStr(mod, "UUID");
-		patchArray = json_object_get(mod, "patches");
-		if (patchArray == NULL) {
-			CURRERROR = errCRIT_DBASE;
-			return FALSE;
-		}
-
-		patch = json_array_get(patchArray, patchNo);
-		if (patch == NULL) {
-			CURRERROR = errCRIT_DBASE;
-			return FALSE;
+	
+	for(i = 0; i < Count; i++){
+		struct VarValue var = Vars[i];
+		const struct VarValue *old = Var_Lookup(var.UUID);
+		int len = Var_GetLen(&var);
+		
+		if(old == NULL){
+			if(CURRERROR == errNOERR){CURRERROR = errCRIT_ARGMNT;}
+			retval = FALSE;
+			break;
 		}
-
-		// Uninstall patch
-		{
-			size_t i;
-			json_t *out, *row;
-			sqlite3_stmt *command;
-			struct ModSpace patchSpace;
-			const char *query = "SELECT * FROM Spaces WHERE PatchID = ? "
-								"ORDER BY ROWID DESC";
-			char *LastPatch = NULL;
-
-			// Get space
-			patchSpace = Mod_GetPatchInfo(patch, modPath, modUUID, patchNo);
-
-			//Get the spaces created by the mod
-			if (SQL_HandleErrors(__FILE__, __LINE__, 
-				sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
-			) != 0 || SQL_HandleErrors(__FILE__, __LINE__, 
-				sqlite3_bind_text(command, 1, patchSpace.PatchID, -1, SQLITE_STATIC)
-			) != 0) {
-				CURRERROR = errCRIT_DBASE;
-				return FALSE;
-			}
-
-			out = SQL_GetJSON(command);
-			sqlite3_finalize(command);
-			
-			// Parse rows
-			json_array_foreach(out, i, row){
-				Mod_Uninstall_Space(row, &LastPatch);
-			}
-
-			safe_free(patchSpace.Bytes);
-			safe_free(patchSpace.ID);
-			safe_free(patchSpace.PatchID);
-			json_decref(out);
+		if(old->type == var.type && len > 0 && memcmp(old->raw, var.raw, len) == 0){
+			continue;
 		}
-
-		// Reinstall patch
-		Mod_InstallPatch(patch, modPath, modUUID, patchNo);
 		
+		// Reinstalls wait until everything is saved
+		var.norepatch = TRUE;
+		if(!Var_UpdateEntry(var)){
+			if(CURRERROR == errNOERR){CURRERROR = errCRIT_DBASE;}
+			retval = FALSE;
+			break;
+		}
+		Changed[ChangedCount++] = Vars[i].UUID;
+	}
+	
+	// Patches shared between variables are only reinstalled once
+	if(retval && !Var_RePatchAll(Changed, ChangedCount)){
+		if(CURRERROR == errNOERR){CURRERROR = errCRIT_FUNCT;}
+		retval = FALSE;
+	}
+	free(Changed);
+	
+	if(retval == FALSE){
+		enum errCode err = CURRERROR;
+		sqlite3_exec(CURRDB, "ROLLBACK TO VarBatch; RELEASE VarBatch;", NULL, NULL, NULL);
+		Var_Invalidate();
+		CURRERROR = err;
+		return FALSE;
+	}
+	if(SQL_HandleErrors(__FILE__, __LINE__, 
+		sqlite3_exec(CURRDB, "RELEASE VarBatch;", NULL, NULL, NULL)
+	) != 0){
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
 	}
-
 	return TRUE;
 }
 
@@ -825,7 +1116,7 @@ BOOL Var_MakeEntry(struct VarValue result)
 {
 	CURRERROR = errNOERR;
 	// Check if variable already exists
-	if(Var_GetValue_SQL(result.UUID).type != INVALID){
+	if(Var_Exists(result.UUID)){
 		return Var_UpdateEntry(result);
 	}
 		
@@ -882,7 +1173,7 @@ BOOL Var_MakeEntry(struct VarValue result)
 		command = NULL;
 	}
 		
-	return TRUE;
+	return Var_CacheRefresh(result.UUID);
 }
 
 // Create a variable entry from mod configuration JSON
@@ -937,6 +1228,15 @@ BOOL Var_DerefPointer(struct VarValue *var){
 	// the string.
 	pch += strlen("Start.");
 
+	// Came from the space map, which already knows the file offset
+	if(VARSPACES != NULL){
+		struct VarSpace *space = HashTable_Get(VARSPACES, pch);
+		if(space != NULL){
+			var->uInt32 = (uint32_t)space->StartOff;
+			return TRUE;
+		}
+	}
+
 	// Find file patch belongs to
 	{
 		sqlite3_stmt *command;
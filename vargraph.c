@@ -0,0 +1,421 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+
+// Variable -> patch -> variable dependency graph.
+// A patch depends on every variable its expressions use (the VarRepatch
+// table). Reinstalling a patch rewrites its Start. and End. variables,
+// which other patches may use in turn. The graph is walked before anything
+// is touched, so a cycle is reported instead of reinstalling forever, and
+// every affected patch is reinstalled once, after the patches it depends on.
+
+struct VarRepatchNode {
+	char *ModPath;
+	char *Mod;
+	int Patch;
+	char *PatchID;
+	json_t *Body;
+	int Mark;                     //0 = new, 1 = on path, 2 = done
+};
+
+// One step of the current walk: a patch and the variable that led to it
+struct VarRepatchStep {
+	struct VarRepatchNode *Node;
+	const char *Var;
+};
+
+struct VarRepatchGraph {
+	struct HashTable *Nodes;      //"ModPath|Patch" -> VarRepatchNode
+	struct VarRepatchNode **Order;//Each patch after everything that uses it
+	size_t OrderLen, OrderCap;
+	struct VarRepatchStep *Path;
+	size_t PathLen, PathCap;
+	json_t *Manifest;             //Fallback for patches with no stored copy
+	char *ManifestPath;
+};
+
+// Set while a schedule is being reinstalled
+static BOOL VARREPATCH_ACTIVE = FALSE;
+
+static void VarGraph_FreeNode(void *Value)
+{
+	struct VarRepatchNode *node = Value;
+	if(!node){return;}
+	safe_free(node->ModPath);
+	safe_free(node->Mod);
+	safe_free(node->PatchID);
+	json_decref(node->Body);
+	free(node);
+}
+
+static void VarGraph_Free(struct VarRepatchGraph *graph)
+{
+	HashTable_Destroy(graph->Nodes, VarGraph_FreeNode);
+	safe_free(graph->Order);
+	safe_free(graph->Path);
+	json_decref(graph->Manifest);
+	safe_free(graph->ManifestPath);
+	memset(graph, 0, sizeof(*graph));
+}
+
+// Find the node for a VarRepatch row, loading its patch the first time
+static struct VarRepatchNode * VarGraph_GetNode(struct VarRepatchGraph *graph, json_t *row)
+{
+	const char *modPath = json_string_value(json_object_get(row, "ModPath"));
+	const char *modUUID = json_string_value(json_object_get(row, "Mod"));
+	const char *body = json_string_value(json_object_get(row, "Body"));
+	int patchNo = JSON_GetInt(row, "Patch");
+	struct VarRepatchNode *node;
+	char *key = NULL;
+
+	asprintf(&key, "%s|%d", modPath, patchNo);
+	if(!key){
+		CURRERROR = errCRIT_MALLOC;
+		return NULL;
+	}
+	node = HashTable_Get(graph->Nodes, key);
+	if(node){
+		free(key);
+		return node;
+	}
+
+	node = calloc(1, sizeof(struct VarRepatchNode));
+	if(!node){
+		CURRERROR = errCRIT_MALLOC;
+		free(key);
+		return NULL;
+	}
+	node->ModPath = strdup(modPath);
+	node->Mod = strdup(modUUID);
+	node->Patch = patchNo;
+
+	if(body != NULL){
+		node->Body = json_loads(body, 0, NULL);
+	} else {
+		// Load selected mod JSON, unless the last patch already did
+		if(!graph->ManifestPath || strcmp(graph->ManifestPath, modPath) != 0){
+			char *jsonPath = NULL;
+
+			json_decref(graph->Manifest);
+			safe_free(graph->ManifestPath);
+			graph->ManifestPath = strdup(modPath);
+			asprintf(&jsonPath, "%sinfo.json", modPath);
+			graph->Manifest = JSON_Load(jsonPath);
+			safe_free(jsonPath);
+		}
+		node->Body = json_incref(json_array_get(
+			json_object_get(graph->Manifest, "patches"), patchNo
+		));
+	}
+	if(node->Body == NULL){
+		CURRERROR = errCRIT_DBASE;
+		VarGraph_FreeNode(node);
+		free(key);
+		return NULL;
+	}
+
+	// Same ID Mod_GetPatchInfo would give it
+	node->PatchID = JSON_GetStr(node->Body, "ID");
+	if(strndef(node->PatchID)){
+		safe_free(node->PatchID);
+		asprintf(&node->PatchID, "Patch-%lu.%s", (unsigned long)patchNo, modUUID);
+	}
+
+	if(!HashTable_Set(graph->Nodes, key, node, VarGraph_FreeNode)){
+		VarGraph_FreeNode(node);
+		node = NULL;
+	}
+	free(key);
+	return node;
+}
+
+// Tell the user which patches depend on each other, then fail
+static BOOL VarGraph_Cycle(
+	struct VarRepatchGraph *graph, struct VarRepatchNode *node, const char *VarUUID
+){
+	char *msg = NULL;
+	size_t first, i;
+
+	for(first = graph->PathLen; first > 0; first--){
+		if(graph->Path[first - 1].Node == node){break;}
+	}
+	first--;
+
+	asprintf(&msg, "These patches depend on each other's variables, so "
+		"changing one would reinstall them forever:\n\n%s", node->PatchID);
+	for(i = first + 1; i < graph->PathLen && msg; i++){
+		char *next = NULL;
+		asprintf(&next, "%s\n  -> %s\n%s", msg,
+			graph->Path[i].Var, graph->Path[i].Node->PatchID);
+		free(msg);
+		msg = next;
+	}
+	if(msg){
+		char *next = NULL;
+		asprintf(&next, "%s\n  -> %s\n%s", msg, VarUUID, node->PatchID);
+		free(msg);
+		msg = next;
+	}
+
+	AlertMsg(msg ? msg : node->PatchID, "Variable Dependency Cycle");
+	safe_free(msg);
+	CURRERROR = errWNG_MODCFG;
+	return FALSE;
+}
+
+// Depth-first walk from a variable to every patch that transitively uses it.
+// Patches are added to Order after everything that depends on them.
+static BOOL VarGraph_Visit(struct VarRepatchGraph *graph, const char *VarUUID)
+{
+	// Walked backwards so reversing Order keeps independent patches in
+	// mod and patch order
+	const char *query = "SELECT DISTINCT VarRepatch.ModPath AS ModPath, "
+		"VarRepatch.Patch AS Patch, Mods.UUID AS Mod, VarRepatchPatch.Body AS Body "
+		"FROM VarRepatch JOIN Mods ON Mods.Path = VarRepatch.ModPath "
+		"LEFT JOIN VarRepatchPatch ON "
+			"VarRepatchPatch.ModPath = VarRepatch.ModPath AND "
+			"VarRepatchPatch.Patch = VarRepatch.Patch "
+		"WHERE VarRepatch.Var = ? "
+		"ORDER BY VarRepatch.ModPath DESC, VarRepatch.Patch DESC";
+	sqlite3_stmt *command;
+	json_t *out, *row;
+	size_t i;
+
+	if (SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_bind_text(command, 1, VarUUID, -1, SQLITE_STATIC)
+	) != 0) {
+		CURRERROR = errCRIT_DBASE;
+		return FALSE;
+	}
+	out = SQL_GetJSON(command);
+	sqlite3_finalize(command);
+
+	json_array_foreach(out, i, row){
+		struct VarRepatchNode *node = VarGraph_GetNode(graph, row);
+		char *StartVar = NULL, *EndVar = NULL;
+		BOOL result;
+
+		if(!node){
+			json_decref(out);
+			return FALSE;
+		}
+		if(node->Mark == 2){continue;}
+
+		// A patch using its own Start or End gets the new value anyways
+		if(graph->PathLen > 0 && graph->Path[graph->PathLen - 1].Node == node){
+			continue;
+		}
+		if(node->Mark == 1){
+			json_decref(out);
+			return VarGraph_Cycle(graph, node, VarUUID);
+		}
+
+		if(graph->PathLen == graph->PathCap){
+			struct VarRepatchStep *PathNew;
+			graph->PathCap = graph->PathCap ? graph->PathCap * 2 : 8;
+			PathNew = realloc(graph->Path, graph->PathCap * sizeof(struct VarRepatchStep));
+			if(!PathNew){
+				CURRERROR = errCRIT_MALLOC;
+				json_decref(out);
+				return FALSE;
+			}
+			graph->Path = PathNew;
+		}
+		graph->Path[graph->PathLen].Node = node;
+		graph->Path[graph->PathLen].Var = VarUUID;
+		graph->PathLen++;
+		node->Mark = 1;
+
+		// Everything that uses where this patch ends up
+		asprintf(&StartVar, "Start.%s", node->PatchID);
+		asprintf(&EndVar, "End.%s", node->PatchID);
+		result = StartVar && EndVar &&
+			VarGraph_Visit(graph, StartVar) && VarGraph_Visit(graph, EndVar);
+		safe_free(StartVar);
+		safe_free(EndVar);
+		graph->PathLen--;
+		if(!result){
+			if(CURRERROR == errNOERR){CURRERROR = errCRIT_MALLOC;}
+			json_decref(out);
+			return FALSE;
+		}
+		node->Mark = 2;
+
+		if(graph->OrderLen == graph->OrderCap){
+			struct VarRepatchNode **OrderNew;
+			graph->OrderCap = graph->OrderCap ? graph->OrderCap * 2 : 8;
+			OrderNew = realloc(graph->Order, graph->OrderCap * sizeof(struct VarRepatchNode *));
+			if(!OrderNew){
+				CURRERROR = errCRIT_MALLOC;
+				json_decref(out);
+				return FALSE;
+			}
+			graph->Order = OrderNew;
+		}
+		graph->Order[graph->OrderLen++] = node;
+	}
+
+	json_decref(out);
+	return TRUE;
+}
+
+// Work out every patch affected by a change to the given variables
+static BOOL VarGraph_Build(struct VarRepatchGraph *graph, const char **Vars, size_t Count)
+{
+	size_t i;
+
+	CURRERROR = errNOERR;
+	memset(graph, 0, sizeof(*graph));
+	graph->Nodes = HashTable_Create(0);
+	if(!graph->Nodes){return FALSE;}
+
+	for(i = 0; i < Count; i++){
+		if(!VarGraph_Visit(graph, Vars[i])){
+			VarGraph_Free(graph);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+// Uninstall and reinstall one patch
+static BOOL Var_RePatchNode(struct VarRepatchNode *node)
+{
+	size_t i;
+	json_t *out, *row;
+	sqlite3_stmt *command;
+	struct ModSpace patchSpace;
+	const char *query = "SELECT * FROM Spaces WHERE PatchID = ? "
+						"ORDER BY ROWID DESC";
+	char *LastPatch = NULL;
+	BOOL retval = TRUE;
+
+	// Get space
+	patchSpace = Mod_GetPatchInfo(node->Body, node->ModPath, node->Mod, node->Patch);
+
+	//Get the spaces created by the mod
+	if (SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_prepare_v2(CURRDB, query, -1, &command, NULL)
+	) != 0 || SQL_HandleErrors(__FILE__, __LINE__,
+		sqlite3_bind_text(command, 1, patchSpace.PatchID, -1, SQLITE_STATIC)
+	) != 0) {
+		CURRERROR = errCRIT_DBASE;
+		safe_free(patchSpace.Bytes);
+		safe_free(patchSpace.SrcPath);
+		safe_free(patchSpace.ID);
+		safe_free(patchSpace.PatchID);
+		return FALSE;
+	}
+
+	out = SQL_GetJSON(command);
+	sqlite3_finalize(command);
+
+	// Parse rows
+	json_array_foreach(out, i, row){
+		if(!Mod_Uninstall_Space(row, &LastPatch)){
+			retval = FALSE;
+			break;
+		}
+	}
+
+	safe_free(LastPatch);
+	safe_free(patchSpace.Bytes);
+	safe_free(patchSpace.SrcPath);
+	safe_free(patchSpace.ID);
+	safe_free(patchSpace.PatchID);
+	json_decref(out);
+
+	// Reinstall patch
+	if(retval && !Mod_InstallPatch(node->Body, node->ModPath, node->Mod, node->Patch)){
+		retval = FALSE;
+	}
+	if(!retval && CURRERROR == errNOERR){CURRERROR = errCRIT_FUNCT;}
+	return retval;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Var_RePatchOrder
+ *  Description:  Returns a double-null-terminated list of the IDs of every patch a
+ *                change to VarUUID would reinstall, in the order they would be
+ *                reinstalled. Returns NULL and sets errWNG_MODCFG if they form a
+ *                cycle.
+ * =====================================================================================
+ */
+char * Var_RePatchOrder(const char *VarUUID)
+{
+	struct VarRepatchGraph graph;
+	char *List, *pos;
+	size_t i, Size = 1;
+
+	if(!VarGraph_Build(&graph, &VarUUID, 1)){return NULL;}
+
+	for(i = 0; i < graph.OrderLen; i++){
+		Size += strlen(graph.Order[i]->PatchID) + 1;
+	}
+	List = calloc(Size + 1, 1);
+	if(!List){
+		CURRERROR = errCRIT_MALLOC;
+		VarGraph_Free(&graph);
+		return NULL;
+	}
+
+	pos = List;
+	for(i = graph.OrderLen; i > 0; i--){
+		size_t len = strlen(graph.Order[i - 1]->PatchID) + 1;
+		memcpy(pos, graph.Order[i - 1]->PatchID, len);
+		pos += len;
+	}
+
+	VarGraph_Free(&graph);
+	return List;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  Var_RePatchAll
+ *  Description:  Reinstalls every patch that depends on any of the given variables,
+ *                directly or through another reinstalled patch's Start or End. Each
+ *                patch is reinstalled once, after the patches it depends on, and
+ *                replayed from the copy stored at install time if there is one.
+ *                Nothing is reinstalled if the patches form a cycle.
+ * =====================================================================================
+ */
+BOOL Var_RePatchAll(const char **Vars, size_t Count)
+{
+	struct VarRepatchGraph graph;
+	BOOL retval = TRUE;
+	size_t i;
+
+	// Already reinstalling. The running schedule covers everything a
+	// reinstalled patch can change.
+	if(VARREPATCH_ACTIVE || Count == 0){return TRUE;}
+
+	TRACE_BEGIN("Var_RePatch", Vars[0]);
+	if(!VarGraph_Build(&graph, Vars, Count)){
+		TRACE_END("Var_RePatch");
+		return FALSE;
+	}
+
+	VARREPATCH_ACTIVE = TRUE;
+	for(i = graph.OrderLen; i > 0 && retval; i--){
+		retval = Var_RePatchNode(graph.Order[i - 1]);
+	}
+	VARREPATCH_ACTIVE = FALSE;
+
+	VarGraph_Free(&graph);
+	TRACE_END("Var_RePatch");
+	return retval;
+}
+
+// Reinstalls every patch that depends on the given variable
+BOOL Var_RePatch(const char *VarUUID)
+{
+	return Var_RePatchAll(&VarUUID, 1);
+}
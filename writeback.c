@@ -0,0 +1,156 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "includes.h"              // LOCAL: All includes
+#include "funcproto.h"             // LOCAL: Function prototypes and structs
+#include "errormsgs.h"             // LOCAL: Canned error messages
+
+#if defined(HAVE_WINDOWS_H)
+	#define WRITEBACK_THREADS
+#elif defined(HAVE_PTHREAD_H)
+	#include <pthread.h>
+	#define WRITEBACK_THREADS
+#endif
+
+// Parallel write-back. Once every write has been worked out, sorted and
+// logged, each file's writes are independent of every other file's, so
+// each file gets its own worker thread. Workers only touch their own
+// handle and WriteBackFile: no CURRERROR, no database, no trace. Errors are
+// collected per file and reported afterwards in the order the files were
+// given, so the result doesn't depend on which thread finished first.
+
+#define WRITEBACK_MAX_THREADS 8
+
+// Write every planned write of one file, in order
+static void File_WriteBack_One(struct WriteBackFile *file)
+{
+	size_t i;
+
+	file->Error = errNOERR;
+	for(i = 0; i < file->WriteCount; i++){
+		const struct WriteBackWrite *curr = &file->Writes[i];
+		const unsigned char *ptr = curr->Bytes;
+		int remain = curr->Len;
+
+		if(lseek(file->Handle, curr->Offset, SEEK_SET) == -1){
+			file->Error = errCRIT_FILESYS;
+			return;
+		}
+		while(remain > 0){
+			int count = write(file->Handle, ptr, remain);
+			if(count <= 0){
+				file->Error = errCRIT_FILESYS;
+				return;
+			}
+			ptr += count;
+			remain -= count;
+		}
+	}
+}
+
+#if defined(HAVE_WINDOWS_H)
+static DWORD WINAPI File_WriteBack_Thread(LPVOID arg)
+{
+	File_WriteBack_One(arg);
+	return 0;
+}
+#elif defined(HAVE_PTHREAD_H)
+static void * File_WriteBack_Thread(void *arg)
+{
+	File_WriteBack_One(arg);
+	return NULL;
+}
+#endif
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  File_WriteBack
+ *  Description:  Flushes the planned writes of several files at once, one worker
+ *                thread per file (at most WRITEBACK_MAX_THREADS at a time). Writes
+ *                within a file happen in the order given.
+ *                Each file's Error is set. Returns FALSE if any failed, with
+ *                CURRERROR set from the first failed file in the list.
+ * =====================================================================================
+ */
+BOOL File_WriteBack(struct WriteBackFile *files, size_t count)
+{
+	size_t i;
+
+	CURRERROR = errNOERR;
+	TRACE_BEGIN("File_WriteBack", NULL);
+
+	if(File_OverlayActive()){
+		// Dry run writes go to the overlay, which isn't thread-safe
+		for(i = 0; i < count; i++){
+			size_t j;
+			for(j = 0; j < files[i].WriteCount; j++){
+				File_WriteBytes(files[i].Handle, files[i].Writes[j].Offset,
+					files[i].Writes[j].Bytes, files[i].Writes[j].Len);
+			}
+			files[i].Error = errNOERR;
+		}
+		TRACE_END("File_WriteBack");
+		return TRUE;
+	}
+
+	#ifdef WRITEBACK_THREADS
+	for(i = 0; i < count; i += WRITEBACK_MAX_THREADS){
+		size_t batch = MIN(count - i, WRITEBACK_MAX_THREADS);
+		size_t j;
+		#if defined(HAVE_WINDOWS_H)
+		HANDLE threads[WRITEBACK_MAX_THREADS];
+		#else
+		pthread_t threads[WRITEBACK_MAX_THREADS];
+		#endif
+		BOOL started[WRITEBACK_MAX_THREADS];
+
+		// No point starting a thread for just one file
+		if(batch == 1){
+			File_WriteBack_One(&files[i]);
+			continue;
+		}
+
+		for(j = 0; j < batch; j++){
+			#if defined(HAVE_WINDOWS_H)
+			threads[j] = CreateThread(NULL, 0, File_WriteBack_Thread, &files[i + j], 0, NULL);
+			started[j] = (threads[j] != NULL);
+			#else
+			started[j] = (pthread_create(
+				&threads[j], NULL, File_WriteBack_Thread, &files[i + j]
+			) == 0);
+			#endif
+			// Couldn't get a thread; do it here instead
+			if(!started[j]){
+				File_WriteBack_One(&files[i + j]);
+			}
+		}
+
+		for(j = 0; j < batch; j++){
+			if(!started[j]){continue;}
+			#if defined(HAVE_WINDOWS_H)
+			WaitForSingleObject(threads[j], INFINITE);
+			CloseHandle(threads[j]);
+			#else
+			pthread_join(threads[j], NULL);
+			#endif
+		}
+	}
+	#else
+	for(i = 0; i < count; i++){
+		File_WriteBack_One(&files[i]);
+	}
+	#endif
+
+	TRACE_END("File_WriteBack");
+	for(i = 0; i < count; i++){
+		File_InfoForget(files[i].Handle);
+	}
+	for(i = 0; i < count; i++){
+		if(files[i].Error != errNOERR){
+			CURRERROR = files[i].Error;
+			return FALSE;
+		}
+	}
+	return TRUE;
+}